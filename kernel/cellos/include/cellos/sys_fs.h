@@ -274,6 +274,10 @@ struct lv2_file final : lv2_fs_object {
   // Stream lock
   atomic_t<u32> lock{0};
 
+  // Owns file position for sequential reads and writes, which hold mount point
+  // mutex shared so that I/O on different files proceeds in parallel
+  shared_mutex mutex;
+
   // Some variables for convenience of data restoration
   struct save_restore_t {
     u64 seek_pos;
@@ -323,6 +327,14 @@ struct lv2_file final : lv2_fs_object {
     return op_read(file, buf, size, opt_pos);
   }
 
+  struct read_result_t {
+    CellError error;
+    u64 bytes;
+  };
+
+  // Read from the file position with wrapped locking of sys_fs_read
+  read_result_t read(vm::ptr<void> buf, u64 size);
+
   // File writing with intermediate buffer
   static u64 op_write(const fs::file &file, vm::cptr<void> buf, u64 size);
 
@@ -383,6 +383,31 @@ lv2_fs_object::lv2_fs_object(std::string_view filename)
 lv2_fs_object::lv2_fs_object(utils::serial &ar, bool)
     : name(ar), mp(g_fxo->get<lv2_fs_mount_info_map>().lookup(name.data())) {}
 
+lv2_file::read_result_t lv2_file::read(vm::ptr<void> buf, u64 size) {
+  std::shared_lock mp_lock(mp->mutex);
+  std::unique_lock lock(mutex);
+
+  if (!file) {
+    return {CELL_EBADF, 0};
+  }
+
+  if (this->lock == 2) {
+    return {CELL_EIO, 0};
+  }
+
+  // Positional read, file position is only advanced by the result
+  const u64 pos = file.pos();
+  const u64 read_bytes = op_read(buf, size, pos);
+  file.seek(pos + read_bytes);
+
+  if (!read_bytes && pos < file.size()) {
+    // EDATA corruption perhaps
+    return {CELL_EFSSPECIFIC, 0};
+  }
+
+  return {{}, read_bytes};
+}
+
 u64 lv2_file::op_read(const fs::file &file, vm::ptr<void> buf, u64 size,
                       u64 opt_pos) {
   if (u64 region = buf.addr() >> 28,
@@ -1078,27 +1103,23 @@ error_code sys_fs_read(ppu_thread &ppu, u32 fd, vm::ptr<void> buf, u64 nbytes,
     return CELL_OK;
   }
 
-  std::unique_lock lock(file->mp->mutex);
+  const auto [error, read_bytes] = file->read(buf, nbytes);
 
-  if (!file->file) {
+  if (error == CELL_EBADF) {
     return CELL_EBADF;
   }
 
-  if (file->lock == 2) {
+  if (error == CELL_EIO) {
     nread.try_write(0);
     return CELL_EIO;
   }
 
-  const u64 read_bytes = file->op_read(buf, nbytes);
-  const bool failure = !read_bytes && file->file.pos() < file->file.size();
-  lock.unlock();
   ppu.check_state();
 
   *nread = read_bytes;
 
-  if (failure) {
-    // EDATA corruption perhaps
-    return CELL_EFSSPECIFIC;
+  if (error) {
+    return error;
   }
 
   return CELL_OK;
@@ -1151,7 +1172,8 @@ error_code sys_fs_write(ppu_thread &ppu, u32 fd, vm::cptr<void> buf, u64 nbytes,
     return CELL_EROFS;
   }
 
-  std::unique_lock lock(file->mp->mutex);
+  std::shared_lock mp_lock(file->mp->mutex);
+  std::unique_lock lock(file->mutex);
 
   if (!file->file) {
     return CELL_EBADF;
@@ -1173,6 +1195,7 @@ error_code sys_fs_write(ppu_thread &ppu, u32 fd, vm::cptr<void> buf, u64 nbytes,
 
   const u64 written = file->op_write(buf, nbytes);
   lock.unlock();
+  mp_lock.unlock();
   ppu.check_state();
 
   *nwrite = written;
@@ -1869,16 +1892,12 @@ error_code sys_fs_fcntl(ppu_thread &ppu, u32 fd, u32 op, vm::ptr<void> _arg,
                    arg->size, file->name.data());
     }
 
-    std::unique_lock wlock(file->mp->mutex, std::defer_lock);
-    std::shared_lock rlock(file->mp->mutex, std::defer_lock);
+    // Reads don't touch file position, writes temporarily move it
+    std::shared_lock mp_lock(file->mp->mutex);
+    std::unique_lock wlock(file->mutex, std::defer_lock);
 
     if (op == 0x8000000b) {
-      // Writer lock
       wlock.lock();
-    } else {
-      // Reader lock (not needing exclusivity in this special case because the
-      // state should not change)
-      rlock.lock();
     }
 
     if (!file->file) {
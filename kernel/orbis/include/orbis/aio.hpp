@@ -0,0 +1,57 @@
+#pragma once
+
+#include "error/ErrorCode.hpp"
+#include "orbis-config.hpp"
+
+namespace orbis {
+struct Thread;
+
+inline constexpr uint kAioCmdRead = 0x001;
+inline constexpr uint kAioCmdWrite = 0x002;
+inline constexpr uint kAioCmdMask = 0xfff;
+
+// every request gets own submit id, otherwise whole batch shares one id
+inline constexpr uint kAioCmdMultiple = 0x1000;
+
+inline constexpr uint kAioPriorityLow = 1;
+inline constexpr uint kAioPriorityMid = 2;
+inline constexpr uint kAioPriorityHigh = 3;
+
+inline constexpr sint kAioStateSubmitted = 1;
+inline constexpr sint kAioStateProcessing = 2;
+inline constexpr sint kAioStateCompleted = 3;
+inline constexpr sint kAioStateAborted = 4;
+
+inline constexpr uint kAioWaitAnd = 0x01;
+inline constexpr uint kAioWaitOr = 0x02;
+
+inline constexpr sint kAioMaxRequests = 128;
+
+using AioSubmitId = sint;
+
+struct AioResult {
+  slong returnValue;
+  uint32_t state;
+};
+
+struct AioRWRequest {
+  off_t offset;
+  size_t nbyte;
+  ptr<void> buf;
+  ptr<AioResult> result;
+  sint fd;
+};
+
+ErrorCode aio_submit_cmd(Thread *thread, uint cmd,
+                         ptr<const AioRWRequest> requests, sint count,
+                         uint priority, ptr<AioSubmitId> ids);
+ErrorCode aio_multi_wait(Thread *thread, ptr<const AioSubmitId> ids,
+                         sint count, ptr<sint> states, uint mode,
+                         ptr<uint32_t> usec);
+ErrorCode aio_multi_poll(Thread *thread, ptr<const AioSubmitId> ids,
+                         sint count, ptr<sint> states);
+ErrorCode aio_multi_cancel(Thread *thread, ptr<const AioSubmitId> ids,
+                           sint count, ptr<sint> states);
+ErrorCode aio_multi_delete(Thread *thread, ptr<const AioSubmitId> ids,
+                           sint count, ptr<sint> states);
+} // namespace orbis
@@ -8,6 +8,7 @@
 
 #include "orbis-config.hpp"
 #include <string>
+#include <string_view>
 
 namespace orbis {
 struct Thread;
@@ -58,6 +59,20 @@ struct Symbol {
   SymbolType type;
 };
 
+struct ExportKey {
+  std::uint64_t id;
+  std::uint32_t libraryIndex;
+
+  bool operator==(const ExportKey &) const = default;
+};
+
+struct ExportKeyHash {
+  std::size_t operator()(const ExportKey &key) const {
+    // symbol ids are already hashes of names
+    return key.id ^ (key.libraryIndex * 0x9e37'79b9'7f4a'7c15);
+  }
+};
+
 struct Relocation {
   std::uint64_t offset;
   std::uint32_t relType;
@@ -120,6 +135,9 @@ struct Module final {
   kvector<rx::Ref<Module>> namespaceModules;
   kvector<kstring> needed;
 
+  // (symbol id, first library index with same name) -> symbol index
+  kunmap<ExportKey, std::uint32_t, ExportKeyHash> exportIndex;
+
   std::atomic<unsigned> references{0};
 
   void incRef() {
@@ -137,6 +155,13 @@ struct Module final {
 
   orbis::SysResult relocate(Process *process);
 
+  /// Indexes symbols by id and library name, must be called after symbols
+  /// and needed libraries are loaded.
+  void buildExportIndex();
+
+  /// Returns non-local, non-hidden symbol with `id` from `library`.
+  const Symbol *findExport(std::uint64_t id, std::string_view library) const;
+
   void operator delete(void *pointer);
 
 private:
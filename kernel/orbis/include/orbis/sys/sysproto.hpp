@@ -13,6 +13,7 @@ using cpusetid_t = sint;
 using cpuwhich_t = sint;
 using cpulevel_t = sint;
 using SceKernelModule = ModuleHandle;
+using AioSubmitId = sint;
 
 struct Thread;
 struct AuthInfo;
@@ -33,6 +34,7 @@ struct SigSet;
 struct SigAction;
 struct SocketAddress;
 struct AppMountInfo;
+struct AioRWRequest;
 
 SysResult nosys(Thread *thread);
 
@@ -794,15 +796,22 @@ SysResult sys_fdatasync(Thread *thread /* TODO */);
 SysResult sys_dynlib_get_list2(Thread *thread /* TODO */);
 SysResult sys_dynlib_get_info2(Thread *thread /* TODO */);
 SysResult sys_aio_submit(Thread *thread /* TODO */);
-SysResult sys_aio_multi_delete(Thread *thread /* TODO */);
-SysResult sys_aio_multi_wait(Thread *thread /* TODO */);
-SysResult sys_aio_multi_poll(Thread *thread /* TODO */);
+SysResult sys_aio_multi_delete(Thread *thread, ptr<const AioSubmitId> ids,
+                               sint count, ptr<sint> states);
+SysResult sys_aio_multi_wait(Thread *thread, ptr<const AioSubmitId> ids,
+                             sint count, ptr<sint> states, uint mode,
+                             ptr<uint32_t> usec);
+SysResult sys_aio_multi_poll(Thread *thread, ptr<const AioSubmitId> ids,
+                             sint count, ptr<sint> states);
 SysResult sys_aio_get_data(Thread *thread /* TODO */);
-SysResult sys_aio_multi_cancel(Thread *thread /* TODO */);
+SysResult sys_aio_multi_cancel(Thread *thread, ptr<const AioSubmitId> ids,
+                               sint count, ptr<sint> states);
 SysResult sys_get_bio_usage_all(Thread *thread /* TODO */);
 SysResult sys_aio_create(Thread *thread /* TODO */);
-SysResult sys_aio_submit_cmd(Thread *thread /* TODO */);
-SysResult sys_aio_init(Thread *thread /* TODO */);
+SysResult sys_aio_submit_cmd(Thread *thread, uint cmd,
+                             ptr<const AioRWRequest> requests, sint count,
+                             uint priority, ptr<AioSubmitId> ids);
+SysResult sys_aio_init(Thread *thread, ptr<void> param, uint size);
 SysResult sys_get_page_table_stats(Thread *thread /* TODO */);
 SysResult sys_dynlib_get_list_for_libdbg(Thread *thread /* TODO */);
 SysResult sys_blockpool_move(Thread *thread /* TODO */);
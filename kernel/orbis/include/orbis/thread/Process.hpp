@@ -10,6 +10,7 @@
 #include "../thread/Thread.hpp"
 #include "../thread/types.hpp"
 #include "ProcessState.hpp"
+#include "SyscallStats.hpp"
 #include "cpuset.hpp"
 #include "orbis/AppInfo.hpp"
 #include "orbis/AuthInfo.hpp"
@@ -91,6 +92,7 @@ struct Process final {
   bool isInSandbox = false;
   EventEmitter event;
   std::optional<sint> exitStatus;
+  SyscallStats syscallStats;
 
   std::uint32_t sdkVersion = 0;
   std::uint64_t nextTlsSlot = 1;
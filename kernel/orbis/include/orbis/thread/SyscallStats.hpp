@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace orbis {
+struct sysentvec;
+
+///
+/// \brief Per-syscall counters of process.
+///
+/// Counts calls, failed calls and TSC cycles spent in syscall handlers,
+/// indexed by syscall number of process sysentvec. Cycles are measured around
+/// the handler only, argument copy and tracing hooks are excluded. Recording
+/// is a few relaxed atomic additions, counters are always enabled.
+///
+class SyscallStats {
+public:
+  static constexpr std::size_t kMaxSyscalls = 1024;
+
+  struct Entry {
+    std::uint64_t calls = 0;
+    std::uint64_t errors = 0;
+    std::uint64_t cycles = 0;
+    std::uint64_t maxCycles = 0;
+  };
+
+  using Stats = std::array<Entry, kMaxSyscalls>;
+
+  void record(int id, std::uint64_t cycles, bool isError) {
+    if (static_cast<unsigned>(id) >= kMaxSyscalls) {
+      return;
+    }
+
+    auto &counters = mCounters[id];
+    counters.calls.fetch_add(1, std::memory_order::relaxed);
+    counters.cycles.fetch_add(cycles, std::memory_order::relaxed);
+
+    if (isError) {
+      counters.errors.fetch_add(1, std::memory_order::relaxed);
+    }
+
+    auto maxCycles = counters.maxCycles.load(std::memory_order::relaxed);
+    while (cycles > maxCycles &&
+           !counters.maxCycles.compare_exchange_weak(
+               maxCycles, cycles, std::memory_order::relaxed)) {
+    }
+  }
+
+  /// Returns counters accumulated since process creation or last reset.
+  [[nodiscard]] Stats getStats() const;
+  void reset();
+
+  /// Prints non-zero entries sorted by cycles to stderr, names are resolved
+  /// with `sysent`. Max cycles of delta are the max since process start.
+  static void print(const Stats &stats, const sysentvec *sysent,
+                    std::uint64_t tscFrequency);
+
+  /// Returns `current - last`, entries reset between snapshots are skipped.
+  static Stats delta(const Stats &current, const Stats &last);
+
+private:
+  struct Counters {
+    std::atomic<std::uint64_t> calls{0};
+    std::atomic<std::uint64_t> errors{0};
+    std::atomic<std::uint64_t> cycles{0};
+    std::atomic<std::uint64_t> maxCycles{0};
+  };
+
+  Counters mCounters[kMaxSyscalls];
+};
+} // namespace orbis
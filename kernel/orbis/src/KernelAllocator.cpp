@@ -3,6 +3,9 @@
 #include "rx/Serializer.hpp"
 #include "rx/SharedMutex.hpp"
 #include "rx/print.hpp"
+#include <array>
+#include <bit>
+#include <pthread.h>
 #include <sys/mman.h>
 
 static const std::uint64_t g_allocProtWord = 0xDEADBEAFBADCAFE1;
@@ -10,14 +13,83 @@ static constexpr std::uintptr_t kHeapBaseAddress = 0x00000600'0000'0000;
 static constexpr auto kHeapSize = 0x1'0000'0000;
 static constexpr int kDebugHeap = 0;
 
+static constexpr std::size_t kHeapPageSize = 4096;
+static constexpr std::size_t kHeapPageCount = kHeapSize / kHeapPageSize;
+static constexpr std::size_t kFreeRangeBucketCount =
+    std::bit_width(kHeapPageCount);
+
+// allocations up to kMaxSmallSize are served from slabs of same size objects,
+// bigger allocations use page ranges
+static constexpr std::size_t kSlabSize = 64 * 1024;
+static constexpr std::size_t kMaxSmallSize = 2048;
+static constexpr std::size_t kMagazineSize = 32;
+static constexpr std::size_t kSizeClasses[] = {
+    16,  32,  48,  64,  80,  96,  112,  128,  160,  192,  224,  256,
+    320, 384, 448, 512, 640, 768, 896, 1024, 1280, 1536, 1792, 2048,
+};
+static constexpr std::size_t kSizeClassCount = std::size(kSizeClasses);
+
+// size / 16 -> first class that fits
+static constexpr auto kSizeClassTable = [] {
+  std::array<std::uint8_t, kMaxSmallSize / 16 + 1> result{};
+  std::size_t sizeClass = 0;
+  for (std::size_t i = 0; i < result.size(); ++i) {
+    while (kSizeClasses[sizeClass] < i * 16) {
+      ++sizeClass;
+    }
+    result[i] = sizeClass;
+  }
+  return result;
+}();
+
 namespace orbis {
+namespace {
+// header of free page range, footer is page count stored at the last page
+struct FreeRange {
+  std::size_t pageCount;
+  FreeRange *next;
+  FreeRange *prev;
+};
+
+struct FreeObject {
+  FreeObject *next;
+};
+
+// process local cache of free objects per size class, magazines are not
+// shared with other threads so hot alloc/free pairs take no lock
+struct Magazines {
+  struct Magazine {
+    std::uint32_t count;
+    void *objects[kMagazineSize];
+  };
+
+  Magazine classes[kSizeClassCount]{};
+
+  ~Magazines();
+};
+
+thread_local Magazines t_magazines;
+} // namespace
+
 struct KernelMemoryResource {
   mutable rx::shared_mutex m_heap_mtx;
-  rx::shared_mutex m_heap_map_mtx;
   void *m_heap_next = nullptr;
 
-  kmultimap<std::size_t, void *> m_free_heap;
-  kmultimap<std::size_t, void *> m_used_node;
+  // free page ranges, bucketed by log2 of page count
+  FreeRange *m_free_ranges[kFreeRangeBucketCount]{};
+  std::uint64_t m_free_pages[kHeapPageCount / 64]{};
+
+  struct SizeClass {
+    rx::shared_mutex mtx;
+    FreeObject *freeList = nullptr;
+    std::byte *slabPos = nullptr;
+    std::byte *slabEnd = nullptr;
+  };
+
+  SizeClass m_size_classes[kSizeClassCount];
+
+  // size class + 1 of each slab sized heap block, 0 for page allocations
+  std::uint8_t m_slab_classes[kHeapSize / kSlabSize]{};
 
   ~KernelMemoryResource() {
     ::munmap(std::bit_cast<void *>(kHeapBaseAddress), kHeapSize);
@@ -27,6 +99,13 @@ struct KernelMemoryResource {
                std::size_t align = __STDCPP_DEFAULT_NEW_ALIGNMENT__);
   void kfree(void *ptr, std::size_t size);
 
+  void *allocatePages(std::size_t pageCount, std::size_t alignPages);
+  void freePages(std::uintptr_t address, std::size_t pageCount);
+
+  void refillMagazine(std::size_t sizeClass, Magazines::Magazine &magazine);
+  void drainMagazine(std::size_t sizeClass, Magazines::Magazine &magazine,
+                     std::uint32_t count);
+
   void serialize(rx::Serializer &) const {
     // FIXME: implement
   }
@@ -36,6 +115,23 @@ struct KernelMemoryResource {
 
   void lock() const { m_heap_mtx.lock(); }
   void unlock() const { m_heap_mtx.unlock(); }
+
+private:
+  static std::size_t getPageIndex(std::uintptr_t address) {
+    return (address - kHeapBaseAddress) / kHeapPageSize;
+  }
+
+  static std::uintptr_t getPageAddress(std::size_t page) {
+    return kHeapBaseAddress + page * kHeapPageSize;
+  }
+
+  bool isPageFree(std::size_t page) const {
+    return (m_free_pages[page / 64] & (1ull << (page % 64))) != 0;
+  }
+
+  void setPagesFree(std::size_t page, std::size_t count, bool isFree);
+  void insertFreeRange(std::size_t page, std::size_t pageCount);
+  void removeFreeRange(FreeRange *range);
 };
 
 static KernelMemoryResource *sMemoryResource;
@@ -45,6 +141,24 @@ using GlobalStorage =
     kernel::StaticKernelObjectStorage<OrbisNamespace,
                                       kernel::detail::GlobalScope>;
 
+Magazines::~Magazines() {
+  if (sMemoryResource == nullptr) {
+    return;
+  }
+
+  for (std::size_t i = 0; i < kSizeClassCount; ++i) {
+    sMemoryResource->drainMagazine(i, classes[i], classes[i].count);
+  }
+}
+
+static void resetMagazinesAfterFork() {
+  // heap is shared with parent process, cached objects still belong to the
+  // parent copy of this thread
+  for (auto &magazine : t_magazines.classes) {
+    magazine.count = 0;
+  }
+}
+
 void initializeAllocator() {
   auto ptr = (std::byte *)::mmap(std::bit_cast<void *>(kHeapBaseAddress),
                                  kHeapSize, PROT_READ | PROT_WRITE,
@@ -65,7 +179,15 @@ void initializeAllocator() {
   }
 
   sMemoryResource = new (ptr) KernelMemoryResource();
-  sMemoryResource->m_heap_next = ptr + sizeof(KernelMemoryResource);
+  sMemoryResource->m_heap_next =
+      ptr + ((sizeof(KernelMemoryResource) + kHeapPageSize - 1) &
+             ~(kHeapPageSize - 1));
+
+  static bool isAtForkRegistered = false;
+  if (!isAtForkRegistered) {
+    pthread_atfork(nullptr, nullptr, resetMagazinesAfterFork);
+    isAtForkRegistered = true;
+  }
 
   rx::print(stderr, "global: size {}, alignment {}\n", GlobalStorage::GetSize(),
             GlobalStorage::GetAlignment());
@@ -76,94 +198,265 @@ void initializeAllocator() {
 
 void deinitializeAllocator() {
   sMemoryResource->kfree(g_globalStorage, GlobalStorage::GetSize());
+  resetMagazinesAfterFork();
   delete sMemoryResource;
   sMemoryResource = nullptr;
   g_globalStorage = nullptr;
 }
 
-void *KernelMemoryResource::kalloc(std::size_t size, std::size_t align) {
-  size = (size + (__STDCPP_DEFAULT_NEW_ALIGNMENT__ - 1)) &
-         ~(__STDCPP_DEFAULT_NEW_ALIGNMENT__ - 1);
-  if (!size)
-    std::abort();
-
-  if (m_heap_map_mtx.try_lock()) {
-    std::lock_guard lock(m_heap_map_mtx, std::adopt_lock);
-
-    // Try to reuse previously freed block
-    for (auto [it, end] = m_free_heap.equal_range(size); it != end; ++it) {
-      auto result = it->second;
-      if (!(std::bit_cast<std::uintptr_t>(result) & (align - 1))) {
-        auto node = m_free_heap.extract(it);
-        node.key() = 0;
-        node.mapped() = nullptr;
-        m_used_node.insert(m_used_node.begin(), std::move(node));
-
-        // std::fprintf(stderr, "kalloc: reuse %p-%p, size = %lx\n", result,
-        //              (char *)result + size, size);
-
-        if (kDebugHeap > 0) {
-          std::memcpy(std::bit_cast<std::byte *>(result) + size,
-                      &g_allocProtWord, sizeof(g_allocProtWord));
-        }
-        return result;
-      }
+void KernelMemoryResource::setPagesFree(std::size_t page, std::size_t count,
+                                        bool isFree) {
+  for (auto end = page + count; page < end; ++page) {
+    if (isFree) {
+      m_free_pages[page / 64] |= 1ull << (page % 64);
+    } else {
+      m_free_pages[page / 64] &= ~(1ull << (page % 64));
     }
   }
+}
+
+void KernelMemoryResource::insertFreeRange(std::size_t page,
+                                           std::size_t pageCount) {
+  auto range = std::bit_cast<FreeRange *>(getPageAddress(page));
+  auto &bucket = m_free_ranges[std::bit_width(pageCount) - 1];
+
+  range->pageCount = pageCount;
+  range->prev = nullptr;
+  range->next = bucket;
+  if (bucket != nullptr) {
+    bucket->prev = range;
+  }
+  bucket = range;
+
+  *std::bit_cast<std::size_t *>(getPageAddress(page + pageCount - 1)) =
+      pageCount;
+  setPagesFree(page, pageCount, true);
+}
+
+void KernelMemoryResource::removeFreeRange(FreeRange *range) {
+  auto &bucket = m_free_ranges[std::bit_width(range->pageCount) - 1];
+
+  if (range->prev != nullptr) {
+    range->prev->next = range->next;
+  } else {
+    bucket = range->next;
+  }
 
+  if (range->next != nullptr) {
+    range->next->prev = range->prev;
+  }
+
+  setPagesFree(getPageIndex(std::bit_cast<std::uintptr_t>(range)),
+               range->pageCount, false);
+}
+
+void *KernelMemoryResource::allocatePages(std::size_t pageCount,
+                                          std::size_t alignPages) {
   std::lock_guard lock(m_heap_mtx);
-  align = std::max<std::size_t>(align, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
-  auto heap = reinterpret_cast<std::uintptr_t>(m_heap_next);
-  heap = (heap + (align - 1)) & ~(align - 1);
 
-  if (kDebugHeap > 1) {
-    if (auto diff = (heap + size + sizeof(g_allocProtWord)) % 4096; diff != 0) {
-      heap += 4096 - diff;
-      heap &= ~(align - 1);
+  // first fit from the smallest bucket that can contain the range
+  for (auto bucket = std::bit_width(pageCount) - 1;
+       bucket < kFreeRangeBucketCount; ++bucket) {
+    for (auto range = m_free_ranges[bucket]; range != nullptr;
+         range = range->next) {
+      auto rangePage = getPageIndex(std::bit_cast<std::uintptr_t>(range));
+      auto rangeEnd = rangePage + range->pageCount;
+      auto page = (rangePage + alignPages - 1) & ~(alignPages - 1);
+
+      if (page + pageCount > rangeEnd) {
+        continue;
+      }
+
+      removeFreeRange(range);
+
+      if (page > rangePage) {
+        insertFreeRange(rangePage, page - rangePage);
+      }
+
+      if (page + pageCount < rangeEnd) {
+        insertFreeRange(page + pageCount, rangeEnd - page - pageCount);
+      }
+
+      return std::bit_cast<void *>(getPageAddress(page));
     }
   }
 
-  if (heap + size > kHeapBaseAddress + kHeapSize) {
-    std::fprintf(stderr, "out of kernel memory");
-    std::abort();
-  }
+  auto heapPage = getPageIndex(std::bit_cast<std::uintptr_t>(m_heap_next));
+  auto page = (heapPage + alignPages - 1) & ~(alignPages - 1);
+
   // Check overflow
-  if (heap + size < heap) {
+  if (page + pageCount < page) {
     std::fprintf(stderr, "too big allocation");
     std::abort();
   }
 
-  // std::fprintf(stderr, "kalloc: allocate %lx-%lx, size = %lx, align=%lx\n",
-  //              heap, heap + size, size, align);
+  if (page + pageCount > kHeapPageCount) {
+    std::fprintf(stderr, "out of kernel memory");
+    std::abort();
+  }
+
+  if (page > heapPage) {
+    insertFreeRange(heapPage, page - heapPage);
+  }
 
-  auto result = reinterpret_cast<void *>(heap);
-  if (kDebugHeap > 0) {
-    std::memcpy(std::bit_cast<std::byte *>(result) + size, &g_allocProtWord,
-                sizeof(g_allocProtWord));
+  m_heap_next = std::bit_cast<void *>(getPageAddress(page + pageCount));
+  return std::bit_cast<void *>(getPageAddress(page));
+}
+
+void KernelMemoryResource::freePages(std::uintptr_t address,
+                                     std::size_t pageCount) {
+  std::lock_guard lock(m_heap_mtx);
+
+  auto page = getPageIndex(address);
+
+  // coalesce with neighbor free ranges
+  if (page > 0 && isPageFree(page - 1)) {
+    auto prevCount =
+        *std::bit_cast<std::size_t *>(getPageAddress(page - 1));
+    auto prevPage = page - prevCount;
+    removeFreeRange(std::bit_cast<FreeRange *>(getPageAddress(prevPage)));
+    page = prevPage;
+    pageCount += prevCount;
+  }
+
+  if (auto nextPage = page + pageCount;
+      nextPage < kHeapPageCount && isPageFree(nextPage)) {
+    auto next = std::bit_cast<FreeRange *>(getPageAddress(nextPage));
+    pageCount += next->pageCount;
+    removeFreeRange(next);
   }
 
+  // return top of the heap to bump allocator
+  if (getPageAddress(page + pageCount) ==
+      std::bit_cast<std::uintptr_t>(m_heap_next)) {
+    m_heap_next = std::bit_cast<void *>(getPageAddress(page));
+    return;
+  }
+
+  insertFreeRange(page, pageCount);
+}
+
+void KernelMemoryResource::refillMagazine(std::size_t sizeClass,
+                                          Magazines::Magazine &magazine) {
+  auto &state = m_size_classes[sizeClass];
+  auto objectSize = kSizeClasses[sizeClass];
+
+  std::lock_guard lock(state.mtx);
+
+  while (magazine.count < kMagazineSize / 2 && state.freeList != nullptr) {
+    magazine.objects[magazine.count++] = state.freeList;
+    state.freeList = state.freeList->next;
+  }
+
+  while (magazine.count < kMagazineSize / 2) {
+    if (state.slabPos + objectSize > state.slabEnd) {
+      state.slabPos = static_cast<std::byte *>(allocatePages(
+          kSlabSize / kHeapPageSize, kSlabSize / kHeapPageSize));
+      state.slabEnd = state.slabPos + kSlabSize;
+
+      // slabs are never returned to page allocator
+      m_slab_classes[(std::bit_cast<std::uintptr_t>(state.slabPos) -
+                      kHeapBaseAddress) /
+                     kSlabSize] = sizeClass + 1;
+    }
+
+    magazine.objects[magazine.count++] = state.slabPos;
+    state.slabPos += objectSize;
+  }
+}
+
+void KernelMemoryResource::drainMagazine(std::size_t sizeClass,
+                                         Magazines::Magazine &magazine,
+                                         std::uint32_t count) {
+  if (count == 0) {
+    return;
+  }
+
+  auto &state = m_size_classes[sizeClass];
+  std::lock_guard lock(state.mtx);
+
+  for (std::uint32_t i = 0; i < count; ++i) {
+    auto object = static_cast<FreeObject *>(magazine.objects[--magazine.count]);
+    object->next = state.freeList;
+    state.freeList = object;
+  }
+}
+
+static std::size_t getSmallSizeClass(std::size_t size, std::size_t align) {
+  if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+    size = (size + (align - 1)) & ~(align - 1);
+  }
+
+  if (size > kMaxSmallSize || align > kMaxSmallSize) {
+    return kSizeClassCount;
+  }
+
+  // slabs are aligned to slab size, objects are aligned if class size is
+  // multiple of requested alignment
+  auto sizeClass = kSizeClassTable[(size + 15) / 16];
+  while (sizeClass < kSizeClassCount && kSizeClasses[sizeClass] % align != 0) {
+    ++sizeClass;
+  }
+
+  return sizeClass;
+}
+
+void *KernelMemoryResource::kalloc(std::size_t size, std::size_t align) {
+  size = (size + (__STDCPP_DEFAULT_NEW_ALIGNMENT__ - 1)) &
+         ~(__STDCPP_DEFAULT_NEW_ALIGNMENT__ - 1);
+  if (!size)
+    std::abort();
+
+  align = std::max<std::size_t>(align, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+
+  auto allocSize = size;
   if (kDebugHeap > 0) {
-    m_heap_next =
-        reinterpret_cast<void *>(heap + size + sizeof(g_allocProtWord));
-  } else {
-    m_heap_next = reinterpret_cast<void *>(heap + size);
+    allocSize += sizeof(g_allocProtWord);
   }
 
-  if (kDebugHeap > 1) {
-    heap = reinterpret_cast<std::uintptr_t>(m_heap_next);
-    align = std::min<std::size_t>(align, 4096);
-    heap = (heap + (align - 1)) & ~(align - 1);
-    size = 4096;
-    // std::fprintf(stderr, "kalloc: protect %lx-%lx, size = %lx, align=%lx\n",
-    //              heap, heap + size, size, align);
+  void *result;
 
-    auto result = ::mmap(reinterpret_cast<void *>(heap), size, PROT_NONE,
-                         MAP_FIXED | MAP_ANONYMOUS | MAP_SHARED, -1, 0);
-    if (result == MAP_FAILED) {
-      std::fprintf(stderr, "failed to protect memory");
-      std::abort();
+  // page guard requires own pages for every allocation
+  if (auto sizeClass = getSmallSizeClass(allocSize, align);
+      kDebugHeap < 2 && sizeClass < kSizeClassCount) {
+    auto &magazine = t_magazines.classes[sizeClass];
+    if (magazine.count == 0) {
+      refillMagazine(sizeClass, magazine);
+    }
+
+    result = magazine.objects[--magazine.count];
+  } else {
+    auto pageCount = (allocSize + kHeapPageSize - 1) / kHeapPageSize;
+    auto alignPages = std::max<std::size_t>(align / kHeapPageSize, 1);
+
+    if (kDebugHeap > 1) {
+      // trailing guard page is never returned to the heap. It stays part of
+      // the shared heap mapping, so forked processes see the same layout
+      result = allocatePages(pageCount + 1, alignPages);
+      auto guard =
+          std::bit_cast<std::byte *>(result) + pageCount * kHeapPageSize;
+
+      if (::mprotect(guard, kHeapPageSize, PROT_NONE) != 0) {
+        std::fprintf(stderr, "failed to protect memory");
+        std::abort();
+      }
+
+      // place guard word right before the guard page
+      auto data = std::bit_cast<std::uintptr_t>(guard - allocSize) &
+                  ~(align - 1);
+      result = std::bit_cast<void *>(
+          std::max(data, std::bit_cast<std::uintptr_t>(result)));
+    } else {
+      result = allocatePages(pageCount, alignPages);
     }
-    m_heap_next = reinterpret_cast<void *>(heap + size);
+  }
+
+  // std::fprintf(stderr, "kalloc: allocate %p-%p, size = %lx, align=%lx\n",
+  //              result, (char *)result + size, size, align);
+
+  if (kDebugHeap > 0) {
+    std::memcpy(std::bit_cast<std::byte *>(result) + size, &g_allocProtWord,
+                sizeof(g_allocProtWord));
   }
 
   return result;
@@ -182,6 +475,8 @@ void KernelMemoryResource::kfree(void *ptr, std::size_t size) {
     std::abort();
   }
 
+  auto allocSize = size;
+
   if (kDebugHeap > 0) {
     if (std::memcmp(std::bit_cast<std::byte *>(ptr) + size, &g_allocProtWord,
                     sizeof(g_allocProtWord)) != 0) {
@@ -190,20 +485,28 @@ void KernelMemoryResource::kfree(void *ptr, std::size_t size) {
     }
 
     std::memset(ptr, 0xcc, size + sizeof(g_allocProtWord));
+    allocSize += sizeof(g_allocProtWord);
   }
 
   // std::fprintf(stderr, "kfree: release %p-%p, size = %lx\n", ptr,
   //              (char *)ptr + size, size);
 
-  std::lock_guard lock(m_heap_map_mtx);
-  if (!m_used_node.empty()) {
-    auto node = m_used_node.extract(m_used_node.begin());
-    node.key() = size;
-    node.mapped() = ptr;
-    m_free_heap.insert(std::move(node));
-  } else {
-    m_free_heap.emplace(size, ptr);
+  auto address = std::bit_cast<std::uintptr_t>(ptr);
+
+  if (auto slabClass =
+          m_slab_classes[(address - kHeapBaseAddress) / kSlabSize];
+      slabClass != 0) {
+    auto &magazine = t_magazines.classes[slabClass - 1];
+    if (magazine.count == kMagazineSize) {
+      drainMagazine(slabClass - 1, magazine, kMagazineSize / 2);
+    }
+
+    magazine.objects[magazine.count++] = ptr;
+    return;
   }
+
+  auto pageCount = (allocSize + kHeapPageSize - 1) / kHeapPageSize;
+  freePages(address & ~(kHeapPageSize - 1), pageCount);
 }
 
 void kfree(void *ptr, std::size_t size) {
@@ -0,0 +1,873 @@
+#include "aio.hpp"
+#include "error.hpp"
+#include "file.hpp"
+#include "thread/Process.hpp"
+#include "thread/Thread.hpp"
+#include "uio.hpp"
+#include "utils/Logs.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <linux/io_uring.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace orbis {
+namespace {
+constexpr unsigned kRingEntries = 256;
+constexpr std::size_t kWorkerCount = 4;
+constexpr std::size_t kPriorityLevels = 3;
+
+struct AioSubmission;
+
+struct AioOp {
+  AioSubmission *submission;
+  rx::Ref<File> file;
+
+  // keeps issuing thread alive for file ops that run after it exits
+  rx::Ref<Thread> thread;
+  std::uint64_t offset;
+  std::uint64_t size;
+  void *buf;
+  ptr<AioResult> result;
+  bool isWrite;
+
+  // bytes done by previous short reads or writes, remainder is resubmitted
+  std::uint64_t transferred = 0;
+
+  // guarded by engine mutex
+  bool inRing = false;
+  bool done = false;
+};
+
+struct AioSubmission {
+  AioSubmitId id;
+  std::size_t priority;
+  std::atomic<bool> cancelled{false};
+
+  // guarded by engine mutex
+  sint state = kAioStateSubmitted;
+  std::uint32_t pending = 0;
+  bool aborted = false;
+  std::vector<AioOp> ops;
+
+  bool isFinished() const {
+    return state == kAioStateCompleted || state == kAioStateAborted;
+  }
+};
+
+slong toResult(ErrorCode error) { return -static_cast<slong>(error); }
+
+slong toResult(int hostErrno) {
+  return toResult(toErrorCode(static_cast<std::errc>(hostErrno)));
+}
+
+void writeResult(ptr<AioResult> result, slong value, sint state) {
+  if (result == nullptr) {
+    return;
+  }
+
+  // guest can poll state without syscall, value must be visible first
+  if (uwrite(&result->returnValue, value) != ErrorCode{}) {
+    return;
+  }
+
+  std::atomic_ref(result->state).store(state, std::memory_order::release);
+}
+
+// minimal io_uring over raw syscalls. Single producer under caller lock,
+// single consumer on completion thread. Entries are published to the kernel
+// by submit, completion thread also submits published entries while waiting.
+class IoUring {
+  int mFd = -1;
+  unsigned mSqEntries = 0;
+  unsigned mCqEntries = 0;
+
+  unsigned *mSqHead = nullptr;
+  unsigned *mSqTail = nullptr;
+  unsigned mSqMask = 0;
+  unsigned *mSqArray = nullptr;
+  io_uring_sqe *mSqes = nullptr;
+  unsigned mSqLocalTail = 0;
+
+  unsigned *mCqHead = nullptr;
+  unsigned *mCqTail = nullptr;
+  unsigned mCqMask = 0;
+  io_uring_cqe *mCqes = nullptr;
+
+public:
+  bool setup(unsigned entries) {
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 2;
+
+    mFd = ::syscall(__NR_io_uring_setup, entries, &params);
+    if (mFd < 0) {
+      return false;
+    }
+
+    std::size_t sqRingSize =
+        params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    std::size_t cqRingSize =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap) {
+      sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+
+    auto sqRing = static_cast<std::byte *>(
+        ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQ_RING));
+    auto cqRing = sqRing;
+
+    if (sqRing != MAP_FAILED && !singleMmap) {
+      cqRing = static_cast<std::byte *>(
+          ::mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_CQ_RING));
+    }
+
+    auto sqes =
+        ::mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe),
+               PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd,
+               IORING_OFF_SQES);
+
+    if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+      if (sqes != MAP_FAILED) {
+        ::munmap(sqes, params.sq_entries * sizeof(io_uring_sqe));
+      }
+
+      if (cqRing != MAP_FAILED && cqRing != sqRing) {
+        ::munmap(cqRing, cqRingSize);
+      }
+
+      if (sqRing != MAP_FAILED) {
+        ::munmap(sqRing, sqRingSize);
+      }
+
+      ::close(mFd);
+      mFd = -1;
+      return false;
+    }
+
+    mSqEntries = params.sq_entries;
+    mSqHead = reinterpret_cast<unsigned *>(sqRing + params.sq_off.head);
+    mSqTail = reinterpret_cast<unsigned *>(sqRing + params.sq_off.tail);
+    mSqLocalTail = *mSqTail;
+    mSqMask = *reinterpret_cast<unsigned *>(sqRing + params.sq_off.ring_mask);
+    mSqArray = reinterpret_cast<unsigned *>(sqRing + params.sq_off.array);
+    mSqes = static_cast<io_uring_sqe *>(sqes);
+
+    mCqEntries = params.cq_entries;
+    mCqHead = reinterpret_cast<unsigned *>(cqRing + params.cq_off.head);
+    mCqTail = reinterpret_cast<unsigned *>(cqRing + params.cq_off.tail);
+    mCqMask = *reinterpret_cast<unsigned *>(cqRing + params.cq_off.ring_mask);
+    mCqes = reinterpret_cast<io_uring_cqe *>(cqRing + params.cq_off.cqes);
+    return true;
+  }
+
+  // half of completion queue is reserved for cancel requests
+  unsigned getRequestCapacity() const { return mCqEntries / 2; }
+
+  // entry is not visible to the kernel until next submit
+  io_uring_sqe *getSqe() {
+    auto tail = mSqLocalTail;
+    auto head = std::atomic_ref(*mSqHead).load(std::memory_order::acquire);
+    if (tail - head >= mSqEntries) {
+      return nullptr;
+    }
+
+    auto index = tail & mSqMask;
+    auto sqe = &mSqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    mSqArray[index] = index;
+    mSqLocalTail = tail + 1;
+    return sqe;
+  }
+
+  void submit() {
+    std::atomic_ref(*mSqTail).store(mSqLocalTail, std::memory_order::release);
+
+    while (auto pending = getPendingCount()) {
+      auto result =
+          ::syscall(__NR_io_uring_enter, mFd, pending, 0, 0, nullptr, 0);
+      if (result > 0) {
+        continue;
+      }
+
+      if (result < 0 && errno == EINTR) {
+        continue;
+      }
+
+      // EAGAIN and EBUSY are resolved by reaping completions, entries stay
+      // in the ring and completion thread submits them after that
+      if (result < 0 && errno != EAGAIN && errno != EBUSY) {
+        ORBIS_LOG_ERROR("aio: io_uring_enter failed", errno);
+      }
+
+      return;
+    }
+  }
+
+  template <typename Fn> void waitCompletions(Fn &&fn) {
+    auto result = ::syscall(__NR_io_uring_enter, mFd, getPendingCount(), 1,
+                            IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (result < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      ORBIS_LOG_ERROR("aio: io_uring wait failed", errno);
+    }
+
+    auto head = *mCqHead;
+    auto tail = std::atomic_ref(*mCqTail).load(std::memory_order::acquire);
+
+    for (; head != tail; ++head) {
+      auto &cqe = mCqes[head & mCqMask];
+      fn(cqe.user_data, cqe.res);
+    }
+
+    std::atomic_ref(*mCqHead).store(head, std::memory_order::release);
+  }
+
+private:
+  // published entries not consumed by the kernel yet
+  unsigned getPendingCount() const {
+    return std::atomic_ref(*mSqTail).load(std::memory_order::acquire) -
+           std::atomic_ref(*mSqHead).load(std::memory_order::acquire);
+  }
+};
+
+// Executes AIO requests of one process. Reads and writes of host files go to
+// io_uring, whole batch of submit_cmd is one io_uring_enter. Requests of
+// other files, requests that do not fit the ring and everything on hosts
+// without io_uring run on worker threads, highest priority first.
+class AioEngine {
+  Process *mProcess;
+  std::once_flag mStartFlag;
+
+  std::mutex mMtx;
+  std::condition_variable mDoneCv;
+  std::unordered_map<AioSubmitId, std::unique_ptr<AioSubmission>> mSubmissions;
+  AioSubmitId mNextId = 1;
+
+  std::mutex mQueueMtx;
+  std::condition_variable mQueueCv;
+  std::deque<AioOp *> mQueues[kPriorityLevels];
+
+  std::mutex mRingMtx;
+  IoUring mRing;
+  bool mHasRing = false;
+  unsigned mRingInFlight = 0;
+
+public:
+  explicit AioEngine(Process *process) : mProcess(process) {}
+
+  Process *getProcess() const { return mProcess; }
+
+  ErrorCode submit(Thread *thread, uint cmd,
+                   std::span<const AioRWRequest> requests, std::size_t priority,
+                   ptr<AioSubmitId> ids);
+  ErrorCode wait(std::span<const AioSubmitId> ids, ptr<sint> states,
+                 uint mode, ptr<uint32_t> usec);
+  ErrorCode poll(std::span<const AioSubmitId> ids, ptr<sint> states);
+  ErrorCode cancel(std::span<const AioSubmitId> ids, ptr<sint> states);
+  ErrorCode erase(std::span<const AioSubmitId> ids, ptr<sint> states);
+
+private:
+  void start();
+  void dispatch(std::span<AioOp *> ops);
+  void prepareRingOp(io_uring_sqe *sqe, AioOp *op);
+  void resubmit(AioOp *op);
+  void complete(AioOp *op, slong result, bool aborted);
+  void workerEntry();
+  void completionEntry();
+  ErrorCode writeStates(std::span<const AioSubmitId> ids, ptr<sint> states);
+};
+
+void AioEngine::start() {
+  mHasRing = mRing.setup(kRingEntries);
+  if (!mHasRing) {
+    ORBIS_LOG_WARNING("aio: io_uring is not available, using thread pool",
+                      errno);
+  } else {
+    std::thread([this] { completionEntry(); }).detach();
+  }
+
+  for (std::size_t i = 0; i < kWorkerCount; ++i) {
+    std::thread([this] { workerEntry(); }).detach();
+  }
+}
+
+ErrorCode AioEngine::submit(Thread *thread, uint cmd,
+                            std::span<const AioRWRequest> requests,
+                            std::size_t priority, ptr<AioSubmitId> ids) {
+  std::call_once(mStartFlag, [this] { start(); });
+
+  bool isWrite = (cmd & kAioCmdMask) == kAioCmdWrite;
+  bool multiple = (cmd & kAioCmdMultiple) != 0;
+  auto submissionCount = multiple ? requests.size() : 1;
+  auto opsPerSubmission = multiple ? 1 : requests.size();
+
+  std::vector<std::unique_ptr<AioSubmission>> submissions(submissionCount);
+
+  for (std::size_t i = 0; i < submissionCount; ++i) {
+    auto &submission = submissions[i];
+    submission = std::make_unique<AioSubmission>();
+    submission->priority = priority;
+    submission->pending = opsPerSubmission;
+    submission->ops.reserve(opsPerSubmission);
+
+    for (std::size_t j = 0; j < opsPerSubmission; ++j) {
+      auto &request = requests[i * opsPerSubmission + j];
+      rx::Ref<File> file = thread->tproc->fileDescriptors.get(request.fd);
+      if (file == nullptr) {
+        return ErrorCode::BADF;
+      }
+
+      if (request.offset < 0) {
+        return ErrorCode::INVAL;
+      }
+
+      submission->ops.push_back({
+          .submission = submission.get(),
+          .file = std::move(file),
+          .thread = thread,
+          .offset = static_cast<std::uint64_t>(request.offset),
+          .size = request.nbyte,
+          .buf = request.buf,
+          .result = request.result,
+          .isWrite = isWrite,
+      });
+    }
+  }
+
+  std::vector<AioSubmitId> submitIds(submissionCount);
+  std::vector<AioOp *> ops;
+  ops.reserve(requests.size());
+
+  {
+    std::lock_guard lock(mMtx);
+
+    for (std::size_t i = 0; i < submissionCount; ++i) {
+      auto &submission = submissions[i];
+      submission->id = mNextId;
+      mNextId = mNextId == std::numeric_limits<AioSubmitId>::max()
+                    ? 1
+                    : mNextId + 1;
+      submitIds[i] = submission->id;
+
+      for (auto &op : submission->ops) {
+        ops.push_back(&op);
+      }
+
+      mSubmissions[submission->id] = std::move(submission);
+    }
+  }
+
+  if (auto error =
+          uwrite(ids, submitIds.data(), multiple ? submissionCount : 1);
+      error != ErrorCode{}) {
+    // nothing was dispatched yet, waiters of guessed ids see them deleted
+    std::lock_guard lock(mMtx);
+    for (auto id : submitIds) {
+      mSubmissions.erase(id);
+    }
+
+    mDoneCv.notify_all();
+    return error;
+  }
+
+  for (auto op : ops) {
+    writeResult(op->result, 0, kAioStateSubmitted);
+  }
+
+  dispatch(ops);
+  return {};
+}
+
+void AioEngine::dispatch(std::span<AioOp *> ops) {
+  std::vector<AioOp *> poolOps;
+
+  if (mHasRing) {
+    std::lock_guard lock(mRingMtx);
+
+    for (auto op : ops) {
+      // io_uring length is 32 bit
+      if (op->file->hostFd < 0 || op->size > ~std::uint32_t(0) ||
+          mRingInFlight >= mRing.getRequestCapacity()) {
+        poolOps.push_back(op);
+        continue;
+      }
+
+      auto sqe = mRing.getSqe();
+      if (sqe == nullptr) {
+        mRing.submit();
+        sqe = mRing.getSqe();
+      }
+
+      if (sqe == nullptr) {
+        poolOps.push_back(op);
+        continue;
+      }
+
+      {
+        std::lock_guard engineLock(mMtx);
+        op->inRing = true;
+
+        if (op->submission->state == kAioStateSubmitted) {
+          op->submission->state = kAioStateProcessing;
+        }
+      }
+
+      prepareRingOp(sqe, op);
+      writeResult(op->result, 0, kAioStateProcessing);
+      mRingInFlight++;
+    }
+
+    mRing.submit();
+  } else {
+    poolOps.assign(ops.begin(), ops.end());
+  }
+
+  if (poolOps.empty()) {
+    return;
+  }
+
+  {
+    std::lock_guard lock(mQueueMtx);
+    for (auto op : poolOps) {
+      mQueues[op->submission->priority].push_back(op);
+    }
+  }
+
+  mQueueCv.notify_all();
+}
+
+// caller holds ring lock
+void AioEngine::prepareRingOp(io_uring_sqe *sqe, AioOp *op) {
+  // best effort class, level 2, 4 and 6 for high, mid and low
+  sqe->opcode = op->isWrite ? IORING_OP_WRITE : IORING_OP_READ;
+  sqe->fd = op->file->hostFd;
+  sqe->addr = reinterpret_cast<std::uint64_t>(
+      static_cast<std::byte *>(op->buf) + op->transferred);
+  sqe->len = op->size - op->transferred;
+  sqe->off = op->offset + op->transferred;
+  sqe->ioprio = (2 << 13) | (6 - op->submission->priority * 2);
+  sqe->user_data = reinterpret_cast<std::uint64_t>(op);
+}
+
+// continues short read or write, in the ring if there is free entry,
+// otherwise on worker thread
+void AioEngine::resubmit(AioOp *op) {
+  {
+    std::lock_guard lock(mRingMtx);
+
+    auto sqe = mRing.getSqe();
+    if (sqe == nullptr) {
+      mRing.submit();
+      sqe = mRing.getSqe();
+    }
+
+    if (sqe != nullptr) {
+      prepareRingOp(sqe, op);
+      mRing.submit();
+      return;
+    }
+
+    mRingInFlight--;
+
+    std::lock_guard engineLock(mMtx);
+    op->inRing = false;
+  }
+
+  {
+    std::lock_guard lock(mQueueMtx);
+    mQueues[op->submission->priority].push_back(op);
+  }
+
+  mQueueCv.notify_all();
+}
+
+void AioEngine::complete(AioOp *op, slong result, bool aborted) {
+  writeResult(op->result, aborted ? toResult(ErrorCode::CANCELED) : result,
+              aborted ? kAioStateAborted : kAioStateCompleted);
+
+  std::lock_guard lock(mMtx);
+  auto submission = op->submission;
+  op->done = true;
+  submission->aborted |= aborted;
+
+  if (--submission->pending == 0) {
+    submission->state =
+        submission->aborted ? kAioStateAborted : kAioStateCompleted;
+    mDoneCv.notify_all();
+  }
+}
+
+void AioEngine::completionEntry() {
+  while (true) {
+    // entries left by EAGAIN or EBUSY are submitted together with the wait
+    mRing.waitCompletions([this](std::uint64_t userData, int res) {
+      // cancel requests have no user data
+      if (userData == 0) {
+        return;
+      }
+
+      auto op = reinterpret_cast<AioOp *>(userData);
+
+      if (res > 0) {
+        op->transferred += res;
+
+        if (op->transferred < op->size &&
+            !op->submission->cancelled.load(std::memory_order::relaxed)) {
+          resubmit(op);
+          return;
+        }
+      }
+
+      {
+        std::lock_guard lock(mRingMtx);
+        mRingInFlight--;
+      }
+
+      if (res == -ECANCELED) {
+        complete(op, 0, true);
+      } else {
+        complete(op, res < 0 ? toResult(-res) : slong(op->transferred),
+                 false);
+      }
+    });
+  }
+}
+
+void AioEngine::workerEntry() {
+  while (true) {
+    AioOp *op = nullptr;
+
+    {
+      std::unique_lock lock(mQueueMtx);
+      mQueueCv.wait(lock, [&] {
+        for (auto &queue : std::views::reverse(mQueues)) {
+          if (!queue.empty()) {
+            op = queue.front();
+            queue.pop_front();
+            return true;
+          }
+        }
+
+        return false;
+      });
+    }
+
+    if (op->submission->cancelled.load(std::memory_order::relaxed)) {
+      complete(op, 0, true);
+      continue;
+    }
+
+    {
+      std::lock_guard lock(mMtx);
+      if (op->submission->state == kAioStateSubmitted) {
+        op->submission->state = kAioStateProcessing;
+      }
+    }
+
+    writeResult(op->result, 0, kAioStateProcessing);
+
+    if (op->file->hostFd >= 0) {
+      auto bytes = static_cast<std::byte *>(op->buf);
+      std::uint64_t done = op->transferred;
+      slong result = done;
+
+      while (done < op->size) {
+        auto count =
+            op->isWrite
+                ? ::pwrite(op->file->hostFd, bytes + done, op->size - done,
+                           op->offset + done)
+                : ::pread(op->file->hostFd, bytes + done, op->size - done,
+                          op->offset + done);
+
+        if (count < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+
+          result = toResult(errno);
+          break;
+        }
+
+        if (count == 0) {
+          break;
+        }
+
+        done += count;
+        result = done;
+      }
+
+      complete(op, result, false);
+      continue;
+    }
+
+    auto fn = op->isWrite ? op->file->ops->write : op->file->ops->read;
+    if (fn == nullptr) {
+      complete(op, toResult(ErrorCode::NOTSUP), false);
+      continue;
+    }
+
+    IoVec vec{.base = op->buf, .len = op->size};
+    Uio io{
+        .offset = op->offset,
+        .iov = &vec,
+        .iovcnt = 1,
+        .segflg = UioSeg::UserSpace,
+        .rw = op->isWrite ? UioRw::Write : UioRw::Read,
+        .td = op->thread.get(),
+    };
+
+    ErrorCode error;
+    {
+      std::lock_guard lock(op->file->mtx);
+      error = fn(op->file.get(), &io, op->thread.get());
+    }
+
+    if (error != ErrorCode{} && error != ErrorCode::AGAIN) {
+      complete(op, toResult(error), false);
+    } else {
+      complete(op, io.offset - op->offset, false);
+    }
+  }
+}
+
+ErrorCode AioEngine::writeStates(std::span<const AioSubmitId> ids,
+                                 ptr<sint> states) {
+  ErrorCode result{};
+
+  for (std::size_t i = 0; i < ids.size(); ++i) {
+    auto it = mSubmissions.find(ids[i]);
+    sint state = 0;
+
+    if (it == mSubmissions.end()) {
+      result = ErrorCode::SRCH;
+    } else {
+      state = it->second->state;
+    }
+
+    if (states != nullptr) {
+      ORBIS_RET_ON_ERROR(uwrite(states + i, state));
+    }
+  }
+
+  return result;
+}
+
+ErrorCode AioEngine::wait(std::span<const AioSubmitId> ids, ptr<sint> states,
+                          uint mode, ptr<uint32_t> usec) {
+  if (mode != kAioWaitAnd && mode != kAioWaitOr) {
+    return ErrorCode::INVAL;
+  }
+
+  std::optional<std::chrono::steady_clock::time_point> deadline;
+  if (usec != nullptr) {
+    uint32_t timeout;
+    ORBIS_RET_ON_ERROR(uread(timeout, usec));
+    deadline =
+        std::chrono::steady_clock::now() + std::chrono::microseconds(timeout);
+  }
+
+  std::unique_lock lock(mMtx);
+
+  // deleted submissions are reported by writeStates
+  auto isReady = [&] {
+    std::size_t finished = 0;
+    for (auto id : ids) {
+      auto it = mSubmissions.find(id);
+      if (it == mSubmissions.end() || it->second->isFinished()) {
+        finished++;
+      }
+    }
+
+    return mode == kAioWaitAnd ? finished == ids.size() : finished > 0;
+  };
+
+  bool ready = true;
+  if (deadline) {
+    ready = mDoneCv.wait_until(lock, *deadline, isReady);
+
+    auto left = std::chrono::duration_cast<std::chrono::microseconds>(
+        *deadline - std::chrono::steady_clock::now());
+    ORBIS_RET_ON_ERROR(
+        uwrite(usec, static_cast<uint32_t>(std::max<std::int64_t>(
+                         left.count(), 0))));
+  } else {
+    mDoneCv.wait(lock, isReady);
+  }
+
+  ORBIS_RET_ON_ERROR(writeStates(ids, states));
+  return ready ? ErrorCode{} : ErrorCode::TIMEDOUT;
+}
+
+ErrorCode AioEngine::poll(std::span<const AioSubmitId> ids, ptr<sint> states) {
+  std::lock_guard lock(mMtx);
+  return writeStates(ids, states);
+}
+
+ErrorCode AioEngine::cancel(std::span<const AioSubmitId> ids,
+                            ptr<sint> states) {
+  {
+    std::lock_guard ringLock(mRingMtx);
+    std::lock_guard lock(mMtx);
+
+    for (auto id : ids) {
+      auto it = mSubmissions.find(id);
+      if (it == mSubmissions.end() || it->second->isFinished()) {
+        continue;
+      }
+
+      auto &submission = *it->second;
+      submission.cancelled.store(true, std::memory_order::relaxed);
+
+      // queued requests are dropped by workers, requests in the ring are
+      // cancelled if they have not started yet
+      for (auto &op : submission.ops) {
+        if (!op.inRing || op.done) {
+          continue;
+        }
+
+        if (auto sqe = mRing.getSqe()) {
+          sqe->opcode = IORING_OP_ASYNC_CANCEL;
+          sqe->addr = reinterpret_cast<std::uint64_t>(&op);
+          sqe->user_data = 0;
+        }
+      }
+    }
+
+    if (mHasRing) {
+      mRing.submit();
+    }
+  }
+
+  std::lock_guard lock(mMtx);
+  return writeStates(ids, states);
+}
+
+ErrorCode AioEngine::erase(std::span<const AioSubmitId> ids,
+                           ptr<sint> states) {
+  std::lock_guard lock(mMtx);
+  auto result = writeStates(ids, states);
+
+  for (auto id : ids) {
+    auto it = mSubmissions.find(id);
+    if (it == mSubmissions.end()) {
+      continue;
+    }
+
+    if (!it->second->isFinished()) {
+      if (result == ErrorCode{}) {
+        result = ErrorCode::BUSY;
+      }
+
+      continue;
+    }
+
+    mSubmissions.erase(it);
+  }
+
+  return result;
+}
+
+AioEngine &getEngine(Process *process) {
+  static std::atomic<AioEngine *> g_engine;
+
+  // engine of parent process is abandoned after fork, its threads do not
+  // exist in child
+  auto engine = g_engine.load(std::memory_order::acquire);
+  if (engine != nullptr && engine->getProcess() == process) {
+    return *engine;
+  }
+
+  auto created = new AioEngine(process);
+  if (g_engine.compare_exchange_strong(engine, created,
+                                       std::memory_order::acq_rel)) {
+    return *created;
+  }
+
+  delete created;
+  return *engine;
+}
+
+ErrorCode readIds(std::vector<AioSubmitId> &result,
+                  ptr<const AioSubmitId> ids, sint count) {
+  if (count <= 0 || count > kAioMaxRequests) {
+    return ErrorCode::INVAL;
+  }
+
+  result.resize(count);
+  return uread(result.data(), ids, count);
+}
+} // namespace
+} // namespace orbis
+
+orbis::ErrorCode orbis::aio_submit_cmd(Thread *thread, uint cmd,
+                                       ptr<const AioRWRequest> requests,
+                                       sint count, uint priority,
+                                       ptr<AioSubmitId> ids) {
+  auto op = cmd & kAioCmdMask;
+  if (op != kAioCmdRead && op != kAioCmdWrite) {
+    return ErrorCode::INVAL;
+  }
+
+  if (count <= 0 || count > kAioMaxRequests || priority < kAioPriorityLow ||
+      priority > kAioPriorityHigh) {
+    return ErrorCode::INVAL;
+  }
+
+  std::vector<AioRWRequest> kernelRequests(count);
+  ORBIS_RET_ON_ERROR(uread(kernelRequests.data(), requests, count));
+
+  return getEngine(thread->tproc)
+      .submit(thread, cmd, kernelRequests, priority - kAioPriorityLow, ids);
+}
+
+orbis::ErrorCode orbis::aio_multi_wait(Thread *thread,
+                                       ptr<const AioSubmitId> ids, sint count,
+                                       ptr<sint> states, uint mode,
+                                       ptr<uint32_t> usec) {
+  std::vector<AioSubmitId> kernelIds;
+  ORBIS_RET_ON_ERROR(readIds(kernelIds, ids, count));
+  return getEngine(thread->tproc).wait(kernelIds, states, mode, usec);
+}
+
+orbis::ErrorCode orbis::aio_multi_poll(Thread *thread,
+                                       ptr<const AioSubmitId> ids, sint count,
+                                       ptr<sint> states) {
+  std::vector<AioSubmitId> kernelIds;
+  ORBIS_RET_ON_ERROR(readIds(kernelIds, ids, count));
+  return getEngine(thread->tproc).poll(kernelIds, states);
+}
+
+orbis::ErrorCode orbis::aio_multi_cancel(Thread *thread,
+                                         ptr<const AioSubmitId> ids,
+                                         sint count, ptr<sint> states) {
+  std::vector<AioSubmitId> kernelIds;
+  ORBIS_RET_ON_ERROR(readIds(kernelIds, ids, count));
+  return getEngine(thread->tproc).cancel(kernelIds, states);
+}
+
+orbis::ErrorCode orbis::aio_multi_delete(Thread *thread,
+                                         ptr<const AioSubmitId> ids,
+                                         sint count, ptr<sint> states) {
+  std::vector<AioSubmitId> kernelIds;
+  ORBIS_RET_ON_ERROR(readIds(kernelIds, ids, count));
+  return getEngine(thread->tproc).erase(kernelIds, states);
+}
@@ -1,6 +1,7 @@
 #include "module/Module.hpp"
 #include "KernelAllocator.hpp"
 #include "thread.hpp"
+#include <chrono>
 #include <utility>
 
 #include "thread/Process.hpp"
@@ -69,96 +70,126 @@ static void allocateTlsOffset(orbis::Process *process, orbis::Module *module) {
   module->isTlsDone = true;
 }
 
-static orbis::SysResult doPltRelocation(orbis::Process *process,
-                                        orbis::Module *module,
-                                        orbis::Relocation rel) {
-  auto symbol = module->symbols.at(rel.symbolIndex);
+static std::uint32_t findLibraryIndex(const orbis::Module *module,
+                                      std::string_view name) {
+  for (std::uint32_t i = 0; i < module->neededLibraries.size(); ++i) {
+    if (module->neededLibraries[i].name == name) {
+      return i;
+    }
+  }
 
-  auto A = rel.addend;
-  auto B = reinterpret_cast<std::uint64_t>(module->base);
-  auto where = reinterpret_cast<std::uint64_t *>(B + rel.offset);
-  auto where32 = reinterpret_cast<std::uint32_t *>(B + rel.offset);
-  auto P = reinterpret_cast<std::uintptr_t>(where);
+  return -1;
+}
 
-  auto findDefModule = [module,
-                        symbol] -> std::pair<orbis::Module *, std::uint64_t> {
-    if (symbol.moduleIndex == -1 || symbol.bind == orbis::SymbolBind::Local) {
-      return std::pair(module, symbol.address);
-    }
+void orbis::Module::buildExportIndex() {
+  exportIndex.clear();
+  exportIndex.reserve(symbols.size());
 
-    auto &defModule = module->importedModules.at(symbol.moduleIndex);
-    if (!defModule) {
-      // std::printf(
-      //     "Delaying plt relocation '%s' ('%s'), symbol '%llx' in %s
-      //     module\n", module->moduleName, module->soName, (unsigned long
-      //     long)symbol.id,
-      //     module->neededModules[symbol.moduleIndex].name.c_str());
+  for (std::uint32_t i = 0; i < symbols.size(); ++i) {
+    auto &symbol = symbols[i];
 
-      return {};
+    if (symbol.bind == SymbolBind::Local ||
+        symbol.visibility == SymbolVisibility::Hidden ||
+        symbol.libraryIndex >= neededLibraries.size()) {
+      continue;
     }
 
-    auto library = module->neededLibraries.at(symbol.libraryIndex);
+    // libraries are matched by name, use first library with the same name
+    auto libraryIndex =
+        findLibraryIndex(this, neededLibraries[symbol.libraryIndex].name);
 
-    std::vector<std::string> foundInLibs;
-    for (auto defSym : defModule->symbols) {
-      if (defSym.id != symbol.id || defSym.bind == orbis::SymbolBind::Local) {
-        continue;
-      }
+    // first symbol wins, same as linear lookup
+    exportIndex.try_emplace({symbol.id, libraryIndex}, i);
+  }
+}
 
-      if (defSym.visibility == orbis::SymbolVisibility::Hidden) {
-        std::printf("Ignoring hidden symbol\n");
-        continue;
-      }
+const orbis::Symbol *
+orbis::Module::findExport(std::uint64_t id, std::string_view library) const {
+  auto libraryIndex = findLibraryIndex(this, library);
+  if (libraryIndex == static_cast<std::uint32_t>(-1)) {
+    return nullptr;
+  }
 
-      auto defLib = defModule->neededLibraries.at(defSym.libraryIndex);
+  auto it = exportIndex.find({id, libraryIndex});
+  if (it == exportIndex.end()) {
+    return nullptr;
+  }
 
-      if (defLib.name == library.name) {
-        return std::pair(defModule.get(), defSym.address);
-      }
+  return &symbols[it->second];
+}
 
-      foundInLibs.emplace_back(std::string_view(defLib.name));
-    }
+static std::pair<orbis::Module *, std::uint64_t>
+findDefModule(orbis::Module *module, const orbis::Symbol &symbol) {
+  if (symbol.moduleIndex == -1 || symbol.bind == orbis::SymbolBind::Local) {
+    return std::pair(module, symbol.address);
+  }
 
-    for (auto nsDefModule : defModule->namespaceModules) {
-      for (auto defSym : nsDefModule->symbols) {
-        if (defSym.id != symbol.id || defSym.bind == orbis::SymbolBind::Local) {
-          continue;
-        }
+  auto &defModule = module->importedModules.at(symbol.moduleIndex);
+  if (!defModule) {
+    // std::printf(
+    //     "Delaying relocation '%s' ('%s'), symbol '%llx' in %s module\n",
+    //     module->moduleName, module->soName, (unsigned long long)symbol.id,
+    //     module->neededModules[symbol.moduleIndex].name.c_str());
+
+    return {};
+  }
 
-        if (defSym.visibility == orbis::SymbolVisibility::Hidden) {
-          std::printf("Ignoring hidden symbol\n");
-          continue;
-        }
+  auto &library = module->neededLibraries.at(symbol.libraryIndex);
 
-        auto defLib = nsDefModule->neededLibraries.at(defSym.libraryIndex);
+  if (auto defSym = defModule->findExport(symbol.id, library.name)) {
+    return std::pair(defModule.get(), defSym->address);
+  }
 
-        if (defLib.name == library.name) {
-          return std::pair(nsDefModule.get(), defSym.address);
-        }
-      }
+  for (auto &nsDefModule : defModule->namespaceModules) {
+    if (auto defSym = nsDefModule->findExport(symbol.id, library.name)) {
+      return std::pair(nsDefModule.get(), defSym->address);
     }
+  }
 
-    std::printf(
-        "'%s' ('%s') uses undefined symbol '%llx' in '%s' ('%s') module\n",
-        module->moduleName, module->soName, (unsigned long long)symbol.id,
-        defModule->moduleName, defModule->soName);
-    if (foundInLibs.size() > 0) {
-      std::printf("Requested library is '%s', exists in libraries: [",
-                  library.name.c_str());
-
-      for (bool isFirst = true; auto &lib : foundInLibs) {
-        if (isFirst) {
-          isFirst = false;
-        } else {
-          std::printf(", ");
-        }
-
-        std::printf("'%s'", lib.c_str());
+  std::vector<std::string> foundInLibs;
+  for (auto &defSym : defModule->symbols) {
+    if (defSym.id != symbol.id || defSym.bind == orbis::SymbolBind::Local ||
+        defSym.visibility == orbis::SymbolVisibility::Hidden ||
+        defSym.libraryIndex >= defModule->neededLibraries.size()) {
+      continue;
+    }
+
+    auto &defLib = defModule->neededLibraries[defSym.libraryIndex];
+    foundInLibs.emplace_back(std::string_view(defLib.name));
+  }
+
+  std::printf(
+      "'%s' ('%s') uses undefined symbol '%llx' in '%s' ('%s') module\n",
+      module->moduleName, module->soName, (unsigned long long)symbol.id,
+      defModule->moduleName, defModule->soName);
+  if (foundInLibs.size() > 0) {
+    std::printf("Requested library is '%s', exists in libraries: [",
+                library.name.c_str());
+
+    for (bool isFirst = true; auto &lib : foundInLibs) {
+      if (isFirst) {
+        isFirst = false;
+      } else {
+        std::printf(", ");
       }
-      std::printf("]\n");
+
+      std::printf("'%s'", lib.c_str());
     }
-    return std::pair(module, symbol.address);
-  };
+    std::printf("]\n");
+  }
+  return std::pair(module, symbol.address);
+}
+
+static orbis::SysResult doPltRelocation(orbis::Process *process,
+                                        orbis::Module *module,
+                                        orbis::Relocation rel) {
+  auto &symbol = module->symbols.at(rel.symbolIndex);
+
+  auto A = rel.addend;
+  auto B = reinterpret_cast<std::uint64_t>(module->base);
+  auto where = reinterpret_cast<std::uint64_t *>(B + rel.offset);
+  auto where32 = reinterpret_cast<std::uint32_t *>(B + rel.offset);
+  auto P = reinterpret_cast<std::uintptr_t>(where);
 
   switch (rel.relType) {
   case kRelJumpSlot: {
@@ -166,7 +197,7 @@ static orbis::SysResult doPltRelocation(orbis::Process *process,
     if (isLazyBind) {
       *where += B;
     } else {
-      auto [defObj, S] = findDefModule();
+      auto [defObj, S] = findDefModule(module, symbol);
 
       if (defObj == nullptr) {
         return orbis::ErrorCode::INVAL;
@@ -187,7 +218,7 @@ static orbis::SysResult doPltRelocation(orbis::Process *process,
 static orbis::SysResult doRelocation(orbis::Process *process,
                                      orbis::Module *module,
                                      orbis::Relocation rel) {
-  auto symbol = module->symbols.at(rel.symbolIndex);
+  auto &symbol = module->symbols.at(rel.symbolIndex);
 
   auto A = rel.addend;
   auto B = reinterpret_cast<std::uint64_t>(module->base);
@@ -195,93 +226,11 @@ static orbis::SysResult doRelocation(orbis::Process *process,
   auto where32 = reinterpret_cast<std::uint32_t *>(B + rel.offset);
   auto P = reinterpret_cast<std::uintptr_t>(where);
 
-  auto findDefModule = [module, symbol,
-                        rel] -> std::pair<orbis::Module *, std::uint64_t> {
-    if (symbol.moduleIndex == -1 || symbol.bind == orbis::SymbolBind::Local) {
-      return std::pair(module, symbol.address);
-    }
-
-    auto &defModule = module->importedModules.at(symbol.moduleIndex);
-    if (!defModule) {
-      // std::printf("'%s' ('%s') uses undefined symbol '%llx' in unloaded
-      // module "
-      //             "'%s', rel %u\n",
-      //             module->moduleName, module->soName,
-      //             (unsigned long long)symbol.id,
-      //             module->neededModules.at(symbol.moduleIndex).name.c_str(),
-      //             rel.relType);
-
-      return {};
-    }
-
-    auto library = module->neededLibraries.at(symbol.libraryIndex);
-
-    std::vector<std::string> foundInLibs;
-    for (auto defSym : defModule->symbols) {
-      if (defSym.id != symbol.id || defSym.bind == orbis::SymbolBind::Local) {
-        continue;
-      }
-
-      if (defSym.visibility == orbis::SymbolVisibility::Hidden) {
-        std::printf("Ignoring hidden symbol\n");
-        continue;
-      }
-
-      auto defLib = defModule->neededLibraries.at(defSym.libraryIndex);
-
-      if (defLib.name == library.name) {
-        return std::pair(defModule.get(), defSym.address);
-      }
-
-      foundInLibs.emplace_back(std::string_view(defLib.name));
-    }
-
-    for (auto nsDefModule : defModule->namespaceModules) {
-      for (auto defSym : nsDefModule->symbols) {
-        if (defSym.id != symbol.id || defSym.bind == orbis::SymbolBind::Local) {
-          continue;
-        }
-
-        if (defSym.visibility == orbis::SymbolVisibility::Hidden) {
-          std::printf("Ignoring hidden symbol\n");
-          continue;
-        }
-
-        auto defLib = nsDefModule->neededLibraries.at(defSym.libraryIndex);
-
-        if (defLib.name == library.name) {
-          return std::pair(nsDefModule.get(), defSym.address);
-        }
-      }
-    }
-
-    std::printf(
-        "'%s' ('%s') uses undefined symbol '%llx' in '%s' ('%s') module\n",
-        module->moduleName, module->soName, (unsigned long long)symbol.id,
-        defModule->moduleName, defModule->soName);
-    if (foundInLibs.size() > 0) {
-      std::printf("Requested library is '%s', exists in libraries: [",
-                  library.name.c_str());
-
-      for (bool isFirst = true; auto &lib : foundInLibs) {
-        if (isFirst) {
-          isFirst = false;
-        } else {
-          std::printf(", ");
-        }
-
-        std::printf("'%s'", lib.c_str());
-      }
-      std::printf("]\n");
-    }
-    return std::pair(module, symbol.address);
-  };
-
   switch (rel.relType) {
   case kRelNone:
     return {};
   case kRel64: {
-    auto [defObj, S] = findDefModule();
+    auto [defObj, S] = findDefModule(module, symbol);
 
     if (defObj == nullptr) {
       return orbis::ErrorCode::INVAL;
@@ -291,7 +240,7 @@ static orbis::SysResult doRelocation(orbis::Process *process,
   }
     return {};
   case kRelPc32: {
-    auto [defObj, S] = findDefModule();
+    auto [defObj, S] = findDefModule(module, symbol);
 
     if (defObj == nullptr) {
       return orbis::ErrorCode::INVAL;
@@ -303,7 +252,7 @@ static orbis::SysResult doRelocation(orbis::Process *process,
   // case kRelCopy:
   //   return{};
   case kRelGlobDat: {
-    auto [defObj, S] = findDefModule();
+    auto [defObj, S] = findDefModule(module, symbol);
 
     if (defObj == nullptr) {
       return orbis::ErrorCode::INVAL;
@@ -315,7 +264,7 @@ static orbis::SysResult doRelocation(orbis::Process *process,
     *where = B + A;
     return {};
   case kRelDtpMod64: {
-    auto [defObj, S] = findDefModule();
+    auto [defObj, S] = findDefModule(module, symbol);
     if (defObj == nullptr) {
       return orbis::ErrorCode::INVAL;
     }
@@ -323,7 +272,7 @@ static orbis::SysResult doRelocation(orbis::Process *process,
     return {};
   }
   case kRelDtpOff64: {
-    auto [defObj, S] = findDefModule();
+    auto [defObj, S] = findDefModule(module, symbol);
     if (defObj == nullptr) {
       return orbis::ErrorCode::INVAL;
     }
@@ -331,7 +280,7 @@ static orbis::SysResult doRelocation(orbis::Process *process,
     return {};
   }
   case kRelTpOff64: {
-    auto [defObj, S] = findDefModule();
+    auto [defObj, S] = findDefModule(module, symbol);
     if (defObj == nullptr) {
       return orbis::ErrorCode::INVAL;
     }
@@ -342,12 +291,12 @@ static orbis::SysResult doRelocation(orbis::Process *process,
     return {};
   }
   case kRelDtpOff32: {
-    auto [defObj, S] = findDefModule();
+    auto [defObj, S] = findDefModule(module, symbol);
     *where32 += S + A;
     return {};
   }
   case kRelTpOff32: {
-    auto [defObj, S] = findDefModule();
+    auto [defObj, S] = findDefModule(module, symbol);
     if (defObj == nullptr) {
       return orbis::ErrorCode::INVAL;
     }
@@ -366,6 +315,14 @@ static orbis::SysResult doRelocation(orbis::Process *process,
 }
 
 orbis::SysResult orbis::Module::relocate(Process *process) {
+  auto startTime = std::chrono::steady_clock::now();
+  auto getElapsedUs = [&] {
+    return static_cast<long long>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - startTime)
+            .count());
+  };
+
   if (!pltRelocations.empty()) {
     kvector<Relocation> delayedRelocations;
     std::size_t resolved = 0;
@@ -381,12 +338,13 @@ orbis::SysResult orbis::Module::relocate(Process *process) {
       }
     }
 
-    std::printf("plt relocation of %s: delayed/resolved: %zu/%zu\n", moduleName,
-                delayed, resolved);
+    std::printf("plt relocation of %s: delayed/resolved: %zu/%zu, %lld us\n",
+                moduleName, delayed, resolved, getElapsedUs());
     pltRelocations = std::move(delayedRelocations);
   }
 
   if (!nonPltRelocations.empty()) {
+    startTime = std::chrono::steady_clock::now();
     kvector<Relocation> delayedRelocations;
     std::size_t resolved = 0;
     std::size_t delayed = 0;
@@ -401,8 +359,9 @@ orbis::SysResult orbis::Module::relocate(Process *process) {
       }
     }
 
-    std::printf("non-plt relocation of %s: delayed/resolved: %zu/%zu\n",
-                moduleName, delayed, resolved);
+    std::printf(
+        "non-plt relocation of %s: delayed/resolved: %zu/%zu, %lld us\n",
+        moduleName, delayed, resolved, getElapsedUs());
     nonPltRelocations = std::move(delayedRelocations);
   }
 
@@ -1,5 +1,6 @@
 #include "sys/sys_sce.hpp"
 #include "KernelContext.hpp"
+#include "aio.hpp"
 #include "error.hpp"
 #include "evf.hpp"
 #include "ipmi.hpp"
@@ -1768,22 +1769,36 @@ orbis::SysResult orbis::sys_dynlib_get_info2(Thread *thread /* TODO */) {
   return ErrorCode::NOSYS;
 }
 orbis::SysResult orbis::sys_aio_submit(Thread *thread /* TODO */) {
+  // libkernel submits read and write commands through aio_submit_cmd, no
+  // caller of this entry or its arguments are known yet. When found it
+  // should forward to aio_submit_cmd like sys_aio_submit_cmd does
   return ErrorCode::NOSYS;
 }
-orbis::SysResult orbis::sys_aio_multi_delete(Thread *thread /* TODO */) {
-  return ErrorCode::NOSYS;
+orbis::SysResult orbis::sys_aio_multi_delete(Thread *thread,
+                                             ptr<const AioSubmitId> ids,
+                                             sint count, ptr<sint> states) {
+  return aio_multi_delete(thread, ids, count, states);
 }
-orbis::SysResult orbis::sys_aio_multi_wait(Thread *thread /* TODO */) {
-  return ErrorCode::NOSYS;
+orbis::SysResult orbis::sys_aio_multi_wait(Thread *thread,
+                                           ptr<const AioSubmitId> ids,
+                                           sint count, ptr<sint> states,
+                                           uint mode, ptr<uint32_t> usec) {
+  return aio_multi_wait(thread, ids, count, states, mode, usec);
 }
-orbis::SysResult orbis::sys_aio_multi_poll(Thread *thread /* TODO */) {
-  return ErrorCode::NOSYS;
+orbis::SysResult orbis::sys_aio_multi_poll(Thread *thread,
+                                           ptr<const AioSubmitId> ids,
+                                           sint count, ptr<sint> states) {
+  return aio_multi_poll(thread, ids, count, states);
 }
 orbis::SysResult orbis::sys_aio_get_data(Thread *thread /* TODO */) {
+  // results are written to AioResult of every request on completion, no
+  // caller of this entry is known yet
   return ErrorCode::NOSYS;
 }
-orbis::SysResult orbis::sys_aio_multi_cancel(Thread *thread /* TODO */) {
-  return ErrorCode::NOSYS;
+orbis::SysResult orbis::sys_aio_multi_cancel(Thread *thread,
+                                             ptr<const AioSubmitId> ids,
+                                             sint count, ptr<sint> states) {
+  return aio_multi_cancel(thread, ids, count, states);
 }
 orbis::SysResult orbis::sys_get_bio_usage_all(Thread *thread /* TODO */) {
   return ErrorCode::NOSYS;
@@ -1791,11 +1806,18 @@ orbis::SysResult orbis::sys_get_bio_usage_all(Thread *thread /* TODO */) {
 orbis::SysResult orbis::sys_aio_create(Thread *thread /* TODO */) {
   return ErrorCode::NOSYS;
 }
-orbis::SysResult orbis::sys_aio_submit_cmd(Thread *thread /* TODO */) {
-  return ErrorCode::NOSYS;
+orbis::SysResult orbis::sys_aio_submit_cmd(Thread *thread, uint cmd,
+                                           ptr<const AioRWRequest> requests,
+                                           sint count, uint priority,
+                                           ptr<AioSubmitId> ids) {
+  return aio_submit_cmd(thread, cmd, requests, count, priority, ids);
 }
-orbis::SysResult orbis::sys_aio_init(Thread *thread /* TODO */) {
-  return ErrorCode::NOSYS;
+orbis::SysResult orbis::sys_aio_init(Thread *thread, ptr<void> param,
+                                     uint size) {
+  // scheduling parameters of libkernel are not used, engine is created on
+  // first submit
+  ORBIS_LOG_NOTICE(__FUNCTION__, param, size);
+  return {};
 }
 orbis::SysResult orbis::sys_get_page_table_stats(Thread *thread /* TODO */) {
   return ErrorCode::NOSYS;
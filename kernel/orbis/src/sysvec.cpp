@@ -1,3 +1,4 @@
+#include "rx/tsc.hpp"
 #include "sys/syscall.hpp"
 #include "sys/sysentry.hpp"
 #include "sys/sysproto.hpp"
@@ -65,9 +66,13 @@ void orbis::syscall_entry(Thread *thread) {
         thread->tproc->onSysEnter(thread, syscall_num, args, sysent.narg);
       }
 
+      auto start = rx::get_tsc();
       auto result = sysent.call(thread, args);
+      auto cycles = rx::get_tsc() - start;
 
       thread = orbis::g_currentThread;
+      thread->tproc->syscallStats.record(syscall_num, cycles,
+                                         result.isError());
 
       if (thread->tproc->onSysExit != nullptr) {
         thread->tproc->onSysExit(thread, syscall_num, args, sysent.narg,
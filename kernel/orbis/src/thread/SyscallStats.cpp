@@ -0,0 +1,108 @@
+#include "thread/SyscallStats.hpp"
+#include "rx/print.hpp"
+#include "sys/sysentry.hpp"
+#include "thread/sysent.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+orbis::SyscallStats::Stats orbis::SyscallStats::getStats() const {
+  Stats result;
+
+  for (std::size_t id = 0; id < kMaxSyscalls; ++id) {
+    auto &counters = mCounters[id];
+    result[id] = {
+        .calls = counters.calls.load(std::memory_order::relaxed),
+        .errors = counters.errors.load(std::memory_order::relaxed),
+        .cycles = counters.cycles.load(std::memory_order::relaxed),
+        .maxCycles = counters.maxCycles.load(std::memory_order::relaxed),
+    };
+  }
+
+  return result;
+}
+
+void orbis::SyscallStats::reset() {
+  for (auto &counters : mCounters) {
+    counters.calls.store(0, std::memory_order::relaxed);
+    counters.errors.store(0, std::memory_order::relaxed);
+    counters.cycles.store(0, std::memory_order::relaxed);
+    counters.maxCycles.store(0, std::memory_order::relaxed);
+  }
+}
+
+orbis::SyscallStats::Stats
+orbis::SyscallStats::delta(const Stats &current, const Stats &last) {
+  Stats result = current;
+
+  for (std::size_t id = 0; id < kMaxSyscalls; ++id) {
+    auto &prev = last[id];
+    auto &stats = result[id];
+
+    // counters may be reset between snapshots
+    if (stats.calls < prev.calls || stats.errors < prev.errors ||
+        stats.cycles < prev.cycles) {
+      continue;
+    }
+
+    stats.calls -= prev.calls;
+    stats.errors -= prev.errors;
+    stats.cycles -= prev.cycles;
+  }
+
+  return result;
+}
+
+void orbis::SyscallStats::print(const Stats &stats, const sysentvec *sysent,
+                                std::uint64_t tscFrequency) {
+  struct Row {
+    std::uint32_t id;
+    Entry stats;
+  };
+
+  std::vector<Row> rows;
+  std::uint64_t totalCycles = 0;
+
+  for (std::uint32_t id = 0; id < kMaxSyscalls; ++id) {
+    if (stats[id].calls == 0) {
+      continue;
+    }
+
+    rows.push_back({id, stats[id]});
+    totalCycles += stats[id].cycles;
+  }
+
+  if (rows.empty()) {
+    return;
+  }
+
+  std::ranges::sort(rows, std::greater{},
+                    [](const Row &row) { return row.stats.cycles; });
+
+  auto usPerCycle =
+      1e6 / static_cast<double>(std::max<std::uint64_t>(tscFrequency, 1));
+
+  rx::println(stderr, "syscall profile:");
+  rx::println(stderr, "  {:<40} {:>10} {:>8} {:>12} {:>10} {:>12} {:>6}",
+              "syscall", "calls", "errors", "total ms", "avg us", "max us",
+              "%");
+
+  for (auto &row : rows) {
+    const char *name = nullptr;
+    if (sysent != nullptr && row.id < static_cast<unsigned>(sysent->size)) {
+      name = getSysentName(sysent->table[row.id].call);
+    }
+
+    auto percent =
+        row.stats.cycles * 100.0 / std::max<std::uint64_t>(totalCycles, 1);
+
+    rx::println(stderr,
+                "  {:<40} {:>10} {:>8} {:>12.3f} {:>10.3f} {:>12.3f} {:>6.2f}",
+                name != nullptr ? std::string(name)
+                                : "sys_" + std::to_string(row.id),
+                row.stats.calls, row.stats.errors,
+                row.stats.cycles * usPerCycle / 1000,
+                row.stats.cycles * usPerCycle / row.stats.calls,
+                row.stats.maxCycles * usPerCycle, percent);
+  }
+}
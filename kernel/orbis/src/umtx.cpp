@@ -16,22 +16,45 @@ struct UmtxKey {
   auto operator<=>(const UmtxKey &) const = default;
 };
 
+struct UmtxQueue;
+
 struct UmtxCond {
-  Thread *thr;
+  Thread *thr = nullptr;
   rx::shared_cv cv;
 
-  UmtxCond(Thread *thr) : thr(thr) {}
+  // waiter accepts mutex ownership passed by unlock
+  bool handoff = false;
+
+  UmtxQueue *queue = nullptr;
+  UmtxCond *next = nullptr;
+  UmtxCond *prev = nullptr;
+};
+
+// FIFO of waiters of single address
+struct UmtxQueue {
+  UmtxKey key;
+  std::size_t count = 0;
+  UmtxCond *head = nullptr;
+  UmtxCond *tail = nullptr;
+  UmtxQueue *next = nullptr;
+  UmtxQueue *prev = nullptr;
 };
 
 struct UmtxChain {
   rx::shared_mutex mtx;
-  using queue_type = kmultimap<UmtxKey, UmtxCond>;
-  queue_type sleep_queue;
-  queue_type spare_queue;
 
-  std::pair<const UmtxKey, UmtxCond> *enqueue(UmtxKey &key, Thread *thr);
-  void erase(std::pair<const UmtxKey, UmtxCond> *obj);
-  queue_type::iterator erase(queue_type::iterator it);
+  // active queues of the chain, usually one or two addresses
+  UmtxQueue *queues = nullptr;
+
+  // nodes are reused, woken thread may still read its node
+  UmtxQueue *spare_queues = nullptr;
+  UmtxCond *spare_nodes = nullptr;
+
+  UmtxQueue *find(const UmtxKey &key);
+  UmtxCond *enqueue(const UmtxKey &key, Thread *thr, bool handoff = false);
+  void erase(UmtxCond *obj);
+  std::size_t count(const UmtxKey &key);
+  UmtxCond *front(const UmtxKey &key);
   uint notify_one(const UmtxKey &key);
   uint notify_all(const UmtxKey &key);
   uint notify_n(const UmtxKey &key, sint count);
@@ -80,49 +103,125 @@ struct UmtxStorage {
 
 static auto umtxStorage = createGlobalObject<UmtxStorage>();
 
-std::pair<const UmtxKey, UmtxCond> *UmtxChain::enqueue(UmtxKey &key,
-                                                       Thread *thr) {
-  if (!spare_queue.empty()) {
-    auto node = spare_queue.extract(spare_queue.begin());
-    node.key() = key;
-    node.mapped().thr = thr;
-    return &*sleep_queue.insert(std::move(node));
+UmtxQueue *UmtxChain::find(const UmtxKey &key) {
+  for (auto queue = queues; queue != nullptr; queue = queue->next) {
+    if (queue->key == key) {
+      return queue;
+    }
   }
-  return &*sleep_queue.emplace(key, thr);
+
+  return nullptr;
 }
 
-void UmtxChain::erase(std::pair<const UmtxKey, UmtxCond> *obj) {
-  for (auto [it, e] = sleep_queue.equal_range(obj->first); it != e; it++) {
-    if (&*it == obj) {
-      erase(it);
-      return;
+UmtxCond *UmtxChain::enqueue(const UmtxKey &key, Thread *thr, bool handoff) {
+  auto queue = find(key);
+
+  if (queue == nullptr) {
+    if (spare_queues != nullptr) {
+      queue = std::exchange(spare_queues, spare_queues->next);
+    } else {
+      queue = knew<UmtxQueue>();
+    }
+
+    queue->key = key;
+    queue->prev = nullptr;
+    queue->next = queues;
+    if (queues != nullptr) {
+      queues->prev = queue;
     }
+    queues = queue;
+  }
+
+  UmtxCond *node;
+  if (spare_nodes != nullptr) {
+    node = std::exchange(spare_nodes, spare_nodes->next);
+  } else {
+    node = knew<UmtxCond>();
   }
+
+  node->thr = thr;
+  node->handoff = handoff;
+  node->queue = queue;
+  node->next = nullptr;
+  node->prev = queue->tail;
+
+  if (queue->tail != nullptr) {
+    queue->tail->next = node;
+  } else {
+    queue->head = node;
+  }
+
+  queue->tail = node;
+  queue->count++;
+  return node;
 }
 
-UmtxChain::queue_type::iterator UmtxChain::erase(queue_type::iterator it) {
-  auto next = std::next(it);
-  auto node = sleep_queue.extract(it);
-  node.key() = {};
-  spare_queue.insert(spare_queue.begin(), std::move(node));
-  return next;
+void UmtxChain::erase(UmtxCond *obj) {
+  auto queue = obj->queue;
+
+  if (obj->prev != nullptr) {
+    obj->prev->next = obj->next;
+  } else {
+    queue->head = obj->next;
+  }
+
+  if (obj->next != nullptr) {
+    obj->next->prev = obj->prev;
+  } else {
+    queue->tail = obj->prev;
+  }
+
+  obj->queue = nullptr;
+  obj->prev = nullptr;
+  obj->next = std::exchange(spare_nodes, obj);
+
+  if (--queue->count != 0) {
+    return;
+  }
+
+  if (queue->prev != nullptr) {
+    queue->prev->next = queue->next;
+  } else {
+    queues = queue->next;
+  }
+
+  if (queue->next != nullptr) {
+    queue->next->prev = queue->prev;
+  }
+
+  queue->key = {};
+  queue->prev = nullptr;
+  queue->next = std::exchange(spare_queues, queue);
+}
+
+std::size_t UmtxChain::count(const UmtxKey &key) {
+  auto queue = find(key);
+  return queue != nullptr ? queue->count : 0;
+}
+
+UmtxCond *UmtxChain::front(const UmtxKey &key) {
+  auto queue = find(key);
+  return queue != nullptr ? queue->head : nullptr;
 }
 
 uint UmtxChain::notify_n(const UmtxKey &key, sint count) {
-  auto it = sleep_queue.find(key);
-  if (it == sleep_queue.end())
+  auto queue = find(key);
+  if (queue == nullptr)
     return 0;
 
   uint n = 0;
   while (count > 0) {
-    it->second.thr = nullptr;
-    it->second.cv.notify_all(mtx);
-    it = erase(it);
+    // erase releases empty queue, check before it
+    bool last = queue->count == 1;
+    auto node = queue->head;
+    node->thr = nullptr;
+    node->cv.notify_all(mtx);
+    erase(node);
 
     n++;
     count--;
 
-    if (it == sleep_queue.end() || it->first != key) {
+    if (last) {
       break;
     }
   }
@@ -166,8 +265,8 @@ orbis::ErrorCode orbis::umtx_wait(Thread *thread, ptr<void> addr, ulong id,
     if (ut + 1 == 0) {
       while (true) {
         orbis::scoped_unblock unblock;
-        result = orbis::toErrorCode(node->second.cv.wait(chain.mtx));
-        if ((result != ErrorCode{}) || node->second.thr != thread)
+        result = orbis::toErrorCode(node->cv.wait(chain.mtx));
+        if ((result != ErrorCode{}) || node->thr != thread)
           break;
       }
     } else {
@@ -176,8 +275,8 @@ orbis::ErrorCode orbis::umtx_wait(Thread *thread, ptr<void> addr, ulong id,
       while (true) {
         orbis::scoped_unblock unblock;
         result =
-            orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut - udiff));
-        if (node->second.thr != thread)
+            orbis::toErrorCode(node->cv.wait(chain.mtx, ut - udiff));
+        if (node->thr != thread)
           break;
         udiff = std::chrono::duration_cast<std::chrono::microseconds>(
                     std::chrono::steady_clock::now() - start)
@@ -194,7 +293,7 @@ orbis::ErrorCode orbis::umtx_wait(Thread *thread, ptr<void> addr, ulong id,
   }
 
   ORBIS_LOG_NOTICE(__FUNCTION__, "wakeup", thread->tid, addr);
-  if (node->second.thr == thread)
+  if (node->thr == thread)
     chain.erase(node);
   return result;
 }
@@ -265,19 +364,25 @@ static ErrorCode do_lock_normal(Thread *thread, ptr<umutex> m, uint flags,
     if (error != ErrorCode{})
       return error;
 
-    auto node = chain.enqueue(key, thread);
+    auto node = chain.enqueue(key, thread, mode == umutex_lock_mode::lock);
     if (m->owner.compare_exchange_strong(owner, owner | kUmutexContested)) {
       {
         orbis::scoped_unblock unblock;
-        error = orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut));
+        error = orbis::toErrorCode(node->cv.wait(chain.mtx, ut));
       }
-      if (error == ErrorCode{} && node->second.thr == thread &&
+      if (error == ErrorCode{} && node->thr == thread &&
           m->owner.load() != 0) {
         error = ErrorCode::TIMEDOUT;
       }
     }
-    if (node->second.thr == thread)
+    if (node->thr == thread) {
       chain.erase(node);
+    } else if (mode == umutex_lock_mode::lock &&
+               (m->owner.load(std::memory_order::acquire) &
+                ~kUmutexContested) == thread->tid) {
+      // ownership was passed by unlock
+      return {};
+    }
   }
 }
 static ErrorCode do_lock_pi(Thread *thread, ptr<umutex> m, uint flags,
@@ -304,7 +409,7 @@ static ErrorCode do_unlock_normal(Thread *thread, ptr<umutex> m, uint flags) {
       return {};
   }
 
-  std::size_t count = chain.sleep_queue.count(key);
+  std::size_t count = chain.count(key);
   bool ok;
   if (key.pid == 0) {
     ok = m->owner.compare_exchange_strong(owner, kUmutexUnowned);
@@ -315,8 +420,15 @@ static ErrorCode do_unlock_normal(Thread *thread, ptr<umutex> m, uint flags) {
     return {};
   }
 
-  ok = m->owner.compare_exchange_strong(owner, count <= 1 ? kUmutexUnowned
-                                                          : kUmutexContested);
+  if (auto waiter = chain.front(key); waiter != nullptr && waiter->handoff) {
+    // pass ownership to first waiter directly, woken thread does not have to
+    // race with threads that did not sleep
+    ok = m->owner.compare_exchange_strong(
+        owner, waiter->thr->tid | (count > 1 ? kUmutexContested : 0));
+  } else {
+    ok = m->owner.compare_exchange_strong(
+        owner, count <= 1 ? kUmutexUnowned : kUmutexContested);
+  }
   chain.notify_one(key);
 
   if (!ok)
@@ -430,9 +542,9 @@ orbis::ErrorCode orbis::umtx_cv_wait(Thread *thread, ptr<ucond> cv,
     orbis::scoped_unblock unblock;
     if (ut + 1 == 0) {
       while (true) {
-        result = orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut));
+        result = orbis::toErrorCode(node->cv.wait(chain.mtx, ut));
 
-        if (result != ErrorCode{} || node->second.thr != thread) {
+        if (result != ErrorCode{} || node->thr != thread) {
           break;
         }
       }
@@ -441,8 +553,8 @@ orbis::ErrorCode orbis::umtx_cv_wait(Thread *thread, ptr<ucond> cv,
       std::uint64_t udiff = 0;
       while (true) {
         result =
-            orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut - udiff));
-        if (node->second.thr != thread) {
+            orbis::toErrorCode(node->cv.wait(chain.mtx, ut - udiff));
+        if (node->thr != thread) {
           break;
         }
         udiff = std::chrono::duration_cast<std::chrono::microseconds>(
@@ -460,11 +572,11 @@ orbis::ErrorCode orbis::umtx_cv_wait(Thread *thread, ptr<ucond> cv,
     }
   }
 
-  if (node->second.thr != thread) {
+  if (node->thr != thread) {
     result = {};
   } else {
     chain.erase(node);
-    if (chain.sleep_queue.count(key) == 0)
+    if (chain.count(key) == 0)
       cv->has_waiters.store(0, std::memory_order::relaxed);
   }
   return result;
@@ -479,7 +591,7 @@ orbis::ErrorCode orbis::umtx_cv_signal(Thread *thread, ptr<ucond> cv) {
     cv->has_waiters = 0;
     return {};
   }
-  std::size_t count = chain.sleep_queue.count(key);
+  std::size_t count = chain.count(key);
   if (chain.notify_one(key) >= count)
     cv->has_waiters.store(0, std::memory_order::relaxed);
   return {};
@@ -538,8 +650,8 @@ orbis::ErrorCode orbis::umtx_rw_rdlock(Thread *thread, ptr<urwlock> rwlock,
       if (ut + 1 == 0) {
         while (true) {
           orbis::scoped_unblock unblock;
-          result = orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut));
-          if (result != ErrorCode{} || node->second.thr != thread) {
+          result = orbis::toErrorCode(node->cv.wait(chain.mtx, ut));
+          if (result != ErrorCode{} || node->thr != thread) {
             break;
           }
         }
@@ -549,8 +661,8 @@ orbis::ErrorCode orbis::umtx_rw_rdlock(Thread *thread, ptr<urwlock> rwlock,
         while (true) {
           orbis::scoped_unblock unblock;
           result =
-              orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut - udiff));
-          if (node->second.thr != thread)
+              orbis::toErrorCode(node->cv.wait(chain.mtx, ut - udiff));
+          if (node->thr != thread)
             break;
           udiff = std::chrono::duration_cast<std::chrono::microseconds>(
                       std::chrono::steady_clock::now() - start)
@@ -566,7 +678,7 @@ orbis::ErrorCode orbis::umtx_rw_rdlock(Thread *thread, ptr<urwlock> rwlock,
         }
       }
 
-      if (node->second.thr != thread) {
+      if (node->thr != thread) {
         result = {};
       } else {
         chain.erase(node);
@@ -642,8 +754,8 @@ orbis::ErrorCode orbis::umtx_rw_wrlock(Thread *thread, ptr<urwlock> rwlock,
       if (ut + 1 == 0) {
         while (true) {
           orbis::scoped_unblock unblock;
-          error = orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut));
-          if ((error != ErrorCode{}) || node->second.thr != thread) {
+          error = orbis::toErrorCode(node->cv.wait(chain.mtx, ut));
+          if ((error != ErrorCode{}) || node->thr != thread) {
             break;
           }
         }
@@ -653,8 +765,8 @@ orbis::ErrorCode orbis::umtx_rw_wrlock(Thread *thread, ptr<urwlock> rwlock,
         while (true) {
           orbis::scoped_unblock unblock;
           error =
-              orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut - udiff));
-          if (node->second.thr != thread)
+              orbis::toErrorCode(node->cv.wait(chain.mtx, ut - udiff));
+          if (node->thr != thread)
             break;
           udiff = std::chrono::duration_cast<std::chrono::microseconds>(
                       std::chrono::steady_clock::now() - start)
@@ -669,7 +781,7 @@ orbis::ErrorCode orbis::umtx_rw_wrlock(Thread *thread, ptr<urwlock> rwlock,
         }
       }
 
-      if (node->second.thr != thread) {
+      if (node->thr != thread) {
         error = {};
       } else {
         chain.erase(node);
@@ -794,7 +906,7 @@ orbis::ErrorCode orbis::umtx_wake_umutex(Thread *thread, ptr<umutex> m,
   if ((owner & ~kUmutexContested) != 0)
     return {};
 
-  std::size_t count = chain.sleep_queue.count(key);
+  std::size_t count = chain.count(key);
   if (count <= 1) {
     owner = kUmutexContested;
     m->owner.compare_exchange_strong(owner, kUmutexUnowned);
@@ -825,8 +937,8 @@ orbis::ErrorCode orbis::umtx_sem_wait(Thread *thread, ptr<usem> sem,
     if (ut + 1 == 0) {
       while (true) {
         orbis::scoped_unblock unblock;
-        result = orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut));
-        if ((result != ErrorCode{}) || node->second.thr != thread)
+        result = orbis::toErrorCode(node->cv.wait(chain.mtx, ut));
+        if ((result != ErrorCode{}) || node->thr != thread)
           break;
       }
     } else {
@@ -835,8 +947,8 @@ orbis::ErrorCode orbis::umtx_sem_wait(Thread *thread, ptr<usem> sem,
       while (true) {
         orbis::scoped_unblock unblock;
         result =
-            orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut - udiff));
-        if (node->second.thr != thread)
+            orbis::toErrorCode(node->cv.wait(chain.mtx, ut - udiff));
+        if (node->thr != thread)
           break;
         udiff = std::chrono::duration_cast<std::chrono::microseconds>(
                     std::chrono::steady_clock::now() - start)
@@ -852,7 +964,7 @@ orbis::ErrorCode orbis::umtx_sem_wait(Thread *thread, ptr<usem> sem,
     }
   }
 
-  if (node->second.thr != thread) {
+  if (node->thr != thread) {
     result = {};
   } else {
     chain.erase(node);
@@ -869,7 +981,7 @@ orbis::ErrorCode orbis::umtx_sem_wake(Thread *thread, ptr<usem> sem) {
     sem->has_waiters = 0;
     return {};
   }
-  std::size_t count = chain.sleep_queue.count(key);
+  std::size_t count = chain.count(key);
   if (chain.notify_one(key) >= count)
     sem->has_waiters.store(0, std::memory_order::relaxed);
   return {};
@@ -901,7 +1013,7 @@ orbis::ErrorCode orbis::umtx_wake2_umutex(Thread *thread, ptr<umutex> m,
 
   int owner = 0;
 
-  std::size_t count = chain.sleep_queue.count(key);
+  std::size_t count = chain.count(key);
 
   if (count > 1) {
     owner = m->owner.load(std::memory_order::acquire);
@@ -942,7 +1054,7 @@ orbis::ErrorCode orbis::umtx_wake3_umutex(Thread *thread, ptr<umutex> m,
       umtxStorage->getUmtxChain1(thread, wakeFlags & 1, m);
 
   int owner = 0;
-  std::size_t count = chain.sleep_queue.count(key);
+  std::size_t count = chain.count(key);
 
   if (count > 1) {
     owner = m->owner.load(std::memory_order::acquire);
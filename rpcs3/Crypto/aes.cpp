@@ -773,6 +773,14 @@ int aes_crypt_cbc(aes_context* ctx,
 
 	if (mode == AES_DECRYPT)
 	{
+#if defined(__SSE2__) || defined(_M_X64)
+		if (aesni_supports(POLARSSL_AESNI_AES))
+		{
+			aesni_crypt_cbc_dec(ctx, length / 16, iv, input, output);
+			return (0);
+		}
+#endif
+
 		while (length > 0)
 		{
 			memcpy(temp, input, 16);
@@ -867,6 +875,24 @@ int aes_crypt_ctr(aes_context* ctx,
 	int c, i;
 	size_t n = *nc_off;
 
+	while (n != 0 && length > 0)
+	{
+		c = *input++;
+		*output++ = static_cast<unsigned char>(c ^ stream_block[n]);
+
+		n = (n + 1) & 0x0F;
+		length--;
+	}
+
+	if (length >= 16)
+	{
+		aes_crypt_ctr_blocks(ctx, length / 16, nonce_counter, input, output);
+
+		input += length & ~size_t{0x0F};
+		output += length & ~size_t{0x0F};
+		length &= 0x0F;
+	}
+
 	while (length--)
 	{
 		if (n == 0)
@@ -888,6 +914,44 @@ int aes_crypt_ctr(aes_context* ctx,
 	return (0);
 }
 
+/*
+ * AES-CTR encryption/decryption of whole blocks
+ */
+int aes_crypt_ctr_blocks(aes_context* ctx,
+	size_t blocks,
+	unsigned char nonce_counter[16],
+	const unsigned char* input,
+	unsigned char* output)
+{
+	int i;
+	unsigned char stream_block[16];
+
+#if defined(__SSE2__) || defined(_M_X64)
+	if (aesni_supports(POLARSSL_AESNI_AES))
+	{
+		aesni_crypt_ctr_blocks(ctx, blocks, nonce_counter, input, output);
+		return (0);
+	}
+#endif
+
+	while (blocks--)
+	{
+		aes_crypt_ecb(ctx, AES_ENCRYPT, nonce_counter, stream_block);
+
+		for (i = 16; i > 0; i--)
+			if (++nonce_counter[i - 1] != 0)
+				break;
+
+		for (i = 0; i < 16; i++)
+			output[i] = static_cast<unsigned char>(input[i] ^ stream_block[i]);
+
+		input += 16;
+		output += 16;
+	}
+
+	return (0);
+}
+
 /* AES-CMAC */
 
 unsigned char const_Rb[16] = {
@@ -172,6 +172,25 @@ extern "C"
 		const unsigned char* input,
 		unsigned char* output);
 
+	/**
+	 * \brief               AES-CTR encryption/decryption of whole blocks
+	 *
+	 * Same as aes_crypt_ctr() starting at block boundary, without saved
+	 * stream block. Uses wide AES-NI/VAES pipeline when available.
+	 *
+	 * \param blocks        The number of 16-byte blocks
+	 * \param nonce_counter The 128-bit nonce and counter.
+	 * \param input         The input data stream
+	 * \param output        The output data stream
+	 *
+	 * \return         0 if successful
+	 */
+	int aes_crypt_ctr_blocks(aes_context* ctx,
+		size_t blocks,
+		unsigned char nonce_counter[16],
+		const unsigned char* input,
+		unsigned char* output);
+
 	void aes_cmac(aes_context* ctx, size_t length, unsigned char* input, unsigned char* output);
 
 #ifdef __cplusplus
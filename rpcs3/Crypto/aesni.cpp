@@ -31,12 +31,38 @@
  */
 
 #include "aesni.h"
+#include "util/sysinfo.hpp"
 
 #if defined(_MSC_VER) && defined(_M_X64)
 #define POLARSSL_HAVE_MSVC_X64_INTRINSICS
 #include <intrin.h>
 #endif
 
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#define SSE4_1_FUNC
+#define AES_FUNC
+#define VAES_FUNC
+#else
+#define SSE4_1_FUNC __attribute__((__target__("sse4.1")))
+#define AES_FUNC __attribute__((__target__("aes,sse4.1")))
+#define VAES_FUNC __attribute__((__target__("aes,vaes,avx2")))
+#endif
+
+/*
+ * Blocks kept in flight by the wide CTR/CBC routines. aesenc has latency of
+ * 3-4 cycles and throughput of one or two per cycle, so eight independent
+ * blocks hide the latency completely.
+ */
+#define AESNI_PIPELINE 8
+
+#if defined(_MSC_VER)
+#define AESNI_UNROLL
+#else
+#define AESNI_UNROLL _Pragma("GCC unroll 8")
+#endif
+
 /*
  * AES-NI support detection routine
  */
@@ -683,4 +709,238 @@ int aesni_setkey_enc(unsigned char* rk,
 	return (0);
 }
 
+/*
+ * Converts counter block to little-endian 128-bit integer and back
+ */
+SSE4_1_FUNC
+static inline __m128i ctr_bswap(__m128i v)
+{
+	return _mm_shuffle_epi8(v, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+/*
+ * 128-bit increment of little-endian counter by `n`
+ */
+SSE4_1_FUNC
+static inline __m128i ctr_add(__m128i ctr, unsigned long long n)
+{
+	const unsigned long long lo = _mm_extract_epi64(ctr, 0);
+	const unsigned long long hi = _mm_extract_epi64(ctr, 1);
+	return _mm_set_epi64x(hi + (lo + n < lo), lo + n);
+}
+
+AES_FUNC
+static void aesni_crypt_ctr_128(const __m128i* rk, int nr, size_t blocks, __m128i* ctr, const unsigned char* input, unsigned char* output)
+{
+	__m128i b[AESNI_PIPELINE];
+
+	while (blocks >= AESNI_PIPELINE)
+	{
+		/* carry into high half is rare, only then increments go through ctr_add */
+		if (static_cast<unsigned long long>(_mm_extract_epi64(*ctr, 0)) <= ~0ull - AESNI_PIPELINE)
+		{
+			AESNI_UNROLL
+			for (int j = 0; j < AESNI_PIPELINE; j++)
+				b[j] = _mm_add_epi64(*ctr, _mm_set_epi64x(0, j));
+
+			*ctr = _mm_add_epi64(*ctr, _mm_set_epi64x(0, AESNI_PIPELINE));
+		}
+		else
+		{
+			AESNI_UNROLL
+			for (int j = 0; j < AESNI_PIPELINE; j++)
+				b[j] = ctr_add(*ctr, j);
+
+			*ctr = ctr_add(*ctr, AESNI_PIPELINE);
+		}
+
+		const __m128i k0 = _mm_loadu_si128(rk);
+
+		AESNI_UNROLL
+		for (int j = 0; j < AESNI_PIPELINE; j++)
+			b[j] = _mm_xor_si128(ctr_bswap(b[j]), k0);
+
+		for (int r = 1; r < nr; r++)
+		{
+			const __m128i k = _mm_loadu_si128(rk + r);
+
+			AESNI_UNROLL
+			for (int j = 0; j < AESNI_PIPELINE; j++)
+				b[j] = _mm_aesenc_si128(b[j], k);
+		}
+
+		const __m128i kl = _mm_loadu_si128(rk + nr);
+
+		AESNI_UNROLL
+		for (int j = 0; j < AESNI_PIPELINE; j++)
+		{
+			const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input) + j);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(output) + j, _mm_xor_si128(in, _mm_aesenclast_si128(b[j], kl)));
+		}
+
+		input += AESNI_PIPELINE * 16;
+		output += AESNI_PIPELINE * 16;
+		blocks -= AESNI_PIPELINE;
+	}
+
+	for (; blocks; blocks--)
+	{
+		__m128i a = _mm_xor_si128(ctr_bswap(*ctr), _mm_loadu_si128(rk));
+		*ctr = ctr_add(*ctr, 1);
+
+		for (int r = 1; r < nr; r++)
+			a = _mm_aesenc_si128(a, _mm_loadu_si128(rk + r));
+
+		a = _mm_aesenclast_si128(a, _mm_loadu_si128(rk + nr));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(output), _mm_xor_si128(a, _mm_loadu_si128(reinterpret_cast<const __m128i*>(input))));
+
+		input += 16;
+		output += 16;
+	}
+}
+
+/*
+ * Same as aesni_crypt_ctr_128 with two blocks per ymm register
+ */
+VAES_FUNC
+static void aesni_crypt_ctr_256(const __m128i* rk, int nr, size_t blocks, __m128i* ctr, const unsigned char* input, unsigned char* output)
+{
+	constexpr int pairs = AESNI_PIPELINE;
+	const __m256i bswap = _mm256_broadcastsi128_si256(_mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+	__m256i b[pairs];
+
+	while (blocks >= pairs * 2 && static_cast<unsigned long long>(_mm_extract_epi64(*ctr, 0)) <= ~0ull - pairs * 2)
+	{
+		const __m256i base = _mm256_broadcastsi128_si256(*ctr);
+
+		AESNI_UNROLL
+		for (int j = 0; j < pairs; j++)
+			b[j] = _mm256_add_epi64(base, _mm256_set_epi64x(0, j * 2 + 1, 0, j * 2));
+
+		*ctr = _mm_add_epi64(*ctr, _mm_set_epi64x(0, pairs * 2));
+
+		const __m256i k0 = _mm256_broadcastsi128_si256(_mm_loadu_si128(rk));
+
+		AESNI_UNROLL
+		for (int j = 0; j < pairs; j++)
+			b[j] = _mm256_xor_si256(_mm256_shuffle_epi8(b[j], bswap), k0);
+
+		for (int r = 1; r < nr; r++)
+		{
+			const __m256i k = _mm256_broadcastsi128_si256(_mm_loadu_si128(rk + r));
+
+			AESNI_UNROLL
+			for (int j = 0; j < pairs; j++)
+				b[j] = _mm256_aesenc_epi128(b[j], k);
+		}
+
+		const __m256i kl = _mm256_broadcastsi128_si256(_mm_loadu_si128(rk + nr));
+
+		AESNI_UNROLL
+		for (int j = 0; j < pairs; j++)
+		{
+			const __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input) + j);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(output) + j, _mm256_xor_si256(in, _mm256_aesenclast_epi128(b[j], kl)));
+		}
+
+		input += pairs * 32;
+		output += pairs * 32;
+		blocks -= pairs * 2;
+	}
+
+	aesni_crypt_ctr_128(rk, nr, blocks, ctr, input, output);
+}
+
+/*
+ * AES-NI AES-CTR keystream xor of whole blocks
+ */
+SSE4_1_FUNC
+void aesni_crypt_ctr_blocks(aes_context* ctx,
+	size_t blocks,
+	unsigned char nonce_counter[16],
+	const unsigned char* input,
+	unsigned char* output)
+{
+	const auto rk = reinterpret_cast<const __m128i*>(ctx->rk);
+	__m128i ctr = ctr_bswap(_mm_loadu_si128(reinterpret_cast<const __m128i*>(nonce_counter)));
+
+	if (utils::has_vaes())
+		aesni_crypt_ctr_256(rk, ctx->nr, blocks, &ctr, input, output);
+	else
+		aesni_crypt_ctr_128(rk, ctx->nr, blocks, &ctr, input, output);
+
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(nonce_counter), ctr_bswap(ctr));
+}
+
+/*
+ * AES-NI AES-CBC decryption of whole blocks
+ *
+ * Every block of a batch is loaded before any output is stored, in-place
+ * decryption is allowed.
+ */
+AES_FUNC
+void aesni_crypt_cbc_dec(aes_context* ctx,
+	size_t blocks,
+	unsigned char iv[16],
+	const unsigned char* input,
+	unsigned char* output)
+{
+	const auto rk = reinterpret_cast<const __m128i*>(ctx->rk);
+	const int nr = ctx->nr;
+	__m128i prev = _mm_loadu_si128(reinterpret_cast<const __m128i*>(iv));
+	__m128i c[AESNI_PIPELINE];
+	__m128i b[AESNI_PIPELINE];
+
+	for (; blocks >= AESNI_PIPELINE; blocks -= AESNI_PIPELINE)
+	{
+		const __m128i k0 = _mm_loadu_si128(rk);
+
+		AESNI_UNROLL
+		for (int j = 0; j < AESNI_PIPELINE; j++)
+		{
+			c[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input) + j);
+			b[j] = _mm_xor_si128(c[j], k0);
+		}
+
+		for (int r = 1; r < nr; r++)
+		{
+			const __m128i k = _mm_loadu_si128(rk + r);
+
+			AESNI_UNROLL
+			for (int j = 0; j < AESNI_PIPELINE; j++)
+				b[j] = _mm_aesdec_si128(b[j], k);
+		}
+
+		const __m128i kl = _mm_loadu_si128(rk + nr);
+
+		AESNI_UNROLL
+		for (int j = 0; j < AESNI_PIPELINE; j++)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(output) + j, _mm_xor_si128(_mm_aesdeclast_si128(b[j], kl), prev));
+			prev = c[j];
+		}
+
+		input += AESNI_PIPELINE * 16;
+		output += AESNI_PIPELINE * 16;
+	}
+
+	for (; blocks; blocks--)
+	{
+		const __m128i cipher = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input));
+		__m128i a = _mm_xor_si128(cipher, _mm_loadu_si128(rk));
+
+		for (int r = 1; r < nr; r++)
+			a = _mm_aesdec_si128(a, _mm_loadu_si128(rk + r));
+
+		a = _mm_aesdeclast_si128(a, _mm_loadu_si128(rk + nr));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(output), _mm_xor_si128(a, prev));
+		prev = cipher;
+
+		input += 16;
+		output += 16;
+	}
+
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(iv), prev);
+}
+
 #endif
@@ -99,6 +99,40 @@ extern "C"
 		const unsigned char* key,
 		size_t bits);
 
+	/**
+	 * \brief          AES-NI AES-CTR encryption/decryption of whole blocks
+	 *
+	 * Keeps eight blocks in flight, sixteen when VAES is available.
+	 *
+	 * \param ctx      AES context initialized with aes_setkey_enc()
+	 * \param blocks   number of 16-byte blocks
+	 * \param nonce_counter  128-bit big-endian counter (updated after use)
+	 * \param input    buffer holding the input data
+	 * \param output   buffer holding the output data
+	 */
+	void aesni_crypt_ctr_blocks(aes_context* ctx,
+		size_t blocks,
+		unsigned char nonce_counter[16],
+		const unsigned char* input,
+		unsigned char* output);
+
+	/**
+	 * \brief          AES-NI AES-CBC decryption of whole blocks
+	 *
+	 * Keeps eight blocks in flight, input and output may be the same buffer.
+	 *
+	 * \param ctx      AES context initialized with aes_setkey_dec()
+	 * \param blocks   number of 16-byte blocks
+	 * \param iv       initialization vector (updated after use)
+	 * \param input    buffer holding the input data
+	 * \param output   buffer holding the output data
+	 */
+	void aesni_crypt_cbc_dec(aes_context* ctx,
+		size_t blocks,
+		unsigned char iv[16],
+		const unsigned char* input,
+		unsigned char* output);
+
 #ifdef __cplusplus
 }
 #endif
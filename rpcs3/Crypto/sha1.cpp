@@ -30,6 +30,7 @@
 
 #include "sha1.h"
 #include "utils.h"
+#include "util/sysinfo.hpp"
 
 /*
  * 32-bit integer manipulation macros (big endian)
@@ -312,6 +313,162 @@ void sha1(const unsigned char* input, size_t ilen, unsigned char output[20])
 	mbedtls_zeroize(&ctx, sizeof(sha1_context));
 }
 
+#if defined(__GNUC__)
+#if defined(_MSC_VER) || !defined(__SSE2__)
+#define AVX2_FUNC
+#else
+#define AVX2_FUNC __attribute__((__target__("avx2")))
+#endif
+
+/*
+ * Multi-buffer SHA-1: lane j of every vector belongs to message j, all
+ * messages go through the rounds together
+ */
+#define SHA1_MULTI_ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+template <typename V>
+[[gnu::always_inline]] static inline const V& sha1_multi_schedule(V w[16], int t)
+{
+	if (t >= 16)
+		w[t & 15] = SHA1_MULTI_ROTL(w[(t - 3) & 15] ^ w[(t - 8) & 15] ^ w[(t - 14) & 15] ^ w[t & 15], 1);
+
+	return w[t & 15];
+}
+
+template <typename V>
+[[gnu::always_inline]] static inline void sha1_multi_round(V& a, V& b, V& c, V& d, V& e, const V& f, uint32_t k, const V& wt)
+{
+	const V temp = SHA1_MULTI_ROTL(a, 5) + f + e + k + wt;
+	e = d;
+	d = c;
+	c = SHA1_MULTI_ROTL(b, 30);
+	b = a;
+	a = temp;
+}
+
+template <typename V>
+[[gnu::always_inline]] static inline void sha1_multi_process(V h[5], V w[16])
+{
+	V a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+#pragma GCC unroll 20
+	for (int t = 0; t < 20; t++)
+		sha1_multi_round(a, b, c, d, e, d ^ (b & (c ^ d)), 0x5A827999, sha1_multi_schedule(w, t));
+
+#pragma GCC unroll 20
+	for (int t = 20; t < 40; t++)
+		sha1_multi_round(a, b, c, d, e, b ^ c ^ d, 0x6ED9EBA1, sha1_multi_schedule(w, t));
+
+#pragma GCC unroll 20
+	for (int t = 40; t < 60; t++)
+		sha1_multi_round(a, b, c, d, e, (b & c) | (d & (b | c)), 0x8F1BBCDC, sha1_multi_schedule(w, t));
+
+#pragma GCC unroll 20
+	for (int t = 60; t < 80; t++)
+		sha1_multi_round(a, b, c, d, e, b ^ c ^ d, 0xCA62C1D6, sha1_multi_schedule(w, t));
+
+	h[0] += a;
+	h[1] += b;
+	h[2] += c;
+	h[3] += d;
+	h[4] += e;
+}
+
+/*
+ * SHA-1 of sizeof(V) / 4 messages of 64 bytes each
+ */
+template <typename V>
+[[gnu::always_inline]] static inline void sha1_multi_64_lanes(const unsigned char* input, unsigned char* output)
+{
+	constexpr int lanes = sizeof(V) / sizeof(uint32_t);
+
+	V h[5] = {};
+	V w[16];
+
+	for (int j = 0; j < lanes; j++)
+	{
+		for (int t = 0; t < 16; t++)
+		{
+			uint32_t word;
+			GET_UINT32_BE(word, input, j * 64 + t * 4);
+			w[t][j] = word;
+		}
+	}
+
+	h[0] += 0x67452301;
+	h[1] += 0xEFCDAB89;
+	h[2] += 0x98BADCFE;
+	h[3] += 0x10325476;
+	h[4] += 0xC3D2E1F0;
+
+	sha1_multi_process(h, w);
+
+	// Second block is padding of 64-byte message, same for every lane
+	w[0] = V{} + 0x80000000u;
+
+	for (int t = 1; t < 15; t++)
+		w[t] = V{};
+
+	w[15] = V{} + 512u;
+
+	sha1_multi_process(h, w);
+
+	for (int j = 0; j < lanes; j++)
+	{
+		for (int i = 0; i < 5; i++)
+			PUT_UINT32_BE(h[i][j], output, j * 20 + i * 4);
+	}
+}
+
+typedef uint32_t sha1_vec4 __attribute__((vector_size(16)));
+typedef uint32_t sha1_vec8 __attribute__((vector_size(32)));
+
+static void sha1_multi_64_x4(const unsigned char* input, unsigned char* output)
+{
+	sha1_multi_64_lanes<sha1_vec4>(input, output);
+}
+
+AVX2_FUNC static void sha1_multi_64_x8(const unsigned char* input, unsigned char* output)
+{
+	sha1_multi_64_lanes<sha1_vec8>(input, output);
+}
+#endif
+
+/*
+ * output = SHA-1( input block ) for several 64-byte blocks
+ */
+void sha1_multi_64(size_t count, const unsigned char* input, unsigned char* output)
+{
+#if defined(__GNUC__)
+	if (utils::has_avx2())
+	{
+		for (; count >= 8; count -= 8)
+		{
+			sha1_multi_64_x8(input, output);
+
+			input += 8 * 64;
+			output += 8 * 20;
+		}
+	}
+
+	for (; count >= 4; count -= 4)
+	{
+		sha1_multi_64_x4(input, output);
+
+		input += 4 * 64;
+		output += 4 * 20;
+	}
+#endif
+
+	for (; count; count--)
+	{
+		sha1(input, 64, output);
+
+		input += 64;
+		output += 20;
+	}
+}
+
 /*
  * SHA-1 HMAC context setup
  */
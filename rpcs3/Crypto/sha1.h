@@ -103,6 +103,18 @@ extern "C"
 	 */
 	void sha1(const unsigned char* input, size_t ilen, unsigned char output[20]);
 
+	/**
+	 * \brief          Output = SHA-1( input block ) for several 64-byte blocks
+	 *
+	 * Independent messages are hashed in parallel SIMD lanes, eight at a time
+	 * with AVX2.
+	 *
+	 * \param count    number of 64-byte messages
+	 * \param input    messages stored one after another
+	 * \param output   SHA-1 checksums stored one after another
+	 */
+	void sha1_multi_64(size_t count, const unsigned char* input, unsigned char* output);
+
 	/**
 	 * \brief          Output = SHA-1( file contents )
 	 *
@@ -1420,20 +1420,30 @@ usz package_reader::decrypt(u64 offset, u64 size, const uchar* key, void* local_
 				m_header.qa_digest[1],
 			};
 
-		for (u64 i = 0; i < blocks; i++)
+		// Inputs of consecutive blocks differ only in position, they are hashed together
+		constexpr u64 batch_size = 16;
+
+		be_t<u64> inputs[batch_size][8];
+		u8 hashes[batch_size][20];
+
+		for (u64 i = 0; i < blocks; i += batch_size)
 		{
-			// Initialize stream cipher for current position
-			input[7] = offset / 16 + i;
+			const u64 count = std::min(batch_size, blocks - i);
 
-			struct sha1_hash
+			for (u64 j = 0; j < count; j++)
 			{
-				u8 data[20];
-			} hash{};
+				// Initialize stream cipher for current position
+				std::memcpy(inputs[j], input, sizeof(input));
+				inputs[j][7] = offset / 16 + i + j;
+			}
 
-			sha1(reinterpret_cast<const u8*>(input), sizeof(input), hash.data);
+			sha1_multi_64(count, reinterpret_cast<const u8*>(inputs), hashes[0]);
 
-			const u128 v = read_from_ptr<u128>(out_data, i * 16);
-			write_to_ptr<u128>(out_data, i * 16, v ^ read_from_ptr<u128>(hash.data));
+			for (u64 j = 0; j < count; j++)
+			{
+				const u128 v = read_from_ptr<u128>(out_data, (i + j) * 16);
+				write_to_ptr<u128>(out_data, (i + j) * 16, v ^ read_from_ptr<u128>(hashes[j]));
+			}
 		}
 	}
 	else if (m_header.pkg_type == PKG_RELEASE_TYPE_RELEASE)
@@ -1446,16 +1456,8 @@ usz package_reader::decrypt(u64 offset, u64 size, const uchar* key, void* local_
 		// Initialize stream cipher for start position
 		be_t<u128> input = m_header.klicensee.value() + offset / 16;
 
-		// Increment stream position for every block
-		for (u64 i = 0; i < blocks; i++, input++)
-		{
-			u128 key;
-
-			aes_crypt_ecb(&ctx, AES_ENCRYPT, reinterpret_cast<const u8*>(&input), reinterpret_cast<u8*>(&key));
-
-			const u128 v = read_from_ptr<u128>(out_data, i * 16);
-			write_to_ptr<u128>(out_data, i * 16, v ^ key);
-		}
+		// Counter is incremented for every block
+		aes_crypt_ctr_blocks(&ctx, blocks, reinterpret_cast<u8*>(&input), out_data, out_data);
 	}
 	else
 	{
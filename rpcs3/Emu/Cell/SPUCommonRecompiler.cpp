@@ -1332,6 +1332,12 @@ spu_runtime::spu_runtime()
 		fs::file(m_cache_path + "spu.log", fs::rewrite);
 		fs::file(m_cache_path + "spu-ir.log", fs::rewrite);
 	}
+
+	if (g_cfg.core.spu_cache && g_cfg.core.spu_object_cache && g_cfg.core.spu_decoder == spu_decoder_type::llvm)
+	{
+		// Native code of SPU LLVM programs
+		fs::create_path(m_cache_path + "spu-obj/");
+	}
 }
 
 spu_item* spu_runtime::add_empty(spu_program&& data)
@@ -1495,6 +1495,227 @@ public:
 		m_spu_frsqest_exponent_lut = new llvm::GlobalVariable(*m_module, llvm::ArrayType::get(GetType<u32>(), 256), true, llvm::GlobalValue::PrivateLinkage, llvm::ConstantDataArray::get(m_context, spu_frsqest_exponent_lut));
 	}
 
+	// Kinds of external symbols recorded in the link table of a cached object
+	enum class obj_link : u8
+	{
+		image,      // Function or variable of the executable, stored as offset from the anchor
+		runtime,    // SPU runtime entry point, resolved by name
+		patchpoint, // Branch patchpoint, allocated anew
+	};
+
+	// Fixed point of the executable image, host addresses are stored relative to it (ASLR)
+	static u64 get_link_anchor()
+	{
+		return reinterpret_cast<u64>(&spu_cache::initialize);
+	}
+
+	static u64 get_runtime_symbol(std::string_view name)
+	{
+		if (name == "spu_segment_base")
+			return reinterpret_cast<u64>(jit_runtime::alloc(0, 0));
+		if (name == "spu_dispatcher")
+			return reinterpret_cast<u64>(spu_runtime::tr_all);
+		if (name == "spu_dispatch")
+			return reinterpret_cast<u64>(spu_runtime::tr_dispatch);
+		if (name == "spu_escape")
+			return reinterpret_cast<u64>(spu_runtime::g_escape);
+
+		return 0;
+	}
+
+	// Object file name of the current program, versioned by everything that affects generated code
+	std::string get_object_name() const
+	{
+		// Executable identity: addresses of host functions and code of runtime helpers
+		static const std::string s_exec_id = []
+		{
+			fs::stat_t info{};
+			fs::get_stat(fs::get_executable_path(), info);
+			return fmt::format("%u:%d", info.size, info.mtime);
+		}();
+
+		std::string settings = g_cfg.core.to_string();
+		fmt::append(settings, "%s\n%u\n%u\n%u\n%u\n", s_exec_id, +g_cfg.savestate.compatible_mode.get(), +g_cfg.video.strict_rendering_mode.get(), +g_use_rtm, utils::get_tsc_freq());
+
+		sha1_context ctx;
+		u8 output[20];
+
+		sha1_starts(&ctx);
+		sha1_update(&ctx, reinterpret_cast<const u8*>(settings.data()), settings.size());
+		sha1_finish(&ctx, output);
+
+		return fmt::format("v1-%s-%s-%s.obj", m_hash, fmt::base57(output, 12), jit_compiler::cpu(g_cfg.core.llvm_cpu));
+	}
+
+	// Write link table of the module before its object, fails if the object can't be relocated on load
+	bool save_link_table(const llvm::Module& _module, const std::string& path) const
+	{
+		std::string table;
+
+		for (const llvm::GlobalValue& gv : _module.global_values())
+		{
+			if (!gv.isDeclaration() || gv.getName().starts_with("llvm."))
+			{
+				continue;
+			}
+
+			const std::string name = gv.getName().str();
+			obj_link kind = obj_link::image;
+			s64 offset = 0;
+
+			if (get_runtime_symbol(name))
+			{
+				kind = obj_link::runtime;
+			}
+			else if (name.starts_with(m_hash + "-pp-"))
+			{
+				kind = obj_link::patchpoint;
+			}
+			else if (const u64 addr = m_engine->getAddressToGlobalIfAvailable(name))
+			{
+				offset = static_cast<s64>(addr - get_link_anchor());
+
+				if (offset < -(1ll << 30) || offset >= (1ll << 30))
+				{
+					spu_log.notice("Object of %s is not cached (external symbol %s)", m_hash, name);
+					return false;
+				}
+			}
+			else
+			{
+				// Resolved by the memory manager (system libraries)
+				continue;
+			}
+
+			const u16 size = ::narrow<u16>(name.size());
+			table += static_cast<char>(kind);
+			table.append(reinterpret_cast<const char*>(&size), sizeof(size));
+			table += name;
+			table.append(reinterpret_cast<const char*>(&offset), sizeof(offset));
+		}
+
+		fs::pending_file file;
+
+		if (!file.open(path + ".link"))
+		{
+			spu_log.error("Failed to create %s.link (%s)", path, fs::g_tls_error);
+			return false;
+		}
+
+		file.file.write(table);
+
+		if (!file.commit())
+		{
+			spu_log.error("Failed to write %s.link (%s)", path, fs::g_tls_error);
+			return false;
+		}
+
+		return true;
+	}
+
+	// Load cached object of the current program, bind its external symbols and return the entry point
+	spu_function_t load_object(const std::string& path)
+	{
+		if (!fs::is_file(path + ".gz"))
+		{
+			return nullptr;
+		}
+
+		fs::file link{path + ".link"};
+
+		if (!link)
+		{
+			return nullptr;
+		}
+
+		const std::string table = link.to_string();
+
+		const auto discard = [&](std::string_view reason) -> spu_function_t
+		{
+			spu_log.error("Discarding cached object %s: %s", path, reason);
+			fs::remove_file(path + ".gz");
+			fs::remove_file(path + ".link");
+			return nullptr;
+		};
+
+		m_engine->clearAllGlobalMappings();
+
+		for (usz pos = 0; pos < table.size();)
+		{
+			u16 size = 0;
+			s64 offset = 0;
+
+			if (table.size() - pos < 1 + sizeof(size))
+			{
+				return discard("truncated link table");
+			}
+
+			const auto kind = static_cast<obj_link>(table[pos]);
+			std::memcpy(&size, table.data() + pos + 1, sizeof(size));
+			pos += 1 + sizeof(size);
+
+			if (table.size() - pos < size + sizeof(offset))
+			{
+				return discard("truncated link table");
+			}
+
+			const std::string name = table.substr(pos, size);
+			std::memcpy(&offset, table.data() + pos + size, sizeof(offset));
+			pos += size + sizeof(offset);
+
+			u64 addr = 0;
+
+			switch (kind)
+			{
+			case obj_link::image: addr = get_link_anchor() + offset; break;
+			case obj_link::runtime: addr = get_runtime_symbol(name); break;
+			case obj_link::patchpoint: addr = reinterpret_cast<u64>(m_spurt->make_branch_patchpoint()); break;
+			}
+
+			if (!addr)
+			{
+				return discard(fmt::format("unresolved symbol %s", name));
+			}
+
+			m_engine->updateGlobalMapping(name, addr);
+		}
+
+#if defined(__APPLE__)
+		pthread_jit_write_protect_np(false);
+#endif
+
+		const bool added = m_jit.add(path);
+
+		if (added)
+		{
+			m_jit.fin();
+		}
+
+#if defined(__APPLE__)
+		pthread_jit_write_protect_np(true);
+#endif
+#if defined(ARCH_ARM64)
+		// Flush all cache lines after potentially writing executable code
+		asm("ISB");
+		asm("DSB ISH");
+#endif
+
+		if (!added)
+		{
+			return discard("invalid object file");
+		}
+
+		return reinterpret_cast<spu_function_t>(m_jit.get(m_hash));
+	}
+
+	// g_timebase_offs, linked by name so that cached objects don't contain its address
+	llvm::Value* get_timebase_offs()
+	{
+		const auto var = m_module->getOrInsertGlobal("spu_timebase_offs", get_type<u64>());
+		m_engine->updateGlobalMapping("spu_timebase_offs", reinterpret_cast<u64>(&g_timebase_offs));
+		return var;
+	}
+
 	virtual spu_function_t compile(spu_program&& _func) override
 	{
 		if (_func.data.empty() && m_interp_magn)
@@ -1548,6 +1769,45 @@ public:
 			m_hash_start = hash_start;
 		}
 
+		// Native code cache (spu_debug writes its own objects)
+		std::string obj_name;
+
+		if (g_cfg.core.spu_cache && g_cfg.core.spu_object_cache && !g_cfg.core.spu_debug && fs::is_dir(m_spurt->get_cache_path() + "spu-obj/"))
+		{
+			obj_name = get_object_name();
+
+			if (const spu_function_t fn = load_object(m_spurt->get_cache_path() + "spu-obj/" + obj_name))
+			{
+				add_loc->compiled = fn;
+
+				if (!m_spurt->rebuild_ubertrampoline(func.data[0]))
+				{
+					if (auto& cache = g_fxo->get<spu_cache>())
+					{
+						if (add_to_file)
+						{
+							cache.add(func);
+						}
+					}
+
+					return nullptr;
+				}
+
+				add_loc->compiled.notify_all();
+
+				if (auto& cache = g_fxo->get<spu_cache>())
+				{
+					if (add_to_file)
+					{
+						cache.add(func);
+					}
+				}
+
+				spu_log.trace("Loaded function 0x%x from cache (%s)", func.entry_point, obj_name);
+				return fn;
+			}
+		}
+
 		spu_log.notice("Building function 0x%x... (size %u, %s)", func.entry_point, func.data.size(), m_hash);
 
 		m_pos = func.lower_bound;
@@ -1594,7 +1854,7 @@ public:
 		m_engine->clearAllGlobalMappings();
 
 		// Create LLVM module
-		std::unique_ptr<Module> _module = std::make_unique<Module>(m_hash + ".obj", m_context);
+		std::unique_ptr<Module> _module = std::make_unique<Module>(obj_name.empty() ? m_hash + ".obj" : obj_name, m_context);
 		_module->setTargetTriple(jit_compiler::triple2());
 		_module->setDataLayout(m_jit.get_engine().getTargetMachine()->createDataLayout());
 		m_module = _module.get();
@@ -2790,6 +3050,11 @@ public:
 			// Testing only
 			m_jit.add(std::move(_module), m_spurt->get_cache_path() + "llvm/");
 		}
+		else if (!obj_name.empty() && save_link_table(*_module, m_spurt->get_cache_path() + "spu-obj/" + obj_name))
+		{
+			// Object is written only after its link table
+			m_jit.add(std::move(_module), m_spurt->get_cache_path() + "spu-obj/");
+		}
 		else
 		{
 			m_jit.add(std::move(_module));
@@ -3518,7 +3783,7 @@ public:
 #if defined(ARCH_X64)
 			if (utils::get_tsc_freq() && !(g_cfg.core.spu_loop_detection) && (g_cfg.core.clocks_scale == 100))
 			{
-				const auto timebase_offs = m_ir->CreateLoad(get_type<u64>(), m_ir->CreateIntToPtr(m_ir->getInt64(reinterpret_cast<u64>(&g_timebase_offs)), get_type<u64*>()));
+				const auto timebase_offs = m_ir->CreateLoad(get_type<u64>(), get_timebase_offs());
 				const auto timestamp = m_ir->CreateLoad(get_type<u64>(), spu_ptr<u64>(OFFSET_OF(spu_thread, ch_dec_start_timestamp)));
 				const auto dec_value = m_ir->CreateLoad(get_type<u32>(), spu_ptr<u32>(OFFSET_OF(spu_thread, ch_dec_value)));
 				const auto tsc = m_ir->CreateCall(get_intrinsic(llvm::Intrinsic::x86_rdtsc));
@@ -4340,7 +4605,7 @@ public:
 #if defined(ARCH_X64)
 			if (utils::get_tsc_freq() && !(g_cfg.core.spu_loop_detection) && (g_cfg.core.clocks_scale == 100))
 			{
-				const auto timebase_offs = m_ir->CreateLoad(get_type<u64>(), m_ir->CreateIntToPtr(m_ir->getInt64(reinterpret_cast<u64>(&g_timebase_offs)), get_type<u64*>()));
+				const auto timebase_offs = m_ir->CreateLoad(get_type<u64>(), get_timebase_offs());
 				const auto tsc = m_ir->CreateCall(get_intrinsic(llvm::Intrinsic::x86_rdtsc));
 				const auto tscx = m_ir->CreateMul(m_ir->CreateUDiv(tsc, m_ir->getInt64(utils::get_tsc_freq())), m_ir->getInt64(80000000));
 				const auto tscm = m_ir->CreateUDiv(m_ir->CreateMul(m_ir->CreateURem(tsc, m_ir->getInt64(utils::get_tsc_freq())), m_ir->getInt64(80000000)), m_ir->getInt64(utils::get_tsc_freq()));
@@ -219,7 +219,7 @@ static FileType getFileType(const fs::file& file)
 		return FileType::Rap;
 	}
 
-	if (iso_dev::open(std::make_unique<file_view_block_dev>(file)))
+	if (compressed_block_dev::is_image(file) || iso_dev::open(std::make_unique<file_view_block_dev>(file)))
 	{
 		return FileType::Iso;
 	}
@@ -1015,7 +1015,33 @@ game_boot_result Emulator::BootGame(std::string path, const std::string& title_i
 		fs::file file(path);
 		if (getFileType(file) == FileType::Iso)
 		{
-			shared_ptr<fs::device_base> iso_device = stx::make_shared<iso_dev>(*ensure(iso_dev::open(std::make_unique<file_block_dev>(std::move(file)))));
+			std::unique_ptr<block_dev> image_dev;
+
+			if (compressed_block_dev::is_image(file))
+			{
+				// Only the header magic is checked by getFileType
+				image_dev = compressed_block_dev::open(std::move(file));
+
+				if (!image_dev)
+				{
+					sys_log.error("Failed to open compressed disc image: '%s'", path);
+					return restore_on_no_boot(game_boot_result::invalid_file_or_folder);
+				}
+			}
+			else
+			{
+				image_dev = std::make_unique<file_block_dev>(std::move(file));
+			}
+
+			auto iso = iso_dev::open(std::move(image_dev));
+
+			if (!iso)
+			{
+				sys_log.error("Failed to open disc image: '%s'", path);
+				return restore_on_no_boot(game_boot_result::invalid_file_or_folder);
+			}
+
+			shared_ptr<fs::device_base> iso_device = stx::make_shared<iso_dev>(std::move(*iso));
 
 			auto mount_path = iso_device->fs_prefix + "/";
 			sys_log.notice("Mounting iso: '%s' -> '%s'", path, mount_path);
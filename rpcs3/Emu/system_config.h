@@ -81,6 +81,7 @@ struct cfg_root : cfg::node
 		fifo_setting rsx_fifo_accuracy{this, "RSX FIFO Accuracy", rsx_fifo_mode::fast};
 		cfg::_bool spu_verification{this, "SPU Verification", true}; // Should be enabled
 		cfg::_bool spu_cache{this, "SPU Cache", true};
+		cfg::_bool spu_object_cache{this, "SPU LLVM Object Cache", true}; // Persist native code of SPU LLVM programs
 		cfg::_bool spu_prof{this, "SPU Profiler", false};
 		cfg::uint<0, 16> mfc_transfers_shuffling{this, "MFC Commands Shuffling Limit", 0};
 		cfg::uint<0, 10000> mfc_transfers_timeout{this, "MFC Commands Timeout", 0, true};
@@ -0,0 +1,569 @@
+#include "block_dev.hpp"
+#include "util/sysinfo.hpp"
+#include "util/types.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <zstd.h>
+
+// Compressed image layout, all values are little endian:
+//
+//   header (64 bytes)
+//   chunk data, in order of first use
+//   chunk table: chunk_count entries of {u64 offset, u32 size, u32 reserved}
+//
+// Every chunk except the last one is `chunk_size` bytes of the image. Chunk
+// of size 0 is zero filled and has no data, chunk of its full size is stored
+// uncompressed, anything else is one zstd frame. Deduplicated chunks share
+// the same data.
+
+namespace
+{
+	constexpr char s_image_magic[8] = {'R', 'P', 'C', 'S', 'X', 'Z', 'C', 'D'};
+	constexpr u32 s_image_version = 1;
+
+	// Chunks of a single read decompressed by one thread
+	constexpr std::size_t s_chunks_per_thread = 4;
+
+	constexpr std::size_t s_cached_chunks = 16;
+
+#pragma pack(push, 1)
+	struct image_header
+	{
+		char magic[8];
+		le_t<u32, 1> version;
+		le_t<u32, 1> block_size;
+		le_t<u32, 1> chunk_size;
+		le_t<u32, 1> reserved0;
+		le_t<u64, 1> image_size;
+		le_t<u64, 1> chunk_count;
+		le_t<u64, 1> table_offset;
+		u8 reserved1[16];
+	};
+
+	struct image_table_entry
+	{
+		le_t<u64, 1> offset;
+		le_t<u32, 1> size;
+		le_t<u32, 1> reserved;
+	};
+#pragma pack(pop)
+
+	static_assert(sizeof(image_header) == 64);
+
+	ZSTD_DCtx* get_dctx()
+	{
+		thread_local std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> s_ctx{ZSTD_createDCtx(), &ZSTD_freeDCtx};
+		return s_ctx.get();
+	}
+
+	ZSTD_CCtx* get_cctx()
+	{
+		thread_local std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> s_ctx{ZSTD_createCCtx(), &ZSTD_freeCCtx};
+		return s_ctx.get();
+	}
+
+	void atomic_min(std::atomic<u64>& value, u64 other)
+	{
+		for (u64 old = value.load(); other < old && !value.compare_exchange_weak(old, other);)
+		{
+		}
+	}
+
+	// Threads helping parallel_for, started on first use and kept for the
+	// lifetime of the process, so large reads don't pay for thread creation
+	// and reuse the thread local decompression contexts
+	class worker_pool
+	{
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		std::condition_variable m_done;
+		std::vector<std::thread> m_threads;
+		bool m_stop = false;
+
+		// Current job, only one is run at a time
+		std::mutex m_job_mutex;
+		const std::function<void(std::size_t)>* m_func = nullptr;
+		std::size_t m_count = 0;
+		std::atomic<std::size_t> m_next = 0;
+		std::size_t m_wanted = 0; // Helpers which may still join the job
+		std::size_t m_active = 0; // Helpers working on the job
+
+		void work()
+		{
+			for (std::size_t i; (i = m_next++) < m_count;)
+			{
+				(*m_func)(i);
+			}
+		}
+
+		void thread_main()
+		{
+			std::unique_lock lock(m_mutex);
+
+			while (true)
+			{
+				m_wake.wait(lock, [this]
+					{
+						return m_stop || m_wanted;
+					});
+
+				if (m_stop)
+				{
+					return;
+				}
+
+				m_wanted--;
+				m_active++;
+				lock.unlock();
+				work();
+				lock.lock();
+
+				if (!--m_active)
+				{
+					m_done.notify_one();
+				}
+			}
+		}
+
+	public:
+		worker_pool()
+		{
+			const std::size_t count = utils::get_thread_count() - 1;
+
+			for (std::size_t i = 0; i < count; i++)
+			{
+				m_threads.emplace_back(&worker_pool::thread_main, this);
+			}
+		}
+
+		worker_pool(const worker_pool&) = delete;
+		worker_pool& operator=(const worker_pool&) = delete;
+
+		~worker_pool()
+		{
+			{
+				std::lock_guard lock(m_mutex);
+				m_stop = true;
+			}
+
+			m_wake.notify_all();
+
+			for (auto& thread : m_threads)
+			{
+				thread.join();
+			}
+		}
+
+		static worker_pool& get()
+		{
+			static worker_pool s_pool;
+			return s_pool;
+		}
+
+		// Run func(0..count-1) on up to `threads` threads including the caller,
+		// concurrent callers don't wait for the pool and run on their own
+		void run(std::size_t count, std::size_t threads, const std::function<void(std::size_t)>& func)
+		{
+			std::unique_lock job_lock(m_job_mutex, std::try_to_lock);
+
+			if (!job_lock || m_threads.empty())
+			{
+				for (std::size_t i = 0; i < count; i++)
+				{
+					func(i);
+				}
+
+				return;
+			}
+
+			{
+				std::lock_guard lock(m_mutex);
+				m_func = &func;
+				m_count = count;
+				m_next = 0;
+				m_wanted = std::min(threads - 1, m_threads.size());
+			}
+
+			m_wake.notify_all();
+			work();
+
+			// Helpers that didn't wake up yet have nothing left to do
+			std::unique_lock lock(m_mutex);
+			m_wanted = 0;
+			m_done.wait(lock, [this]
+				{
+					return !m_active;
+				});
+
+			m_func = nullptr;
+		}
+	};
+
+	void parallel_for(std::size_t count, std::size_t threads, const std::function<void(std::size_t)>& func)
+	{
+		worker_pool::get().run(count, threads, func);
+	}
+} // namespace
+
+bool compressed_block_dev::is_image(const fs::file& file)
+{
+	image_header header{};
+	return file && file.read_at(0, &header, sizeof(header)) == sizeof(header) && std::memcmp(header.magic, s_image_magic, sizeof(s_image_magic)) == 0;
+}
+
+std::unique_ptr<compressed_block_dev> compressed_block_dev::open(fs::file file)
+{
+	image_header header{};
+
+	if (!is_image(file) || file.read_at(0, &header, sizeof(header)) != sizeof(header) || header.version != s_image_version)
+	{
+		return nullptr;
+	}
+
+	const u64 file_size = file.size();
+	const u64 block_size = header.block_size;
+	const u64 chunk_size = header.chunk_size;
+	const u64 image_size = header.image_size;
+	const u64 chunk_count = header.chunk_count;
+
+	if (!block_size || !chunk_size || chunk_size % block_size || chunk_count != (image_size + chunk_size - 1) / chunk_size)
+	{
+		return nullptr;
+	}
+
+	if (header.table_offset > file_size || (file_size - header.table_offset) / sizeof(image_table_entry) < chunk_count)
+	{
+		return nullptr;
+	}
+
+	std::vector<image_table_entry> table(chunk_count);
+
+	if (file.read_at(header.table_offset, table.data(), table.size() * sizeof(image_table_entry)) != table.size() * sizeof(image_table_entry))
+	{
+		return nullptr;
+	}
+
+	std::unique_ptr<compressed_block_dev> result(new compressed_block_dev());
+	result->m_image_size = image_size;
+	result->m_chunk_size = chunk_size;
+	result->m_table.resize(chunk_count);
+
+	for (std::size_t i = 0; i < chunk_count; i++)
+	{
+		const u64 offset = table[i].offset;
+		const u32 size = table[i].size;
+
+		if (offset > file_size || file_size - offset < size || size > ZSTD_compressBound(result->chunk_bytes(i)))
+		{
+			return nullptr;
+		}
+
+		result->m_table[i] = {offset, size};
+	}
+
+	result->m_file = std::move(file);
+	result->m_cache.resize(s_cached_chunks);
+	result->set_block_info(block_size, image_size / block_size);
+	return result;
+}
+
+std::size_t compressed_block_dev::chunk_bytes(std::size_t index) const
+{
+	return std::min<u64>(m_chunk_size, m_image_size - u64{index} * m_chunk_size);
+}
+
+bool compressed_block_dev::decompress(std::size_t index, std::byte* out) const
+{
+	const chunk_entry& entry = m_table[index];
+	const std::size_t bytes = chunk_bytes(index);
+
+	if (entry.size == 0)
+	{
+		std::memset(out, 0, bytes);
+		return true;
+	}
+
+	if (entry.size == bytes)
+	{
+		return m_file.read_at(entry.offset, out, bytes) == bytes;
+	}
+
+	thread_local std::vector<std::byte> s_packed;
+	s_packed.resize(entry.size);
+
+	if (m_file.read_at(entry.offset, s_packed.data(), entry.size) != entry.size)
+	{
+		return false;
+	}
+
+	const usz result = ZSTD_decompressDCtx(get_dctx(), out, bytes, s_packed.data(), entry.size);
+	return !ZSTD_isError(result) && result == bytes;
+}
+
+bool compressed_block_dev::read_cached(std::size_t index, std::byte* out, std::size_t offset, std::size_t size)
+{
+	{
+		std::lock_guard lock(m_cache_mutex);
+
+		for (auto& chunk : m_cache)
+		{
+			if (chunk.index == index)
+			{
+				chunk.last_use = ++m_cache_tick;
+				std::memcpy(out, chunk.data.data() + offset, size);
+				return true;
+			}
+		}
+	}
+
+	std::vector<std::byte> data(chunk_bytes(index));
+
+	if (!decompress(index, data.data()))
+	{
+		return false;
+	}
+
+	std::memcpy(out, data.data() + offset, size);
+
+	std::lock_guard lock(m_cache_mutex);
+
+	auto& slot = *std::min_element(m_cache.begin(), m_cache.end(), [](const cached_chunk& lhs, const cached_chunk& rhs)
+		{
+			return lhs.last_use < rhs.last_use;
+		});
+
+	slot.index = index;
+	slot.last_use = ++m_cache_tick;
+	slot.data = std::move(data);
+	return true;
+}
+
+std::size_t compressed_block_dev::read(std::size_t blockIndex, void* data, std::size_t blockCount)
+{
+	if (blockIndex >= block_count())
+	{
+		return 0;
+	}
+
+	blockCount = std::min(blockCount, block_count() - blockIndex);
+
+	const u64 begin = u64{blockIndex} * block_size();
+	const u64 end = begin + u64{blockCount} * block_size();
+	const auto out = static_cast<std::byte*>(data);
+
+	// Offset of the first byte that couldn't be read
+	std::atomic<u64> failed = end;
+
+	// Chunks completely inside of the request bypass the cache
+	std::vector<std::size_t> direct;
+
+	for (std::size_t index = begin / m_chunk_size; u64{index} * m_chunk_size < end; index++)
+	{
+		const u64 chunk_begin = u64{index} * m_chunk_size;
+		const u64 chunk_end = chunk_begin + chunk_bytes(index);
+
+		if (chunk_begin >= begin && chunk_end <= end)
+		{
+			direct.push_back(index);
+			continue;
+		}
+
+		const u64 from = std::max(begin, chunk_begin);
+		const u64 to = std::min(end, chunk_end);
+
+		if (!read_cached(index, out + (from - begin), from - chunk_begin, to - from))
+		{
+			atomic_min(failed, from);
+		}
+	}
+
+	auto decompress_direct = [&](std::size_t i)
+	{
+		const u64 chunk_begin = u64{direct[i]} * m_chunk_size;
+
+		if (!decompress(direct[i], out + (chunk_begin - begin)))
+		{
+			atomic_min(failed, chunk_begin);
+		}
+	};
+
+	const std::size_t threads = std::min<std::size_t>(utils::get_thread_count(), (direct.size() + s_chunks_per_thread - 1) / s_chunks_per_thread);
+
+	if (threads > 1)
+	{
+		parallel_for(direct.size(), threads, decompress_direct);
+	}
+	else
+	{
+		for (std::size_t i = 0; i < direct.size(); i++)
+		{
+			decompress_direct(i);
+		}
+	}
+
+	return (failed.load() - begin) / block_size();
+}
+
+bool compressed_block_dev::create(const fs::file& image, const fs::file& out, const create_options& options)
+{
+	if (!options.block_size || !options.chunk_size || options.chunk_size % options.block_size)
+	{
+		return false;
+	}
+
+	const u64 image_size = image.size();
+	const std::size_t chunk_size = options.chunk_size;
+	const u64 chunk_count = (image_size + chunk_size - 1) / chunk_size;
+
+	image_header header{};
+	std::memcpy(header.magic, s_image_magic, sizeof(s_image_magic));
+	header.version = s_image_version;
+	header.block_size = ::narrow<u32>(options.block_size);
+	header.chunk_size = ::narrow<u32>(chunk_size);
+	header.image_size = image_size;
+	header.chunk_count = chunk_count;
+
+	// Header is written last, so incomplete file is never a valid image
+	if (out.write_at(0, std::vector<u8>(sizeof(header)).data(), sizeof(header)) != sizeof(header))
+	{
+		return false;
+	}
+
+	std::vector<image_table_entry> table(chunk_count);
+	u64 data_offset = sizeof(header);
+
+	// Stored chunks by hash of their original data
+	std::unordered_multimap<usz, std::size_t> stored;
+
+	const std::size_t threads = utils::get_thread_count();
+	const std::size_t batch_size = threads * s_chunks_per_thread;
+
+	std::vector<std::vector<std::byte>> raw(batch_size);
+	std::vector<std::vector<std::byte>> packed(batch_size);
+	std::vector<u8> is_zero(batch_size);
+	std::atomic<bool> failed = false;
+
+	for (u64 first = 0; first < chunk_count; first += batch_size)
+	{
+		const std::size_t count = std::min<u64>(batch_size, chunk_count - first);
+
+		parallel_for(count, threads, [&](std::size_t i)
+			{
+				const u64 offset = (first + i) * chunk_size;
+				const std::size_t bytes = std::min<u64>(chunk_size, image_size - offset);
+
+				raw[i].resize(bytes);
+
+				if (image.read_at(offset, raw[i].data(), bytes) != bytes)
+				{
+					failed = true;
+					return;
+				}
+
+				is_zero[i] = std::all_of(raw[i].begin(), raw[i].end(), [](std::byte b)
+					{
+						return b == std::byte{};
+					});
+
+				if (is_zero[i])
+				{
+					return;
+				}
+
+				packed[i].resize(ZSTD_compressBound(bytes));
+				const usz size = ZSTD_compressCCtx(get_cctx(), packed[i].data(), packed[i].size(), raw[i].data(), bytes, options.level);
+
+				if (ZSTD_isError(size) || size >= bytes)
+				{
+					// Incompressible chunk is stored
+					packed[i] = raw[i];
+				}
+				else
+				{
+					packed[i].resize(size);
+				}
+			});
+
+		if (failed)
+		{
+			return false;
+		}
+
+		for (std::size_t i = 0; i < count; i++)
+		{
+			auto& entry = table[first + i];
+
+			if (is_zero[i])
+			{
+				entry.offset = 0;
+				entry.size = 0;
+				continue;
+			}
+
+			const usz hash = std::hash<std::string_view>{}({reinterpret_cast<const char*>(raw[i].data()), raw[i].size()});
+			bool deduplicated = false;
+
+			if (options.dedup)
+			{
+				for (auto [it, range_end] = stored.equal_range(hash); it != range_end; ++it)
+				{
+					// Equal data of equal size means equal chunk
+					const auto& other = table[it->second];
+					const u64 other_bytes = std::min<u64>(chunk_size, image_size - u64{it->second} * chunk_size);
+
+					if (other.size != packed[i].size() || other_bytes != raw[i].size())
+					{
+						continue;
+					}
+
+					std::vector<std::byte> other_data(other.size);
+
+					if (out.read_at(other.offset, other_data.data(), other_data.size()) == other_data.size() && other_data == packed[i])
+					{
+						entry = other;
+						deduplicated = true;
+						break;
+					}
+				}
+			}
+
+			if (deduplicated)
+			{
+				continue;
+			}
+
+			if (out.write_at(data_offset, packed[i].data(), packed[i].size()) != packed[i].size())
+			{
+				return false;
+			}
+
+			entry.offset = data_offset;
+			entry.size = ::narrow<u32>(packed[i].size());
+			data_offset += packed[i].size();
+
+			if (options.dedup)
+			{
+				stored.emplace(hash, first + i);
+			}
+		}
+	}
+
+	header.table_offset = data_offset;
+
+	const usz table_bytes = table.size() * sizeof(image_table_entry);
+
+	if (out.write_at(data_offset, table.data(), table_bytes) != table_bytes)
+	{
+		return false;
+	}
+
+	out.trunc(data_offset + table_bytes);
+	return out.write_at(0, &header, sizeof(header)) == sizeof(header);
+}
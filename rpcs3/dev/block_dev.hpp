@@ -1,8 +1,16 @@
 #pragma once
 
 #include "util/File.h"
+#include <algorithm>
 #include <cstddef>
+#include <cstring>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 class block_dev
 {
@@ -104,3 +112,249 @@ public:
 		return result / block_size();
 	}
 };
+
+// LRU cache of fixed size block groups (lines) in front of another device.
+// Read that continues previous one also fetches `readAhead` following lines,
+// reads larger than quarter of the cache bypass it.
+class cached_block_dev final : public block_dev
+{
+	struct line
+	{
+		std::size_t index;
+		std::size_t blocks; // Short at the end of device
+		std::vector<std::byte> data;
+	};
+
+	std::unique_ptr<block_dev> m_dev;
+	const std::size_t m_line_blocks;
+	const std::size_t m_max_lines;
+	const std::size_t m_read_ahead;
+
+	std::mutex m_mutex;
+	std::list<line> m_lru; // Most recently used first
+	std::unordered_map<std::size_t, std::list<line>::iterator> m_lines;
+	std::size_t m_next_block = umax; // Block following the last read
+	std::size_t m_generation = 0; // Incremented by every write
+
+public:
+	explicit cached_block_dev(std::unique_ptr<block_dev> dev,
+		std::size_t lineBlocks = 16, std::size_t maxLines = 512,
+		std::size_t readAhead = 8)
+		: m_dev(std::move(dev)), m_line_blocks(lineBlocks),
+		  m_max_lines(maxLines), m_read_ahead(std::min(readAhead, maxLines / 2))
+	{
+		set_block_info(m_dev->block_size(), m_dev->block_count());
+	}
+
+	std::size_t read(std::size_t blockIndex, void* data,
+		std::size_t blockCount) override
+	{
+		if (blockIndex >= block_count())
+		{
+			return 0;
+		}
+
+		blockCount = std::min(blockCount, block_count() - blockIndex);
+
+		// Device I/O is done without the lock, so concurrent readers only
+		// serialize on cache lookups
+		std::unique_lock lock(m_mutex);
+
+		const bool sequential = blockIndex == m_next_block;
+		m_next_block = blockIndex + blockCount;
+
+		if (blockCount * 4 > m_line_blocks * m_max_lines)
+		{
+			lock.unlock();
+			return m_dev->read(blockIndex, data, blockCount);
+		}
+
+		const std::size_t line_count = (block_count() + m_line_blocks - 1) / m_line_blocks;
+		const std::size_t end_line = std::min((blockIndex + blockCount - 1) / m_line_blocks + 1 + (sequential ? m_read_ahead : 0), line_count);
+
+		auto out = static_cast<std::byte*>(data);
+		std::size_t done = 0;
+
+		for (std::size_t index = blockIndex / m_line_blocks; done < blockCount; index++)
+		{
+			auto found = m_lines.find(index);
+
+			if (found == m_lines.end())
+			{
+				// Fetch run of missing lines with one read
+				std::size_t count = 1;
+
+				while (index + count < end_line && count < m_max_lines / 2 && !m_lines.contains(index + count))
+				{
+					count++;
+				}
+
+				const std::size_t generation = m_generation;
+				lock.unlock();
+				auto fetched = fetch(index, count);
+				lock.lock();
+
+				if (fetched.empty())
+				{
+					break;
+				}
+
+				if (generation != m_generation)
+				{
+					// Written meanwhile, fetched data can be stale
+					index--;
+					continue;
+				}
+
+				insert(index, fetched);
+				found = m_lines.find(index);
+			}
+			else
+			{
+				m_lru.splice(m_lru.begin(), m_lru, found->second);
+			}
+
+			const line& cached = *found->second;
+			const std::size_t offset = blockIndex + done - index * m_line_blocks;
+
+			if (offset >= cached.blocks)
+			{
+				break;
+			}
+
+			const std::size_t count = std::min(cached.blocks - offset, blockCount - done);
+			std::memcpy(out + done * block_size(), cached.data.data() + offset * block_size(), count * block_size());
+			done += count;
+
+			if (offset + count < m_line_blocks && done < blockCount)
+			{
+				break;
+			}
+		}
+
+		return done;
+	}
+
+	std::size_t write(std::size_t blockIndex, const void* data,
+		std::size_t blockCount) override
+	{
+		std::lock_guard lock(m_mutex);
+
+		for (std::size_t index = blockIndex / m_line_blocks; index * m_line_blocks < blockIndex + blockCount; index++)
+		{
+			if (auto found = m_lines.find(index); found != m_lines.end())
+			{
+				m_lru.erase(found->second);
+				m_lines.erase(found);
+			}
+		}
+
+		m_next_block = umax;
+		m_generation++;
+		return m_dev->write(blockIndex, data, blockCount);
+	}
+
+private:
+	// Reads `count` lines starting at `index`, returns read data, empty on failure
+	std::vector<std::byte> fetch(std::size_t index, std::size_t count)
+	{
+		const std::size_t first_block = index * m_line_blocks;
+		const std::size_t blocks = std::min(count * m_line_blocks, block_count() - first_block);
+
+		std::vector<std::byte> buffer(blocks * block_size());
+		const std::size_t read_blocks = m_dev->read(first_block, buffer.data(), blocks);
+		buffer.resize(read_blocks * block_size());
+		return buffer;
+	}
+
+	// Adds fetched lines to the cache, lines fetched meanwhile by other reader are kept
+	void insert(std::size_t index, const std::vector<std::byte>& buffer)
+	{
+		const std::size_t read_blocks = buffer.size() / block_size();
+
+		// Insert backwards so that the requested line becomes the most recent
+		for (std::size_t i = (read_blocks - 1) / m_line_blocks + 1; i-- > 0;)
+		{
+			if (auto found = m_lines.find(index + i); found != m_lines.end())
+			{
+				m_lru.splice(m_lru.begin(), m_lru, found->second);
+				continue;
+			}
+
+			const std::size_t line_blocks = std::min(m_line_blocks, read_blocks - i * m_line_blocks);
+			const auto begin = buffer.begin() + i * m_line_blocks * block_size();
+
+			m_lru.push_front({index + i, line_blocks, {begin, begin + line_blocks * block_size()}});
+			m_lines.emplace(index + i, m_lru.begin());
+		}
+
+		while (m_lru.size() > m_max_lines)
+		{
+			m_lines.erase(m_lru.back().index);
+			m_lru.pop_back();
+		}
+	}
+};
+
+// Read-only disc image stored as independently compressed (zstd) chunks
+// with a chunk offset table, layout is described in block_dev.cpp. Recently
+// used chunks are kept decompressed, chunks fully covered by a large read
+// are decompressed in parallel straight into the destination.
+class compressed_block_dev final : public block_dev
+{
+	struct chunk_entry
+	{
+		std::uint64_t offset;
+		std::uint32_t size; // 0: zero filled, equal to chunk size: stored
+	};
+
+	struct cached_chunk
+	{
+		std::size_t index = umax;
+		std::uint64_t last_use = 0;
+		std::vector<std::byte> data;
+	};
+
+	fs::file m_file;
+	std::uint64_t m_image_size = 0;
+	std::size_t m_chunk_size = 0;
+	std::vector<chunk_entry> m_table;
+
+	std::mutex m_cache_mutex;
+	std::vector<cached_chunk> m_cache;
+	std::uint64_t m_cache_tick = 0;
+
+	compressed_block_dev() = default;
+
+public:
+	struct create_options
+	{
+		std::size_t block_size = 2048;
+		std::size_t chunk_size = 64 * 1024;
+		int level = 19;
+		bool dedup = true; // Store identical chunks once
+	};
+
+	// Check image header
+	static bool is_image(const fs::file& file);
+
+	static std::unique_ptr<compressed_block_dev> open(fs::file file);
+
+	// Convert plain image, `out` must be opened for reading and writing
+	static bool create(const fs::file& image, const fs::file& out,
+		const create_options& options);
+
+	std::size_t read(std::size_t blockIndex, void* data,
+		std::size_t blockCount) override;
+
+	std::size_t write(std::size_t, const void*, std::size_t) override
+	{
+		return 0;
+	}
+
+private:
+	std::size_t chunk_bytes(std::size_t index) const;
+	bool decompress(std::size_t index, std::byte* out) const;
+	bool read_cached(std::size_t index, std::byte* out, std::size_t offset,
+		std::size_t size);
+};
@@ -11,6 +11,7 @@
 #include <ctime>
 #include <memory>
 #include <string>
+#include <unordered_set>
 
 static std::string u16_ne_to_string(const char16_t* bytes, std::size_t count)
 {
@@ -116,21 +117,21 @@ bool iso_dev::initialize()
 
 bool iso_dev::stat(const std::string& path, fs::stat_t& info)
 {
-	auto optEntry = open_entry(path);
-	if (!optEntry)
+	auto entry = open_entry(path);
+	if (!entry)
 	{
 		fs::g_tls_error = fs::error::noent;
 		return false;
 	}
 
-	info = optEntry->to_fs_stat();
+	info = entry->entry.to_fs_stat();
 	return true;
 }
 
 bool iso_dev::statfs(const std::string& path, fs::device_stat& info)
 {
-	auto optEntry = open_entry(path);
-	if (!optEntry)
+	auto entry = open_entry(path);
+	if (!entry)
 	{
 		fs::g_tls_error = fs::error::noent;
 		return false;
@@ -154,123 +155,147 @@ std::unique_ptr<fs::file_base> iso_dev::open(const std::string& path, rx::EnumBi
 		return {};
 	}
 
-	auto optEntry = open_entry(path);
-	if (!optEntry)
+	auto entry = open_entry(path);
+	if (!entry)
 	{
 		fs::g_tls_error = fs::error::noent;
 		return {};
 	}
 
-	if ((optEntry->flags & iso::DirEntryFlags::Directory) == iso::DirEntryFlags::Directory)
+	if ((entry->entry.flags & iso::DirEntryFlags::Directory) == iso::DirEntryFlags::Directory)
 	{
 		fs::g_tls_error = fs::error::isdir;
 		return {};
 	}
 
-	return read_file(*optEntry).release();
+	return read_file(entry->entry).release();
 }
 
 std::unique_ptr<fs::dir_base> iso_dev::open_dir(const std::string& path)
 {
-	auto optEntry = open_entry(path);
-	if (!optEntry)
+	auto entry = open_entry(path);
+	if (!entry)
 	{
 		fs::g_tls_error = fs::error::noent;
 		return {};
 	}
 
-	if ((optEntry->flags & iso::DirEntryFlags::Directory) != iso::DirEntryFlags::Directory)
+	if ((entry->entry.flags & iso::DirEntryFlags::Directory) != iso::DirEntryFlags::Directory)
 	{
 		fs::g_tls_error = fs::error::exist;
 		return {};
 	}
 
-	auto items = read_dir(*optEntry);
-	std::vector<fs::dir_entry> result_items(items.first.size());
+	return std::make_unique<fs::virtual_dir>(entry->listing);
+}
 
-	for (std::size_t i = 0; i < result_items.size(); ++i)
+static void append_lowercase(std::string& out, std::string_view name)
+{
+	for (char c : name)
 	{
-		result_items[i] = items.first[i].to_fs_entry(items.second[i]);
+		out += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
 	}
-
-	return std::make_unique<fs::virtual_dir>(std::move(result_items));
 }
 
-std::optional<iso::DirEntry>
-iso_dev::open_entry(std::string_view path)
+void iso_dev::build_index()
 {
-	if (path == "/" || path == "\\" || path.empty())
-	{
-		return m_root_dir;
-	}
+	auto& entries = m_index->entries;
+	entries[""].entry = m_root_dir;
 
-	auto item = m_root_dir;
+	// Directories already listed, by location (protects from loops in damaged images)
+	std::unordered_set<u32> listed;
+	std::vector<std::string> queue{""};
 
-	auto isStringEqNoCase = [](std::string_view lhs, std::string_view rhs)
+	for (std::size_t i = 0; i < queue.size(); ++i)
 	{
-		if (lhs.size() != rhs.size())
+		const std::string path = queue[i];
+		auto& dir = entries.at(path);
+
+		if (!listed.insert(dir.entry.lba.value()).second)
 		{
-			return false;
+			continue;
 		}
 
-		for (std::size_t i = 0; i < lhs.size(); ++i)
+		auto items = read_dir(dir.entry);
+		dir.listing.resize(items.first.size());
+
+		for (std::size_t j = 0; j < items.first.size(); ++j)
 		{
-			if (std::tolower(lhs[i]) != std::tolower(rhs[i]))
+			const auto& name = items.second[j];
+			dir.listing[j] = items.first[j].to_fs_entry(name);
+
+			if (name == "." || name == "..")
+			{
+				continue;
+			}
+
+			std::string child_path = path;
+			if (!child_path.empty())
+			{
+				child_path += '/';
+			}
+
+			append_lowercase(child_path, name);
+
+			// First of entries with the same name wins
+			auto [child, inserted] = entries.try_emplace(std::move(child_path));
+			if (!inserted)
+			{
+				continue;
+			}
+
+			child->second.entry = items.first[j];
+
+			if ((items.first[j].flags & iso::DirEntryFlags::Directory) == iso::DirEntryFlags::Directory)
 			{
-				return false;
+				queue.push_back(child->first);
 			}
 		}
+	}
+}
 
-		return true;
-	};
+const iso_dev::index_entry* iso_dev::open_entry(std::string_view path)
+{
+	std::call_once(m_index->built, [this]
+		{
+			build_index();
+		});
+
+	std::string key;
 
 	while (!path.empty())
 	{
 		auto sepPos = path.find_first_of("/\\");
-		if (sepPos == 0)
+		auto name = path.substr(0, sepPos);
+		path = sepPos == std::string_view::npos ? std::string_view{} : path.substr(sepPos + 1);
+
+		if (name.empty() || name == ".")
 		{
-			path.remove_prefix(1);
 			continue;
 		}
 
-		if ((item.flags & iso::DirEntryFlags::Directory) !=
-			iso::DirEntryFlags::Directory)
+		if (name == "..")
 		{
-			return {};
+			auto parentEnd = key.rfind('/');
+			key.resize(parentEnd == std::string::npos ? 0 : parentEnd);
+			continue;
 		}
 
-		auto dirName = path.substr(0, sepPos);
-		if (sepPos == std::string_view::npos)
+		if (!key.empty())
 		{
-			path = {};
+			key += '/';
 		}
-		else
-		{
-			path.remove_prefix(sepPos);
-		}
-
-		auto items = read_dir(item);
 
-		bool found = false;
-		for (std::size_t i = 0; i < items.first.size(); ++i)
-		{
-			if (!isStringEqNoCase(items.second[i], dirName))
-			{
-				continue;
-			}
-
-			item = items.first[i];
-			found = true;
-			break;
-		}
+		append_lowercase(key, name);
+	}
 
-		if (!found)
-		{
-			return {};
-		}
+	auto found = m_index->entries.find(key);
+	if (found == m_index->entries.end())
+	{
+		return nullptr;
 	}
 
-	return item;
+	return &found->second;
 }
 
 std::pair<std::vector<iso::DirEntry>, std::vector<std::string>>
@@ -5,8 +5,13 @@
 #include "util/endian.hpp"
 #include "util/types.hpp"
 #include <bit>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <string>
 #include <string_view>
+#include <unordered_map>
+#include <vector>
 
 namespace iso
 {
@@ -208,9 +213,24 @@ namespace iso
 
 class iso_dev final : public fs::device_base
 {
+	struct index_entry
+	{
+		iso::DirEntry entry;
+		std::vector<fs::dir_entry> listing; // Directory contents, including "." and ".."
+	};
+
+	// Every entry of the image by lowercase path without leading and trailing
+	// separators (root is empty), built by single walk on first lookup
+	struct path_index
+	{
+		std::once_flag built;
+		std::unordered_map<std::string, index_entry> entries;
+	};
+
 	std::unique_ptr<block_dev> m_dev;
 	iso::DirEntry m_root_dir;
 	iso::StringEncoding m_encoding = iso::StringEncoding::ascii;
+	std::unique_ptr<path_index> m_index = std::make_unique<path_index>();
 
 public:
 	iso_dev() = default;
@@ -218,7 +238,16 @@ public:
 	static std::optional<iso_dev> open(std::unique_ptr<block_dev> device)
 	{
 		iso_dev result;
-		result.m_dev = std::move(device);
+
+		// Compressed image keeps its own cache of decompressed chunks
+		if (dynamic_cast<compressed_block_dev*>(device.get()))
+		{
+			result.m_dev = std::move(device);
+		}
+		else
+		{
+			result.m_dev = std::make_unique<cached_block_dev>(std::move(device));
+		}
 
 		if (!result.initialize())
 		{
@@ -235,8 +264,9 @@ public:
 
 private:
 	bool initialize();
+	void build_index();
 
-	std::optional<iso::DirEntry> open_entry(std::string_view path);
+	const index_entry* open_entry(std::string_view path);
 	std::pair<std::vector<iso::DirEntry>, std::vector<std::string>> read_dir(const iso::DirEntry& entry);
 	fs::file read_file(const iso::DirEntry& entry);
 };
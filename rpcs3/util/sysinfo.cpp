@@ -194,6 +194,16 @@ bool utils::has_avx2()
 #endif
 }
 
+bool utils::has_vaes()
+{
+#if defined(ARCH_X64)
+	static const bool g_value = has_avx2() && get_cpuid(7, 0)[2] & 0x200;
+	return g_value;
+#else
+	return false;
+#endif
+}
+
 bool utils::has_rtm()
 {
 #if defined(ARCH_X64)
@@ -13,6 +13,8 @@ namespace utils
 
 	bool has_avx2();
 
+	bool has_vaes();
+
 	bool has_rtm();
 
 	bool has_tsx_force_abort();
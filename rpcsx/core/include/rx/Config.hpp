@@ -1,12 +1,35 @@
 #pragma once
 
 namespace rx {
+enum class ShaderTranslationMode {
+  // translate on worker threads, draws wait for their shaders
+  Async,
+
+  // translate on worker threads, draws with pending shaders are skipped
+  AsyncSkipDraw,
+
+  // translate on the command processor thread
+  Sync,
+};
+
 // FIXME: serialization
 struct Config {
   int gpuIndex = 0;
   bool validateGpu = false;
   bool disableGpuCache = false;
+  bool uffdPageTracking = false;
+  bool cpuTiler = false;
   bool debugGpu = false;
+  bool headlessGpu = false; // no window and swapchain, flips are not shown
+  bool disableShaderCache = false;
+  const char *shaderCachePath = "shader-cache";
+  ShaderTranslationMode shaderTranslationMode = ShaderTranslationMode::Async;
+  unsigned shaderTranslationThreads = 0;
+  const char *shaderDumpPath = nullptr;
+  const char *shaderDumpStages = nullptr;
+  const char *pm4CapturePath = nullptr;
+  bool profilePm4 = false;
+  unsigned pm4ProfileInterval = 0; // ms, 0 prints profile on exit only
 };
 
 extern Config g_config;
@@ -1,6 +1,7 @@
 #include "Cache.hpp"
 #include "Device.hpp"
 #include "amdgpu/tiler.hpp"
+#include "amdgpu/tiler_cpu.hpp"
 #include "gnm/vulkan.hpp"
 #include "rx/Config.hpp"
 #include "rx/Rc.hpp"
@@ -10,8 +11,6 @@
 #include "shader/Evaluator.hpp"
 #include "shader/GcnConverter.hpp"
 #include "shader/dialect.hpp"
-#include "shader/glsl.hpp"
-#include "shader/spv.hpp"
 #include "vk.hpp"
 #include <cstddef>
 #include <cstring>
@@ -84,6 +83,13 @@ static void markHostInvalidated(Device *device, int vmId, std::uint64_t address,
   }
 }
 
+// guest memory consumed by the command processor, for pm4 replay
+static void captureMemory(Device *device, int vmId, rx::AddressRange range) {
+  if (device->pm4Capture.isEnabled()) {
+    device->pm4Capture.recordMemory(vmId, range);
+  }
+}
+
 static bool isPrimRequiresConversion(gnm::PrimitiveType primType) {
   switch (primType) {
   case gnm::PrimitiveType::PointList:
@@ -778,6 +784,7 @@ constexpr VkImageAspectFlags toAspect(ImageKind kind) {
 struct CachedImageBuffer : Cache::Entry {
   vk::Buffer buffer;
   GpuTiler *tiler;
+  bool cpuTiling = false; // buffer is host visible, tiled on the cpu
   TileMode tileMode{};
   gnm::DataFormat dfmt{};
   std::uint32_t pitch{};
@@ -837,6 +844,25 @@ struct CachedImageBuffer : Cache::Entry {
     auto subresource = getSubresource(range);
     auto &sched = tag->getScheduler();
 
+    if (!isLinear() && cpuTiling) {
+      // recorded commands may still use either buffer
+      sched.submit();
+      sched.wait();
+
+      std::span<const std::byte> tiled(tiledBuffer.data, range.size());
+      std::span<std::byte> linear(buffer.getData(), info.totalLinearSize);
+      auto tiledBaseOffset =
+          range.beginAddress() - addressRange.beginAddress();
+
+      for (unsigned mipLevel = subresource.baseMipLevel;
+           mipLevel < subresource.baseMipLevel + subresource.levelCount;
+           ++mipLevel) {
+        amdgpu::detile(info, tileMode, tiled, linear, mipLevel, 0,
+                       info.arrayLayerCount, tiledBaseOffset);
+      }
+      return;
+    }
+
     if (!isLinear()) {
       auto linearAddress = buffer.getAddress();
 
@@ -868,8 +894,33 @@ struct CachedImageBuffer : Cache::Entry {
                     buffer.getHandle(), regions.size(), regions.data());
   }
 
+  // tiledBuffer starts at the first tiled byte of the base mip level
   void write(Scheduler &scheduler, Cache::Buffer tiledBuffer,
+             std::uint64_t tiledSize,
              const VkImageSubresourceRange &subresourceRange) {
+    auto tiledBaseOffset =
+        info.getSubresourceInfo(subresourceRange.baseMipLevel).tiledOffset;
+
+    if (!isLinear() && cpuTiling) {
+      // wait for rendering to the linear buffer
+      scheduler.submit();
+      scheduler.wait();
+
+      std::span<const std::byte> linear(buffer.getData(),
+                                        info.totalLinearSize);
+      std::span<std::byte> tiled(tiledBuffer.data, tiledSize);
+
+      for (unsigned mipLevel = subresourceRange.baseMipLevel;
+           mipLevel <
+           subresourceRange.baseMipLevel + subresourceRange.levelCount;
+           ++mipLevel) {
+        amdgpu::tile(info, tileMode, linear, tiled, mipLevel, 0,
+                     info.arrayLayerCount, tiledBaseOffset);
+      }
+
+      return;
+    }
+
     if (!isLinear()) {
       for (unsigned mipLevel = 0; mipLevel < subresourceRange.levelCount;
            ++mipLevel) {
@@ -892,7 +943,8 @@ struct CachedImageBuffer : Cache::Entry {
 
       regions.push_back({
           .srcOffset = mipInfo.linearOffset,
-          .dstOffset = mipInfo.tiledOffset + tiledBuffer.offset,
+          .dstOffset =
+              mipInfo.tiledOffset - tiledBaseOffset + tiledBuffer.offset,
           .size = mipInfo.linearSize,
       });
     }
@@ -914,7 +966,7 @@ struct CachedImageBuffer : Cache::Entry {
     auto lastLevelInfo = info.getSubresourceInfo(
         subresourceRange.baseMipLevel + subresourceRange.levelCount - 1);
     auto totalTiledSubresourceSize =
-        lastLevelInfo.tiledOffset +
+        lastLevelInfo.tiledOffset - beginOffset +
         lastLevelInfo.tiledSize * subresourceRange.layerCount;
 
     auto targetRange = rx::AddressRange::fromBeginSize(
@@ -922,7 +974,7 @@ struct CachedImageBuffer : Cache::Entry {
 
     auto tiledBuffer = tag.getBuffer(targetRange, Access::Write);
 
-    write(scheduler, tiledBuffer, subresourceRange);
+    write(scheduler, tiledBuffer, targetRange.size(), subresourceRange);
     return true;
   }
 
@@ -1309,7 +1361,8 @@ SamplerKey SamplerKey::createFrom(const gnm::SSampler &sampler) {
 }
 
 Cache::Shader Cache::Tag::getShader(const ShaderKey &key,
-                                    const ShaderKey *dependedKey) {
+                                    const ShaderKey *dependedKey,
+                                    bool allowPending) {
   auto stage = shaderStageToVk(key.stage);
   if (auto result = findShader(key, dependedKey)) {
     auto cachedShader = static_cast<CachedShader *>(result.get());
@@ -1321,47 +1374,55 @@ Cache::Shader Cache::Tag::getShader(const ShaderKey &key,
     };
   }
 
-  auto vmId = mParent->mVmId;
+  auto device = mParent->mDevice;
+  auto &translator = device->shaderTranslator;
+  auto request = ShaderTranslator::makeRequest(mParent->mVmId, key.address,
+                                               key.stage, key.env);
+  auto &env = request.env;
 
-  std::optional<gcn::ConvertedShader> converted;
+  auto readGuestMemory = [this](void *target, rx::AddressRange range) {
+    readMemory(target, range);
+  };
 
-  {
-    auto env = key.env;
-    env.supportsBarycentric = vk::context->supportsBarycentric;
-    env.supportsInt8 = vk::context->supportsInt8;
-    env.supportsInt64Atomics = vk::context->supportsInt64Atomics;
-    env.supportsNonSemanticInfo = vk::context->supportsNonSemanticInfo;
-
-    gcn::Context context;
-    auto deserialized = gcn::deserialize(
-        context, env, mParent->mDevice->gcnSemantic, key.address,
-        [vmId](std::uint64_t address) -> std::uint32_t {
-          return *RemoteMemory{vmId}.getPointer<std::uint32_t>(address);
-        });
-
-    // deserialized.print(std::cerr, context.ns);
-
-    converted = gcn::convertToSpv(
-        context, deserialized, mParent->mDevice->gcnSemantic,
-        mParent->mDevice->gcnSemanticModuleInfo, key.stage, env);
-    if (!converted) {
+  auto persistentKey = ShaderCache::computeKey(key.address, key.stage, env);
+  auto converted =
+      device->shaderCache.find(persistentKey, env.userSgprs, readGuestMemory);
+
+  if (!converted &&
+      rx::g_config.shaderTranslationMode != rx::ShaderTranslationMode::Sync) {
+    auto status = translator.enqueue(persistentKey, request);
+
+    if (status == ShaderTranslator::Status::Pending && allowPending &&
+        rx::g_config.shaderTranslationMode ==
+            rx::ShaderTranslationMode::AsyncSkipDraw) {
+      return {.info = nullptr, .stage = stage, .pending = true};
+    }
+
+    if (status == ShaderTranslator::Status::Pending) {
+      status = translator.wait(persistentKey, request);
+    }
+
+    if (status == ShaderTranslator::Status::Failed) {
       return {};
     }
 
-    converted->info.resources.dump();
-    if (!shader::spv::validate(converted->spv)) {
-      shader::spv::dump(converted->spv, true);
+    converted =
+        device->shaderCache.find(persistentKey, env.userSgprs, readGuestMemory);
+
+    if (!converted) {
+      converted =
+          translator.takeResult(persistentKey, request, readGuestMemory);
+    }
+  }
+
+  if (!converted) {
+    // sync mode, or guest memory changed while shader was translated
+    converted = translator.translate(request);
+    if (!converted) {
       return {};
     }
 
-    rx::print(stderr, "{}", shader::glsl::decompile(converted->spv));
-    // if (auto opt = shader::spv::optimize(converted->spv)) {
-    //   converted->spv = std::move(*opt);
-    //   std::fprintf(stderr, "opt: %s",
-    //              shader::glsl::decompile(converted->spv).c_str());
-    // } else {
-    //   std::printf("optimization failed\n");
-    // }
+    device->shaderCache.store(persistentKey, *converted, readGuestMemory);
   }
 
   VkShaderCreateInfoEXT createInfo{
@@ -1535,6 +1596,8 @@ Cache::Buffer Cache::Tag::getBuffer(rx::AddressRange range, Access access) {
       cached->update(addressRange,
                      memory.getPointer(addressRange.beginAddress()));
     }
+
+    captureMemory(getDevice(), mParent->mVmId, range);
   }
 
   auto offset = range.beginAddress() - addressRange.beginAddress();
@@ -1843,8 +1906,11 @@ Cache::ImageBuffer Cache::Tag::getImageBuffer(const ImageBufferKey &key,
 
   if (it.get() == nullptr) {
     auto cached = std::make_shared<CachedImageBuffer>();
+    cached->cpuTiling = rx::g_config.cpuTiler;
     cached->buffer = vk::Buffer::Allocate(
-        vk::getDeviceLocalMemory(), surfaceInfo.totalLinearSize,
+        cached->cpuTiling ? vk::getHostVisibleMemory()
+                          : vk::getDeviceLocalMemory(),
+        surfaceInfo.totalLinearSize,
         VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
     cached->tiler = &getDevice()->tiler;
     cached->info = surfaceInfo;
@@ -2107,6 +2173,7 @@ Cache::ImageView Cache::Tag::getImageView(const ImageViewKey &key,
 
 void Cache::Tag::readMemory(void *target, rx::AddressRange range) {
   mParent->flush(*this, range);
+  captureMemory(getDevice(), mParent->mVmId, range);
   auto memoryPtr =
       RemoteMemory{mParent->mVmId}.getPointer(range.beginAddress());
   std::memcpy(target, memoryPtr, range.size());
@@ -2121,6 +2188,7 @@ void Cache::Tag::writeMemory(const void *source, rx::AddressRange range) {
 
 int Cache::Tag::compareMemory(const void *source, rx::AddressRange range) {
   mParent->flush(*this, range);
+  captureMemory(getDevice(), mParent->mVmId, range);
   auto memoryPtr =
       RemoteMemory{mParent->mVmId}.getPointer(range.beginAddress());
   return std::memcmp(memoryPtr, source, range.size());
@@ -2301,11 +2369,13 @@ Cache::Shader Cache::GraphicsTag::getShader(
       .userSgprs = std::span(pgm.userData.data(), pgm.rsrc2.userSgpr),
   };
 
-  auto shader = Tag::getShader({
-      .address = pgm.address << 8,
-      .stage = stage,
-      .env = env,
-  });
+  auto shader = Tag::getShader(
+      {
+          .address = pgm.address << 8,
+          .stage = stage,
+          .env = env,
+      },
+      nullptr, true);
 
   if (!shader.handle) {
     return shader;
@@ -12,6 +12,7 @@
 #include <memory>
 #include <rx/ConcurrentBitPool.hpp>
 #include <rx/MemoryTable.hpp>
+#include <rx/PoolAllocator.hpp>
 #include <shader/gcn.hpp>
 #include <utility>
 #include <vulkan/vulkan_core.h>
@@ -174,6 +175,7 @@ struct Cache {
     VkShaderEXT handle = VK_NULL_HANDLE;
     shader::gcn::ShaderInfo *info;
     VkShaderStageFlagBits stage;
+    bool pending = false;
   };
 
   struct Sampler {
@@ -244,8 +246,9 @@ private:
     Tag *cacheTag = nullptr;
 
     std::uint32_t slotOffset = 0;
-    rx::MemoryTableWithPayload<Access> bufferMemoryTable;
-    rx::MemoryTableWithPayload<std::pair<ImageBufferKey, Access>>
+    rx::MemoryTableWithPayload<Access, rx::PoolAllocator> bufferMemoryTable;
+    rx::MemoryTableWithPayload<std::pair<ImageBufferKey, Access>,
+                               rx::PoolAllocator>
         imageMemoryTable;
     std::vector<std::pair<std::uint32_t, std::uint64_t>> resourceSlotToAddress;
     std::vector<Cache::Sampler> samplerResources;
@@ -343,7 +346,8 @@ public:
     }
 
     Shader getShader(const ShaderKey &key,
-                     const ShaderKey *dependedKey = nullptr);
+                     const ShaderKey *dependedKey = nullptr,
+                     bool allowPending = false);
 
     TagId getReadId() const { return TagId{std::uint64_t(mTagId) - 1}; }
     TagId getWriteId() const { return mTagId; }
@@ -620,8 +624,8 @@ private:
   std::shared_ptr<Entry> mFrameBuffers[10];
   std::mutex mResourcesMtx;
 
-  rx::MemoryTableWithPayload<std::shared_ptr<Entry>>
+  rx::MemoryTableWithPayload<std::shared_ptr<Entry>, rx::PoolAllocator>
       mTables[static_cast<std::size_t>(EntryType::Count)];
-  rx::MemoryTableWithPayload<TagId> mSyncTable;
+  rx::MemoryTableWithPayload<TagId, rx::PoolAllocator> mSyncTable;
 };
 } // namespace amdgpu
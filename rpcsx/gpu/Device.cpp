@@ -18,7 +18,9 @@
 #include "shader/spv.hpp"
 #include "shaders/rdna-semantic-spirv.hpp"
 #include "vk.hpp"
+#include <algorithm>
 #include <chrono>
+#include <csignal>
 #include <cstdio>
 #include <fcntl.h>
 #include <stop_token>
@@ -61,19 +63,19 @@ makeDisplayEvent(DisplayEvent id, std::uint16_t unk0 = 0,
   return result;
 }
 
-static vk::Context createVkContext(Device *device) {
-  std::vector<const char *> optionalLayers;
-  bool enableValidation = rx::g_config.validateGpu;
-
-  for (std::size_t process = 0; process < 6; ++process) {
-    if (!rx::mem::reserve(
-            reinterpret_cast<void *>(orbis::kMinAddress +
-                                     orbis::kMaxAddress * process),
-            orbis::kMaxAddress - orbis::kMinAddress)) {
-      rx::die("failed to reserve userspace memory");
-    }
-  }
+static void emitFlipEvent(std::uint64_t arg) {
+  orbis::g_context->deviceEventEmitter->emit(
+      orbis::kEvFiltDisplay,
+      [=](orbis::KNote *note) -> std::optional<orbis::intptr_t> {
+        if (DisplayEvent(note->event.ident >> 48) == DisplayEvent::Flip) {
+          return arg;
+        }
+        return {};
+      });
+}
 
+// returns instance extensions required by window surface
+static std::vector<const char *> createHiddenWindow(Device *device) {
   auto createWindow = [=] {
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
     device->window = glfwCreateWindow(1920, 1080, "RPCSX", nullptr, nullptr);
@@ -186,8 +188,27 @@ static vk::Context createVkContext(Device *device) {
   const char **glfwExtensions;
   uint32_t glfwExtensionCount = 0;
   glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-  std::vector<const char *> requiredExtensions{
-      glfwExtensions, glfwExtensions + glfwExtensionCount};
+  return {glfwExtensions, glfwExtensions + glfwExtensionCount};
+}
+
+static vk::Context createVkContext(Device *device) {
+  std::vector<const char *> optionalLayers;
+  bool enableValidation = rx::g_config.validateGpu;
+
+  for (std::size_t process = 0; process < 6; ++process) {
+    if (!rx::mem::reserve(
+            reinterpret_cast<void *>(orbis::kMinAddress +
+                                     orbis::kMaxAddress * process),
+            orbis::kMaxAddress - orbis::kMinAddress)) {
+      rx::die("failed to reserve userspace memory");
+    }
+  }
+
+  std::vector<const char *> requiredExtensions;
+  if (!rx::g_config.headlessGpu) {
+    requiredExtensions = createHiddenWindow(device);
+  }
+
   if (enableValidation) {
     optionalLayers.push_back("VK_LAYER_KHRONOS_validation");
     requiredExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -217,8 +238,10 @@ static vk::Context createVkContext(Device *device) {
         &device->debugMessenger));
   }
 
-  glfwCreateWindowSurface(vk::context->instance, device->window, nullptr,
-                          &device->surface);
+  if (device->window != nullptr) {
+    glfwCreateWindowSurface(vk::context->instance, device->window, nullptr,
+                            &device->surface);
+  }
 
   result.createDevice(device->surface, rx::g_config.gpuIndex,
                       {
@@ -289,6 +312,34 @@ Device::Device() : vkContext(createVkContext(this)) {
     rx::die("failed to deserialize builtin semantics\n");
   }
 
+  if (!rx::g_config.disableShaderCache) {
+    shaderCache.open(rx::g_config.shaderCachePath);
+  }
+
+  if (rx::g_config.shaderDumpPath != nullptr) {
+    shaderDumper.open(rx::g_config.shaderDumpPath,
+                      rx::g_config.shaderDumpStages);
+  }
+
+  if (rx::g_config.pm4CapturePath != nullptr) {
+    pm4Capture.open(rx::g_config.pm4CapturePath);
+  }
+
+  // SIGRTMIN is used by syscall stats
+  pm4Profiler.setEnabled(rx::g_config.profilePm4);
+  pm4Profiler.enableSignalToggle(SIGRTMIN + 1);
+  pm4Profiler.startDumps(
+      std::chrono::milliseconds(rx::g_config.pm4ProfileInterval));
+
+  if (rx::g_config.shaderTranslationMode != rx::ShaderTranslationMode::Sync) {
+    std::size_t workerCount = rx::g_config.shaderTranslationThreads;
+    if (workerCount == 0) {
+      workerCount = std::max(std::thread::hardware_concurrency() / 2, 1u);
+    }
+
+    shaderTranslator.start(workerCount);
+  }
+
   for (auto &pipe : graphicsPipes) {
     pipe.device = this;
   }
@@ -310,35 +361,7 @@ Device::Device() : vkContext(createVkContext(this)) {
       prevIdleValue = gpuCacheCommandIdle.load(std::memory_order::acquire);
 
       for (int vmId = 0; vmId < kMaxProcessCount; ++vmId) {
-        auto page = gpuCacheCommand[vmId].load(std::memory_order::relaxed);
-        if (page == 0) {
-          continue;
-        }
-
-        gpuCacheCommand[vmId].store(0, std::memory_order::relaxed);
-        auto address = static_cast<std::uint64_t>(page) * rx::mem::pageSize;
-
-        auto range =
-            rx::AddressRange::fromBeginSize(address, rx::mem::pageSize);
-        auto tag = getCacheTag(vmId, sched);
-
-        auto flushedRange = tag.getCache()->flushImages(tag, range);
-        flushedRange =
-            flushedRange.merge(tag.getCache()->flushImageBuffers(tag, range));
-
-        if (flushedRange) {
-          sched.submit();
-          sched.wait();
-        }
-
-        flushedRange = tag.getCache()->flushBuffers(flushedRange);
-
-        if (flushedRange) {
-          unlockReadWrite(vmId, flushedRange.beginAddress(),
-                          flushedRange.size());
-        } else {
-          unlockReadWrite(vmId, range.beginAddress(), range.size());
-        }
+        processGpuCacheCommands(vmId, sched);
       }
     }
   });
@@ -370,6 +393,11 @@ Device::Device() : vkContext(createVkContext(this)) {
 Device::~Device() {
   vkDeviceWaitIdle(vk::context->device);
 
+  pm4Profiler.stopDumps();
+  if (pm4Profiler.isEnabled()) {
+    Pm4Profiler::print(pm4Profiler.getStats());
+  }
+
   if (debugMessenger != VK_NULL_HANDLE) {
     vk::DestroyDebugUtilsMessengerEXT(vk::context->instance, debugMessenger,
                                       vk::context->allocator);
@@ -723,6 +751,10 @@ void Device::submitGfxCommand(int gfxPipe,
 }
 
 void Device::mapProcess(std::uint32_t pid, int vmId) {
+  if (pm4Capture.isEnabled()) {
+    pm4Capture.recordMapProcess(pid, vmId);
+  }
+
   auto &process = processInfo[pid];
   process.vmId = vmId;
 
@@ -771,6 +803,10 @@ void Device::mapProcess(std::uint32_t pid, int vmId) {
 }
 
 void Device::unmapProcess(std::uint32_t pid) {
+  if (pm4Capture.isEnabled()) {
+    pm4Capture.recordUnmapProcess(pid);
+  }
+
   auto &process = processInfo[pid];
   auto startAddress = static_cast<std::uint64_t>(process.vmId) << 40;
   auto size = static_cast<std::uint64_t>(1) << 40;
@@ -787,6 +823,10 @@ void Device::unmapProcess(std::uint32_t pid) {
 
 void Device::protectMemory(std::uint32_t pid, std::uint64_t address,
                            std::uint64_t size, int prot) {
+  if (pm4Capture.isEnabled()) {
+    pm4Capture.recordProtectMemory(pid, address, size, prot);
+  }
+
   auto &process = processInfo[pid];
 
   auto vmSlotIt = process.vmTable.queryArea(address);
@@ -1065,6 +1105,25 @@ bool Device::flip(std::uint32_t pid, int bufferIndex, std::uint64_t arg,
 }
 
 void Device::flip(std::uint32_t pid, int bufferIndex, std::uint64_t arg) {
+  if (pm4Capture.isEnabled()) {
+    pm4Capture.recordFlip(pid, bufferIndex, arg);
+  }
+
+  if (window == nullptr) {
+    // headless device has no swapchain, flip completes without reading the
+    // display buffer
+    auto &process = processInfo[pid];
+    if (process.vmId >= 0) {
+      graphicsPipes[0].scheduler.wait();
+      flipBuffer[process.vmId] = bufferIndex;
+      flipArg[process.vmId] = arg;
+      flipCount[process.vmId] = flipCount[process.vmId] + 1;
+    }
+
+    emitFlipEvent(arg);
+    return;
+  }
+
   auto recreateSwapchain = [this] {
     int width;
     int height;
@@ -1097,14 +1156,7 @@ void Device::flip(std::uint32_t pid, int bufferIndex, std::uint64_t arg) {
       flip(pid, bufferIndex, arg, vk::context->swapchainImages[imageIndex],
            vk::context->swapchainImageViews[imageIndex]);
 
-  orbis::g_context->deviceEventEmitter->emit(
-      orbis::kEvFiltDisplay,
-      [=](orbis::KNote *note) -> std::optional<orbis::intptr_t> {
-        if (DisplayEvent(note->event.ident >> 48) == DisplayEvent::Flip) {
-          return arg;
-        }
-        return {};
-      });
+  emitFlipEvent(arg);
 
   if (!flipComplete) {
     isImageAcquired = true;
@@ -1164,6 +1216,11 @@ void Device::waitForIdle() {
 void Device::mapMemory(std::uint32_t pid, std::uint64_t address,
                        std::uint64_t size, int memoryType, int dmemIndex,
                        int prot, std::int64_t offset) {
+  if (pm4Capture.isEnabled()) {
+    pm4Capture.recordMapMemory(pid, address, size, memoryType, dmemIndex, prot,
+                               offset);
+  }
+
   auto &process = processInfo[pid];
 
   process.vmTable.map(address, address + size,
@@ -1206,6 +1263,10 @@ void Device::mapMemory(std::uint32_t pid, std::uint64_t address,
 
 void Device::unmapMemory(std::uint32_t pid, std::uint64_t address,
                          std::uint64_t size) {
+  if (pm4Capture.isEnabled()) {
+    pm4Capture.recordUnmapMemory(pid, address, size);
+  }
+
   // TODO
   protectMemory(pid, address, size, 0);
 }
@@ -1279,3 +1340,70 @@ void Device::unlockReadWrite(int vmId, std::uint64_t address,
   modifyWatchFlags(this, vmId, address, size, kPageWriteWatch,
                    kPageReadWriteLock | kPageLazyLock);
 }
+
+void Device::processGpuCacheCommands(int vmId, Scheduler &sched) {
+  std::uint32_t pages[kGpuCacheQueueSize];
+  std::size_t pageCount = 0;
+
+  for (auto &slot : gpuCacheCommands[vmId]) {
+    if (slot.load(std::memory_order::relaxed) == 0) {
+      continue;
+    }
+
+    if (auto page = slot.exchange(0, std::memory_order::acquire)) {
+      pages[pageCount++] = page;
+    }
+  }
+
+  if (pageCount == 0) {
+    return;
+  }
+
+  std::sort(pages, pages + pageCount);
+
+  struct FlushRange {
+    rx::AddressRange range;
+    rx::AddressRange flushedRange;
+  };
+
+  FlushRange ranges[kGpuCacheQueueSize];
+  std::size_t rangeCount = 0;
+
+  for (std::size_t i = 0; i < pageCount;) {
+    auto first = pages[i];
+    auto last = first;
+
+    while (++i < pageCount && pages[i] <= last + 1) {
+      last = pages[i];
+    }
+
+    ranges[rangeCount++].range = rx::AddressRange::fromBeginEnd(
+        static_cast<std::uint64_t>(first) * rx::mem::pageSize,
+        static_cast<std::uint64_t>(last + 1) * rx::mem::pageSize);
+  }
+
+  auto tag = getCacheTag(vmId, sched);
+  bool hasFlushedImages = false;
+
+  for (auto &range : std::span(ranges, rangeCount)) {
+    range.flushedRange = tag.getCache()->flushImages(tag, range.range);
+    range.flushedRange = range.flushedRange.merge(
+        tag.getCache()->flushImageBuffers(tag, range.range));
+    hasFlushedImages |= static_cast<bool>(range.flushedRange);
+  }
+
+  if (hasFlushedImages) {
+    sched.submit();
+    sched.wait();
+  }
+
+  for (auto &range : std::span(ranges, rangeCount)) {
+    auto flushedRange = tag.getCache()->flushBuffers(range.flushedRange);
+
+    if (flushedRange) {
+      unlockReadWrite(vmId, flushedRange.beginAddress(), flushedRange.size());
+    } else {
+      unlockReadWrite(vmId, range.range.beginAddress(), range.range.size());
+    }
+  }
+}
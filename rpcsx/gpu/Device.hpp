@@ -3,9 +3,15 @@
 #include "DeviceContext.hpp"
 #include "FlipPipeline.hpp"
 #include "Pipe.hpp"
+#include "Pm4Capture.hpp"
+#include "Pm4Profiler.hpp"
+#include "ShaderCache.hpp"
+#include "ShaderDumper.hpp"
+#include "ShaderTranslator.hpp"
 #include "amdgpu/tiler_vulkan.hpp"
 #include "orbis/KernelAllocator.hpp"
 #include "rx/MemoryTable.hpp"
+#include "rx/PoolAllocator.hpp"
 #include "rx/Rc.hpp"
 #include "rx/SharedMutex.hpp"
 #include "shader/SemanticInfo.hpp"
@@ -50,7 +56,7 @@ struct ProcessInfo {
   int vmFd = -1;
   BufferAttribute bufferAttributes[10];
   Buffer buffers[10];
-  rx::MemoryTableWithPayload<VmMapSlot> vmTable;
+  rx::MemoryTableWithPayload<VmMapSlot, rx::PoolAllocator> vmTable;
 };
 
 struct RemoteMemory {
@@ -70,6 +76,12 @@ struct Device : rx::RcBase, DeviceContext {
   shader::SemanticInfo gcnSemantic;
   shader::spv::Context shaderSemanticContext;
   shader::gcn::SemanticModuleInfo gcnSemanticModuleInfo;
+  ShaderCache shaderCache;
+  ShaderDumper shaderDumper;
+  ShaderTranslator shaderTranslator{gcnSemantic, gcnSemanticModuleInfo,
+                                    shaderCache, shaderDumper};
+  Pm4Capture pm4Capture;
+  Pm4Profiler pm4Profiler;
   Registers::Config config;
   GLFWwindow *window = nullptr;
   VkSurfaceKHR surface = VK_NULL_HANDLE;
@@ -137,5 +149,9 @@ struct Device : rx::RcBase, DeviceContext {
   void lockReadWrite(int vmId, std::uint64_t address, std::uint64_t size,
                      bool isLazy);
   void unlockReadWrite(int vmId, std::uint64_t address, std::uint64_t size);
+
+  /// Flushes gpu caches of all pages queued by cpu faults, adjacent pages
+  /// are coalesced and flushed with a single scheduler submit.
+  void processGpuCacheCommands(int vmId, Scheduler &sched);
 };
 } // namespace amdgpu
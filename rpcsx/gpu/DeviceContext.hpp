@@ -2,6 +2,7 @@
 
 #include "rx/SharedAtomic.hpp"
 #include <atomic>
+#include <cstddef>
 #include <cstdint>
 
 namespace amdgpu {
@@ -66,11 +67,14 @@ enum {
 
 struct DeviceContext {
   static constexpr auto kMaxProcessCount = 6;
+  static constexpr auto kGpuCacheQueueSize = 64;
 
   PadState kbPadState{};
   std::atomic<std::uint64_t> cpuCacheCommands[kMaxProcessCount][4]{};
   rx::shared_atomic32 cpuCacheCommandsIdle[kMaxProcessCount]{};
-  rx::shared_atomic32 gpuCacheCommand[kMaxProcessCount]{};
+
+  // pages faulted by cpu that wait for gpu cache flush, 0 is empty slot
+  rx::shared_atomic32 gpuCacheCommands[kMaxProcessCount][kGpuCacheQueueSize]{};
   rx::shared_atomic32 gpuCacheCommandIdle{};
   std::atomic<std::uint8_t> *cachePages[kMaxProcessCount]{};
 
@@ -78,5 +82,23 @@ struct DeviceContext {
   volatile std::uint64_t flipArg[kMaxProcessCount];
   volatile std::uint64_t flipCount[kMaxProcessCount];
   volatile std::uint64_t bufferInUseAddress[kMaxProcessCount];
+
+  /// Queues page for gpu cache flush. Lock-free, safe to call from signal
+  /// handler. Returns false if queue is full.
+  bool pushGpuCacheCommand(int vmId, std::uint32_t page) {
+    auto &queue = gpuCacheCommands[vmId];
+
+    // start from page dependent slot to spread concurrent faults
+    for (std::size_t i = 0; i < kGpuCacheQueueSize; ++i) {
+      auto &slot = queue[(page + i) % kGpuCacheQueueSize];
+      std::uint32_t empty = 0;
+      if (slot.compare_exchange_strong(empty, page,
+                                       std::memory_order::relaxed)) {
+        return true;
+      }
+    }
+
+    return false;
+  }
 };
 } // namespace amdgpu
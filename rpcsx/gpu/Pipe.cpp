@@ -5,11 +5,15 @@
 #include "gnm/mmio.hpp"
 #include "gnm/pm4.hpp"
 #include "orbis/KernelContext.hpp"
+#include "rx/Config.hpp"
 #include "rx/print.hpp"
+#include "rx/tsc.hpp"
 #include "vk.hpp"
 #include <bit>
 #include <cstdio>
+#include <cstring>
 #include <mutex>
+#include <vector>
 #include <rx/bits.hpp>
 #include <rx/die.hpp>
 #include <rx/format.hpp>
@@ -63,6 +67,39 @@ static Scheduler createComputeScheduler(int index) {
   return Scheduler{queue, family};
 }
 
+// true if registers write touches address or resources of the shader program
+template <typename T>
+static bool isShaderProgramWrite(const std::uint32_t *regs, std::uint32_t count,
+                                 const T &pgm) {
+  auto pgmBegin = reinterpret_cast<const std::byte *>(&pgm.address);
+  auto pgmEnd = reinterpret_cast<const std::byte *>(&pgm.rsrc2 + 1);
+  auto writeBegin = reinterpret_cast<const std::byte *>(regs);
+  auto writeEnd = reinterpret_cast<const std::byte *>(regs + count);
+  return writeBegin < pgmEnd && pgmBegin < writeEnd;
+}
+
+// records packet at read pointer after its handler accepted it, packets that
+// are waiting for a condition are recorded once
+static void capturePacket(Device *device, gnm::capture::Queue queue, int pipe,
+                          int queueId, const Ring &ring, std::uint32_t len) {
+  auto packet = const_cast<const std::uint32_t *>(ring.rptr);
+  auto tailLen = ring.size - (ring.rptr - ring.base);
+
+  if (len <= tailLen) {
+    device->pm4Capture.recordPacket(queue, pipe, queueId, ring.vmId,
+                                    ring.indirectLevel, std::span(packet, len));
+    return;
+  }
+
+  // packet wraps around ring end, continues at ring base
+  std::vector<std::uint32_t> words(len);
+  std::memcpy(words.data(), packet, tailLen * sizeof(std::uint32_t));
+  std::memcpy(words.data() + tailLen, ring.base,
+              (len - tailLen) * sizeof(std::uint32_t));
+  device->pm4Capture.recordPacket(queue, pipe, queueId, ring.vmId,
+                                  ring.indirectLevel, words);
+}
+
 static bool compare(int cmpFn, std::uint32_t poll, std::uint32_t mask,
                     std::uint32_t ref) {
   poll &= mask;
@@ -135,6 +172,7 @@ bool ComputePipe::processRing(Ring &ring) {
     }
 
     auto origRptr = ring.rptr;
+    bool profile = device->pm4Profiler.isEnabled();
 
     while (ring.rptr != ring.wptr) {
       if (ring.rptr >= ring.base + ring.size) {
@@ -157,13 +195,26 @@ bool ComputePipe::processRing(Ring &ring) {
         }
 
         auto handler = commandHandlers[op];
-        if (!(this->*handler)(ring)) {
+        auto profileStart = profile ? rx::get_tsc() : 0;
+        bool consumed = (this->*handler)(ring);
+
+        if (profile) {
+          device->pm4Profiler.record(Pm4Profiler::Queue::Compute, op,
+                                     rx::get_tsc() - profileStart, consumed);
+        }
+
+        if (!consumed) {
           if (ring.rptrReportLocation != nullptr) {
             *ring.rptrReportLocation = ring.rptr - ring.base;
           }
           return false;
         }
 
+        if (device->pm4Capture.isEnabled()) {
+          capturePacket(device, gnm::capture::Queue::Compute, index,
+                        currentQueueId, ring, len);
+        }
+
         ring.rptr += len;
         continue;
       }
@@ -270,6 +321,14 @@ bool ComputePipe::setShReg(Ring &ring) {
   std::memcpy(ring.doorbell + offset, const_cast<const uint32_t *>(data),
               sizeof(std::uint32_t) * len);
 
+  if (rx::g_config.shaderTranslationMode != rx::ShaderTranslationMode::Sync) {
+    auto &config = *std::bit_cast<Registers::ComputeConfig *>(ring.doorbell);
+
+    if (isShaderProgramWrite(ring.doorbell + offset, len, config)) {
+      device->shaderTranslator.pretranslate(ring.vmId, config);
+    }
+  }
+
   return true;
 }
 
@@ -601,7 +660,8 @@ std::uint32_t *ComputePipe::getMmRegister(Ring &ring, std::uint32_t dwAddress) {
           dwAddress, gnm::mmio::registerName(dwAddress));
 }
 
-GraphicsPipe::GraphicsPipe(int index) : scheduler(createGfxScheduler(index)) {
+GraphicsPipe::GraphicsPipe(int index)
+    : scheduler(createGfxScheduler(index)), index(index) {
   for (auto &processorHandlers : commandHandlers) {
     for (auto &handler : processorHandlers) {
       handler = &GraphicsPipe::unknownPacket;
@@ -821,6 +881,8 @@ void GraphicsPipe::processRing(Ring &ring) {
     }
   }
 
+  bool profile = device->pm4Profiler.isEnabled();
+
   while (ring.rptr != ring.wptr) {
     if (ring.rptr >= ring.base + ring.size) {
       ring.rptr = ring.base;
@@ -844,9 +906,22 @@ void GraphicsPipe::processRing(Ring &ring) {
         std::println("unimplemented COND_EXEC");
       } else {
         auto handler = commandHandlers[cp][op];
-        if (!(this->*handler)(ring)) {
+        auto profileStart = profile ? rx::get_tsc() : 0;
+        bool consumed = (this->*handler)(ring);
+
+        if (profile) {
+          device->pm4Profiler.record(Pm4Profiler::Queue::Graphics, op,
+                                     rx::get_tsc() - profileStart, consumed);
+        }
+
+        if (!consumed) {
           return;
         }
+
+        if (device->pm4Capture.isEnabled()) {
+          capturePacket(device, gnm::capture::Queue::Graphics, index, 0,
+                        ring, len);
+        }
       }
 
       ring.rptr +=
@@ -1765,6 +1840,25 @@ bool GraphicsPipe::setShReg(Ring &ring) {
 
   std::memcpy(reinterpret_cast<std::uint32_t *>(&sh) + offset,
               const_cast<std::uint32_t *>(data), sizeof(std::uint32_t) * len);
+
+  if (rx::g_config.shaderTranslationMode != rx::ShaderTranslationMode::Sync) {
+    auto regs = reinterpret_cast<std::uint32_t *>(&sh) + offset;
+    auto &translator = device->shaderTranslator;
+
+    if (isShaderProgramWrite(regs, len, sh.spiShaderPgmPs)) {
+      translator.pretranslate(ring.vmId, shader::gcn::Stage::Ps, sh.spiShaderPgmPs);
+    }
+
+    if (context.vgtShaderStagesEn.vsEn == amdgpu::VsStage::VsReal &&
+        isShaderProgramWrite(regs, len, sh.spiShaderPgmVs)) {
+      translator.pretranslate(ring.vmId, shader::gcn::Stage::VsVs, sh.spiShaderPgmVs);
+    }
+
+    if (isShaderProgramWrite(regs, len, sh.compute)) {
+      translator.pretranslate(ring.vmId, sh.compute);
+    }
+  }
+
   // for (std::size_t i = 0; i < len; ++i) {
   //   std::fprintf(
   //       stderr, "writing to %s value %x\n",
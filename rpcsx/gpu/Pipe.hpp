@@ -115,6 +115,7 @@ struct GraphicsPipe {
 
   using CommandHandler = bool (GraphicsPipe::*)(Ring &);
   CommandHandler commandHandlers[4][255];
+  int index;
 
   GraphicsPipe(int index);
 
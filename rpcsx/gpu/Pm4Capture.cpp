@@ -0,0 +1,216 @@
+#include "Pm4Capture.hpp"
+#include "Device.hpp"
+#include "rx/print.hpp"
+#include <algorithm>
+#include <cstring>
+
+using namespace amdgpu;
+using namespace gnm::capture;
+
+namespace {
+std::uint64_t hashMemory(const std::byte *data, std::size_t size) {
+  std::uint64_t hash = 0xcbf2'9ce4'8422'2325;
+
+  // word at a time, capture hashes every referenced buffer and image
+  for (; size >= sizeof(std::uint64_t); size -= sizeof(std::uint64_t)) {
+    std::uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    data += sizeof(word);
+    hash ^= word;
+    hash *= 0x100'0000'01b3;
+  }
+
+  for (; size > 0; --size) {
+    hash ^= static_cast<std::uint8_t>(*data++);
+    hash *= 0x100'0000'01b3;
+  }
+
+  return hash;
+}
+} // namespace
+
+bool Pm4Capture::open(const std::filesystem::path &path) {
+  close();
+
+  auto file = std::fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    rx::println(stderr, "pm4 capture: failed to create {}", path.string());
+    return false;
+  }
+
+  std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+  FileHeader header{
+      .magic = kFileMagic,
+      .formatVersion = kFileFormatVersion,
+  };
+
+  if (std::fwrite(&header, sizeof(header), 1, file) != 1) {
+    rx::println(stderr, "pm4 capture: failed to write {}", path.string());
+    std::fclose(file);
+    return false;
+  }
+
+  std::lock_guard lock(mMtx);
+  mFile = file;
+  mEnabled.store(true, std::memory_order::relaxed);
+  rx::println(stderr, "pm4 capture: recording to {}", path.string());
+  return true;
+}
+
+void Pm4Capture::close() {
+  std::lock_guard lock(mMtx);
+  mEnabled.store(false, std::memory_order::relaxed);
+
+  if (mFile == nullptr) {
+    return;
+  }
+
+  std::fclose(mFile);
+  mFile = nullptr;
+  mMemoryHashes.clear();
+
+  rx::println(stderr, "pm4 capture: {} packets, {} bytes of memory",
+              mPacketCount, mMemoryBytes);
+}
+
+void Pm4Capture::writeRecord(RecordType type, const void *record,
+                             std::size_t recordSize,
+                             std::span<const std::byte> tail) {
+  // caller holds mMtx
+  if (mFile == nullptr) {
+    return;
+  }
+
+  RecordHeader header{
+      .type = type,
+      .size = static_cast<std::uint32_t>(recordSize + tail.size()),
+  };
+
+  bool ok = std::fwrite(&header, sizeof(header), 1, mFile) == 1 &&
+            std::fwrite(record, recordSize, 1, mFile) == 1 &&
+            (tail.empty() ||
+             std::fwrite(tail.data(), tail.size(), 1, mFile) == 1);
+
+  if (!ok) {
+    rx::println(stderr, "pm4 capture: write failed, stopping capture");
+    mEnabled.store(false, std::memory_order::relaxed);
+    std::fclose(mFile);
+    mFile = nullptr;
+  }
+}
+
+void Pm4Capture::recordPacket(Queue queue, int pipe, int queueId, int vmId,
+                              int indirectLevel,
+                              std::span<const std::uint32_t> packet) {
+  PacketRecord record{
+      .queue = queue,
+      .pipe = static_cast<std::uint32_t>(pipe),
+      .vmId = vmId,
+      .indirectLevel = indirectLevel,
+      .queueId = static_cast<std::uint32_t>(queueId),
+  };
+
+  std::lock_guard lock(mMtx);
+  write(RecordType::Packet, record, std::as_bytes(packet));
+  ++mPacketCount;
+}
+
+void Pm4Capture::recordMemory(int vmId, rx::AddressRange range) {
+  if (!range || vmId < 0) {
+    return;
+  }
+
+  auto data = RemoteMemory{vmId}.getPointer<const std::byte>(
+      range.beginAddress());
+  if (data == nullptr) {
+    return;
+  }
+
+  std::lock_guard lock(mMtx);
+
+  // single record is limited by 32 bit size of record header
+  constexpr std::uint64_t kMaxChunkSize = 1ull << 30;
+
+  for (auto address = range.beginAddress(); address < range.endAddress();
+       address += kMaxChunkSize) {
+    auto size = std::min(range.endAddress() - address, kMaxChunkSize);
+    auto chunk = std::span(data + (address - range.beginAddress()), size);
+    auto hash = hashMemory(chunk.data(), chunk.size());
+
+    auto [it, inserted] =
+        mMemoryHashes.try_emplace({vmId, address, size}, hash);
+    if (!inserted) {
+      if (it->second == hash) {
+        continue;
+      }
+
+      it->second = hash;
+    }
+
+    MemoryRecord record{
+        .vmId = vmId,
+        .address = address,
+    };
+
+    write(RecordType::Memory, record, chunk);
+    mMemoryBytes += size;
+  }
+}
+
+void Pm4Capture::recordMapProcess(std::uint32_t pid, int vmId) {
+  std::lock_guard lock(mMtx);
+  write(RecordType::MapProcess, MapProcessRecord{.pid = pid, .vmId = vmId});
+}
+
+void Pm4Capture::recordUnmapProcess(std::uint32_t pid) {
+  std::lock_guard lock(mMtx);
+  write(RecordType::UnmapProcess, UnmapProcessRecord{.pid = pid});
+}
+
+void Pm4Capture::recordMapMemory(std::uint32_t pid, std::uint64_t address,
+                                 std::uint64_t size, int memoryType,
+                                 int dmemIndex, int prot,
+                                 std::int64_t offset) {
+  std::lock_guard lock(mMtx);
+  write(RecordType::MapMemory, MapMemoryRecord{
+                                   .pid = pid,
+                                   .memoryType = memoryType,
+                                   .dmemIndex = dmemIndex,
+                                   .prot = prot,
+                                   .address = address,
+                                   .size = size,
+                                   .offset = offset,
+                               });
+}
+
+void Pm4Capture::recordUnmapMemory(std::uint32_t pid, std::uint64_t address,
+                                   std::uint64_t size) {
+  std::lock_guard lock(mMtx);
+  write(RecordType::UnmapMemory, UnmapMemoryRecord{
+                                     .pid = pid,
+                                     .address = address,
+                                     .size = size,
+                                 });
+}
+
+void Pm4Capture::recordProtectMemory(std::uint32_t pid, std::uint64_t address,
+                                     std::uint64_t size, int prot) {
+  std::lock_guard lock(mMtx);
+  write(RecordType::ProtectMemory, ProtectMemoryRecord{
+                                       .pid = pid,
+                                       .prot = prot,
+                                       .address = address,
+                                       .size = size,
+                                   });
+}
+
+void Pm4Capture::recordFlip(std::uint32_t pid, int bufferIndex,
+                            std::uint64_t arg) {
+  std::lock_guard lock(mMtx);
+  write(RecordType::Flip, FlipRecord{
+                              .pid = pid,
+                              .bufferIndex = bufferIndex,
+                              .arg = arg,
+                          });
+}
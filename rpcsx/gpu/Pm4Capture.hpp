@@ -0,0 +1,70 @@
+#pragma once
+
+#include "gnm/capture.hpp"
+#include "rx/AddressRange.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <span>
+#include <tuple>
+
+namespace amdgpu {
+///
+/// \brief Records PM4 command stream for headless replay.
+///
+/// Captures every packet consumed by graphics and compute pipes, memory map
+/// events and guest memory read by the cache. Memory range is written again
+/// only when its contents changed since the previous record, so the file
+/// stays proportional to the amount of modified data. Replay with
+/// `pm4-replay`.
+///
+class Pm4Capture {
+public:
+  Pm4Capture() = default;
+  Pm4Capture(const Pm4Capture &) = delete;
+  Pm4Capture &operator=(const Pm4Capture &) = delete;
+  ~Pm4Capture() { close(); }
+
+  bool open(const std::filesystem::path &path);
+  void close();
+
+  [[nodiscard]] bool isEnabled() const {
+    return mEnabled.load(std::memory_order::relaxed);
+  }
+
+  void recordPacket(gnm::capture::Queue queue, int pipe, int queueId, int vmId,
+                    int indirectLevel, std::span<const std::uint32_t> packet);
+  void recordMemory(int vmId, rx::AddressRange range);
+  void recordMapProcess(std::uint32_t pid, int vmId);
+  void recordUnmapProcess(std::uint32_t pid);
+  void recordMapMemory(std::uint32_t pid, std::uint64_t address,
+                       std::uint64_t size, int memoryType, int dmemIndex,
+                       int prot, std::int64_t offset);
+  void recordUnmapMemory(std::uint32_t pid, std::uint64_t address,
+                         std::uint64_t size);
+  void recordProtectMemory(std::uint32_t pid, std::uint64_t address,
+                           std::uint64_t size, int prot);
+  void recordFlip(std::uint32_t pid, int bufferIndex, std::uint64_t arg);
+
+private:
+  template <typename T>
+  void write(gnm::capture::RecordType type, const T &record,
+             std::span<const std::byte> tail = {}) {
+    writeRecord(type, &record, sizeof(record), tail);
+  }
+
+  void writeRecord(gnm::capture::RecordType type, const void *record,
+                   std::size_t recordSize, std::span<const std::byte> tail);
+
+  std::mutex mMtx;
+  std::FILE *mFile = nullptr;
+  std::atomic<bool> mEnabled{false};
+  std::map<std::tuple<int, std::uint64_t, std::uint64_t>, std::uint64_t>
+      mMemoryHashes;
+  std::uint64_t mPacketCount = 0;
+  std::uint64_t mMemoryBytes = 0;
+};
+} // namespace amdgpu
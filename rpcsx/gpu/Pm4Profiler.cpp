@@ -0,0 +1,194 @@
+#include "Pm4Profiler.hpp"
+#include "gnm/pm4.hpp"
+#include "rx/print.hpp"
+#include <algorithm>
+#include <csignal>
+#include <string_view>
+#include <vector>
+
+using namespace amdgpu;
+
+namespace {
+// dumps thread polls for runtime toggles at least this often
+constexpr auto kPollInterval = std::chrono::milliseconds(100);
+
+std::atomic<Pm4Profiler *> g_signalProfiler;
+} // namespace
+
+// atomic flag store only, handler may interrupt the profiled pipe
+__attribute__((no_stack_protector)) static void handleToggleSignal(int) {
+  if (auto profiler = g_signalProfiler.load(std::memory_order::relaxed)) {
+    profiler->setEnabled(!profiler->isEnabled());
+  }
+}
+
+void Pm4Profiler::enableSignalToggle(int signo) {
+  g_signalProfiler.store(this, std::memory_order::relaxed);
+
+  struct sigaction act{};
+  act.sa_handler = handleToggleSignal;
+  act.sa_flags = SA_ONSTACK | SA_RESTART;
+
+  if (sigaction(signo, &act, nullptr)) {
+    perror("pm4 profiler: sigaction");
+  }
+}
+
+void Pm4Profiler::startDumps(std::chrono::milliseconds interval) {
+  stopDumps();
+
+  mThread = std::jthread([this, interval](const std::stop_token &stopToken) {
+    threadMain(stopToken, interval);
+  });
+}
+
+void Pm4Profiler::stopDumps() {
+  if (!mThread.joinable()) {
+    return;
+  }
+
+  mThread.request_stop();
+  mCv.notify_all();
+  mThread.join();
+}
+
+Pm4Profiler::Stats Pm4Profiler::getStats() const {
+  Stats result;
+
+  for (std::size_t queue = 0; queue < result.size(); ++queue) {
+    for (std::size_t op = 0; op < result[queue].size(); ++op) {
+      auto &counters = mCounters[queue][op];
+      result[queue][op] = {
+          .count = counters.count.load(std::memory_order::relaxed),
+          .stalls = counters.stalls.load(std::memory_order::relaxed),
+          .cycles = counters.cycles.load(std::memory_order::relaxed),
+      };
+    }
+  }
+
+  return result;
+}
+
+void Pm4Profiler::reset() {
+  for (auto &queue : mCounters) {
+    for (auto &counters : queue) {
+      counters.count.store(0, std::memory_order::relaxed);
+      counters.stalls.store(0, std::memory_order::relaxed);
+      counters.cycles.store(0, std::memory_order::relaxed);
+    }
+  }
+}
+
+void Pm4Profiler::print(const Stats &stats) {
+  static constexpr const char *kQueueNames[] = {"gfx", "compute"};
+
+  struct Row {
+    const char *queue;
+    std::uint32_t op;
+    OpcodeStats stats;
+  };
+
+  std::vector<Row> rows;
+  std::uint64_t totalCycles = 0;
+
+  for (std::size_t queue = 0; queue < stats.size(); ++queue) {
+    for (std::uint32_t op = 0; op < stats[queue].size(); ++op) {
+      auto &opStats = stats[queue][op];
+      if (opStats.count == 0 && opStats.stalls == 0) {
+        continue;
+      }
+
+      rows.push_back({kQueueNames[queue], op, opStats});
+      totalCycles += opStats.cycles;
+    }
+  }
+
+  if (rows.empty()) {
+    return;
+  }
+
+  std::ranges::sort(rows, std::greater{},
+                    [](const Row &row) { return row.stats.cycles; });
+
+  rx::println(stderr, "pm4 profile:");
+  rx::println(stderr, "  {:<8} {:<28} {:>10} {:>10} {:>14} {:>10} {:>6}",
+              "queue", "opcode", "count", "stalls", "cycles", "avg", "%");
+
+  for (auto &row : rows) {
+    auto name = gnm::pm4OpcodeToString(row.op);
+    auto calls = row.stats.count + row.stats.stalls;
+    auto percent =
+        row.stats.cycles * 100.0 / std::max<std::uint64_t>(totalCycles, 1);
+
+    rx::println(stderr, "  {:<8} {:<28} {:>10} {:>10} {:>14} {:>10} {:>6.2f}",
+                row.queue,
+                name != nullptr ? std::string_view(name) : "<unknown>",
+                row.stats.count, row.stats.stalls, row.stats.cycles,
+                row.stats.cycles / calls, percent);
+  }
+}
+
+void Pm4Profiler::threadMain(const std::stop_token &stopToken,
+                             std::chrono::milliseconds interval) {
+  Stats last{};
+  bool wasEnabled = isEnabled();
+  auto nextDump = std::chrono::steady_clock::now() + interval;
+
+  while (!stopToken.stop_requested()) {
+    {
+      std::unique_lock lock(mMtx);
+      mCv.wait_for(lock, stopToken,
+                   interval.count() != 0 ? std::min(interval, kPollInterval)
+                                         : kPollInterval,
+                   [] { return false; });
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    bool enabled = isEnabled();
+
+    if (enabled != wasEnabled) {
+      wasEnabled = enabled;
+
+      if (enabled) {
+        rx::println(stderr, "pm4 profiler: enabled");
+        reset();
+      } else {
+        rx::println(stderr, "pm4 profiler: disabled");
+        print(getStats());
+      }
+
+      last = {};
+      nextDump = now + interval;
+      continue;
+    }
+
+    if (!enabled || interval.count() == 0 || now < nextDump) {
+      continue;
+    }
+
+    nextDump = now + interval;
+
+    auto current = getStats();
+    auto delta = current;
+
+    for (std::size_t queue = 0; queue < delta.size(); ++queue) {
+      for (std::size_t op = 0; op < delta[queue].size(); ++op) {
+        auto &prev = last[queue][op];
+        auto &stats = delta[queue][op];
+
+        // counters may be reset between dumps
+        if (stats.count < prev.count || stats.stalls < prev.stalls ||
+            stats.cycles < prev.cycles) {
+          continue;
+        }
+
+        stats.count -= prev.count;
+        stats.stalls -= prev.stalls;
+        stats.cycles -= prev.cycles;
+      }
+    }
+
+    print(delta);
+    last = current;
+  }
+}
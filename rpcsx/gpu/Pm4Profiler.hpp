@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+
+namespace amdgpu {
+///
+/// \brief Per-opcode counters of PM4 command processor.
+///
+/// Counts packets and TSC cycles spent in their handlers, separately for
+/// graphics and compute pipes. Cycles are exclusive: INDIRECT_BUFFER handlers
+/// only switch the pipe to the indirect ring, its packets are counted under
+/// their own opcodes when the ring is processed. Packets whose handler returned
+/// without consuming them (waiting for memory, register or previous work) are
+/// counted as stalls, their cycles are the cost of the polling. The flag is
+/// latched when a pipe starts processing a ring, so toggling takes effect on
+/// the next ring and a disabled profiler costs one atomic load per ring.
+///
+class Pm4Profiler {
+public:
+  enum class Queue : std::uint8_t {
+    Graphics,
+    Compute,
+
+    Count,
+  };
+
+  struct OpcodeStats {
+    std::uint64_t count = 0;
+    std::uint64_t stalls = 0;
+    std::uint64_t cycles = 0;
+  };
+
+  using Stats = std::array<std::array<OpcodeStats, 256>,
+                           static_cast<std::size_t>(Queue::Count)>;
+
+  Pm4Profiler() = default;
+  Pm4Profiler(const Pm4Profiler &) = delete;
+  Pm4Profiler &operator=(const Pm4Profiler &) = delete;
+  ~Pm4Profiler() { stopDumps(); }
+
+  [[nodiscard]] bool isEnabled() const {
+    return mEnabled.load(std::memory_order::relaxed);
+  }
+
+  void setEnabled(bool enabled) {
+    mEnabled.store(enabled, std::memory_order::relaxed);
+  }
+
+  /// Prints counters collected since previous dump to stderr every `interval`
+  /// while profiler is enabled, zero interval disables periodic dumps.
+  /// Counters are reset when profiler is enabled at runtime and printed when
+  /// it is disabled.
+  void startDumps(std::chrono::milliseconds interval);
+  void stopDumps();
+
+  /// Makes `signo` toggle the profiler, e.g. `kill -s RTMIN+1 <gpu pid>`.
+  /// Only one profiler of the process can be toggled by signal.
+  void enableSignalToggle(int signo);
+
+  void record(Queue queue, std::uint32_t op, std::uint64_t cycles,
+              bool consumed) {
+    auto &counters = mCounters[static_cast<std::size_t>(queue)][op & 0xff];
+    counters.cycles.fetch_add(cycles, std::memory_order::relaxed);
+
+    if (consumed) {
+      counters.count.fetch_add(1, std::memory_order::relaxed);
+    } else {
+      counters.stalls.fetch_add(1, std::memory_order::relaxed);
+    }
+  }
+
+  /// Returns counters accumulated since start or last reset.
+  [[nodiscard]] Stats getStats() const;
+  void reset();
+
+  static void print(const Stats &stats);
+
+private:
+  struct Counters {
+    std::atomic<std::uint64_t> count{0};
+    std::atomic<std::uint64_t> stalls{0};
+    std::atomic<std::uint64_t> cycles{0};
+  };
+
+  void threadMain(const std::stop_token &stopToken,
+                  std::chrono::milliseconds interval);
+
+  std::atomic<bool> mEnabled{false};
+  Counters mCounters[static_cast<std::size_t>(Queue::Count)][256];
+  std::mutex mMtx;
+  std::condition_variable_any mCv;
+  std::jthread mThread;
+};
+} // namespace amdgpu
@@ -467,13 +467,22 @@ void amdgpu::draw(GraphicsPipe &pipe, int vmId, std::uint32_t firstVertex,
         vsPrimType, viewPorts);
   }
 
+  Cache::Shader pixelShader;
+
+  if (pipe.sh.spiShaderPgmPs.address != 0) {
+    pixelShader = cacheTag.getPixelShader(pipe.sh.spiShaderPgmPs, pipe.context,
+                                          viewPorts);
+  }
+
+  if (vertexShader.pending || pixelShader.pending) {
+    // skip draw until translation of its shaders is finished
+    return;
+  }
+
   shaders[Cache::getStageIndex(VK_SHADER_STAGE_VERTEX_BIT)] =
       vertexShader.handle;
 
   if (pipe.sh.spiShaderPgmPs.address != 0) {
-    auto pixelShader = cacheTag.getPixelShader(pipe.sh.spiShaderPgmPs,
-                                               pipe.context, viewPorts);
-
     shaders[Cache::getStageIndex(VK_SHADER_STAGE_FRAGMENT_BIT)] =
         pixelShader.handle != nullptr
             ? pixelShader.handle
@@ -0,0 +1,412 @@
+#include "ShaderCache.hpp"
+#include "rx/Serializer.hpp"
+#include "rx/print.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace amdgpu;
+
+namespace {
+constexpr std::uint64_t kFileMagic = 0x5245'4448'4153'5852; // RXSHADER
+constexpr std::uint32_t kFileFormatVersion = 1;
+
+struct FileHeader {
+  std::uint64_t magic;
+  std::uint32_t formatVersion;
+  std::uint32_t converterVersion;
+};
+
+struct RecordHeader {
+  std::uint32_t size;
+  std::uint32_t pad;
+  std::uint64_t key;
+};
+
+struct VectorSerializer : rx::Serializer {
+  std::vector<std::byte> data;
+
+  void write(std::span<const std::byte> bytes) override {
+    data.insert(data.end(), bytes.begin(), bytes.end());
+  }
+};
+
+struct SpanDeserializer : rx::Deserializer {
+  std::span<const std::byte> data;
+
+  explicit SpanDeserializer(std::span<const std::byte> data) : data(data) {}
+
+  void read(std::span<std::byte> bytes) override {
+    if (bytes.size() > data.size()) {
+      setFailure();
+      std::memset(bytes.data(), 0, bytes.size());
+      return;
+    }
+
+    std::memcpy(bytes.data(), data.data(), bytes.size());
+    data = data.subspan(bytes.size());
+  }
+};
+
+struct Fnv1a {
+  std::uint64_t value = 0xcbf2'9ce4'8422'2325;
+
+  void update(const void *data, std::size_t size) {
+    auto bytes = static_cast<const std::uint8_t *>(data);
+    for (std::size_t i = 0; i < size; ++i) {
+      value ^= bytes[i];
+      value *= 0x100'0000'01b3;
+    }
+  }
+
+  template <typename T>
+    requires std::is_trivially_copyable_v<T>
+  void update(const T &object) {
+    update(&object, sizeof(object));
+  }
+};
+
+std::vector<std::pair<std::uint64_t, std::uint64_t>>
+getMemoryRanges(const shader::gcn::ConvertedShader &shader) {
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> result;
+  for (auto area :
+       const_cast<rx::MemoryAreaTable<> &>(shader.info.memoryMap)) {
+    result.emplace_back(area.beginAddress, area.endAddress);
+  }
+  return result;
+}
+
+std::uint64_t
+hashMemory(std::span<const std::pair<std::uint64_t, std::uint64_t>> ranges,
+           ShaderCache::ReadMemoryFn readMemory) {
+  Fnv1a hash;
+  std::vector<std::byte> buffer;
+
+  for (auto [beginAddress, endAddress] : ranges) {
+    buffer.resize(endAddress - beginAddress);
+    readMemory(buffer.data(),
+               rx::AddressRange::fromBeginEnd(beginAddress, endAddress));
+    hash.update(beginAddress);
+    hash.update(buffer.data(), buffer.size());
+  }
+
+  return hash.value;
+}
+
+bool writeAll(int fd, std::span<const std::byte> data) {
+  while (!data.empty()) {
+    auto written = ::write(fd, data.data(), data.size());
+    if (written <= 0) {
+      return false;
+    }
+
+    data = data.subspan(written);
+  }
+
+  return true;
+}
+} // namespace
+
+ShaderCache::~ShaderCache() {
+  if (isOpen() || mStores.load(std::memory_order::relaxed) != 0) {
+    printStats();
+  }
+
+  close();
+}
+
+bool ShaderCache::open(const std::filesystem::path &directory) {
+  close();
+
+  std::error_code ec;
+  std::filesystem::create_directories(directory, ec);
+  if (ec) {
+    rx::println(stderr, "shader cache: failed to create {}: {}",
+                directory.string(), ec.message());
+    return false;
+  }
+
+  auto path = directory / "shaders.bin";
+  int fd = ::open(path.c_str(), O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    rx::println(stderr, "shader cache: failed to open {}", path.string());
+    return false;
+  }
+
+  struct stat fileStat{};
+  ::fstat(fd, &fileStat);
+
+  std::vector<std::byte> data(fileStat.st_size);
+  std::size_t offset = 0;
+  while (offset < data.size()) {
+    auto count = ::pread(fd, data.data() + offset, data.size() - offset,
+                         static_cast<off_t>(offset));
+    if (count <= 0) {
+      break;
+    }
+    offset += count;
+  }
+  data.resize(offset);
+
+  FileHeader header{};
+  bool valid = data.size() >= sizeof(header);
+  if (valid) {
+    std::memcpy(&header, data.data(), sizeof(header));
+    valid = header.magic == kFileMagic &&
+            header.formatVersion == kFileFormatVersion &&
+            header.converterVersion == shader::gcn::kConverterVersion;
+  }
+
+  std::lock_guard lock(mMtx);
+  mEntries.clear();
+
+  std::uint64_t fileSize = sizeof(header);
+
+  if (valid) {
+    auto records = std::span(data).subspan(sizeof(header));
+    auto loadedSize = loadEntries(records, sizeof(header));
+    fileSize += loadedSize;
+
+    if (loadedSize != records.size()) {
+      // drop incomplete tail left by interrupted write
+      rx::println(stderr, "shader cache: truncating damaged tail of {}",
+                  path.string());
+      valid = ::ftruncate(fd, fileSize) == 0;
+    }
+  } else if (!data.empty()) {
+    rx::println(stderr, "shader cache: discarding outdated cache {}",
+                path.string());
+  }
+
+  if (!valid) {
+    mEntries.clear();
+    fileSize = sizeof(header);
+    header = {
+        .magic = kFileMagic,
+        .formatVersion = kFileFormatVersion,
+        .converterVersion = shader::gcn::kConverterVersion,
+    };
+
+    if (::ftruncate(fd, 0) != 0 ||
+        ::pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+      rx::println(stderr, "shader cache: failed to initialize {}",
+                  path.string());
+      ::close(fd);
+      return false;
+    }
+  }
+
+  mFd = fd;
+  mFileSize = fileSize;
+  rx::println(stderr, "shader cache: loaded {} entries from {}",
+              mEntries.size(), path.string());
+  return true;
+}
+
+void ShaderCache::close() {
+  std::lock_guard lock(mMtx);
+
+  if (mFd >= 0) {
+    ::close(mFd);
+    mFd = -1;
+  }
+
+  mFileSize = 0;
+  mEntries.clear();
+}
+
+void ShaderCache::deserializeIndex(rx::Deserializer &d, Entry &entry) {
+  entry.memoryHash = d.deserialize<std::uint64_t>();
+  d.deserialize(entry.memoryRanges);
+  d.deserialize(entry.requiredSgprs);
+}
+
+std::size_t ShaderCache::loadEntries(std::span<const std::byte> data,
+                                     std::uint64_t fileOffset) {
+  std::size_t loadedSize = 0;
+
+  while (!data.empty()) {
+    RecordHeader header{};
+    if (data.size() < sizeof(header)) {
+      break;
+    }
+
+    std::memcpy(&header, data.data(), sizeof(header));
+    data = data.subspan(sizeof(header));
+
+    if (data.size() < header.size) {
+      break;
+    }
+
+    SpanDeserializer d(data.subspan(0, header.size));
+    data = data.subspan(header.size);
+
+    Entry entry;
+    deserializeIndex(d, entry);
+    d.deserialize<std::vector<std::byte>>();
+    entry.recordOffset = fileOffset + loadedSize + sizeof(header);
+    entry.recordSize = header.size;
+
+    if (d.failure()) {
+      break;
+    }
+
+    mEntries.emplace(header.key, std::move(entry));
+    loadedSize += sizeof(header) + header.size;
+  }
+
+  return loadedSize;
+}
+
+std::uint64_t ShaderCache::computeKey(std::uint64_t address,
+                                      shader::gcn::Stage stage,
+                                      const shader::gcn::Environment &env) {
+  Fnv1a hash;
+  hash.update(shader::gcn::kConverterVersion);
+  hash.update(address);
+  hash.update(stage);
+  hash.update(env.vgprCount);
+  hash.update(env.sgprCount);
+  hash.update(env.numThreadX);
+  hash.update(env.numThreadY);
+  hash.update(env.numThreadZ);
+  hash.update(env.supportsBarycentric);
+  hash.update(env.supportsInt8);
+  hash.update(env.supportsInt64Atomics);
+  hash.update(env.supportsNonSemanticInfo);
+  return hash.value;
+}
+
+std::uint64_t
+ShaderCache::computeMemoryHash(const shader::gcn::ConvertedShader &shader,
+                               ReadMemoryFn readMemory) {
+  return hashMemory(getMemoryRanges(shader), readMemory);
+}
+
+std::optional<shader::gcn::ConvertedShader>
+ShaderCache::find(std::uint64_t key, std::span<const std::uint32_t> userSgprs,
+                  ReadMemoryFn readMemory) {
+  std::lock_guard lock(mMtx);
+
+  auto [beginIt, endIt] = mEntries.equal_range(key);
+  for (auto it = beginIt; it != endIt; ++it) {
+    auto &entry = it->second;
+
+    bool sgprsMatches = true;
+    for (auto [index, value] : entry.requiredSgprs) {
+      if (static_cast<std::size_t>(index) >= userSgprs.size() ||
+          userSgprs[index] != value) {
+        sgprsMatches = false;
+        break;
+      }
+    }
+
+    if (!sgprsMatches ||
+        hashMemory(entry.memoryRanges, readMemory) != entry.memoryHash) {
+      continue;
+    }
+
+    std::vector<std::byte> record(entry.recordSize);
+    if (::pread(mFd, record.data(), record.size(),
+                static_cast<off_t>(entry.recordOffset)) !=
+        static_cast<ssize_t>(record.size())) {
+      rx::println(stderr, "shader cache: failed to read entry {:x}", key);
+      continue;
+    }
+
+    // index part of the record was validated on load
+    SpanDeserializer recordDeserializer(record);
+    Entry recordEntry;
+    deserializeIndex(recordDeserializer, recordEntry);
+    auto payload = recordDeserializer.deserialize<std::vector<std::byte>>();
+
+    shader::gcn::ConvertedShader result;
+    SpanDeserializer d(payload);
+    d.deserialize(result.spv);
+    result.info.deserialize(d);
+
+    if (recordDeserializer.failure() || d.failure()) {
+      rx::println(stderr, "shader cache: corrupted entry {:x}", key);
+      continue;
+    }
+
+    mHits.fetch_add(1, std::memory_order::relaxed);
+    return result;
+  }
+
+  mMisses.fetch_add(1, std::memory_order::relaxed);
+  return {};
+}
+
+void ShaderCache::store(std::uint64_t key,
+                        const shader::gcn::ConvertedShader &shader,
+                        ReadMemoryFn readMemory) {
+  if (!isOpen()) {
+    return;
+  }
+
+  Entry entry;
+  entry.memoryRanges = getMemoryRanges(shader);
+  entry.memoryHash = hashMemory(entry.memoryRanges, readMemory);
+  entry.requiredSgprs = shader.info.requiredSgprs;
+
+  std::vector<std::byte> payload;
+  {
+    VectorSerializer s;
+    s.serialize(shader.spv);
+    shader.info.serialize(s);
+    payload = std::move(s.data);
+  }
+
+  VectorSerializer s;
+  s.serialize(entry.memoryHash);
+  s.serialize(entry.memoryRanges);
+  s.serialize(entry.requiredSgprs);
+  s.serialize(payload);
+
+  RecordHeader header{
+      .size = static_cast<std::uint32_t>(s.data.size()),
+      .key = key,
+  };
+
+  std::lock_guard lock(mMtx);
+  if (mFd < 0) {
+    return;
+  }
+
+  if (::lseek(mFd, static_cast<off_t>(mFileSize), SEEK_SET) < 0 ||
+      !writeAll(mFd, std::as_bytes(std::span(&header, 1))) ||
+      !writeAll(mFd, s.data)) {
+    rx::println(stderr, "shader cache: write failed, disabling persistence");
+    ::close(mFd);
+    mFd = -1;
+    mFileSize = 0;
+    mEntries.clear();
+    return;
+  }
+
+  entry.recordOffset = mFileSize + sizeof(header);
+  entry.recordSize = header.size;
+  mFileSize += sizeof(header) + header.size;
+
+  mEntries.emplace(key, std::move(entry));
+  mStores.fetch_add(1, std::memory_order::relaxed);
+}
+
+ShaderCache::Stats ShaderCache::getStats() const {
+  std::lock_guard lock(mMtx);
+
+  return {
+      .hits = mHits.load(std::memory_order::relaxed),
+      .misses = mMisses.load(std::memory_order::relaxed),
+      .stores = mStores.load(std::memory_order::relaxed),
+      .entries = mEntries.size(),
+  };
+}
+
+void ShaderCache::printStats() const {
+  auto stats = getStats();
+  rx::println(stderr, "shader cache: {} hits, {} misses, {} stored, {} entries",
+              stats.hits, stats.misses, stats.stores, stats.entries);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "rx/AddressRange.hpp"
+#include "rx/FunctionRef.hpp"
+#include "rx/Serializer.hpp"
+#include "shader/GcnConverter.hpp"
+#include "shader/gcn.hpp"
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace amdgpu {
+///
+/// \brief Persistent storage of translated GCN shaders.
+///
+/// Entries are looked up by hash of the shader address, stage and
+/// environment, and validated against the contents of the guest memory that
+/// was read by the converter and against the required user SGPRs, so a hit
+/// is only returned when the translation would produce the same result.
+///
+/// Entries are appended to a single pack file, which is discarded when the
+/// converter version changes. Only the index of entries is kept in memory,
+/// payloads are read back from the file on hit. Nothing is stored while the
+/// cache is not opened.
+///
+class ShaderCache {
+public:
+  struct Stats {
+    std::uint64_t hits;
+    std::uint64_t misses;
+    std::uint64_t stores;
+    std::uint64_t entries;
+  };
+
+  using ReadMemoryFn = rx::FunctionRef<void(void *, rx::AddressRange)>;
+
+  ShaderCache() = default;
+  ShaderCache(const ShaderCache &) = delete;
+  ShaderCache &operator=(const ShaderCache &) = delete;
+  ~ShaderCache();
+
+  bool open(const std::filesystem::path &directory);
+  void close();
+  [[nodiscard]] bool isOpen() const { return mFd >= 0; }
+
+  static std::uint64_t computeKey(std::uint64_t address,
+                                  shader::gcn::Stage stage,
+                                  const shader::gcn::Environment &env);
+
+  /// Hash of the guest memory that was read by the converter.
+  static std::uint64_t
+  computeMemoryHash(const shader::gcn::ConvertedShader &shader,
+                    ReadMemoryFn readMemory);
+
+  std::optional<shader::gcn::ConvertedShader>
+  find(std::uint64_t key, std::span<const std::uint32_t> userSgprs,
+       ReadMemoryFn readMemory);
+
+  void store(std::uint64_t key, const shader::gcn::ConvertedShader &shader,
+             ReadMemoryFn readMemory);
+
+  [[nodiscard]] Stats getStats() const;
+  void printStats() const;
+
+private:
+  struct Entry {
+    std::uint64_t memoryHash;
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> memoryRanges;
+    std::vector<std::pair<int, std::uint32_t>> requiredSgprs;
+
+    // record body in the pack file
+    std::uint64_t recordOffset;
+    std::uint32_t recordSize;
+  };
+
+  // record body is the index part of the entry followed by the payload
+  static void deserializeIndex(rx::Deserializer &d, Entry &entry);
+  std::size_t loadEntries(std::span<const std::byte> data,
+                          std::uint64_t fileOffset);
+
+  int mFd = -1;
+  std::uint64_t mFileSize = 0;
+  mutable std::mutex mMtx;
+  std::multimap<std::uint64_t, Entry> mEntries;
+  std::atomic<std::uint64_t> mHits{0};
+  std::atomic<std::uint64_t> mMisses{0};
+  std::atomic<std::uint64_t> mStores{0};
+};
+} // namespace amdgpu
@@ -0,0 +1,182 @@
+#include "ShaderDumper.hpp"
+#include "rx/format.hpp"
+#include "rx/print.hpp"
+#include "shader/glsl.hpp"
+#include "shader/spv.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string_view>
+
+using namespace amdgpu;
+
+namespace {
+// keep in sync with shader-tool isa stage names
+constexpr std::string_view kStageNames[] = {
+    "ps", "vs-vs", "vs-es", "vs-ls", "cs",
+    "gs", "gs-vs", "hs",    "ds-vs", "ds-es",
+};
+
+static_assert(std::size(kStageNames) ==
+              static_cast<std::size_t>(shader::gcn::Stage::Invalid));
+
+bool parseStageMask(std::string_view stages, std::uint32_t &mask) {
+  mask = 0;
+
+  while (!stages.empty()) {
+    auto name = stages.substr(0, stages.find(','));
+    stages.remove_prefix(std::min(name.size() + 1, stages.size()));
+
+    auto it = std::find(std::begin(kStageNames), std::end(kStageNames), name);
+    if (it == std::end(kStageNames)) {
+      rx::println(stderr, "shader dump: unknown stage '{}'", name);
+      return false;
+    }
+
+    mask |= 1u << (it - std::begin(kStageNames));
+  }
+
+  return true;
+}
+
+void writeFile(const std::filesystem::path &path, const void *data,
+               std::size_t size) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(static_cast<const char *>(data), size);
+
+  if (!file) {
+    rx::println(stderr, "shader dump: failed to write {}", path.string());
+  }
+}
+
+void writeFile(const std::filesystem::path &path, std::string_view text) {
+  writeFile(path, text.data(), text.size());
+}
+} // namespace
+
+bool ShaderDumper::open(const std::filesystem::path &directory,
+                        const char *stages) {
+  close();
+
+  std::uint32_t stageMask = (1u << std::size(kStageNames)) - 1;
+  if (stages != nullptr && !parseStageMask(stages, stageMask)) {
+    return false;
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(directory, ec);
+  if (ec) {
+    rx::println(stderr, "shader dump: failed to create {}: {}",
+                directory.string(), ec.message());
+    return false;
+  }
+
+  mDirectory = directory;
+  mThread = std::jthread(
+      [this](const std::stop_token &stopToken) { threadMain(stopToken); });
+  mStageMask.store(stageMask, std::memory_order::relaxed);
+  return true;
+}
+
+void ShaderDumper::close() {
+  mStageMask.store(0, std::memory_order::relaxed);
+
+  if (mThread.joinable()) {
+    mThread.request_stop();
+    mThread.join();
+  }
+}
+
+void ShaderDumper::dump(Shader shader) {
+  if (!isEnabled(shader.stage)) {
+    return;
+  }
+
+  std::lock_guard lock(mMtx);
+  mQueue.push_back(std::move(shader));
+  mCv.notify_one();
+}
+
+std::string ShaderDumper::formatEnvironment(const Shader &shader) {
+  auto &env = shader.env;
+  auto result = rx::format(
+      "stage = {}\n"
+      "address = {:#x}\n"
+      "vgpr-count = {}\n"
+      "sgpr-count = {}\n"
+      "num-threads = {} {} {}\n"
+      "supports-barycentric = {}\n"
+      "supports-int8 = {}\n"
+      "supports-int64-atomics = {}\n"
+      "supports-non-semantic-info = {}\n"
+      "user-sgprs =",
+      kStageNames[static_cast<std::size_t>(shader.stage)], shader.address,
+      env.vgprCount, env.sgprCount, env.numThreadX, env.numThreadY,
+      env.numThreadZ, int(env.supportsBarycentric), int(env.supportsInt8),
+      int(env.supportsInt64Atomics), int(env.supportsNonSemanticInfo));
+
+  for (auto sgpr : shader.userSgprs) {
+    result += rx::format(" {:#x}", sgpr);
+  }
+
+  result += '\n';
+
+  for (auto region : shader.regions) {
+    result += rx::format("region = {:#x} {}\n", region.address, region.size);
+  }
+
+  return result;
+}
+
+void ShaderDumper::write(const Shader &shader) {
+  auto stageName = kStageNames[static_cast<std::size_t>(shader.stage)];
+
+  std::uint64_t codeHash = 0xcbf2'9ce4'8422'2325;
+  for (auto word : shader.code) {
+    codeHash ^= word;
+    codeHash *= 0x100'0000'01b3;
+  }
+
+  auto basePath =
+      mDirectory / rx::format("{}-{:x}-{:016x}", stageName, shader.address,
+                              codeHash);
+  auto path = [&](std::string_view extension) {
+    auto result = basePath;
+    result += extension;
+    return result;
+  };
+
+  writeFile(path(".gcn"), shader.code.data(),
+            shader.code.size() * sizeof(std::uint32_t));
+  writeFile(path(".env"), formatEnvironment(shader));
+  writeFile(path(".ir"), shader.ir);
+  writeFile(path(".resources"), shader.resources);
+
+  if (shader.spv.empty()) {
+    // translation failed, GCN code and IR is all we have
+    return;
+  }
+
+  writeFile(path(".spv"), shader.spv.data(),
+            shader.spv.size() * sizeof(std::uint32_t));
+  writeFile(path(".spvasm"), shader::spv::disassembly(shader.spv, true));
+  writeFile(path(".glsl"), shader::glsl::decompile(shader.spv));
+}
+
+void ShaderDumper::threadMain(const std::stop_token &stopToken) {
+  std::unique_lock lock(mMtx);
+
+  while (true) {
+    if (!mCv.wait(lock, stopToken, [this] { return !mQueue.empty(); }) &&
+        mQueue.empty()) {
+      return;
+    }
+
+    auto shader = std::move(mQueue.front());
+    mQueue.pop_front();
+
+    lock.unlock();
+    write(shader);
+    lock.lock();
+  }
+}
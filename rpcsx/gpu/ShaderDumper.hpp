@@ -0,0 +1,80 @@
+#pragma once
+
+#include "shader/gcn.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace amdgpu {
+///
+/// \brief Writes translated shaders to files for debugging.
+///
+/// For each translated shader of enabled stage the dumper produces the GCN
+/// code with its environment (the corpus format accepted by
+/// `shader-tool --batch`), the GCN IR, the resource graph, the SPIR-V binary
+/// with its disassembly and the decompiled GLSL. Disassembly, decompilation
+/// and file output are performed on a dedicated thread, disabled dumper costs
+/// a single flag check.
+///
+class ShaderDumper {
+public:
+  /// Contiguous range of code words read by translation.
+  struct CodeRegion {
+    std::uint64_t address;
+    std::uint32_t size; // in words
+  };
+
+  struct Shader {
+    std::uint64_t address;
+    shader::gcn::Stage stage;
+    shader::gcn::Environment env;
+    std::vector<std::uint32_t> userSgprs;
+    std::vector<CodeRegion> regions;
+    std::vector<std::uint32_t> code; // words of all regions, in order
+    std::string ir;
+    std::string resources;
+    std::vector<std::uint32_t> spv;
+  };
+
+  ShaderDumper() = default;
+  ShaderDumper(const ShaderDumper &) = delete;
+  ShaderDumper &operator=(const ShaderDumper &) = delete;
+  ~ShaderDumper() { close(); }
+
+  /// \param stages comma separated list of stage names (ps, vs-vs, vs-es,
+  /// vs-ls, cs, gs, gs-vs, hs, ds-vs, ds-es), null enables all stages
+  bool open(const std::filesystem::path &directory, const char *stages);
+
+  /// Writes all queued shaders and stops the dump thread.
+  void close();
+
+  [[nodiscard]] bool isEnabled(shader::gcn::Stage stage) const {
+    return (mStageMask.load(std::memory_order::relaxed) &
+            (1u << static_cast<unsigned>(stage))) != 0;
+  }
+
+  void dump(Shader shader);
+
+private:
+  /// Formats `.env` sidecar: `key = value` lines with stage, address,
+  /// register counts, thread counts, host capabilities, user SGPRs and one
+  /// `region = <address> <words>` line per code region stored in `.gcn`.
+  static std::string formatEnvironment(const Shader &shader);
+  void write(const Shader &shader);
+  void threadMain(const std::stop_token &stopToken);
+
+  std::filesystem::path mDirectory;
+  std::atomic<std::uint32_t> mStageMask{0};
+  std::mutex mMtx;
+  std::condition_variable_any mCv;
+  std::deque<Shader> mQueue;
+  std::jthread mThread;
+};
+} // namespace amdgpu
@@ -0,0 +1,350 @@
+#include "ShaderTranslator.hpp"
+#include "Device.hpp"
+#include "rx/Config.hpp"
+#include "rx/print.hpp"
+#include "shader/spv.hpp"
+#include "vk.hpp"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <sstream>
+
+using namespace amdgpu;
+using namespace shader;
+
+namespace {
+// results kept while persistent cache is closed
+constexpr std::size_t kMaxResults = 64;
+
+void readRemoteMemory(int vmId, void *target, rx::AddressRange range) {
+  std::memcpy(target, RemoteMemory{vmId}.getPointer(range.beginAddress()),
+              range.size());
+}
+} // namespace
+
+ShaderTranslator::Request
+ShaderTranslator::makeRequest(int vmId, std::uint64_t address,
+                              gcn::Stage stage, gcn::Environment env) {
+  env.supportsBarycentric = vk::context->supportsBarycentric;
+  env.supportsInt8 = vk::context->supportsInt8;
+  env.supportsInt64Atomics = vk::context->supportsInt64Atomics;
+  env.supportsNonSemanticInfo = vk::context->supportsNonSemanticInfo;
+
+  return {
+      .vmId = vmId,
+      .address = address,
+      .stage = stage,
+      .env = env,
+  };
+}
+
+void ShaderTranslator::start(std::size_t workerCount) {
+  stop();
+
+  for (std::size_t i = 0; i < workerCount; ++i) {
+    mWorkers.emplace_back(
+        [this](const std::stop_token &stopToken) { workerMain(stopToken); });
+  }
+}
+
+void ShaderTranslator::stop() {
+  for (auto &worker : mWorkers) {
+    worker.request_stop();
+  }
+
+  mWorkers.clear();
+
+  std::lock_guard lock(mMtx);
+  for (auto &job : mQueue) {
+    auto it = mJobs.find(job.id);
+    if (it->second.waiters == 0) {
+      mJobs.erase(it);
+    } else {
+      // cancelled, waiters find nothing in the cache and translate inline
+      it->second.status = Status::Done;
+    }
+  }
+  mQueue.clear();
+  mDoneCv.notify_all();
+}
+
+std::optional<gcn::ConvertedShader>
+ShaderTranslator::translate(const Request &request) const {
+  RemoteMemory memory{request.vmId};
+  bool dumping = mDumper.isEnabled(request.stage);
+
+  // words read by deserialize, only collected for the dump. Branch targets
+  // and fetch shader may be far from the shader code, so only what was
+  // actually read is dumped
+  std::map<std::uint64_t, std::uint32_t> codeWords;
+
+  gcn::Context context;
+  auto deserialized = gcn::deserialize(
+      context, request.env, mSemantic, request.address,
+      [&](std::uint64_t address) -> std::uint32_t {
+        auto word = *memory.getPointer<std::uint32_t>(address);
+        if (dumping) {
+          codeWords.emplace(address, word);
+        }
+        return word;
+      });
+
+  std::optional<ShaderDumper::Shader> dump;
+  if (dumping) {
+    std::ostringstream ir;
+    deserialized.print(ir, context.ns);
+    dump = {
+        .address = request.address,
+        .stage = request.stage,
+        .env = request.env,
+        .userSgprs = {request.env.userSgprs.begin(),
+                      request.env.userSgprs.end()},
+        .ir = std::move(ir).str(),
+    };
+    dump->env.userSgprs = {};
+
+    for (auto [address, word] : codeWords) {
+      auto &regions = dump->regions;
+      if (regions.empty() ||
+          regions.back().address +
+                  regions.back().size * sizeof(std::uint32_t) !=
+              address) {
+        regions.push_back({.address = address, .size = 0});
+      }
+
+      regions.back().size++;
+      dump->code.push_back(word);
+    }
+  }
+
+  auto converted =
+      gcn::convertToSpv(context, deserialized, mSemantic, mSemanticModuleInfo,
+                        request.stage, request.env);
+
+  if (converted) {
+    if (dump) {
+      std::ostringstream resources;
+      converted->info.resources.print(resources,
+                                      converted->info.resources.context.ns);
+      dump->resources = std::move(resources).str();
+      dump->spv = converted->spv;
+    }
+
+    if (!spv::validate(converted->spv)) {
+      spv::dump(converted->spv, true);
+      converted.reset();
+    }
+  }
+
+  if (dump) {
+    mDumper.dump(std::move(*dump));
+  }
+
+  return converted;
+}
+
+ShaderTranslator::JobId ShaderTranslator::getJobId(std::uint64_t key,
+                                                   const Request &request) {
+  std::uint64_t sgprsHash = 0xcbf2'9ce4'8422'2325;
+  for (auto sgpr : request.env.userSgprs) {
+    sgprsHash ^= sgpr;
+    sgprsHash *= 0x100'0000'01b3;
+  }
+
+  return {key, request.vmId, sgprsHash};
+}
+
+ShaderTranslator::Status ShaderTranslator::enqueue(std::uint64_t key,
+                                                   const Request &request) {
+  auto id = getJobId(key, request);
+
+  Job job{
+      .id = id,
+      .key = key,
+      .request = request,
+      .userSgprs = {request.env.userSgprs.begin(),
+                    request.env.userSgprs.end()},
+  };
+  job.request.env.userSgprs = job.userSgprs;
+
+  std::unique_lock lock(mMtx);
+
+  if (mWorkers.empty()) {
+    lock.unlock();
+    return process(job);
+  }
+
+  auto [it, inserted] = mJobs.try_emplace(id);
+
+  if (!inserted) {
+    return it->second.status;
+  }
+
+  mQueue.push_back(std::move(job));
+  mQueueCv.notify_one();
+  return Status::Pending;
+}
+
+ShaderTranslator::Status ShaderTranslator::wait(std::uint64_t key,
+                                                const Request &request) {
+  auto id = getJobId(key, request);
+
+  std::unique_lock lock(mMtx);
+  auto it = mJobs.find(id);
+  if (it == mJobs.end()) {
+    return Status::Done;
+  }
+
+  auto &state = it->second;
+  ++state.waiters;
+  mDoneCv.wait(lock, [&] { return state.status != Status::Pending; });
+
+  auto status = state.status;
+  if (--state.waiters == 0) {
+    mJobs.erase(it);
+  }
+
+  return status;
+}
+
+void ShaderTranslator::pretranslate(int vmId, gcn::Stage stage,
+                                    const SpiShaderPgm &pgm) {
+  if (pgm.address == 0) {
+    return;
+  }
+
+  auto request =
+      makeRequest(vmId, pgm.address << 8, stage,
+                  {
+                      .vgprCount = pgm.rsrc1.getVGprCount(),
+                      .sgprCount = pgm.rsrc1.getSGprCount(),
+                      .userSgprs = std::span(pgm.userData.data(),
+                                             pgm.rsrc2.userSgpr),
+                  });
+
+  enqueue(ShaderCache::computeKey(request.address, stage, request.env),
+          request);
+}
+
+void ShaderTranslator::pretranslate(int vmId,
+                                    const Registers::ComputeConfig &pgm) {
+  if (pgm.address == 0) {
+    return;
+  }
+
+  auto request = makeRequest(
+      vmId, pgm.address << 8, gcn::Stage::Cs,
+      {
+          .vgprCount = pgm.rsrc1.getVGprCount(),
+          .sgprCount = pgm.rsrc1.getSGprCount(),
+          .numThreadX = static_cast<std::uint8_t>(pgm.numThreadX),
+          .numThreadY = static_cast<std::uint8_t>(pgm.numThreadY),
+          .numThreadZ = static_cast<std::uint8_t>(pgm.numThreadZ),
+          .userSgprs = std::span(pgm.userData.data(), pgm.rsrc2.userSgpr),
+      });
+
+  enqueue(ShaderCache::computeKey(request.address, gcn::Stage::Cs,
+                                  request.env),
+          request);
+}
+
+ShaderTranslator::Status ShaderTranslator::process(Job &job) {
+  auto readMemory = [vmId = job.request.vmId](void *target,
+                                              rx::AddressRange range) {
+    readRemoteMemory(vmId, target, range);
+  };
+
+  if (mCache.find(job.key, job.userSgprs, readMemory)) {
+    return Status::Done;
+  }
+
+  if (!mCache.isOpen()) {
+    std::lock_guard lock(mMtx);
+    if (auto it = mResults.find(job.id);
+        it != mResults.end() &&
+        ShaderCache::computeMemoryHash(it->second.shader, readMemory) ==
+            it->second.memoryHash) {
+      return Status::Done;
+    }
+  }
+
+  auto converted = translate(job.request);
+  if (!converted) {
+    rx::println(stderr, "shader translator: failed to translate {:x} ({})",
+                job.request.address, job.request.stage);
+    return Status::Failed;
+  }
+
+  if (mCache.isOpen()) {
+    mCache.store(job.key, *converted, readMemory);
+    return Status::Done;
+  }
+
+  auto memoryHash = ShaderCache::computeMemoryHash(*converted, readMemory);
+
+  std::lock_guard lock(mMtx);
+  auto [it, inserted] = mResults.insert_or_assign(
+      job.id,
+      Result{.memoryHash = memoryHash, .shader = std::move(*converted)});
+
+  if (inserted) {
+    mResultOrder.push_back(job.id);
+
+    if (mResultOrder.size() > kMaxResults) {
+      mResults.erase(mResultOrder.front());
+      mResultOrder.pop_front();
+    }
+  }
+
+  return Status::Done;
+}
+
+std::optional<gcn::ConvertedShader>
+ShaderTranslator::takeResult(std::uint64_t key, const Request &request,
+                             ShaderCache::ReadMemoryFn readMemory) {
+  auto id = getJobId(key, request);
+
+  std::lock_guard lock(mMtx);
+  auto it = mResults.find(id);
+  if (it == mResults.end()) {
+    return {};
+  }
+
+  auto result = std::move(it->second);
+  mResults.erase(it);
+  std::erase(mResultOrder, id);
+
+  if (ShaderCache::computeMemoryHash(result.shader, readMemory) !=
+      result.memoryHash) {
+    return {};
+  }
+
+  return std::move(result.shader);
+}
+
+void ShaderTranslator::workerMain(const std::stop_token &stopToken) {
+  std::unique_lock lock(mMtx);
+
+  while (true) {
+    if (!mQueueCv.wait(lock, stopToken, [this] { return !mQueue.empty(); })) {
+      return;
+    }
+
+    auto job = std::move(mQueue.front());
+    mQueue.pop_front();
+
+    lock.unlock();
+    auto status = process(job);
+    lock.lock();
+
+    auto it = mJobs.find(job.id);
+    if (it->second.waiters == 0) {
+      // nobody waits, result is published to the cache and failures are
+      // retried on next request
+      mJobs.erase(it);
+    } else {
+      it->second.status = status;
+      mDoneCv.notify_all();
+    }
+  }
+}
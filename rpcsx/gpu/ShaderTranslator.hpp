@@ -0,0 +1,121 @@
+#pragma once
+
+#include "Registers.hpp"
+#include "ShaderCache.hpp"
+#include "ShaderDumper.hpp"
+#include "shader/GcnConverter.hpp"
+#include "shader/SemanticInfo.hpp"
+#include "shader/gcn.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace amdgpu {
+///
+/// \brief Translation of GCN shaders to SPIR-V on a pool of worker threads.
+///
+/// Requests are deduplicated by persistent cache key, guest VM and user SGPR
+/// values. Translated shaders are published to the ShaderCache, from which
+/// the renderer picks them up. While the cache is closed, the last results
+/// are kept here instead and taken by the renderer. A job is forgotten once
+/// its result is consumed, failed translations are retried by the next
+/// request.
+///
+class ShaderTranslator {
+public:
+  enum class Status : std::uint8_t { Pending, Done, Failed };
+
+  struct Request {
+    int vmId;
+    std::uint64_t address;
+    shader::gcn::Stage stage;
+    shader::gcn::Environment env;
+  };
+
+  ShaderTranslator(const shader::SemanticInfo &semantic,
+                   const shader::gcn::SemanticModuleInfo &semanticModuleInfo,
+                   ShaderCache &cache, ShaderDumper &dumper)
+      : mSemantic(semantic), mSemanticModuleInfo(semanticModuleInfo),
+        mCache(cache), mDumper(dumper) {}
+  ShaderTranslator(const ShaderTranslator &) = delete;
+  ShaderTranslator &operator=(const ShaderTranslator &) = delete;
+  ~ShaderTranslator() { stop(); }
+
+  /// Fills in host capabilities of the environment, the returned request is
+  /// ready to be used as persistent cache key.
+  static Request makeRequest(int vmId, std::uint64_t address,
+                             shader::gcn::Stage stage,
+                             shader::gcn::Environment env);
+
+  void start(std::size_t workerCount);
+  void stop();
+
+  std::optional<shader::gcn::ConvertedShader>
+  translate(const Request &request) const;
+
+  /// Queues translation unless the same request is already in flight.
+  /// Translates inline when no workers are running.
+  Status enqueue(std::uint64_t key, const Request &request);
+
+  /// Waits for the queued request and consumes its status. Returns Done if
+  /// the job already finished, the result should be looked up in the cache.
+  Status wait(std::uint64_t key, const Request &request);
+
+  /// Takes result of finished job that was not published to the closed
+  /// cache. Nothing is returned if guest memory changed since translation.
+  std::optional<shader::gcn::ConvertedShader>
+  takeResult(std::uint64_t key, const Request &request,
+             ShaderCache::ReadMemoryFn readMemory);
+
+  /// Queues translation of the shader bound by SET_SH_REG before the draw or
+  /// dispatch that needs it is submitted.
+  void pretranslate(int vmId, shader::gcn::Stage stage,
+                    const SpiShaderPgm &pgm);
+  void pretranslate(int vmId, const Registers::ComputeConfig &pgm);
+
+private:
+  using JobId = std::tuple<std::uint64_t, int, std::uint64_t>;
+
+  struct Job {
+    JobId id;
+    std::uint64_t key;
+    Request request;
+    std::vector<std::uint32_t> userSgprs;
+  };
+
+  struct JobState {
+    Status status = Status::Pending;
+    std::uint32_t waiters = 0;
+  };
+
+  struct Result {
+    std::uint64_t memoryHash;
+    shader::gcn::ConvertedShader shader;
+  };
+
+  static JobId getJobId(std::uint64_t key, const Request &request);
+  Status process(Job &job);
+  void workerMain(const std::stop_token &stopToken);
+
+  const shader::SemanticInfo &mSemantic;
+  const shader::gcn::SemanticModuleInfo &mSemanticModuleInfo;
+  ShaderCache &mCache;
+  ShaderDumper &mDumper;
+
+  std::mutex mMtx;
+  std::condition_variable_any mQueueCv;
+  std::condition_variable mDoneCv;
+  std::deque<Job> mQueue;
+  std::map<JobId, JobState> mJobs;
+  std::map<JobId, Result> mResults;
+  std::deque<JobId> mResultOrder;
+  std::vector<std::jthread> mWorkers;
+};
+} // namespace amdgpu
@@ -2,7 +2,9 @@
 
 #include "gnm/constants.hpp"
 #include "tiler.hpp"
+#include <cstddef>
 #include <cstdint>
+#include <span>
 
 namespace amdgpu {
 std::uint64_t getTiledOffset(gnm::TextureType texType, bool isPow2Padded,
@@ -11,4 +13,20 @@ std::uint64_t getTiledOffset(gnm::TextureType texType, bool isPow2Padded,
                              amdgpu::MacroTileMode macroTileMode, int mipLevel,
                              int arraySlice, int width, int height, int depth,
                              int pitch, int x, int y, int z, int fragmentIndex);
-}
+
+/// Converts subresource of tiled surface to linear layout on the host, with
+/// the same addressing and slice selection as GpuTiler::detile. Work is
+/// performed per micro tile and split between threads for large surfaces.
+/// Linear span covers whole surface, tiled span starts at `tiledBaseOffset`
+/// of tiled surface. Elements outside of the spans are skipped.
+void detile(const SurfaceInfo &info, TileMode tileMode,
+            std::span<const std::byte> tiled, std::span<std::byte> linear,
+            int mipLevel, int baseArray, int arrayCount,
+            std::uint64_t tiledBaseOffset = 0);
+
+/// Inverse of detile, matches GpuTiler::tile.
+void tile(const SurfaceInfo &info, TileMode tileMode,
+          std::span<const std::byte> linear, std::span<std::byte> tiled,
+          int mipLevel, int baseArray, int arrayCount,
+          std::uint64_t tiledBaseOffset = 0);
+} // namespace amdgpu
@@ -1,6 +1,15 @@
 #include "amdgpu/tiler_cpu.hpp"
 #include "amdgpu/tiler.hpp"
 #include "gnm/gnm.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 constexpr std::uint64_t
 getTiledOffset1D(gnm::TextureType texType, bool isPow2Padded,
@@ -344,7 +353,7 @@ getTiledOffset2D(gnm::TextureType texType, bool isPow2Padded,
   case amdgpu::kArrayMode3dTiledThick:
   case amdgpu::kArrayMode3dTiledXThick:
     pipeSliceRotation =
-        std::max(1UL, (numPipes / 2UL) - 1UL) * (slice / tileThickness);
+        (numPipes > 2 ? numPipes / 2 - 1 : 1) * (slice / tileThickness);
     break;
   default:
     break;
@@ -363,7 +372,7 @@ getTiledOffset2D(gnm::TextureType texType, bool isPow2Padded,
   case amdgpu::kArrayMode3dTiledThin:
   case amdgpu::kArrayMode3dTiledThick:
   case amdgpu::kArrayMode3dTiledXThick:
-    sliceRotation = std::max(1UL, (numPipes / 2UL) - 1UL) *
+    sliceRotation = (numPipes > 2 ? numPipes / 2 - 1 : 1) *
                     (slice / tileThickness) / numPipes;
     break;
   default:
@@ -439,3 +448,801 @@ std::uint64_t amdgpu::getTiledOffset(gnm::TextureType texType,
 
   std::abort();
 }
+
+namespace {
+using namespace amdgpu;
+
+// surfaces smaller than this are not worth waking up helper threads
+constexpr std::uint64_t kMinBytesPerThread = 1 << 20;
+constexpr std::uint32_t kMaxTileThickness = 8;
+
+// 8x8 tile of 128 bit elements with 8 fragments split into 64 byte slices
+constexpr std::uint32_t kMaxTileSplitSlices = 128;
+
+/// Micro tile position in tiled memory. Offsets inside of micro tile are
+/// resolved by inserting the pipe and bank bits above the pipe interleave.
+struct TileAddress {
+  std::uint64_t base;
+  std::uint64_t pipeBankBits;
+  std::uint32_t highShift;
+
+  [[nodiscard]] std::uint64_t resolve(std::uint64_t offset) const {
+    auto totalOffset = base + offset;
+    return (totalOffset & (kPipeInterleaveBytes - 1)) | pipeBankBits |
+           ((totalOffset / kPipeInterleaveBytes) << highShift);
+  }
+};
+
+/// Addressing of single subresource, in the same terms as the GPU tiler
+/// shaders. Everything that does not depend on the element position is
+/// computed once per call.
+struct SubresourceLayout {
+  ArrayMode arrayMode;
+  TileMode tileMode;
+  std::uint32_t bitsPerElement;
+  std::uint32_t numFragmentsPerPixel;
+  std::uint32_t elementBytes;
+  std::uint32_t tiledWidth;
+  std::uint32_t tiledHeight;
+  std::uint32_t tiledDepth;
+  std::uint32_t linearPitch;
+  std::uint32_t linearWidth;
+  std::uint32_t linearHeight;
+  std::uint32_t tileThickness;
+
+  // micro tile
+  std::uint64_t tileBytes;
+  std::uint64_t tileSplitBytes;
+  std::uint64_t elementStride;
+  std::uint32_t slicesPerTile;
+  std::uint32_t runLength;
+  std::array<std::uint32_t, kMaxTileThickness * kMicroTileHeight *
+                                kMicroTileWidth>
+      elementOffsets;
+
+  // 1d
+  std::uint64_t tilesPerRow;
+  std::uint64_t tilesPerSlice;
+
+  // 2d
+  std::uint32_t numPipes;
+  std::uint32_t numBanks;
+  std::uint32_t pipeBits;
+  std::uint32_t bankBits;
+  std::uint32_t bankWidth;
+  std::uint32_t bankHeight;
+  std::uint32_t macroTileWidth;
+  std::uint32_t macroTileHeight;
+  std::uint64_t macroTileBytes;
+  std::uint64_t macroTilesPerRow;
+  std::uint64_t sliceBytes;
+
+  [[nodiscard]] bool isLinear() const {
+    return arrayMode == kArrayModeLinearGeneral ||
+           arrayMode == kArrayModeLinearAligned;
+  }
+
+  [[nodiscard]] bool is1D() const {
+    return arrayMode == kArrayMode1dTiledThin ||
+           arrayMode == kArrayMode1dTiledThick;
+  }
+
+  [[nodiscard]] std::uint32_t elementOffset(std::uint32_t x, std::uint32_t y,
+                                            std::uint32_t z) const {
+    return elementOffsets[(z * kMicroTileHeight + y) * kMicroTileWidth + x];
+  }
+};
+
+/// Longest aligned run of elements that is contiguous in both layouts and
+/// does not cross pipe interleave or tile split boundary.
+std::uint32_t getRunLength(const SubresourceLayout &layout) {
+  std::uint64_t elementBits = std::uint64_t(layout.elementBytes) * 8;
+  if (layout.elementStride != elementBits ||
+      std::uint64_t(layout.bitsPerElement) * layout.numFragmentsPerPixel !=
+          elementBits) {
+    return 1;
+  }
+
+  for (auto runLength = kMicroTileWidth; runLength > 1; runLength /= 2) {
+    std::uint64_t runBytes = runLength * layout.elementBytes;
+    bool contiguous = runBytes <= kPipeInterleaveBytes &&
+                      runBytes <= layout.tileSplitBytes;
+
+    for (std::uint32_t z = 0; contiguous && z < layout.tileThickness; ++z) {
+      for (std::uint32_t y = 0; contiguous && y < kMicroTileHeight; ++y) {
+        for (std::uint32_t x = 0; contiguous && x < kMicroTileWidth;
+             x += runLength) {
+          auto runOffset = layout.elementOffset(x, y, z);
+          contiguous = runOffset % runBytes == 0;
+
+          for (std::uint32_t i = 1; contiguous && i < runLength; ++i) {
+            contiguous = layout.elementOffset(x + i, y, z) ==
+                         runOffset + i * layout.elementBytes;
+          }
+        }
+      }
+    }
+
+    if (contiguous) {
+      return runLength;
+    }
+  }
+
+  return 1;
+}
+
+SubresourceLayout makeLayout(const SurfaceInfo &info, TileMode tileMode,
+                             int mipLevel) {
+  auto &subresource = info.getSubresourceInfo(mipLevel);
+
+  SubresourceLayout layout{};
+  layout.arrayMode = tileMode.arrayMode();
+  layout.tileMode = tileMode;
+  layout.bitsPerElement = info.bitsPerElement;
+  layout.numFragmentsPerPixel = 1u << info.numFragments;
+  layout.elementBytes = (info.bitsPerElement + 7) / 8;
+  layout.tiledWidth = subresource.tiledWidth;
+  layout.tiledHeight = subresource.tiledHeight;
+  layout.tiledDepth = subresource.tiledDepth;
+  layout.linearPitch = subresource.linearPitch;
+  layout.linearWidth = subresource.linearWidth;
+  layout.linearHeight = subresource.linearHeight;
+  layout.tileThickness = getMicroTileThickness(layout.arrayMode);
+  layout.slicesPerTile = 1;
+
+  if (layout.isLinear()) {
+    return layout;
+  }
+
+  auto microTileMode = tileMode.microTileMode();
+  auto bitsPerElement = layout.bitsPerElement;
+
+  // only 2d depth tiles interleave fragments of pixel, fragment 0 is at
+  // element offset in all other cases
+  std::uint64_t elementStride = bitsPerElement;
+  if (!layout.is1D() && microTileMode == kMicroTileModeDepth) {
+    elementStride *= layout.numFragmentsPerPixel;
+  }
+  layout.elementStride = elementStride;
+
+  for (std::uint32_t z = 0; z < layout.tileThickness; ++z) {
+    for (std::uint32_t y = 0; y < kMicroTileHeight; ++y) {
+      for (std::uint32_t x = 0; x < kMicroTileWidth; ++x) {
+        auto elementIndex = getElementIndex(x, y, z, bitsPerElement,
+                                            microTileMode, layout.arrayMode);
+        layout.elementOffsets[(z * kMicroTileHeight + y) * kMicroTileWidth +
+                              x] =
+            static_cast<std::uint32_t>(elementIndex * elementStride / 8);
+      }
+    }
+  }
+
+  if (layout.is1D()) {
+    layout.tileBytes = (kMicroTileWidth * kMicroTileHeight *
+                            layout.tileThickness * bitsPerElement +
+                        7) /
+                       8;
+    layout.tileSplitBytes = layout.tileBytes;
+    layout.tilesPerRow = layout.tiledWidth / kMicroTileWidth;
+    layout.tilesPerSlice = std::max<std::uint64_t>(
+        layout.tilesPerRow * (layout.tiledHeight / kMicroTileHeight), 1);
+    layout.runLength = getRunLength(layout);
+    return layout;
+  }
+
+  auto macroTileMode = info.macroTileMode;
+  layout.bankWidth = 1u << macroTileMode.bankWidth();
+  layout.bankHeight = 1u << macroTileMode.bankHeight();
+  layout.numBanks = 2u << macroTileMode.numBanks();
+  auto macroTileAspect = 1u << macroTileMode.macroTileAspect();
+
+  std::uint32_t tileBytes1x = (layout.tileThickness * bitsPerElement *
+                                   kMicroTileWidth * kMicroTileHeight +
+                               7) /
+                              8;
+  std::uint32_t sampleSplit = 1u << tileMode.sampleSplit();
+  std::uint32_t tileSplitC = microTileMode == kMicroTileModeDepth
+                                 ? (64u << tileMode.tileSplit())
+                                 : std::max(256U, tileBytes1x * sampleSplit);
+
+  layout.tileSplitBytes = std::min(kDramRowSize, tileSplitC);
+  layout.numPipes = getPipeCount(tileMode.pipeConfig());
+  layout.pipeBits = std::countr_zero(layout.numPipes);
+  layout.bankBits = std::countr_zero(layout.numBanks);
+  layout.macroTileWidth =
+      (kMicroTileWidth * layout.bankWidth * layout.numPipes) * macroTileAspect;
+  layout.macroTileHeight =
+      (kMicroTileHeight * layout.bankHeight * layout.numBanks) /
+      macroTileAspect;
+
+  layout.tileBytes = (kMicroTileWidth * kMicroTileHeight *
+                          layout.tileThickness * bitsPerElement *
+                          layout.numFragmentsPerPixel +
+                      7) /
+                     8;
+
+  if (layout.tileBytes > layout.tileSplitBytes && layout.tileThickness == 1) {
+    layout.slicesPerTile = layout.tileBytes / layout.tileSplitBytes;
+    layout.tileBytes = layout.tileSplitBytes;
+  } else {
+    layout.tileSplitBytes = layout.tileBytes;
+  }
+
+  layout.macroTileBytes = (layout.macroTileWidth / kMicroTileWidth) *
+                          (layout.macroTileHeight / kMicroTileHeight) *
+                          layout.tileBytes /
+                          (layout.numPipes * layout.numBanks);
+  layout.macroTilesPerRow = layout.tiledWidth / layout.macroTileWidth;
+  layout.sliceBytes = layout.macroTilesPerRow *
+                      (layout.tiledHeight / layout.macroTileHeight) *
+                      layout.macroTileBytes;
+  layout.runLength = getRunLength(layout);
+  return layout;
+}
+
+TileAddress getTileAddress1D(const SubresourceLayout &layout, std::uint32_t x,
+                             std::uint32_t y, std::uint32_t z) {
+  std::uint64_t sliceOffset =
+      (z / layout.tileThickness) * layout.tilesPerSlice * layout.tileBytes;
+  std::uint64_t tileOffset = ((y / kMicroTileHeight) * layout.tilesPerRow +
+                              x / kMicroTileWidth) *
+                             layout.tileBytes;
+
+  return {
+      .base = sliceOffset + tileOffset,
+      .pipeBankBits = 0,
+      .highShift = std::countr_zero(kPipeInterleaveBytes),
+  };
+}
+
+TileAddress getTileAddress2D(const SubresourceLayout &layout, std::uint32_t x,
+                             std::uint32_t y, std::uint32_t z,
+                             std::uint32_t tileSplitSlice) {
+  auto arrayMode = layout.arrayMode;
+  auto numPipes = layout.numPipes;
+  auto numBanks = layout.numBanks;
+  auto tileThickness = layout.tileThickness;
+
+  std::uint32_t xh = x, yh = y;
+  if (arrayMode == kArrayModeTiledThinPrt ||
+      arrayMode == kArrayModeTiledThickPrt) {
+    xh %= layout.macroTileWidth;
+    yh %= layout.macroTileHeight;
+  }
+
+  std::uint64_t pipe = getPipeIndex(xh, yh, layout.tileMode.pipeConfig());
+  std::uint64_t bank = getBankIndex(xh, yh, layout.bankWidth,
+                                    layout.bankHeight, numBanks, numPipes);
+
+  std::uint64_t macroTileIndex =
+      (y / layout.macroTileHeight) * layout.macroTilesPerRow +
+      x / layout.macroTileWidth;
+  std::uint64_t macroTileOffset = macroTileIndex * layout.macroTileBytes;
+
+  std::uint64_t slice = z;
+  std::uint64_t sliceOffset =
+      (tileSplitSlice + layout.slicesPerTile * slice / tileThickness) *
+      layout.sliceBytes;
+
+  std::uint64_t tileRowIndex = (y / kMicroTileHeight) % layout.bankHeight;
+  std::uint64_t tileColumnIndex =
+      ((x / kMicroTileWidth) / numPipes) % layout.bankWidth;
+  std::uint64_t tileOffset =
+      (tileRowIndex * layout.bankWidth + tileColumnIndex) * layout.tileBytes;
+
+  std::uint64_t pipeSliceRotation = 0;
+  std::uint64_t sliceRotation = 0;
+  std::uint64_t tileSplitSliceRotation = 0;
+
+  switch (arrayMode) {
+  case kArrayMode3dTiledThin:
+  case kArrayMode3dTiledThick:
+  case kArrayMode3dTiledXThick:
+    pipeSliceRotation =
+        (numPipes > 2 ? numPipes / 2 - 1 : 1) * (slice / tileThickness);
+    sliceRotation = (numPipes > 2 ? numPipes / 2 - 1 : 1) *
+                    (slice / tileThickness) / numPipes;
+    break;
+  case kArrayMode2dTiledThin:
+  case kArrayMode2dTiledThick:
+  case kArrayMode2dTiledXThick:
+    sliceRotation = ((numBanks / 2) - 1) * (slice / tileThickness);
+    break;
+  default:
+    break;
+  }
+
+  switch (arrayMode) {
+  case kArrayMode2dTiledThin:
+  case kArrayMode3dTiledThin:
+  case kArrayMode2dTiledThinPrt:
+  case kArrayMode3dTiledThinPrt:
+    tileSplitSliceRotation = ((numBanks / 2) + 1) * tileSplitSlice;
+    break;
+  default:
+    break;
+  }
+
+  pipe ^= pipeSliceRotation & (numPipes - 1);
+  bank ^= sliceRotation;
+  bank ^= tileSplitSliceRotation;
+  bank &= numBanks - 1;
+
+  auto pipeInterleaveBits = std::countr_zero(kPipeInterleaveBytes);
+
+  return {
+      .base = sliceOffset + macroTileOffset + tileOffset,
+      .pipeBankBits = (pipe << pipeInterleaveBits) |
+                      (bank << (pipeInterleaveBits + layout.pipeBits)),
+      .highShift = static_cast<std::uint32_t>(
+          pipeInterleaveBits + layout.pipeBits + layout.bankBits),
+  };
+}
+
+template <std::size_t Size>
+void copyFixed(std::byte *dst, const std::byte *src) {
+  // constant size copies are lowered to plain vector loads and stores
+  std::memcpy(dst, src, Size);
+}
+
+using CopyFn = void (*)(std::byte *, const std::byte *);
+
+CopyFn getRunCopy(std::uint32_t runBytes) {
+  switch (runBytes) {
+  case 1:
+    return copyFixed<1>;
+  case 2:
+    return copyFixed<2>;
+  case 4:
+    return copyFixed<4>;
+  case 8:
+    return copyFixed<8>;
+  case 16:
+    return copyFixed<16>;
+  case 32:
+    return copyFixed<32>;
+  case 64:
+    return copyFixed<64>;
+  case 128:
+    return copyFixed<128>;
+  default:
+    return nullptr;
+  }
+}
+
+/// Memory of single array slice of subresource. Tiled and linear spans are
+/// already bounded, copies that fall outside of them are dropped.
+struct SlicePair {
+  std::span<std::byte> tiled;
+  std::span<std::byte> linear;
+};
+
+template <bool Detile>
+void copyBytes(const SlicePair &slice, std::uint64_t tiledOffset,
+               std::uint64_t linearOffset, std::uint64_t size, CopyFn copy) {
+  if (tiledOffset + size > slice.tiled.size() ||
+      linearOffset + size > slice.linear.size()) {
+    return;
+  }
+
+  auto tiled = slice.tiled.data() + tiledOffset;
+  auto linear = slice.linear.data() + linearOffset;
+
+  if constexpr (Detile) {
+    if (copy != nullptr) {
+      copy(linear, tiled);
+    } else {
+      std::memcpy(linear, tiled, size);
+    }
+  } else {
+    if (copy != nullptr) {
+      copy(tiled, linear);
+    } else {
+      std::memcpy(tiled, linear, size);
+    }
+  }
+}
+
+template <bool Detile>
+void copyLinearRow(const SubresourceLayout &layout, const SlicePair &slice,
+                   std::uint32_t y, std::uint32_t z) {
+  auto bitsPerElement = layout.bitsPerElement;
+  std::uint64_t paddedWidth = layout.tiledWidth;
+
+  if (bitsPerElement == 1) {
+    bitsPerElement = 8;
+    paddedWidth = std::max<std::uint64_t>((paddedWidth + 7) / 8, 1);
+  }
+
+  std::uint64_t tiledOffset =
+      (paddedWidth * layout.tiledHeight * z + paddedWidth * y) *
+      bitsPerElement / 8;
+  std::uint64_t linearElementBits =
+      std::uint64_t(layout.bitsPerElement) * layout.numFragmentsPerPixel;
+  std::uint64_t linearOffset =
+      (std::uint64_t(z) * layout.linearPitch * layout.linearHeight +
+       std::uint64_t(y) * layout.linearPitch) *
+      linearElementBits / 8;
+
+  if (bitsPerElement == layout.bitsPerElement &&
+      linearElementBits == bitsPerElement && bitsPerElement % 8 == 0) {
+    copyBytes<Detile>(slice, tiledOffset, linearOffset,
+                      std::uint64_t(layout.linearWidth) * layout.elementBytes,
+                      nullptr);
+    return;
+  }
+
+  for (std::uint32_t x = 0; x < layout.linearWidth; ++x) {
+    copyBytes<Detile>(slice, tiledOffset + std::uint64_t(x) * bitsPerElement / 8,
+                      linearOffset + x * linearElementBits / 8,
+                      layout.elementBytes, nullptr);
+  }
+}
+
+/// Copies micro tile that is contiguous in tiled memory. Rows of linear
+/// memory are moved with single fixed size load or store, elements are
+/// permuted inside of the row buffer with fixed size copies.
+template <bool Detile, std::uint32_t ElementBytes>
+void copyWholeMicroTile(const SubresourceLayout &layout, std::byte *tiled,
+                        std::byte *linear, std::uint64_t linearRowPitch,
+                        std::uint64_t linearSlicePitch) {
+  constexpr std::uint32_t kRowBytes = kMicroTileWidth * ElementBytes;
+
+  for (std::uint32_t z = 0; z < layout.tileThickness; ++z) {
+    for (std::uint32_t y = 0; y < kMicroTileHeight; ++y) {
+      auto linearRow = linear + z * linearSlicePitch + y * linearRowPitch;
+      auto offsets = &layout.elementOffsets[(z * kMicroTileHeight + y) *
+                                            kMicroTileWidth];
+      alignas(16) std::byte row[kRowBytes];
+
+      if constexpr (Detile) {
+        for (std::uint32_t x = 0; x < kMicroTileWidth; ++x) {
+          copyFixed<ElementBytes>(row + x * ElementBytes, tiled + offsets[x]);
+        }
+        copyFixed<kRowBytes>(linearRow, row);
+      } else {
+        copyFixed<kRowBytes>(row, linearRow);
+        for (std::uint32_t x = 0; x < kMicroTileWidth; ++x) {
+          copyFixed<ElementBytes>(tiled + offsets[x], row + x * ElementBytes);
+        }
+      }
+    }
+  }
+}
+
+using WholeMicroTileFn = void (*)(const SubresourceLayout &, std::byte *,
+                                  std::byte *, std::uint64_t, std::uint64_t);
+
+template <bool Detile>
+WholeMicroTileFn getWholeMicroTileCopy(std::uint32_t elementBytes) {
+  switch (elementBytes) {
+  case 1:
+    return copyWholeMicroTile<Detile, 1>;
+  case 2:
+    return copyWholeMicroTile<Detile, 2>;
+  case 4:
+    return copyWholeMicroTile<Detile, 4>;
+  case 8:
+    return copyWholeMicroTile<Detile, 8>;
+  case 16:
+    return copyWholeMicroTile<Detile, 16>;
+  default:
+    return nullptr;
+  }
+}
+
+/// Whole micro tile kernel applies when elements are plain bytes, the tile
+/// is not split and fits into one pipe interleave.
+bool canCopyWholeMicroTiles(const SubresourceLayout &layout) {
+  std::uint64_t elementBits = std::uint64_t(layout.elementBytes) * 8;
+  return layout.slicesPerTile == 1 && layout.elementStride == elementBits &&
+         std::uint64_t(layout.bitsPerElement) * layout.numFragmentsPerPixel ==
+             elementBits &&
+         layout.tileBytes <= kPipeInterleaveBytes &&
+         std::has_single_bit(layout.tileBytes);
+}
+
+template <bool Detile>
+void copyMicroTile(const SubresourceLayout &layout, const SlicePair &slice,
+                   std::uint32_t tileX, std::uint32_t tileY,
+                   std::uint32_t zBegin, std::uint32_t zEnd,
+                   WholeMicroTileFn wholeTileCopy) {
+  auto x0 = tileX * kMicroTileWidth;
+  auto y0 = tileY * kMicroTileHeight;
+  auto zBase = zBegin - zBegin % layout.tileThickness;
+
+  TileAddress addresses[kMaxTileSplitSlices];
+  for (std::uint32_t i = 0; i < layout.slicesPerTile; ++i) {
+    addresses[i] = layout.is1D() ? getTileAddress1D(layout, x0, y0, zBase)
+                                 : getTileAddress2D(layout, x0, y0, zBase, i);
+  }
+
+  auto width = std::min(kMicroTileWidth, layout.linearWidth - x0);
+  auto height = std::min(kMicroTileHeight, layout.linearHeight - y0);
+
+  if (wholeTileCopy != nullptr && width == kMicroTileWidth &&
+      height == kMicroTileHeight && zBegin == zBase &&
+      zEnd - zBegin == layout.tileThickness) {
+    std::uint64_t linearRowPitch =
+        std::uint64_t(layout.linearPitch) * layout.elementBytes;
+    std::uint64_t linearSlicePitch = linearRowPitch * layout.linearHeight;
+    std::uint64_t linearOffset = zBase * linearSlicePitch +
+                                 y0 * linearRowPitch +
+                                 std::uint64_t(x0) * layout.elementBytes;
+    std::uint64_t linearEnd = linearOffset +
+                              (layout.tileThickness - 1) * linearSlicePitch +
+                              (kMicroTileHeight - 1) * linearRowPitch +
+                              kMicroTileWidth * layout.elementBytes;
+    auto tiledOffset = addresses[0].resolve(0);
+
+    if (addresses[0].base % kPipeInterleaveBytes + layout.tileBytes <=
+            kPipeInterleaveBytes &&
+        tiledOffset + layout.tileBytes <= slice.tiled.size() &&
+        linearEnd <= slice.linear.size()) {
+      wholeTileCopy(layout, slice.tiled.data() + tiledOffset,
+                    slice.linear.data() + linearOffset, linearRowPitch,
+                    linearSlicePitch);
+      return;
+    }
+  }
+  auto runLength = layout.runLength;
+  auto runCopy = getRunCopy(runLength * layout.elementBytes);
+  std::uint64_t linearElementBits =
+      std::uint64_t(layout.bitsPerElement) * layout.numFragmentsPerPixel;
+  std::uint64_t linearSlicePitch =
+      std::uint64_t(layout.linearPitch) * layout.linearHeight;
+
+  for (auto z = zBegin; z < zEnd; ++z) {
+    for (std::uint32_t y = 0; y < height; ++y) {
+      std::uint64_t linearRow =
+          z * linearSlicePitch + std::uint64_t(y0 + y) * layout.linearPitch;
+
+      for (std::uint32_t x = 0; x < width; x += runLength) {
+        std::uint64_t elementOffset = layout.elementOffset(x, y, z - zBase);
+        std::uint64_t tileSplitSlice = 0;
+        if (layout.slicesPerTile > 1) {
+          tileSplitSlice = elementOffset / layout.tileSplitBytes;
+          elementOffset %= layout.tileSplitBytes;
+        }
+
+        auto count = std::min(runLength, width - x);
+        copyBytes<Detile>(
+            slice, addresses[tileSplitSlice].resolve(elementOffset),
+            (linearRow + x0 + x) * linearElementBits / 8,
+            std::uint64_t(count) * layout.elementBytes,
+            count == runLength ? runCopy : nullptr);
+      }
+    }
+  }
+}
+
+/// Helper threads shared by all tile and detile calls. Threads are started on
+/// first use and parked on condition variable between calls. Only one call
+/// uses the pool at a time, concurrent callers do their work inline.
+class WorkerPool {
+  using JobFn = void (*)(void *);
+
+  std::mutex mRunMutex;
+  std::mutex mMutex;
+  std::condition_variable mWakeCv;
+  std::condition_variable mDoneCv;
+  std::vector<std::jthread> mThreads;
+  JobFn mJob = nullptr;
+  void *mJobContext = nullptr;
+  std::uint64_t mGeneration = 0;
+  std::size_t mTickets = 0;
+  std::size_t mRunning = 0;
+  bool mStop = false;
+
+public:
+  static WorkerPool &getInstance() {
+    static WorkerPool instance;
+    return instance;
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard lock(mMutex);
+      mStop = true;
+    }
+
+    mWakeCv.notify_all();
+  }
+
+  [[nodiscard]] static std::size_t getMaxHelperCount() {
+    return std::max(std::thread::hardware_concurrency(), 1u) - 1;
+  }
+
+  /// Runs `fn` on the calling thread and on up to `helperCount` helpers,
+  /// returns when all of them are done. `fn` must distribute work by itself.
+  /// Returns false if the pool is busy, nothing is executed in that case.
+  template <typename Fn> bool run(std::size_t helperCount, Fn &fn) {
+    std::unique_lock runLock(mRunMutex, std::try_to_lock);
+    if (!runLock.owns_lock()) {
+      return false;
+    }
+
+    helperCount = std::min(helperCount, getMaxHelperCount());
+
+    {
+      std::lock_guard lock(mMutex);
+      while (mThreads.size() < helperCount) {
+        mThreads.emplace_back([this] { workerLoop(); });
+      }
+
+      mJob = [](void *context) { (*static_cast<Fn *>(context))(); };
+      mJobContext = &fn;
+      mTickets = helperCount;
+      ++mGeneration;
+    }
+
+    mWakeCv.notify_all();
+    fn();
+
+    // work is drained at this point, helpers that did not wake up yet are
+    // not needed anymore
+    std::unique_lock lock(mMutex);
+    mTickets = 0;
+    mDoneCv.wait(lock, [this] { return mRunning == 0; });
+    mJob = nullptr;
+    mJobContext = nullptr;
+    return true;
+  }
+
+private:
+  void workerLoop() {
+    std::uint64_t generation = 0;
+    std::unique_lock lock(mMutex);
+
+    while (true) {
+      mWakeCv.wait(lock, [&] {
+        return mStop || (mTickets > 0 && mGeneration != generation);
+      });
+
+      if (mStop) {
+        return;
+      }
+
+      generation = mGeneration;
+      --mTickets;
+      ++mRunning;
+      auto job = mJob;
+      auto context = mJobContext;
+      lock.unlock();
+
+      job(context);
+
+      lock.lock();
+      if (--mRunning == 0) {
+        mDoneCv.notify_all();
+      }
+    }
+  }
+};
+
+/// Splits `count` work items between threads when amount of work is worth it
+template <typename Fn>
+void parallelFor(std::size_t count, std::uint64_t workBytes, Fn &&fn) {
+  std::size_t threadCount =
+      std::min<std::uint64_t>(WorkerPool::getMaxHelperCount() + 1,
+                              workBytes / kMinBytesPerThread);
+  threadCount = std::min(threadCount, count);
+
+  std::atomic<std::size_t> next{0};
+  auto worker = [&] {
+    for (auto i = next.fetch_add(1, std::memory_order::relaxed); i < count;
+         i = next.fetch_add(1, std::memory_order::relaxed)) {
+      fn(i);
+    }
+  };
+
+  if (threadCount <= 1 ||
+      !WorkerPool::getInstance().run(threadCount - 1, worker)) {
+    worker();
+  }
+}
+
+template <bool Detile>
+void copySubresource(const SurfaceInfo &info, TileMode tileMode,
+                     std::span<std::byte> tiled, std::span<std::byte> linear,
+                     int mipLevel, int baseArray, int arrayCount,
+                     std::uint64_t tiledBaseOffset) {
+  auto &subresource = info.getSubresourceInfo(mipLevel);
+  auto layout = makeLayout(info, tileMode, mipLevel);
+
+  if (layout.linearWidth == 0 || layout.linearHeight == 0) {
+    return;
+  }
+
+  // same slice selection as GpuTiler: array slices are separate surfaces,
+  // otherwise z walks over the depth of the subresource
+  std::uint32_t sliceCount = 1;
+  std::uint32_t depth = layout.tiledDepth;
+  if (arrayCount > 1) {
+    sliceCount = arrayCount;
+    depth = 1;
+  }
+
+  auto getSlice = [&](std::uint32_t index) {
+    SlicePair result{};
+    auto tiledOffset = subresource.tiledOffset +
+                       (baseArray + index) * subresource.tiledSize;
+    auto linearOffset = subresource.linearOffset +
+                        (baseArray + index) * subresource.linearSize;
+
+    if (tiledOffset >= tiledBaseOffset &&
+        tiledOffset - tiledBaseOffset < tiled.size()) {
+      result.tiled = tiled.subspan(tiledOffset - tiledBaseOffset);
+    }
+
+    if (linearOffset < linear.size()) {
+      result.linear = linear.subspan(linearOffset);
+    }
+
+    return result;
+  };
+
+  std::uint64_t workBytes = std::uint64_t(sliceCount) * depth *
+                            layout.linearWidth * layout.linearHeight *
+                            layout.elementBytes;
+
+  if (layout.isLinear()) {
+    std::size_t rowsPerSlice = std::size_t(depth) * layout.linearHeight;
+
+    parallelFor(sliceCount * rowsPerSlice, workBytes, [&](std::size_t index) {
+      auto slice = getSlice(index / rowsPerSlice);
+      auto row = index % rowsPerSlice;
+      copyLinearRow<Detile>(layout, slice, row % layout.linearHeight,
+                            row / layout.linearHeight);
+    });
+    return;
+  }
+
+  // work item is one row of micro tiles of one thick slice
+  auto tilesPerRow = (layout.linearWidth + kMicroTileWidth - 1) /
+                     kMicroTileWidth;
+  std::size_t tileRows =
+      (layout.linearHeight + kMicroTileHeight - 1) / kMicroTileHeight;
+  std::size_t thickSlices =
+      (depth + layout.tileThickness - 1) / layout.tileThickness;
+  std::size_t itemsPerSlice = thickSlices * tileRows;
+
+  auto wholeTileCopy = canCopyWholeMicroTiles(layout)
+                           ? getWholeMicroTileCopy<Detile>(layout.elementBytes)
+                           : nullptr;
+
+  parallelFor(sliceCount * itemsPerSlice, workBytes, [&](std::size_t index) {
+    auto slice = getSlice(index / itemsPerSlice);
+    auto item = index % itemsPerSlice;
+    auto tileY = static_cast<std::uint32_t>(item % tileRows);
+    auto zBegin =
+        static_cast<std::uint32_t>(item / tileRows) * layout.tileThickness;
+    auto zEnd = std::min(zBegin + layout.tileThickness, depth);
+
+    for (std::uint32_t tileX = 0; tileX < tilesPerRow; ++tileX) {
+      copyMicroTile<Detile>(layout, slice, tileX, tileY, zBegin, zEnd,
+                            wholeTileCopy);
+    }
+  });
+}
+} // namespace
+
+void amdgpu::detile(const SurfaceInfo &info, TileMode tileMode,
+                    std::span<const std::byte> tiled, std::span<std::byte> linear,
+                    int mipLevel, int baseArray, int arrayCount,
+                    std::uint64_t tiledBaseOffset) {
+  copySubresource<true>(
+      info, tileMode,
+      std::span(const_cast<std::byte *>(tiled.data()), tiled.size()), linear,
+      mipLevel, baseArray, arrayCount, tiledBaseOffset);
+}
+
+void amdgpu::tile(const SurfaceInfo &info, TileMode tileMode,
+                  std::span<const std::byte> linear, std::span<std::byte> tiled,
+                  int mipLevel, int baseArray, int arrayCount,
+                  std::uint64_t tiledBaseOffset) {
+  copySubresource<false>(
+      info, tileMode, tiled,
+      std::span(const_cast<std::byte *>(linear.data()), linear.size()),
+      mipLevel, baseArray, arrayCount, tiledBaseOffset);
+}
@@ -2,11 +2,20 @@
 
 #include "gcn.hpp"
 #include "rx/MemoryTable.hpp"
+#include "rx/Serializer.hpp"
 #include <cstdint>
 #include <optional>
 #include <vector>
 
 namespace shader::gcn {
+///
+/// \brief Version of the converter output.
+///
+/// Must be incremented on every change that affects generated SPIR-V or
+/// ShaderInfo layout, persistent shader caches are invalidated on mismatch.
+///
+inline constexpr std::uint32_t kConverterVersion = 1;
+
 enum class VsSGprInput {
   State,
   StreamOutWriteIndex,
@@ -178,6 +187,9 @@ struct Resources {
 
   void print(std::ostream &os, ir::NameStorage &ns) const;
   void dump();
+
+  void serialize(rx::Serializer &s) const;
+  void deserialize(rx::Deserializer &s);
 };
 
 struct ShaderInfo {
@@ -202,6 +214,9 @@ struct ShaderInfo {
 
     return configSlots.size() - 1;
   }
+
+  void serialize(rx::Serializer &s) const;
+  void deserialize(rx::Deserializer &s);
 };
 
 struct ConvertedShader {
@@ -10,6 +10,8 @@
 #include "rx/print.hpp"
 #include <iostream>
 #include <limits>
+#include <map>
+#include <variant>
 
 using namespace shader;
 
@@ -720,6 +722,447 @@ void gcn::Resources::print(std::ostream &os, ir::NameStorage &ns) const {
 
 void gcn::Resources::dump() { print(std::cerr, context.ns); }
 
+namespace {
+enum class SerializedNodeType : std::uint8_t {
+  Instruction,
+  Value,
+  Block,
+};
+
+enum class SerializedOperandType : std::uint8_t {
+  Null,
+  Value,
+  Int64,
+  Int32,
+  Double,
+  Float,
+  Bool,
+  String,
+};
+
+constexpr std::uint32_t kNullNodeId = ~static_cast<std::uint32_t>(0);
+
+// resources only reference memory SSA nodes as opaque markers (phi
+// predecessors), their bodies belong to the converter context and are not
+// required for evaluation
+bool isOpaqueNode(ir::InstructionImpl *node) {
+  return node->kind == ir::Kind::MemSSA;
+}
+
+struct ResourceGraphWriter {
+  std::vector<ir::InstructionImpl *> nodes;
+  std::map<ir::InstructionImpl *, std::uint32_t> nodeIds;
+
+  std::uint32_t add(ir::InstructionImpl *node) {
+    if (node == nullptr) {
+      return kNullNodeId;
+    }
+
+    auto [it, inserted] = nodeIds.emplace(node, nodes.size());
+    if (inserted) {
+      nodes.push_back(node);
+    }
+    return it->second;
+  }
+
+  std::uint32_t add(ir::Value value) { return add(value.impl); }
+
+  void collect() {
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+      auto node = nodes[i];
+
+      if (isOpaqueNode(node)) {
+        continue;
+      }
+
+      for (auto &operand : node->getOperands()) {
+        if (auto value = operand.getAsValue()) {
+          add(value);
+        }
+      }
+
+      if (auto block = dynamic_cast<ir::BlockImpl *>(node)) {
+        for (auto child : ir::Block(block).children()) {
+          add(child.impl);
+        }
+      }
+    }
+  }
+
+  void write(rx::Serializer &s) {
+    s.serialize(static_cast<std::uint32_t>(nodes.size()));
+
+    for (auto node : nodes) {
+      auto type = SerializedNodeType::Instruction;
+      if (dynamic_cast<ir::BlockImpl *>(node) != nullptr) {
+        type = SerializedNodeType::Block;
+      } else if (dynamic_cast<ir::ValueImpl *>(node) != nullptr) {
+        type = SerializedNodeType::Value;
+      }
+
+      s.serialize(type);
+      s.serialize(static_cast<std::uint32_t>(node->kind));
+      s.serialize(static_cast<std::uint32_t>(node->op));
+    }
+
+    for (auto node : nodes) {
+      if (isOpaqueNode(node)) {
+        s.serialize(std::uint32_t(0));
+        continue;
+      }
+
+      auto operands = node->getOperands();
+      s.serialize(static_cast<std::uint32_t>(operands.size()));
+
+      for (auto &operand : operands) {
+        std::visit(
+            [&]<typename T>(const T &value) {
+              if constexpr (std::is_same_v<T, std::nullptr_t>) {
+                s.serialize(SerializedOperandType::Null);
+              } else if constexpr (std::is_same_v<T, ir::ValueImpl *>) {
+                s.serialize(SerializedOperandType::Value);
+                s.serialize(nodeIds.at(value));
+              } else if constexpr (std::is_same_v<T, std::int64_t>) {
+                s.serialize(SerializedOperandType::Int64);
+                s.serialize(value);
+              } else if constexpr (std::is_same_v<T, std::int32_t>) {
+                s.serialize(SerializedOperandType::Int32);
+                s.serialize(value);
+              } else if constexpr (std::is_same_v<T, double>) {
+                s.serialize(SerializedOperandType::Double);
+                s.serialize(value);
+              } else if constexpr (std::is_same_v<T, float>) {
+                s.serialize(SerializedOperandType::Float);
+                s.serialize(value);
+              } else if constexpr (std::is_same_v<T, bool>) {
+                s.serialize(SerializedOperandType::Bool);
+                s.serialize(value);
+              } else {
+                s.serialize(SerializedOperandType::String);
+                s.serialize(value);
+              }
+            },
+            operand.value);
+      }
+    }
+
+    for (auto node : nodes) {
+      auto block = dynamic_cast<ir::BlockImpl *>(node);
+      if (block == nullptr || isOpaqueNode(node)) {
+        continue;
+      }
+
+      std::vector<std::uint32_t> children;
+      for (auto child : ir::Block(block).children()) {
+        children.push_back(nodeIds.at(child.impl));
+      }
+
+      s.serialize(children);
+    }
+  }
+};
+
+struct ResourceGraphReader {
+  std::vector<ir::InstructionImpl *> nodes;
+
+  bool read(rx::Deserializer &d, ir::Context &context) {
+    auto nodeCount = d.deserialize<std::uint32_t>();
+    if (d.failure()) {
+      return false;
+    }
+
+    auto loc = context.getUnknownLocation();
+    nodes.reserve(nodeCount);
+
+    for (std::uint32_t i = 0; i < nodeCount; ++i) {
+      auto type = d.deserialize<SerializedNodeType>();
+      auto kind = d.deserialize<std::uint32_t>();
+      auto op = d.deserialize<std::uint32_t>();
+
+      if (d.failure() || kind >= static_cast<std::uint32_t>(ir::Kind::Count)) {
+        return false;
+      }
+
+      switch (type) {
+      case SerializedNodeType::Instruction:
+        nodes.push_back(context
+                            .create<ir::Instruction>(
+                                loc, static_cast<ir::Kind>(kind), op)
+                            .impl);
+        break;
+      case SerializedNodeType::Value:
+        nodes.push_back(
+            context.create<ir::Value>(loc, static_cast<ir::Kind>(kind), op)
+                .impl);
+        break;
+      case SerializedNodeType::Block:
+        nodes.push_back(
+            context.create<ir::Block>(loc, static_cast<ir::Kind>(kind), op)
+                .impl);
+        break;
+      default:
+        return false;
+      }
+    }
+
+    for (auto node : nodes) {
+      auto operandCount = d.deserialize<std::uint32_t>();
+      if (d.failure()) {
+        return false;
+      }
+
+      for (std::uint32_t i = 0; i < operandCount; ++i) {
+        ir::Operand operand;
+
+        switch (d.deserialize<SerializedOperandType>()) {
+        case SerializedOperandType::Null:
+          break;
+        case SerializedOperandType::Value: {
+          auto value = getValue(d.deserialize<std::uint32_t>());
+          if (value == nullptr) {
+            return false;
+          }
+          operand.value = value;
+          break;
+        }
+        case SerializedOperandType::Int64:
+          operand.value = d.deserialize<std::int64_t>();
+          break;
+        case SerializedOperandType::Int32:
+          operand.value = d.deserialize<std::int32_t>();
+          break;
+        case SerializedOperandType::Double:
+          operand.value = d.deserialize<double>();
+          break;
+        case SerializedOperandType::Float:
+          operand.value = d.deserialize<float>();
+          break;
+        case SerializedOperandType::Bool:
+          operand.value = d.deserialize<bool>();
+          break;
+        case SerializedOperandType::String:
+          operand.value = d.deserialize<std::string>();
+          break;
+        default:
+          return false;
+        }
+
+        if (d.failure()) {
+          return false;
+        }
+
+        node->addOperand(std::move(operand));
+      }
+    }
+
+    for (auto node : nodes) {
+      auto block = dynamic_cast<ir::BlockImpl *>(node);
+      if (block == nullptr || isOpaqueNode(node)) {
+        continue;
+      }
+
+      auto children = d.deserialize<std::vector<std::uint32_t>>();
+      if (d.failure()) {
+        return false;
+      }
+
+      for (auto childId : children) {
+        if (childId >= nodes.size() || nodes[childId]->parent != nullptr ||
+            nodes[childId] == node) {
+          return false;
+        }
+
+        ir::Block(block).addChild(ir::Instruction(nodes[childId]));
+      }
+    }
+
+    return true;
+  }
+
+  ir::ValueImpl *getValue(std::uint32_t id) const {
+    if (id >= nodes.size()) {
+      return nullptr;
+    }
+
+    return dynamic_cast<ir::ValueImpl *>(nodes[id]);
+  }
+
+  bool getOptionalValue(std::uint32_t id, ir::Value &result) const {
+    if (id == kNullNodeId) {
+      result = nullptr;
+      return true;
+    }
+
+    result = getValue(id);
+    return result != nullptr;
+  }
+};
+} // namespace
+
+void gcn::Resources::serialize(rx::Serializer &s) const {
+  ResourceGraphWriter writer;
+
+  for (auto &pointer : pointers) {
+    writer.add(pointer.base);
+    writer.add(pointer.offset);
+  }
+
+  auto addWords = [&](auto &resourceList) {
+    for (auto &resource : resourceList) {
+      for (auto &word : resource.words) {
+        writer.add(word);
+      }
+    }
+  };
+
+  addWords(buffers);
+  addWords(textures);
+  addWords(imageBuffers);
+  addWords(samplers);
+
+  writer.collect();
+  writer.write(s);
+
+  s.serialize(hasUnknown);
+  s.serialize(slots);
+
+  auto writeWords = [&](std::span<const ir::Value> words) {
+    for (auto word : words) {
+      s.serialize(word == nullptr ? kNullNodeId : writer.nodeIds.at(word.impl));
+    }
+  };
+
+  s.serialize(static_cast<std::uint32_t>(pointers.size()));
+  for (auto &pointer : pointers) {
+    s.serialize(pointer.resourceSlot);
+    s.serialize(pointer.size);
+    writeWords({&pointer.base, 1});
+    writeWords({&pointer.offset, 1});
+  }
+
+  s.serialize(static_cast<std::uint32_t>(buffers.size()));
+  for (auto &buffer : buffers) {
+    s.serialize(buffer.resourceSlot);
+    s.serialize(buffer.access);
+    writeWords(buffer.words);
+  }
+
+  s.serialize(static_cast<std::uint32_t>(textures.size()));
+  for (auto &texture : textures) {
+    s.serialize(texture.resourceSlot);
+    s.serialize(texture.access);
+    writeWords(texture.words);
+  }
+
+  s.serialize(static_cast<std::uint32_t>(imageBuffers.size()));
+  for (auto &imageBuffer : imageBuffers) {
+    s.serialize(imageBuffer.resourceSlot);
+    s.serialize(imageBuffer.access);
+    writeWords(imageBuffer.words);
+  }
+
+  s.serialize(static_cast<std::uint32_t>(samplers.size()));
+  for (auto &sampler : samplers) {
+    s.serialize(sampler.resourceSlot);
+    s.serialize(sampler.unorm);
+    writeWords(sampler.words);
+  }
+}
+
+void gcn::Resources::deserialize(rx::Deserializer &s) {
+  ResourceGraphReader reader;
+
+  if (!reader.read(s, context)) {
+    s.setFailure();
+    return;
+  }
+
+  hasUnknown = s.deserialize<bool>();
+  slots = s.deserialize<std::uint32_t>();
+
+  auto readWords = [&](std::span<ir::Value> words) {
+    for (auto &word : words) {
+      if (!reader.getOptionalValue(s.deserialize<std::uint32_t>(), word)) {
+        s.setFailure();
+      }
+    }
+  };
+
+  auto readList = [&](auto &list, auto &&readItem) {
+    auto count = s.deserialize<std::uint32_t>();
+    if (s.failure()) {
+      return;
+    }
+
+    list.resize(count);
+    for (auto &item : list) {
+      item.resourceSlot = s.deserialize<std::uint32_t>();
+      readItem(item);
+
+      if (s.failure()) {
+        return;
+      }
+    }
+  };
+
+  readList(pointers, [&](Pointer &pointer) {
+    pointer.size = s.deserialize<std::uint32_t>();
+    readWords({&pointer.base, 1});
+    readWords({&pointer.offset, 1});
+  });
+
+  readList(buffers, [&](Buffer &buffer) {
+    buffer.access = s.deserialize<Access>();
+    readWords(buffer.words);
+  });
+
+  readList(textures, [&](Texture &texture) {
+    texture.access = s.deserialize<Access>();
+    readWords(texture.words);
+  });
+
+  readList(imageBuffers, [&](ImageBuffer &imageBuffer) {
+    imageBuffer.access = s.deserialize<Access>();
+    readWords(imageBuffer.words);
+  });
+
+  readList(samplers, [&](Sampler &sampler) {
+    sampler.unorm = s.deserialize<bool>();
+    readWords(sampler.words);
+  });
+}
+
+void gcn::ShaderInfo::serialize(rx::Serializer &s) const {
+  s.serialize(configSlots);
+
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> areas;
+  for (auto area : const_cast<rx::MemoryAreaTable<> &>(memoryMap)) {
+    areas.emplace_back(area.beginAddress, area.endAddress);
+  }
+  s.serialize(areas);
+  s.serialize(requiredSgprs);
+  resources.serialize(s);
+}
+
+void gcn::ShaderInfo::deserialize(rx::Deserializer &s) {
+  configSlots = s.deserialize<std::vector<ConfigSlot>>();
+
+  auto areas =
+      s.deserialize<std::vector<std::pair<std::uint64_t, std::uint64_t>>>();
+  memoryMap.clear();
+  for (auto [beginAddress, endAddress] : areas) {
+    memoryMap.map(beginAddress, endAddress);
+  }
+
+  requiredSgprs = s.deserialize<std::vector<std::pair<int, std::uint32_t>>>();
+
+  if (s.failure()) {
+    return;
+  }
+
+  resources.deserialize(s);
+}
+
 ir::Value GcnConverter::getGlPosition(gcn::Builder &builder) {
   auto float4OutPtrT = gcnContext.getTypePointer(
       ir::spv::StorageClass::Output,
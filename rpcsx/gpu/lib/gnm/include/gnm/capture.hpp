@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+
+// PM4 command stream capture file format
+//
+// File starts with FileHeader followed by records in submission order. Each
+// record is RecordHeader followed by `size` bytes of payload: fixed record
+// struct and optional variable sized tail (guest memory bytes or PM4 words).
+namespace gnm::capture {
+inline constexpr std::uint64_t kFileMagic = 0x5041'4334'4d50'5852; // RXPM4CAP
+inline constexpr std::uint32_t kFileFormatVersion = 2;
+
+enum class RecordType : std::uint32_t {
+  MapProcess,
+  UnmapProcess,
+  MapMemory,
+  UnmapMemory,
+  ProtectMemory,
+  Memory,
+  Packet,
+  Flip,
+};
+
+enum class Queue : std::uint32_t {
+  Graphics,
+  Compute,
+};
+
+struct FileHeader {
+  std::uint64_t magic;
+  std::uint32_t formatVersion;
+  std::uint32_t pad;
+};
+
+struct RecordHeader {
+  RecordType type;
+  std::uint32_t size;
+};
+
+struct MapProcessRecord {
+  std::uint32_t pid;
+  std::int32_t vmId;
+};
+
+struct UnmapProcessRecord {
+  std::uint32_t pid;
+  std::uint32_t pad;
+};
+
+struct MapMemoryRecord {
+  std::uint32_t pid;
+  std::int32_t memoryType;
+  std::int32_t dmemIndex;
+  std::int32_t prot;
+  std::uint64_t address;
+  std::uint64_t size;
+  std::int64_t offset;
+};
+
+struct UnmapMemoryRecord {
+  std::uint32_t pid;
+  std::uint32_t pad;
+  std::uint64_t address;
+  std::uint64_t size;
+};
+
+struct ProtectMemoryRecord {
+  std::uint32_t pid;
+  std::int32_t prot;
+  std::uint64_t address;
+  std::uint64_t size;
+};
+
+// followed by guest memory contents
+struct MemoryRecord {
+  std::int32_t vmId;
+  std::uint32_t pad;
+  std::uint64_t address;
+};
+
+// followed by packet words, header included
+struct PacketRecord {
+  Queue queue;
+  std::uint32_t pipe;
+  std::int32_t vmId;
+  std::int32_t indirectLevel;
+  std::uint32_t queueId; // compute queue of the pipe, 0 for graphics
+  std::uint32_t pad;
+};
+
+struct FlipRecord {
+  std::uint32_t pid;
+  std::int32_t bufferIndex;
+  std::uint64_t arg;
+};
+} // namespace gnm::capture
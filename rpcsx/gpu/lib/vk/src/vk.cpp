@@ -518,10 +518,16 @@ void vk::Context::createDevice(VkSurfaceKHR surface, int gpuIndex,
   uint32_t queueFamiliesCount = 0;
   for (auto &familyProperty : queueFamilyProperties) {
     VkBool32 supportsPresent;
-    if (vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, queueFamiliesCount,
-                                             surface,
-                                             &supportsPresent) == VK_SUCCESS &&
-        supportsPresent != 0) {
+    if (surface == VK_NULL_HANDLE) {
+      // headless device, graphics queue takes the place of present queue
+      if (familyProperty.queueFamilyProperties.queueFlags &
+          VK_QUEUE_GRAPHICS_BIT) {
+        queueFamiliesWithPresentSupport.insert(queueFamiliesCount);
+      }
+    } else if (vkGetPhysicalDeviceSurfaceSupportKHR(
+                   physicalDevice, queueFamiliesCount, surface,
+                   &supportsPresent) == VK_SUCCESS &&
+               supportsPresent != 0) {
       queueFamiliesWithPresentSupport.insert(queueFamiliesCount);
     }
 
@@ -13,12 +13,14 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <filesystem>
+#include <mutex>
 #include <netinet/in.h>
 #include <optional>
 #include <rx/align.hpp>
 #include <rx/mem.hpp>
 #include <span>
 #include <string>
+#include <sys/inotify.h>
 #include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -26,6 +28,7 @@
 #include <sys/un.h>
 #include <thread>
 #include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
 struct HostFile : orbis::File {
@@ -734,15 +737,237 @@ orbis::ErrorCode createSocket(rx::Ref<orbis::File> *file, orbis::kstring name,
   return {};
 }
 
-static std::optional<std::string>
-findFileInDir(const std::filesystem::path &dir, const char *name) {
-  for (auto entry : std::filesystem::directory_iterator(dir)) {
-    auto entryName = entry.path().filename();
-    if (strcasecmp(entryName.c_str(), name) == 0) {
-      return entryName;
+// Process local cache of host directory listings for case insensitive path
+// lookup. Listings are dropped on our own modifications of the host tree and
+// on inotify events for changes made by other processes.
+struct HostPathCache {
+  struct Directory {
+    // case folded name -> host name
+    std::unordered_map<std::string, std::string> entries;
+    int watch = -1;
+  };
+
+  std::mutex mtx;
+  std::unordered_map<std::string, Directory> dirs;
+  std::unordered_map<int, std::string> watches;
+  int inotifyFd = -1;
+  bool inotifyInitialized = false;
+
+  std::uint64_t hits = 0;
+  std::uint64_t misses = 0;
+  std::uint64_t scans = 0;
+
+  std::optional<std::string> find(const std::filesystem::path &dir,
+                                  const std::string &name) {
+    std::lock_guard lock(mtx);
+    processEvents();
+
+    auto key = getKey(dir);
+    auto it = dirs.find(key);
+
+    if (it != dirs.end()) {
+      hits++;
+    } else {
+      misses++;
+      it = scan(std::move(key));
+
+      if (it == dirs.end()) {
+        return {};
+      }
+    }
+
+    auto entry = it->second.entries.find(fold(name));
+    if (entry == it->second.entries.end()) {
+      return {};
     }
+
+    return entry->second;
   }
-  return {};
+
+  // path was created, removed or renamed
+  void invalidate(const std::filesystem::path &path) {
+    std::lock_guard lock(mtx);
+
+    auto key = getKey(path);
+    drop(getKey(std::filesystem::path(key).parent_path()));
+    dropTree(key);
+  }
+
+  // inotify instance is shared with parent process, removing watches from it
+  // would remove them for parent too. Child starts with empty cache and own
+  // inotify instance
+  void fork() {
+    std::lock_guard lock(mtx);
+
+    if (inotifyFd >= 0) {
+      ::close(inotifyFd);
+      inotifyFd = -1;
+    }
+
+    inotifyInitialized = false;
+    watches.clear();
+    dirs.clear();
+  }
+
+private:
+  static std::string fold(std::string_view name) {
+    std::string result(name);
+    for (auto &c : result) {
+      if (c >= 'A' && c <= 'Z') {
+        c += 'a' - 'A';
+      }
+    }
+    return result;
+  }
+
+  static std::string getKey(const std::filesystem::path &path) {
+    auto result = path.lexically_normal().native();
+    while (result.size() > 1 && result.ends_with('/')) {
+      result.pop_back();
+    }
+    return result;
+  }
+
+  decltype(dirs)::iterator scan(std::string key) {
+    Directory dir;
+    std::error_code ec;
+
+    for (std::filesystem::directory_iterator it(key, ec), end;
+         !ec && it != end; it.increment(ec)) {
+      auto name = it->path().filename().native();
+      dir.entries.emplace(fold(name), std::move(name));
+    }
+
+    if (ec) {
+      return dirs.end();
+    }
+
+    scans++;
+    ORBIS_LOG_NOTICE("host path cache: directory scan", key.c_str(),
+                     dir.entries.size(), hits, misses, scans);
+
+    if (initializeInotify()) {
+      dir.watch = inotify_add_watch(inotifyFd, key.c_str(),
+                                    IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                        IN_MOVED_TO | IN_DELETE_SELF |
+                                        IN_MOVE_SELF | IN_ONLYDIR);
+      if (dir.watch >= 0) {
+        watches[dir.watch] = key;
+      }
+    }
+
+    return dirs.emplace(std::move(key), std::move(dir)).first;
+  }
+
+  bool initializeInotify() {
+    if (!inotifyInitialized) {
+      inotifyInitialized = true;
+      inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+      if (inotifyFd < 0) {
+        ORBIS_LOG_WARNING("host path cache: inotify is not available",
+                          errno);
+      }
+    }
+
+    return inotifyFd >= 0;
+  }
+
+  void processEvents() {
+    if (inotifyFd < 0) {
+      return;
+    }
+
+    alignas(inotify_event) char buffer[4096];
+
+    while (true) {
+      auto size = ::read(inotifyFd, buffer, sizeof(buffer));
+      if (size <= 0) {
+        break;
+      }
+
+      for (std::size_t offset = 0; offset < std::size_t(size);) {
+        auto event = reinterpret_cast<inotify_event *>(buffer + offset);
+        offset += sizeof(inotify_event) + event->len;
+
+        if (event->mask & IN_Q_OVERFLOW) {
+          dropAll();
+          continue;
+        }
+
+        auto watch = watches.find(event->wd);
+        if (watch == watches.end()) {
+          continue;
+        }
+
+        if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+          dropTree(watch->second);
+        } else {
+          drop(watch->second);
+        }
+      }
+    }
+  }
+
+  void drop(const std::string &key) {
+    auto it = dirs.find(key);
+    if (it == dirs.end()) {
+      return;
+    }
+
+    if (it->second.watch >= 0) {
+      inotify_rm_watch(inotifyFd, it->second.watch);
+      watches.erase(it->second.watch);
+    }
+
+    dirs.erase(it);
+  }
+
+  void dropAll() {
+    for (auto &[wd, key] : watches) {
+      inotify_rm_watch(inotifyFd, wd);
+    }
+
+    watches.clear();
+    dirs.clear();
+  }
+
+  void dropTree(const std::string &key) {
+    auto prefix = key.ends_with('/') ? key : key + '/';
+
+    for (auto it = dirs.begin(); it != dirs.end();) {
+      if (it->first != key && !it->first.starts_with(prefix)) {
+        ++it;
+        continue;
+      }
+
+      if (it->second.watch >= 0) {
+        inotify_rm_watch(inotifyFd, it->second.watch);
+        watches.erase(it->second.watch);
+      }
+
+      it = dirs.erase(it);
+    }
+  }
+};
+
+static HostPathCache gHostPathCache;
+
+void forkHostPathCache() { gHostPathCache.fork(); }
+
+// opens host file, `created` is set if O_CREAT created new file
+static int openHostFile(const char *path, int flags, bool &created) {
+  if ((flags & (O_CREAT | O_EXCL)) == O_CREAT) {
+    int fd = ::open(path, flags | O_EXCL, 0777);
+    if (fd >= 0 || errno != EEXIST) {
+      created = fd >= 0;
+      return fd;
+    }
+  }
+
+  int fd = ::open(path, flags, 0777);
+  created = fd >= 0 && (flags & O_CREAT) != 0;
+  return fd;
 }
 
 static std::optional<std::filesystem::path>
@@ -758,7 +983,7 @@ toRealPath(const std::filesystem::path &inp) {
       continue;
     }
 
-    auto icaseElem = findFileInDir(result, elem.c_str());
+    auto icaseElem = gHostPathCache.find(result, elem.native());
     if (!icaseElem) {
       return {};
     }
@@ -821,7 +1046,9 @@ orbis::ErrorCode HostFsDevice::open(rx::Ref<orbis::File> *file,
     ORBIS_LOG_ERROR("host_open: ***ERROR*** Unhandled open flags", flags);
   }
 
-  int hostFd = ::open(realPath.c_str(), realFlags, 0777);
+  std::filesystem::path hostFilePath = realPath;
+  bool created = false;
+  int hostFd = openHostFile(realPath.c_str(), realFlags, created);
 
   orbis::ErrorCode error{};
   if (hostFd < 0) {
@@ -830,13 +1057,15 @@ orbis::ErrorCode HostFsDevice::open(rx::Ref<orbis::File> *file,
     if (auto icaseRealPath = toRealPath(realPath)) {
       ORBIS_LOG_WARNING(__FUNCTION__, path, realPath.c_str(),
                         icaseRealPath->c_str());
-      hostFd = ::open(icaseRealPath->c_str(), realFlags, 0777);
+      hostFd = openHostFile(icaseRealPath->c_str(), realFlags, created);
 
       if (hostFd < 0) {
         ORBIS_LOG_ERROR("host_open failed", path, realPath.c_str(),
                         icaseRealPath->c_str(), error);
         return convertErrno();
       }
+
+      hostFilePath = std::move(*icaseRealPath);
     }
   }
   if (hostFd < 0) {
@@ -844,6 +1073,10 @@ orbis::ErrorCode HostFsDevice::open(rx::Ref<orbis::File> *file,
     return error;
   }
 
+  if (created) {
+    gHostPathCache.invalidate(hostFilePath);
+  }
+
   // Assume the file is a directory and try to read direntries
   orbis::kvector<orbis::Dirent> dirEntries;
   char hostEntryBuffer[sizeof(dirent64) * 4];
@@ -905,6 +1138,7 @@ orbis::ErrorCode HostFsDevice::unlink(const char *path, bool recursive,
     std::filesystem::remove(hostPath + "/" + path, ec);
   }
 
+  gHostPathCache.invalidate(hostPath + "/" + path);
   return convertErrorCode(ec);
 }
 
@@ -915,6 +1149,7 @@ orbis::ErrorCode HostFsDevice::createSymlink(const char *linkPath,
   std::filesystem::create_symlink(
       std::filesystem::absolute(hostPath + "/" + linkPath),
       hostPath + "/" + target, ec);
+  gHostPathCache.invalidate(hostPath + "/" + target);
   return convertErrorCode(ec);
 }
 
@@ -922,17 +1157,26 @@ orbis::ErrorCode HostFsDevice::mkdir(const char *path, int mode,
                                      orbis::Thread *thread) {
   std::error_code ec;
   std::filesystem::create_directories(hostPath + "/" + path, ec);
+
+  // missing parents are created too
+  for (std::filesystem::path dir = path; dir.has_relative_path();
+       dir = dir.parent_path()) {
+    gHostPathCache.invalidate(hostPath + "/" + dir.c_str());
+  }
   return convertErrorCode(ec);
 }
 orbis::ErrorCode HostFsDevice::rmdir(const char *path, orbis::Thread *thread) {
   std::error_code ec;
   std::filesystem::remove_all(hostPath + "/" + path, ec);
+  gHostPathCache.invalidate(hostPath + "/" + path);
   return convertErrorCode(ec);
 }
 orbis::ErrorCode HostFsDevice::rename(const char *from, const char *to,
                                       orbis::Thread *thread) {
   std::error_code ec;
   std::filesystem::rename(hostPath + "/" + from, hostPath + "/" + to, ec);
+  gHostPathCache.invalidate(hostPath + "/" + from);
+  gHostPathCache.invalidate(hostPath + "/" + to);
   return convertErrorCode(ec);
 }
 
@@ -38,3 +38,6 @@ orbis::ErrorCode createSocket(rx::Ref<orbis::File> *file, orbis::kstring name,
 orbis::File *createHostFile(int hostFd, rx::Ref<orbis::IoDevice> device,
                             bool alignTruncate = false);
 orbis::IoDevice *createFdWrapDevice(int fd);
+
+// drops host path cache and inotify instance inherited from parent process
+void forkHostPathCache();
@@ -9,9 +9,11 @@
 #include "orbis/thread/Process.hpp"
 #include "orbis/thread/Thread.hpp"
 #include "orbis/utils/Logs.hpp"
+#include "rx/Config.hpp"
 #include "rx/die.hpp"
 #include "rx/mem.hpp"
 #include "rx/watchdog.hpp"
+#include "uffd-watch.hpp"
 #include "vm.hpp"
 #include <cstdio>
 #include <cstring>
@@ -199,6 +201,18 @@ static void runBridge(int vmId) {
           prot |= PROT_EXEC;
         }
 
+        bool isWriteWatch = (pageFlags & amdgpu::kPageReadWriteLock) == 0 &&
+                            (pageFlags & amdgpu::kPageWriteWatch) != 0;
+
+        if (uffd::isEnabled()) {
+          // write watch keeps cpu protection when uffd handles it
+          if (uffd::setWriteProtect(address, rx::mem::pageSize * count,
+                                    isWriteWatch) &&
+              isWriteWatch) {
+            pageFlags &= ~amdgpu::kPageWriteWatch;
+          }
+        }
+
         if (pageFlags & amdgpu::kPageReadWriteLock) {
           prot &= ~(PROT_READ | PROT_WRITE);
         } else if (pageFlags & amdgpu::kPageWriteWatch) {
@@ -661,6 +675,10 @@ void DceDevice::initializeProcess(orbis::Process *process) {
       process->vmId = vmId;
     }
 
+    if (rx::g_config.uffdPageTracking) {
+      uffd::initialize(vmId);
+    }
+
     runBridge(vmId);
   }
 }
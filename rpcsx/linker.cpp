@@ -968,6 +968,8 @@ rx::Ref<orbis::Module> rx::linker::loadModule(std::span<std::byte> image,
     result->tlsIndex = process->nextTlsSlot++;
   }
 
+  result->buildExportIndex();
+
   return result;
 }
 
@@ -14,7 +14,10 @@
 #include "rx/mem.hpp"
 #include "rx/print.hpp"
 #include "rx/watchdog.hpp"
+#include "sysstats.hpp"
+#include "systrace.hpp"
 #include "thread.hpp"
+#include "uffd-watch.hpp"
 #include "vfs.hpp"
 #include "vm.hpp"
 #include "xbyak/xbyak.h"
@@ -92,9 +95,7 @@ handle_signal(int sig, siginfo_t *info, void *ucontext) {
 
         if ((flags & amdgpu::kPageReadWriteLock) != 0) {
           if ((flags & amdgpu::kPageLazyLock) != 0) {
-            if (std::uint32_t gpuCommand = 0;
-                !gpuContext.gpuCacheCommand[vmid].compare_exchange_weak(
-                    gpuCommand, page)) {
+            if (!gpuContext.pushGpuCacheCommand(vmid, page)) {
               continue;
             }
 
@@ -301,6 +302,11 @@ static const char *getSyscallName(orbis::Thread *thread, int sysno) {
 }
 static void onSysEnter(orbis::Thread *thread, int id, uint64_t *args,
                        int argsCount) {
+  if (systrace::isEnabled()) {
+    systrace::onSysEnter(thread);
+    return;
+  }
+
   if (!g_traceSyscalls) {
     return;
   }
@@ -327,6 +333,11 @@ static void onSysEnter(orbis::Thread *thread, int id, uint64_t *args,
 
 static void onSysExit(orbis::Thread *thread, int id, uint64_t *args,
                       int argsCount, orbis::SysResult result) {
+  if (systrace::isEnabled()) {
+    systrace::onSysExit(thread, id, args, argsCount, result);
+    return;
+  }
+
   if (!result.isError() && !g_traceSyscalls) {
     return;
   }
@@ -767,8 +778,33 @@ static void usage(const char *argv0) {
   std::println(
       "    --gpu <index> - specify physical gpu index to use, default is 0");
   std::println("    --disable-cache - disable cache of gpu resources");
+  std::println("    --uffd-page-tracking - track cpu writes to gpu resources "
+               "with userfaultfd write protection");
+  std::println("    --cpu-tiler - tile and detile image buffers on the cpu "
+               "instead of compute shaders");
+  std::println("    --shader-cache <path> - directory of persistent shader "
+               "cache, default is 'shader-cache'");
+  std::println("    --disable-shader-cache - disable persistent shader cache");
+  std::println("    --shader-translation <async|skip-draw|sync> - shader "
+               "translation mode, default is 'async'");
+  std::println("    --shader-translation-threads <count> - count of shader "
+               "translation threads, default is half of cpu threads");
+  std::println("    --dump-shaders <path> - write translated shaders to "
+               "directory");
+  std::println("    --dump-shader-stages <ps,vs-vs,vs-es,vs-ls,cs,gs,gs-vs,hs,"
+               "ds-vs,ds-es> - stages to dump, default is all");
+  std::println("    --capture-pm4 <path> - record gpu command stream for "
+               "pm4-replay");
+  std::println("    --profile-pm4 <interval-ms> - print per-opcode pm4 "
+               "counters periodically, 0 prints them on exit. SIGRTMIN+1 "
+               "to rpcsx-gpu toggles profiling at any time");
   // std::println("    --presenter <window>");
+  std::println("    --syscall-stats <interval-ms> - print per-syscall "
+               "counters periodically and on exit, 0 prints them on exit "
+               "only. SIGRTMIN prints them at any time");
   std::println("    --trace");
+  std::println("    --trace-file <path> - write binary syscall trace for "
+               "syscall-trace tool, forked processes write to <path>.<pid>");
 }
 
 static orbis::SysResult launchDaemon(orbis::Thread *thread, std::string path,
@@ -827,6 +863,10 @@ static orbis::SysResult launchDaemon(orbis::Thread *thread, std::string path,
 
   vm::fork(childPid);
   vfs::fork();
+  forkHostPathCache();
+  uffd::fork();
+  systrace::fork(childPid);
+  sysstats::fork(process);
 
   *flag = true;
 
@@ -908,6 +948,9 @@ int main(int argc, const char *argv[]) {
   bool asRoot = false;
   bool isSystem = false;
   bool isSafeMode = false;
+  const char *syscallTracePath = nullptr;
+  bool syscallStats = false;
+  int syscallStatsInterval = 0;
 
   int argIndex = 1;
   orbis::initializeAllocator();
@@ -953,6 +996,29 @@ int main(int argc, const char *argv[]) {
       continue;
     }
 
+    if (argv[argIndex] == std::string_view("--syscall-stats")) {
+      if (argc <= argIndex + 1) {
+        usage(argv[0]);
+        return 1;
+      }
+
+      syscallStats = true;
+      syscallStatsInterval = std::atoi(argv[argIndex + 1]);
+      argIndex += 2;
+      continue;
+    }
+
+    if (argv[argIndex] == std::string_view("--trace-file")) {
+      if (argc <= argIndex + 1) {
+        usage(argv[0]);
+        return 1;
+      }
+
+      syscallTracePath = argv[argIndex + 1];
+      argIndex += 2;
+      continue;
+    }
+
     if (argv[argIndex] == std::string_view("--root")) {
       argIndex++;
       asRoot = true;
@@ -999,6 +1065,119 @@ int main(int argc, const char *argv[]) {
       continue;
     }
 
+    if (argv[argIndex] == std::string_view("--uffd-page-tracking")) {
+      argIndex++;
+      rx::g_config.uffdPageTracking = true;
+      continue;
+    }
+
+    if (argv[argIndex] == std::string_view("--cpu-tiler")) {
+      argIndex++;
+      rx::g_config.cpuTiler = true;
+      continue;
+    }
+
+    if (argv[argIndex] == std::string_view("--shader-cache")) {
+      if (argc <= argIndex + 1) {
+        usage(argv[0]);
+        return 1;
+      }
+
+      rx::g_config.shaderCachePath = argv[argIndex + 1];
+      argIndex += 2;
+      continue;
+    }
+
+    if (argv[argIndex] == std::string_view("--disable-shader-cache")) {
+      argIndex++;
+      rx::g_config.disableShaderCache = true;
+      continue;
+    }
+
+    if (argv[argIndex] == std::string_view("--shader-translation")) {
+      if (argc <= argIndex + 1) {
+        usage(argv[0]);
+        return 1;
+      }
+
+      std::string_view mode = argv[argIndex + 1];
+      if (mode == "async") {
+        rx::g_config.shaderTranslationMode = rx::ShaderTranslationMode::Async;
+      } else if (mode == "skip-draw") {
+        rx::g_config.shaderTranslationMode =
+            rx::ShaderTranslationMode::AsyncSkipDraw;
+      } else if (mode == "sync") {
+        rx::g_config.shaderTranslationMode = rx::ShaderTranslationMode::Sync;
+      } else {
+        usage(argv[0]);
+        return 1;
+      }
+
+      argIndex += 2;
+      continue;
+    }
+
+    if (argv[argIndex] == std::string_view("--shader-translation-threads")) {
+      if (argc <= argIndex + 1) {
+        usage(argv[0]);
+        return 1;
+      }
+
+      rx::g_config.shaderTranslationThreads = std::atoi(argv[argIndex + 1]);
+
+      argIndex += 2;
+      continue;
+    }
+
+    if (argv[argIndex] == std::string_view("--dump-shaders")) {
+      if (argc <= argIndex + 1) {
+        usage(argv[0]);
+        return 1;
+      }
+
+      rx::g_config.shaderDumpPath = argv[argIndex + 1];
+
+      argIndex += 2;
+      continue;
+    }
+
+    if (argv[argIndex] == std::string_view("--dump-shader-stages")) {
+      if (argc <= argIndex + 1) {
+        usage(argv[0]);
+        return 1;
+      }
+
+      rx::g_config.shaderDumpStages = argv[argIndex + 1];
+
+      argIndex += 2;
+      continue;
+    }
+
+    if (argv[argIndex] == std::string_view("--capture-pm4")) {
+      if (argc <= argIndex + 1) {
+        usage(argv[0]);
+        return 1;
+      }
+
+      rx::g_config.pm4CapturePath = argv[argIndex + 1];
+
+      argIndex += 2;
+      continue;
+    }
+
+    if (argv[argIndex] == std::string_view("--profile-pm4")) {
+      if (argc <= argIndex + 1) {
+        usage(argv[0]);
+        return 1;
+      }
+
+      rx::g_config.profilePm4 = true;
+      rx::g_config.pm4ProfileInterval = std::atoi(argv[argIndex + 1]);
+
+      argIndex += 2;
+      continue;
+    }
+
     if (argv[argIndex] == std::string_view("--debug-gpu")) {
       argIndex++;
       rx::g_config.debugGpu = true;
@@ -1046,6 +1225,15 @@ int main(int argc, const char *argv[]) {
   // vm::printHostStats();
   orbis::allocatePid();
   auto initProcess = orbis::createProcess(nullptr, asRoot ? 1 : 10);
+
+  sysstats::initialize(initProcess,
+                       std::chrono::milliseconds(syscallStatsInterval),
+                       syscallStats);
+
+  if (syscallTracePath != nullptr &&
+      !systrace::initialize(syscallTracePath, initProcess->pid)) {
+    return 1;
+  }
   // pthread_setname_np(pthread_self(), "10.MAINTHREAD");
 
   int status = 0;
@@ -17,7 +17,10 @@
 #include "orbis/vm.hpp"
 #include "rx/Rc.hpp"
 #include "rx/watchdog.hpp"
+#include "sysstats.hpp"
+#include "systrace.hpp"
 #include "thread.hpp"
+#include "uffd-watch.hpp"
 #include "vfs.hpp"
 #include "vm.hpp"
 #include <chrono>
@@ -805,6 +808,10 @@ SysResult fork(Thread *thread, slong flags) {
 
   vm::fork(childPid);
   vfs::fork();
+  forkHostPathCache();
+  uffd::fork();
+  systrace::fork(childPid);
+  sysstats::fork(process);
 
   *flag = true;
 
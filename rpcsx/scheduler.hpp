@@ -1,151 +1,403 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <condition_variable>
-#include <forward_list>
+#include <cstdint>
 #include <functional>
-#include <map>
+#include <memory>
 #include <mutex>
-#include <orbis/thread/Thread.hpp>
-#include <sys/ucontext.h>
 #include <thread>
 #include <ucontext.h>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+namespace orbis {
+struct Thread;
+}
+
 namespace rx {
-class Scheduler {
+/// \brief Schedules guest threads on fixed set of host cpu threads.
+///
+/// Every cpu owns run queue with FIFO list per priority level and bitmap of
+/// non-empty levels, next thread is picked with single bit scan. Cpu without
+/// work steals from other cpus before going to sleep. Blocked threads are
+/// parked on wait channel and return to run queue only on wakeup() of that
+/// channel, wakeup conditions are never polled.
+///
+/// ThreadT provides `void *context` with saved ucontext_t and `prio.prio`,
+/// lower value is higher priority as in rtprio.
+template <typename ThreadT = orbis::Thread> class Scheduler {
+public:
+  static constexpr std::size_t kPriorityLevels = 32;
+
+private:
+  // tasks kept for reuse per cpu, rest of released tasks are deleted
+  static constexpr std::size_t kMaxFreeTasks = 64;
+
+  struct Task {
+    ThreadT *thread;
+    Task *next = nullptr;
+    const void *channel = nullptr;
+    std::function<bool()> wakeupCondFn;
+  };
+
+  struct RunQueue {
+    std::uint32_t readyMask = 0;
+    Task *heads[kPriorityLevels]{};
+    Task *tails[kPriorityLevels]{};
+
+    void push(Task *task) {
+      auto level = std::min<std::size_t>(task->thread->prio.prio,
+                                         kPriorityLevels - 1);
+      task->next = nullptr;
+
+      if (heads[level] == nullptr) {
+        heads[level] = task;
+        readyMask |= 1u << level;
+      } else {
+        tails[level]->next = task;
+      }
+
+      tails[level] = task;
+    }
+
+    Task *pop() {
+      if (readyMask == 0) {
+        return nullptr;
+      }
+
+      auto level = std::countr_zero(readyMask);
+      auto task = heads[level];
+      heads[level] = task->next;
+
+      if (heads[level] == nullptr) {
+        tails[level] = nullptr;
+        readyMask &= ~(1u << level);
+      }
+
+      return task;
+    }
+  };
+
   struct CpuState {
     std::mutex mtx;
     std::condition_variable cond;
-    orbis::Thread *task = nullptr;
+    RunQueue queue;
+    std::uint64_t kicks = 0;
+    std::atomic<std::size_t> queueSize{0};
+    std::atomic<bool> idle{false};
+
+    // thread that left this cpu, queued by cpu loop after its context is
+    // saved
+    Task *released = nullptr;
     ucontext_t cpuContext;
-  };
 
-  struct Task {
-    orbis::Thread *thread;
-    std::function<bool()> wakeupCondFn;
+    // accessed only by thread of this cpu
+    Task *freeTasks = nullptr;
+    std::size_t freeTaskCount = 0;
   };
 
-  std::mutex taskMtx;
-  std::condition_variable taskCond;
-  std::mutex queueMtx;
-  std::multimap<int, Task, std::greater<>> mQueue;
-  std::forward_list<CpuState> mCpuStates;
+  static inline thread_local CpuState *t_cpu = nullptr;
+
+  std::size_t mCpuCount;
+  std::unique_ptr<CpuState[]> mCpuStates;
   std::vector<std::thread> mCpus;
-  std::thread mThread;
+  std::atomic<std::size_t> mNextCpu{0};
+  std::mutex mWaitMtx;
+  std::unordered_map<const void *, Task *> mWaitLists;
   std::atomic<bool> mExit{false};
 
 public:
-  Scheduler(std::size_t smpCount) {
+  Scheduler(std::size_t smpCount)
+      : mCpuCount(smpCount),
+        mCpuStates(std::make_unique<CpuState[]>(smpCount)) {
     mCpus.resize(smpCount);
 
     for (std::size_t i = 0; i < smpCount; ++i) {
-      auto state = &mCpuStates.emplace_front();
-      mCpus[i] = std::thread{[=, this] { cpuEntry(i, state); }};
+      mCpus[i] = std::thread{[=, this] { cpuEntry(&mCpuStates[i]); }};
     }
-
-    mThread = std::thread{[this] { schedulerEntry(); }};
   }
 
   ~Scheduler() {
     mExit = true;
-    taskCond.notify_one();
 
-    for (auto &cpuState : mCpuStates) {
-      cpuState.cond.notify_one();
+    for (std::size_t i = 0; i < mCpuCount; ++i) {
+      kick(mCpuStates[i]);
     }
 
-    mThread.join();
-
     for (auto &cpu : mCpus) {
       cpu.join();
     }
-  }
 
-  void enqueue(orbis::Thread *thread) {
-    std::lock_guard lockQueue(queueMtx);
-    mQueue.emplace(thread->prio, Task{.thread = thread});
-    taskCond.notify_one();
+    for (std::size_t i = 0; i < mCpuCount; ++i) {
+      while (auto task = mCpuStates[i].queue.pop()) {
+        delete task;
+      }
+
+      for (auto task = mCpuStates[i].freeTasks; task != nullptr;) {
+        delete std::exchange(task, task->next);
+      }
+    }
+
+    for (auto [channel, task] : mWaitLists) {
+      while (task != nullptr) {
+        delete std::exchange(task, task->next);
+      }
+    }
   }
 
+  void enqueue(ThreadT *thread) { pushTask(allocateTask(thread)); }
+
+  /// Leaves current cpu, thread context must be saved by caller. If channel
+  /// is set, thread is parked until wakeup(channel) finds wakeupCondFn true.
   [[noreturn]] void
-  releaseThisCpu(orbis::Thread *thread,
+  releaseThisCpu(ThreadT *thread, const void *channel = nullptr,
                  std::function<bool()> wakeupCondFn = nullptr) {
-    auto cpuContext = static_cast<CpuState *>(thread->cpuContext);
-    thread->cpuContext = nullptr;
-    thread->cpuIndex = -1;
-    mQueue.emplace(thread->prio, Task{.thread = thread,
-                                      .wakeupCondFn = std::move(wakeupCondFn)});
-    cpuContext->task = nullptr;
-    ::setcontext(&cpuContext->cpuContext);
+    t_cpu->released =
+        allocateTask(thread, channel, std::move(wakeupCondFn));
+    ::setcontext(&t_cpu->cpuContext);
+    __builtin_unreachable();
+  }
+
+  /// Leaves current cpu without requeuing current thread.
+  [[noreturn]] void exitThisCpu() {
+    ::setcontext(&t_cpu->cpuContext);
     __builtin_unreachable();
   }
 
+  /// Saves thread context and gives cpu to next ready thread, returns when
+  /// thread is scheduled again.
+  void yield(ThreadT *thread) { switchToCpu(allocateTask(thread)); }
+
+  /// Parks thread on channel until wakeup(channel) finds wakeupCondFn true.
+  /// Condition is also checked before thread is parked, so wakeup between
+  /// condition change and wait() is not lost.
+  void wait(ThreadT *thread, const void *channel,
+            std::function<bool()> wakeupCondFn) {
+    switchToCpu(allocateTask(thread, channel, std::move(wakeupCondFn)));
+  }
+
+  void wakeup(const void *channel) {
+    Task *ready = nullptr;
+
+    {
+      std::lock_guard lock(mWaitMtx);
+      auto it = mWaitLists.find(channel);
+      if (it == mWaitLists.end()) {
+        return;
+      }
+
+      Task *waiting = nullptr;
+      for (auto task = it->second; task != nullptr;) {
+        auto next = std::exchange(task->next, nullptr);
+
+        if (task->wakeupCondFn == nullptr || task->wakeupCondFn()) {
+          task->next = ready;
+          ready = task;
+        } else {
+          task->next = waiting;
+          waiting = task;
+        }
+
+        task = next;
+      }
+
+      if (waiting == nullptr) {
+        mWaitLists.erase(it);
+      } else {
+        it->second = waiting;
+      }
+    }
+
+    while (ready != nullptr) {
+      auto task = std::exchange(ready, ready->next);
+      task->channel = nullptr;
+      task->wakeupCondFn = nullptr;
+      pushTask(task);
+    }
+  }
+
 private:
-  [[noreturn]] void invoke(orbis::Thread *thread) {
-    auto ctxt = reinterpret_cast<ucontext_t *>(thread->context);
-    ::setcontext(ctxt);
+  // reuses task released on current cpu, threads outside of scheduler
+  // allocate
+  Task *allocateTask(ThreadT *thread, const void *channel = nullptr,
+                     std::function<bool()> wakeupCondFn = nullptr) {
+    Task *task;
+    if (auto cpu = t_cpu; cpu != nullptr && cpu->freeTasks != nullptr) {
+      task = std::exchange(cpu->freeTasks, cpu->freeTasks->next);
+      cpu->freeTaskCount--;
+    } else {
+      task = new Task;
+    }
+
+    task->thread = thread;
+    task->next = nullptr;
+    task->channel = channel;
+    task->wakeupCondFn = std::move(wakeupCondFn);
+    return task;
+  }
+
+  void freeTask(CpuState &cpu, Task *task) {
+    if (cpu.freeTaskCount >= kMaxFreeTasks) {
+      delete task;
+      return;
+    }
+
+    task->wakeupCondFn = nullptr;
+    task->next = std::exchange(cpu.freeTasks, task);
+    cpu.freeTaskCount++;
+  }
+
+  void switchToCpu(Task *task) {
+    auto cpu = t_cpu;
+    cpu->released = task;
+    ::swapcontext(static_cast<ucontext_t *>(task->thread->context),
+                  &cpu->cpuContext);
+  }
+
+  [[noreturn]] void invoke(ThreadT *thread) {
+    ::setcontext(static_cast<ucontext_t *>(thread->context));
     __builtin_unreachable();
   }
 
-  orbis::Thread *fetchTask() {
-    std::lock_guard lockQueue(queueMtx);
-    decltype(mQueue)::iterator foundIt = mQueue.end();
-    for (auto it = mQueue.begin(); it != mQueue.end(); ++it) {
-      auto &[prio, task] = *it;
-      if (task.wakeupCondFn != nullptr && !task.wakeupCondFn()) {
-        continue;
+  void kick(CpuState &cpu) {
+    std::lock_guard lock(cpu.mtx);
+    cpu.kicks++;
+    cpu.cond.notify_one();
+  }
+
+  void kickIdleCpu() {
+    for (std::size_t i = 0; i < mCpuCount; ++i) {
+      if (mCpuStates[i].idle.load(std::memory_order::relaxed)) {
+        kick(mCpuStates[i]);
+        return;
       }
+    }
+  }
 
-      if (foundIt == mQueue.end() || foundIt->first < task.thread->prio) {
-        foundIt = it;
+  CpuState &selectCpu() {
+    for (std::size_t i = 0; i < mCpuCount; ++i) {
+      if (mCpuStates[i].idle.load(std::memory_order::relaxed)) {
+        return mCpuStates[i];
       }
     }
 
-    if (foundIt != mQueue.end()) {
-      auto result = foundIt->second.thread;
-      mQueue.erase(foundIt);
-      return result;
+    if (t_cpu != nullptr) {
+      return *t_cpu;
     }
 
-    return nullptr;
+    return mCpuStates[mNextCpu.fetch_add(1, std::memory_order::relaxed) %
+                      mCpuCount];
   }
 
-  void schedulerEntry() {
-    while (!mExit.load(std::memory_order::relaxed)) {
-      if (mQueue.empty()) {
-        continue;
+  void pushTask(Task *task, CpuState &cpu) {
+    std::size_t queueSize;
+
+    {
+      std::lock_guard lock(cpu.mtx);
+      cpu.queue.push(task);
+      queueSize = cpu.queueSize.fetch_add(1, std::memory_order::relaxed) + 1;
+      cpu.kicks++;
+      cpu.cond.notify_one();
+    }
+
+    // let idle cpu steal backlog of busy cpu
+    if (queueSize > 1) {
+      kickIdleCpu();
+    }
+  }
+
+  void pushTask(Task *task) { pushTask(task, selectCpu()); }
+
+  // queues thread that left the cpu, runs on cpu stack
+  void publish(CpuState &cpu, Task *task) {
+    if (task->channel != nullptr) {
+      std::lock_guard lock(mWaitMtx);
+
+      if (task->wakeupCondFn == nullptr || !task->wakeupCondFn()) {
+        auto &head = mWaitLists[task->channel];
+        task->next = head;
+        head = task;
+        return;
       }
 
-      std::unique_lock lock(taskMtx);
-      taskCond.wait(lock);
+      task->channel = nullptr;
+      task->wakeupCondFn = nullptr;
+    }
 
-      for (auto &cpu : mCpuStates) {
-        if (cpu.task == nullptr) {
-          cpu.task = fetchTask();
-        }
+    pushTask(task, cpu);
+  }
+
+  Task *steal(CpuState &self) {
+    auto selfIndex = &self - mCpuStates.get();
+
+    for (std::size_t i = 1; i < mCpuCount; ++i) {
+      auto &victim = mCpuStates[(selfIndex + i) % mCpuCount];
+      if (victim.queueSize.load(std::memory_order::relaxed) == 0) {
+        continue;
+      }
+
+      std::lock_guard lock(victim.mtx);
+      if (auto task = victim.queue.pop()) {
+        victim.queueSize.fetch_sub(1, std::memory_order::relaxed);
+        return task;
       }
     }
+
+    return nullptr;
   }
 
-  void cpuEntry(std::size_t cpuIndex, CpuState *state) {
-    ::getcontext(&state->cpuContext);
+  Task *fetchTask(CpuState &cpu) {
+    std::unique_lock lock(cpu.mtx);
 
-    while (!mExit.load(std::memory_order::relaxed)) {
-      auto task = std::exchange(state->task, nullptr);
-      if (task == nullptr) {
-        taskCond.notify_one();
+    while (true) {
+      if (auto task = cpu.queue.pop()) {
+        cpu.queueSize.fetch_sub(1, std::memory_order::relaxed);
+        return task;
+      }
 
-        std::unique_lock lock(state->mtx);
-        state->cond.wait(lock);
-        task = std::exchange(state->task, nullptr);
+      if (mExit.load(std::memory_order::relaxed)) {
+        return nullptr;
       }
 
+      auto kicks = cpu.kicks;
+      cpu.idle.store(true, std::memory_order::relaxed);
+      lock.unlock();
+
+      auto task = steal(cpu);
+
+      lock.lock();
       if (task != nullptr) {
-        task->cpuIndex = cpuIndex;
-        task->cpuContext = state;
-        invoke(task);
+        cpu.idle.store(false, std::memory_order::relaxed);
+        return task;
       }
+
+      // every push to this cpu or to busy cpu while this one is idle bumps
+      // kicks
+      cpu.cond.wait(lock, [&] {
+        return cpu.kicks != kicks || cpu.queue.readyMask != 0 ||
+               mExit.load(std::memory_order::relaxed);
+      });
+      cpu.idle.store(false, std::memory_order::relaxed);
+    }
+  }
+
+  void cpuEntry(CpuState *state) {
+    t_cpu = state;
+    ::getcontext(&state->cpuContext);
+
+    // execution resumes here every time guest thread leaves the cpu
+    if (auto task = std::exchange(state->released, nullptr)) {
+      publish(*state, task);
+    }
+
+    if (auto task = fetchTask(*state)) {
+      auto thread = task->thread;
+      freeTask(*state, task);
+      invoke(thread);
     }
   }
 };
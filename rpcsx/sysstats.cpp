@@ -0,0 +1,95 @@
+#include "sysstats.hpp"
+#include "orbis/KernelContext.hpp"
+#include "orbis/thread/Process.hpp"
+#include "rx/print.hpp"
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <pthread.h>
+#include <thread>
+
+namespace {
+constexpr auto kPollInterval = std::chrono::milliseconds(100);
+
+std::atomic<orbis::Process *> gProcess;
+std::chrono::milliseconds gInterval;
+std::uint64_t gTscFrequency;
+volatile std::sig_atomic_t gDumpRequested;
+} // namespace
+
+static void printStats(const orbis::SyscallStats::Stats &stats) {
+  auto process = gProcess.load(std::memory_order::relaxed);
+  rx::println(stderr, "pid {}:", process->pid);
+  orbis::SyscallStats::print(stats, process->sysent, gTscFrequency);
+}
+
+// signal can arrive while guest code runs with guest fs base, handler must
+// not touch host thread locals
+__attribute__((no_stack_protector)) static void handleDumpSignal(int) {
+  gDumpRequested = 1;
+}
+
+static void reporterEntry() {
+  orbis::SyscallStats::Stats last{};
+  auto nextDump = std::chrono::steady_clock::now() + gInterval;
+
+  while (true) {
+    std::this_thread::sleep_for(kPollInterval);
+
+    auto process = gProcess.load(std::memory_order::relaxed);
+
+    if (gDumpRequested != 0) {
+      gDumpRequested = 0;
+      printStats(process->syscallStats.getStats());
+    }
+
+    if (gInterval.count() == 0 || std::chrono::steady_clock::now() < nextDump) {
+      continue;
+    }
+
+    nextDump += gInterval;
+
+    auto current = process->syscallStats.getStats();
+    printStats(orbis::SyscallStats::delta(current, last));
+    last = current;
+  }
+}
+
+static void startReporter() {
+  std::thread thread(reporterEntry);
+  pthread_setname_np(thread.native_handle(), "sysstats");
+  thread.detach();
+}
+
+void sysstats::initialize(orbis::Process *process,
+                          std::chrono::milliseconds interval,
+                          bool dumpOnExit) {
+  gProcess = process;
+  gInterval = interval;
+  gTscFrequency = orbis::g_context->getTscFreq();
+
+  struct sigaction act{};
+  act.sa_handler = handleDumpSignal;
+  act.sa_flags = SA_ONSTACK | SA_RESTART;
+
+  // SIGUSR2 is taken by watchdog ipc
+  if (sigaction(SIGRTMIN, &act, nullptr)) {
+    perror("Error sigaction:");
+    std::exit(-1);
+  }
+
+  if (dumpOnExit) {
+    std::atexit([] {
+      printStats(gProcess.load(std::memory_order::relaxed)
+                     ->syscallStats.getStats());
+    });
+  }
+
+  startReporter();
+}
+
+void sysstats::fork(orbis::Process *process) {
+  gProcess = process;
+  gDumpRequested = 0;
+  startReporter();
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <chrono>
+
+namespace orbis {
+struct Process;
+}
+
+// host side reports of orbis::SyscallStats
+//
+// SIGRTMIN (`kill -s RTMIN <pid>`) prints counters of the process accumulated
+// since its start. With non-zero interval counters of last interval are
+// printed periodically, with `dumpOnExit` totals are printed when process
+// exits.
+namespace sysstats {
+void initialize(orbis::Process *process, std::chrono::milliseconds interval,
+                bool dumpOnExit);
+
+/// Restarts reporting thread in forked child for its new process.
+void fork(orbis::Process *process);
+} // namespace sysstats
@@ -0,0 +1,347 @@
+#include "systrace.hpp"
+#include "orbis/KernelContext.hpp"
+#include "orbis/sys/sysentry.hpp"
+#include "orbis/thread/Process.hpp"
+#include "orbis/thread/Thread.hpp"
+#include "rx/print.hpp"
+#include "rx/tsc.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <pthread.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+// 112 KiB per guest thread, writer wakes up when ring is half full
+constexpr std::size_t kRingSize = 1024;
+constexpr auto kWriterInterval = std::chrono::milliseconds(10);
+
+struct Ring {
+  alignas(64) std::atomic<std::uint64_t> head{0};
+  alignas(64) std::atomic<std::uint64_t> tail{0};
+  std::atomic<bool> closed{false};
+
+  // owned by producer thread
+  std::uint64_t enterTsc = 0;
+  std::uint64_t dropped = 0;
+
+  systrace::Record records[kRingSize];
+};
+
+struct RingOwner {
+  Ring *ring = nullptr;
+
+  ~RingOwner() {
+    if (ring != nullptr) {
+      ring->closed.store(true, std::memory_order::release);
+    }
+  }
+};
+
+thread_local RingOwner t_ring;
+
+std::atomic<bool> gEnabled{false};
+std::filesystem::path gPath;
+int gFd = -1;
+std::uint64_t gTscFrequency;
+
+std::mutex gRingsMtx;
+std::vector<Ring *> gRings;
+
+std::mutex gWriterMtx;
+std::condition_variable gWriterCv;
+std::thread *gWriter;
+bool gStop;
+} // namespace
+
+static systrace::SysVec getSysVec(orbis::Thread *thread) {
+  auto sysent = thread->tproc->sysent;
+
+  if (sysent == &orbis::ps4_sysvec) {
+    return systrace::SysVec::Ps4;
+  }
+
+  if (sysent == &orbis::ps5_sysvec) {
+    return systrace::SysVec::Ps5;
+  }
+
+  if (sysent == &orbis::freebsd11_sysvec) {
+    return systrace::SysVec::FreeBsd11;
+  }
+
+  if (sysent == &orbis::freebsd9_sysvec) {
+    return systrace::SysVec::FreeBsd9;
+  }
+
+  return systrace::SysVec::Unknown;
+}
+
+static bool writeAll(const void *data, std::size_t size) {
+  auto bytes = static_cast<const std::byte *>(data);
+
+  while (size > 0) {
+    auto written = ::write(gFd, bytes, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return false;
+    }
+
+    bytes += written;
+    size -= written;
+  }
+
+  return true;
+}
+
+static bool openTraceFile(const std::filesystem::path &path,
+                          std::uint32_t pid) {
+  gFd = ::open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0666);
+  if (gFd < 0) {
+    rx::println(stderr, "systrace: failed to open {}: {}", path.string(),
+                std::strerror(errno));
+    return false;
+  }
+
+  systrace::FileHeader header{
+      .version = systrace::kVersion,
+      .recordSize = sizeof(systrace::Record),
+      .tscFrequency = gTscFrequency,
+      .pid = pid,
+  };
+  std::memcpy(header.magic, systrace::kMagic, sizeof(header.magic));
+
+  return writeAll(&header, sizeof(header));
+}
+
+// moves published records of all rings to batch, frees rings of exited
+// threads once they are empty
+static void drainRings(std::vector<systrace::Record> &batch) {
+  std::lock_guard lock(gRingsMtx);
+
+  std::erase_if(gRings, [&](Ring *ring) {
+    // closed flag is read first, every record of closed ring is published
+    // before head is loaded
+    auto closed = ring->closed.load(std::memory_order::acquire);
+    auto head = ring->head.load(std::memory_order::acquire);
+    auto tail = ring->tail.load(std::memory_order::relaxed);
+
+    for (; tail != head; ++tail) {
+      batch.push_back(ring->records[tail % kRingSize]);
+    }
+
+    ring->tail.store(tail, std::memory_order::release);
+
+    if (closed) {
+      delete ring;
+      return true;
+    }
+
+    return false;
+  });
+}
+
+static void writerEntry() {
+  std::vector<systrace::Record> batch;
+  bool failed = false;
+
+  while (true) {
+    bool stop;
+
+    {
+      std::unique_lock lock(gWriterMtx);
+      gWriterCv.wait_for(lock, kWriterInterval, [] { return gStop; });
+      stop = gStop;
+    }
+
+    drainRings(batch);
+
+    if (!batch.empty() && !failed) {
+      if (!writeAll(batch.data(), batch.size() * sizeof(systrace::Record))) {
+        rx::println(stderr, "systrace: write failed: {}",
+                    std::strerror(errno));
+        failed = true;
+      }
+    }
+
+    batch.clear();
+
+    if (stop) {
+      return;
+    }
+  }
+}
+
+static void startWriter() {
+  gStop = false;
+
+  // previous writer object belongs to parent process after fork, it is
+  // abandoned
+  gWriter = new std::thread(writerEntry);
+  pthread_setname_np(gWriter->native_handle(), "systrace");
+}
+
+static void wakeWriter() { gWriterCv.notify_one(); }
+
+static Ring *getRing() {
+  if (t_ring.ring != nullptr) {
+    return t_ring.ring;
+  }
+
+  auto ring = new Ring();
+
+  {
+    std::lock_guard lock(gRingsMtx);
+    gRings.push_back(ring);
+  }
+
+  t_ring.ring = ring;
+  return ring;
+}
+
+bool systrace::initialize(const std::filesystem::path &path,
+                          std::uint32_t pid) {
+  gPath = path;
+  gTscFrequency = orbis::g_context->getTscFreq();
+
+  if (!openTraceFile(path, pid)) {
+    return false;
+  }
+
+  // writer thread can hold locks at the moment of fork
+  pthread_atfork(
+      [] {
+        gWriterMtx.lock();
+        gRingsMtx.lock();
+      },
+      [] {
+        gRingsMtx.unlock();
+        gWriterMtx.unlock();
+      },
+      [] {
+        gRingsMtx.unlock();
+        gWriterMtx.unlock();
+      });
+
+  std::atexit(flush);
+
+  startWriter();
+  gEnabled.store(true, std::memory_order::release);
+  return true;
+}
+
+bool systrace::isEnabled() {
+  return gEnabled.load(std::memory_order::relaxed);
+}
+
+void systrace::fork(std::uint32_t pid) {
+  if (!isEnabled()) {
+    return;
+  }
+
+  // parent threads do not exist in child, their records are written by
+  // parent
+  for (auto ring : gRings) {
+    delete ring;
+  }
+
+  gRings.clear();
+  t_ring.ring = nullptr;
+
+  ::close(gFd);
+
+  auto path = gPath;
+  path += "." + std::to_string(pid);
+
+  if (!openTraceFile(path, pid)) {
+    gEnabled.store(false, std::memory_order::relaxed);
+    return;
+  }
+
+  startWriter();
+}
+
+void systrace::flush() {
+  if (!gEnabled.exchange(false)) {
+    return;
+  }
+
+  {
+    std::lock_guard lock(gWriterMtx);
+    gStop = true;
+  }
+
+  gWriterCv.notify_one();
+  gWriter->join();
+  ::close(gFd);
+}
+
+void systrace::onSysEnter(orbis::Thread *thread) {
+  getRing()->enterTsc = rx::get_tsc();
+}
+
+void systrace::onSysExit(orbis::Thread *thread, int id,
+                         const std::uint64_t *args, int argsCount,
+                         orbis::SysResult result) {
+  auto exitTsc = rx::get_tsc();
+  auto ring = t_ring.ring;
+
+  // thread was created by fork or exec inside of syscall
+  if (ring == nullptr) {
+    return;
+  }
+
+  auto firstHead = ring->head.load(std::memory_order::relaxed);
+  auto head = firstHead;
+  auto tail = ring->tail.load(std::memory_order::acquire);
+  auto required = ring->dropped != 0 ? 2 : 1;
+
+  if (head - tail + required > kRingSize) {
+    if (ring->dropped++ == 0) {
+      wakeWriter();
+    }
+
+    return;
+  }
+
+  if (ring->dropped != 0) {
+    auto &record = ring->records[head++ % kRingSize];
+    record = {
+        .enterTsc = ring->enterTsc,
+        .exitTsc = ring->enterTsc,
+        .tid = static_cast<std::uint32_t>(thread->tid),
+        .flags = kRecordDropped,
+    };
+    record.args[0] = std::exchange(ring->dropped, 0);
+  }
+
+  auto &record = ring->records[head++ % kRingSize];
+  record.enterTsc = ring->enterTsc;
+  record.exitTsc = exitTsc;
+  record.retval[0] = thread->retval[0];
+  record.retval[1] = thread->retval[1];
+  record.tid = thread->tid;
+  record.status = result.value();
+  record.id = id;
+  record.argCount = std::clamp(argsCount, 0, 8);
+  record.flags = result.isError() ? kRecordError : 0;
+  record.sysvec = getSysVec(thread);
+  std::fill(std::begin(record.args), std::end(record.args), 0);
+  std::copy_n(args, record.argCount, record.args);
+
+  ring->head.store(head, std::memory_order::release);
+
+  if (firstHead - tail < kRingSize / 2 && head - tail >= kRingSize / 2) {
+    wakeWriter();
+  }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "orbis/error/SysResult.hpp"
+#include <cstdint>
+#include <filesystem>
+
+namespace orbis {
+struct Thread;
+}
+
+// binary syscall trace
+//
+// Every guest thread owns single producer ring of fixed size records, syscall
+// exit appends one record without locks or system calls. Writer thread drains
+// all rings into trace file in batches. If writer falls behind, records are
+// dropped and counted, guest thread is never blocked. Trace is decoded
+// offline with tools/syscall-trace.
+namespace systrace {
+inline constexpr char kMagic[8] = {'R', 'P', 'S', 'X', 'S', 'Y', 'S', 'T'};
+inline constexpr std::uint32_t kVersion = 1;
+
+enum class SysVec : std::uint8_t {
+  Unknown,
+  FreeBsd9,
+  FreeBsd11,
+  Ps4,
+  Ps5,
+};
+
+enum RecordFlags : std::uint8_t {
+  kRecordError = 1 << 0,
+
+  // args[0] is count of records of thread lost since previous record
+  kRecordDropped = 1 << 1,
+};
+
+struct FileHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t recordSize;
+  std::uint64_t tscFrequency;
+  std::uint32_t pid;
+  std::uint32_t reserved;
+};
+
+struct Record {
+  std::uint64_t enterTsc;
+  std::uint64_t exitTsc;
+  std::uint64_t args[8];
+  std::uint64_t retval[2];
+  std::uint32_t tid;
+  std::int32_t status;
+  std::uint16_t id;
+  std::uint8_t argCount;
+  std::uint8_t flags;
+  SysVec sysvec;
+  std::uint8_t reserved[3];
+};
+
+static_assert(sizeof(FileHeader) == 32);
+static_assert(sizeof(Record) == 112);
+
+/// Starts writer thread, trace is written to `path`. Processes created by
+/// fork write to `<path>.<pid>`.
+bool initialize(const std::filesystem::path &path, std::uint32_t pid);
+bool isEnabled();
+
+/// Restarts tracing in forked child, rings of parent threads are discarded.
+void fork(std::uint32_t pid);
+
+/// Stops writer thread and writes all pending records.
+void flush();
+
+void onSysEnter(orbis::Thread *thread);
+void onSysExit(orbis::Thread *thread, int id, const std::uint64_t *args,
+               int argsCount, orbis::SysResult result);
+} // namespace systrace
@@ -0,0 +1,223 @@
+#include "uffd-watch.hpp"
+#include "gpu/DeviceCtl.hpp"
+#include "orbis/KernelContext.hpp"
+#include "rx/mem.hpp"
+#include "rx/print.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/userfaultfd.h>
+#include <pthread.h>
+#include <span>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+int g_uffd = -1;
+int g_vmId = -1;
+std::atomic<bool> g_enabled{false};
+
+// returns 0 if headers predate write protection of shared memory
+std::uint64_t getRequiredFeatures() {
+#ifdef UFFD_FEATURE_WP_HUGETLBFS_SHMEM
+  std::uint64_t features =
+      UFFD_FEATURE_PAGEFAULT_FLAG_WP | UFFD_FEATURE_WP_HUGETLBFS_SHMEM;
+#ifdef UFFD_FEATURE_WP_UNPOPULATED
+  features |= UFFD_FEATURE_WP_UNPOPULATED;
+#endif
+  return features;
+#else
+  return 0;
+#endif
+}
+
+int openUffd() {
+#ifdef UFFD_USER_MODE_ONLY
+  // user mode only does not require vm.unprivileged_userfaultfd
+  int fd = ::syscall(SYS_userfaultfd, O_CLOEXEC | UFFD_USER_MODE_ONLY);
+  if (fd >= 0 || errno != EINVAL) {
+    return fd;
+  }
+#endif
+  return ::syscall(SYS_userfaultfd, O_CLOEXEC);
+}
+
+bool unprotectPage(std::uint64_t address) {
+  uffdio_writeprotect wp{
+      .range = {.start = address, .len = rx::mem::pageSize},
+      .mode = 0,
+  };
+
+  return ::ioctl(g_uffd, UFFDIO_WRITEPROTECT, &wp) == 0;
+}
+
+void handleWriteFault(amdgpu::DeviceContext &gpuContext,
+                      std::uint64_t address) {
+  auto page = address / rx::mem::pageSize;
+  auto &pageFlags = gpuContext.cachePages[g_vmId][page];
+
+  // same transitions as write fault in signal handler
+  while (true) {
+    auto flags = pageFlags.load(std::memory_order::relaxed);
+
+    if ((flags & amdgpu::kPageReadWriteLock) != 0) {
+      if ((flags & amdgpu::kPageLazyLock) != 0) {
+        if (!gpuContext.pushGpuCacheCommand(g_vmId, page)) {
+          continue;
+        }
+
+        gpuContext.gpuCacheCommandIdle.fetch_add(1,
+                                                 std::memory_order::release);
+        gpuContext.gpuCacheCommandIdle.notify_all();
+
+        while (!pageFlags.compare_exchange_weak(
+            flags, flags & ~amdgpu::kPageLazyLock,
+            std::memory_order::relaxed)) {
+        }
+      }
+      continue;
+    }
+
+    if ((flags & amdgpu::kPageWriteWatch) == 0) {
+      break;
+    }
+
+    if (pageFlags.compare_exchange_weak(flags, amdgpu::kPageInvalidated,
+                                        std::memory_order::relaxed)) {
+      break;
+    }
+  }
+
+  if (!unprotectPage(page * rx::mem::pageSize)) {
+    rx::println(stderr, "uffd: failed to remove write protection at {:#x}: {}",
+                page * rx::mem::pageSize, std::strerror(errno));
+    std::abort();
+  }
+}
+
+void faultThread() {
+  pthread_setname_np(pthread_self(), "UffdWatch");
+
+  auto gpu = amdgpu::DeviceCtl{orbis::g_context->gpuDevice};
+  auto &gpuContext = gpu.getContext();
+
+  uffd_msg messages[16];
+
+  while (true) {
+    auto result = ::read(g_uffd, messages, sizeof(messages));
+
+    if (result < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+
+      rx::println(stderr, "uffd: read failed: {}", std::strerror(errno));
+      std::abort();
+    }
+
+    for (auto &message : std::span(messages, result / sizeof(uffd_msg))) {
+      if (message.event != UFFD_EVENT_PAGEFAULT ||
+          (message.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WP) == 0) {
+        continue;
+      }
+
+      handleWriteFault(gpuContext, message.arg.pagefault.address);
+    }
+  }
+}
+} // namespace
+
+bool uffd::initialize(int vmId) {
+  if (g_uffd >= 0) {
+    return true;
+  }
+
+  auto features = getRequiredFeatures();
+  if (features == 0) {
+    rx::println(stderr, "uffd: built without shared memory write protection "
+                        "support, using mprotect page tracking");
+    return false;
+  }
+
+  int probeFd = openUffd();
+  if (probeFd < 0) {
+    rx::println(stderr, "uffd: userfaultfd is not available: {}, using "
+                        "mprotect page tracking",
+                std::strerror(errno));
+    return false;
+  }
+
+  uffdio_api api{.api = UFFD_API, .features = 0};
+  bool probed = ::ioctl(probeFd, UFFDIO_API, &api) == 0;
+  ::close(probeFd);
+
+  if (!probed || (api.features & features) != features) {
+    rx::println(stderr, "uffd: kernel does not support shared memory write "
+                        "protection, using mprotect page tracking");
+    return false;
+  }
+
+  int fd = openUffd();
+  api = {.api = UFFD_API, .features = features};
+  if (fd < 0 || ::ioctl(fd, UFFDIO_API, &api) != 0) {
+    rx::println(stderr, "uffd: initialization failed: {}, using mprotect page "
+                        "tracking",
+                std::strerror(errno));
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    return false;
+  }
+
+  g_uffd = fd;
+  g_vmId = vmId;
+  std::thread{faultThread}.detach();
+  g_enabled.store(true, std::memory_order::release);
+  return true;
+}
+
+bool uffd::isEnabled() { return g_enabled.load(std::memory_order::acquire); }
+
+void uffd::fork() {
+  g_enabled.store(false, std::memory_order::release);
+
+  // write protection is not inherited by the child, new userfaultfd is
+  // opened by initialize for vm of the child
+  if (g_uffd >= 0) {
+    ::close(g_uffd);
+    g_uffd = -1;
+  }
+
+  g_vmId = -1;
+}
+
+bool uffd::setWriteProtect(std::uint64_t address, std::uint64_t size,
+                           bool protect) {
+  if (!isEnabled()) {
+    return false;
+  }
+
+  if (protect) {
+    // registering already registered range is no-op, new mappings of the
+    // range drop registration so it is refreshed on every protect
+    uffdio_register reg{
+        .range = {.start = address, .len = size},
+        .mode = UFFDIO_REGISTER_MODE_WP,
+    };
+
+    if (::ioctl(g_uffd, UFFDIO_REGISTER, &reg) != 0) {
+      return false;
+    }
+  }
+
+  uffdio_writeprotect wp{
+      .range = {.start = address, .len = size},
+      .mode = protect ? UFFDIO_WRITEPROTECT_MODE_WP : 0,
+  };
+
+  return ::ioctl(g_uffd, UFFDIO_WRITEPROTECT, &wp) == 0;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+// userfaultfd write-protect backend of gpu page tracking
+//
+// Write watched pages stay writable for mprotect and are write protected with
+// UFFDIO_WRITEPROTECT instead. Write to such page blocks faulting thread in
+// kernel until fault thread invalidates page in `cachePages` and removes the
+// protection, no signal is delivered. Read-write locks still use mprotect.
+namespace uffd {
+/// Opens userfaultfd and starts fault thread for gpu vm `vmId`. Returns false
+/// if kernel does not support write-protect mode for shared memory, callers
+/// should use mprotect path.
+bool initialize(int vmId);
+bool isEnabled();
+
+/// Drops userfaultfd inherited from parent in forked process. Fault thread of
+/// the parent does not exist in the child, so protection is disabled until
+/// the child initializes its own gpu vm.
+void fork();
+
+/// Sets or removes write protection of range. Returns false if backend is
+/// disabled or range cannot be tracked, mprotect should be used instead.
+bool setWriteProtect(std::uint64_t address, std::uint64_t size, bool protect);
+} // namespace uffd
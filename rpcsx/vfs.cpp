@@ -4,8 +4,12 @@
 #include "io-device.hpp"
 #include "orbis/error/ErrorCode.hpp"
 #include "orbis/error/SysResult.hpp"
+#include <algorithm>
 #include <filesystem>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string_view>
 
 static orbis::ErrorCode devfs_stat(orbis::File *file, orbis::Stat *sb,
@@ -59,24 +63,61 @@ struct ProcFs : orbis::IoDevice {
   }
 };
 
+// mount points form a trie of path components, lookup walks the path once
+// and takes the deepest mounted node
+struct MountNode {
+  std::map<std::string, std::unique_ptr<MountNode>, std::less<>> children;
+  rx::Ref<orbis::IoDevice> device;
+};
+
 static rx::shared_mutex gMountMtx;
-static std::map<std::string, rx::Ref<orbis::IoDevice>, std::greater<>>
-    gMountsMap;
+static MountNode gMountRoot;
 static rx::Ref<DevFs> gDevFs;
 
+static MountNode &getMountNode(std::string_view mountPoint) {
+  auto node = &gMountRoot;
+
+  for (std::size_t pos = 1; pos < mountPoint.size();) {
+    auto end = std::min(mountPoint.find('/', pos), mountPoint.size());
+    auto name = mountPoint.substr(pos, end - pos);
+    pos = end + 1;
+
+    auto it = node->children.find(name);
+    if (it == node->children.end()) {
+      it = node->children
+               .emplace(std::string(name), std::make_unique<MountNode>())
+               .first;
+    }
+
+    node = it->second.get();
+  }
+
+  return *node;
+}
+
+template <typename Fn> static void forEachMount(MountNode &node, Fn &&fn) {
+  if (node.device != nullptr) {
+    fn(node.device);
+  }
+
+  for (auto &[name, child] : node.children) {
+    forEachMount(*child, fn);
+  }
+}
+
 void vfs::fork() {
   std::lock_guard lock(gMountMtx);
 
   // NOTE: do not decrease reference counter, it managed by parent process
   auto parentDevFs = gDevFs.release();
 
-  for (auto &mount : gMountsMap) {
-    mount.second->incRef(); // increase reference for new process
-  }
+  forEachMount(gMountRoot, [](rx::Ref<orbis::IoDevice> &device) {
+    device->incRef(); // increase reference for new process
+  });
 
   gDevFs = orbis::knew<DevFs>();
-  gMountsMap["/dev/"] = gDevFs;
-  gMountsMap["/proc/"] = orbis::knew<ProcFs>();
+  getMountNode("/dev/").device = gDevFs;
+  getMountNode("/proc/").device = orbis::knew<ProcFs>();
 
   for (auto &fs : parentDevFs->devices) {
     gDevFs->devices[fs.first] = fs.second;
@@ -85,13 +126,13 @@ void vfs::fork() {
 
 void vfs::initialize() {
   gDevFs = orbis::knew<DevFs>();
-  gMountsMap.emplace("/dev/", gDevFs);
-  gMountsMap.emplace("/proc/", orbis::knew<ProcFs>());
+  getMountNode("/dev/").device = gDevFs;
+  getMountNode("/proc/").device = orbis::knew<ProcFs>();
 }
 
 void vfs::deinitialize() {
   gDevFs = nullptr;
-  gMountsMap.clear();
+  gMountRoot = {};
 }
 
 void vfs::addDevice(std::string name, orbis::IoDevice *device) {
@@ -103,42 +144,44 @@ std::pair<rx::Ref<orbis::IoDevice>, std::string>
 vfs::get(const std::filesystem::path &guestPath) {
   std::string normalPath = std::filesystem::path(guestPath).lexically_normal();
   std::string_view path = normalPath;
-  rx::Ref<orbis::IoDevice> device;
 
-  std::lock_guard lock(gMountMtx);
+  if (!path.starts_with('/')) {
+    return {};
+  }
 
-  if (gDevFs != nullptr) {
-    std::string_view devPath = "/dev/";
-    if (path.starts_with(devPath) ||
-        path == devPath.substr(0, devPath.size() - 1)) {
-      if (path.size() > devPath.size()) {
-        path.remove_prefix(devPath.size());
-      } else {
-        path = {};
-      }
+  std::shared_lock lock(gMountMtx);
 
-      return {gDevFs, std::string(path)};
-    }
-  }
+  MountNode *mount = gMountRoot.device != nullptr ? &gMountRoot : nullptr;
+  std::size_t mountPathEnd = 1;
+  auto node = &gMountRoot;
 
-  for (auto &mount : gMountsMap) {
-    if (!path.starts_with(mount.first)) {
-      if (mount.first.size() - 1 != path.size() ||
-          !std::string_view(mount.first).starts_with(path)) {
-        continue;
-      }
+  for (std::size_t pos = 1; pos < path.size();) {
+    auto end = std::min(path.find('/', pos), path.size());
+    auto it = node->children.find(path.substr(pos, end - pos));
+    if (it == node->children.end()) {
+      break;
     }
 
-    device = mount.second;
-    if (path.size() > mount.first.length()) {
-      path.remove_prefix(mount.first.length());
-    } else {
-      path = {};
+    node = it->second.get();
+    pos = end + 1;
+
+    if (node->device != nullptr) {
+      mount = node;
+      mountPathEnd = pos;
     }
-    return {mount.second, std::string(path)};
   }
 
-  return {};
+  if (mount == nullptr) {
+    return {};
+  }
+
+  if (mountPathEnd < path.size()) {
+    path.remove_prefix(mountPathEnd);
+  } else {
+    path = {};
+  }
+
+  return {mount->device, std::string(path)};
 }
 
 orbis::SysResult vfs::mount(const std::filesystem::path &guestPath,
@@ -150,12 +193,12 @@ orbis::SysResult vfs::mount(const std::filesystem::path &guestPath,
 
   std::lock_guard lock(gMountMtx);
 
-  auto [it, inserted] = gMountsMap.emplace(std::move(mp), dev);
-
-  if (!inserted) {
+  auto &node = getMountNode(mp);
+  if (node.device != nullptr) {
     return orbis::ErrorCode::EXIST;
   }
 
+  node.device = dev;
   return {};
 }
 
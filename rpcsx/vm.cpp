@@ -13,6 +13,8 @@
 #include "rx/watchdog.hpp"
 #include <bit>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
 #include <fcntl.h>
@@ -22,6 +24,7 @@
 #include <rx/mem.hpp>
 #include <sys/mman.h>
 #include <unistd.h>
+#include <vector>
 #include <csignal>
 #include <csetjmp>
 
@@ -658,6 +661,10 @@ struct MapInfo {
   std::uint32_t flags;
   char name[32];
 
+  // memory is mapped by device (host file, direct memory) and is not backed
+  // by process memory file
+  bool isDeviceMapped = false;
+
   bool operator==(const MapInfo &) const = default;
 };
 
@@ -687,7 +694,81 @@ static void forkSigbusHandler(int sig, siginfo_t *info, void *ctx) {
   raise(sig);
 }
 
+// copies range of guest memory from parent process memory file to this
+// process memory file
+static void copyForkRange(int parentShm, std::uint64_t address,
+                          std::uint64_t size) {
+  auto end = address - kMinAddress + size;
+  loff_t srcOffset = address - kMinAddress;
+  loff_t dstOffset = address - kMinAddress;
+
+  // in-kernel copy, memory is not touched through mappings
+  while (std::uint64_t(dstOffset) < end) {
+    auto copied = ::copy_file_range(parentShm, &srcOffset, gMemoryShm,
+                                    &dstOffset, end - dstOffset, 0);
+    if (copied <= 0) {
+      break;
+    }
+  }
+
+  // copy_file_range is not supported, write from current mapping
+  while (std::uint64_t(dstOffset) < end) {
+    auto written = ::pwrite(gMemoryShm,
+                            reinterpret_cast<void *>(dstOffset + kMinAddress),
+                            end - dstOffset, dstOffset);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (written <= 0) {
+      rx::println(stderr, "Memory: fork failed to copy {:#x}-{:#x}: {}",
+                  dstOffset + kMinAddress, end + kMinAddress,
+                  std::strerror(errno));
+      std::abort();
+    }
+
+    dstOffset += written;
+  }
+}
+
+static bool copyForkPage(void *dst, const void *src) {
+  if (sigsetjmp(g_forkJmpBuf, 1) != 0) {
+    g_inForkCopy = false;
+    return false;
+  }
+
+  g_inForkCopy = true;
+  std::memcpy(dst, src, vm::kPageSize);
+  g_inForkCopy = false;
+  return true;
+}
+
+// copies range mapped by device from live mapping to this process memory
+// file, pages past the end of mapped host file are left zeroed
+static void copyForkDeviceRange(std::uint64_t address, std::uint64_t size) {
+  auto mapping = static_cast<std::byte *>(
+      rx::mem::map(nullptr, size, PROT_WRITE, MAP_SHARED, gMemoryShm,
+                   address - kMinAddress));
+  if (mapping == MAP_FAILED) {
+    rx::println(stderr, "Memory: fork failed to map {:#x}-{:#x}", address,
+                address + size);
+    std::abort();
+  }
+
+  // range is remapped to memory file after copy
+  rx::mem::protect(reinterpret_cast<void *>(address), size, PROT_READ);
+
+  for (std::uint64_t offset = 0; offset < size; offset += vm::kPageSize) {
+    copyForkPage(mapping + offset,
+                 reinterpret_cast<const void *>(address + offset));
+  }
+
+  rx::mem::unmap(mapping, size);
+}
+
 void vm::fork(std::uint64_t pid) {
+  auto startTime = std::chrono::steady_clock::now();
+  auto parentShm = gMemoryShm;
   auto shmPath = rx::format("{}/memory-{}", rx::getShmPath(), pid);
   gMemoryShm =
       ::open(shmPath.c_str(), O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR);
@@ -712,47 +793,126 @@ void vm::fork(std::uint64_t pid) {
   sigemptyset(&sa.sa_mask);
   sigaction(SIGBUS, &sa, &oldSa);
 
-  for (auto address = kMinAddress; address < kMaxAddress;
-       address += kPageSize) {
-    auto prot = gBlocks[(address >> kBlockShift) - kFirstBlock].getProtection(
-        (address & kBlockMask) >> vm::kPageShift);
+  std::uint64_t rangeAddress = 0;
+  std::uint64_t rangeSize = 0;
+  unsigned rangeProt = 0;
+  std::uint64_t rangeCount = 0;
+  std::uint64_t copiedSize = 0;
+  std::vector<rx::AddressRange> deviceRanges;
+
+  // device mapped parts of range are not backed by parent memory file, they
+  // are copied from live mapping
+  auto copyRange = [&](std::uint64_t address, std::uint64_t end) {
+    while (address < end) {
+      auto next = end;
+      bool isDeviceMapped = false;
+
+      if (auto it = gMapInfo.lowerBound(address);
+          it != gMapInfo.end() && it.beginAddress() < end) {
+        if (it.beginAddress() <= address) {
+          next = std::min(it.endAddress(), end);
+          isDeviceMapped = it->isDeviceMapped;
+        } else {
+          next = it.beginAddress();
+        }
+      }
 
-    if (prot & kShared) {
-      continue;
+      if (isDeviceMapped) {
+        copyForkDeviceRange(address, next - address);
+        deviceRanges.push_back(
+            rx::AddressRange::fromBeginEnd(address, next));
+      } else {
+        copyForkRange(parentShm, address, next - address);
+      }
+
+      address = next;
+    }
+  };
+
+  // private cpu accessible memory is copied and remapped by runs of pages
+  // with same protection, shared memory stays mapped to parent memory file
+  auto flushRange = [&] {
+    if (rangeSize == 0) {
+      return;
     }
 
-    if (prot & kMapProtCpuAll) {
-      auto mapping = rx::mem::map(nullptr, kPageSize, PROT_WRITE, MAP_SHARED,
-                                  gMemoryShm, address - kMinAddress);
-      assert(mapping != MAP_FAILED);
-
-      // Use setjmp to catch SIGBUS during mprotect/memcpy
-      if (sigsetjmp(g_forkJmpBuf, 1) == 0) {
-        g_inForkCopy = true;
-        rx::mem::protect(reinterpret_cast<void *>(address), kPageSize, PROT_READ);
-        std::memcpy(mapping, reinterpret_cast<void *>(address), kPageSize);
-        g_inForkCopy = false;
-      } else {
-        // SIGBUS occurred - page not actually mapped, skip it
-        g_inForkCopy = false;
-        rx::mem::unmap(mapping, kPageSize);
+    copyRange(rangeAddress, rangeAddress + rangeSize);
+
+    auto mapping = rx::mem::map(reinterpret_cast<void *>(rangeAddress),
+                                rangeSize, rangeProt, MAP_FIXED | MAP_SHARED,
+                                gMemoryShm, rangeAddress - kMinAddress);
+    assert(mapping != MAP_FAILED);
+
+    rangeCount++;
+    copiedSize += rangeSize;
+    rangeSize = 0;
+  };
+
+  for (std::uint64_t blockIndex = 0; blockIndex < kBlockCount; ++blockIndex) {
+    auto &block = gBlocks[blockIndex];
+    auto blockAddress = (kFirstBlock + blockIndex) * kBlockSize;
+
+    for (std::uint64_t groupIndex = 0; groupIndex < kGroupsInBlock;
+         ++groupIndex) {
+      auto &group = block.groups[groupIndex];
+      auto pages = group.allocated & ~group.shared &
+                   (group.readable | group.writable | group.executable);
+
+      if (pages == 0) {
+        flushRange();
         continue;
       }
 
-      rx::mem::unmap(mapping, kPageSize);
-      rx::mem::unmap(reinterpret_cast<void *>(address), kPageSize);
+      for (std::uint64_t page = 0; page < kGroupSize; ++page) {
+        auto blockPage = groupIndex * kGroupSize + page;
+        auto address = blockAddress + blockPage * kPageSize;
 
-      mapping = rx::mem::map(reinterpret_cast<void *>(address), kPageSize,
-                             prot & kMapProtCpuAll, MAP_FIXED | MAP_SHARED,
-                             gMemoryShm, address - kMinAddress);
-      assert(mapping != MAP_FAILED);
-    }
+        if ((pages & (1ull << page)) == 0 || address < kMinAddress) {
+          flushRange();
+          continue;
+        }
 
-    // TODO: copy gpu memory?
+        auto prot = block.getProtection(blockPage) & kMapProtCpuAll;
+
+        if (rangeSize != 0 && rangeProt != prot) {
+          flushRange();
+        }
+
+        if (rangeSize == 0) {
+          rangeAddress = address;
+          rangeProt = prot;
+        }
+
+        rangeSize += kPageSize;
+      }
+    }
   }
 
+  flushRange();
+
   // Restore original SIGBUS handler
   sigaction(SIGBUS, &oldSa, nullptr);
+
+  // copied device ranges are backed by memory file of this process now
+  for (auto range : deviceRanges) {
+    if (auto it = gMapInfo.queryArea(range.beginAddress());
+        it != gMapInfo.end()) {
+      auto info = it.get();
+      info.isDeviceMapped = false;
+      gMapInfo.map(range.beginAddress(), range.endAddress(), info);
+    }
+  }
+
+  // TODO: copy gpu memory?
+
+  if (parentShm >= 0) {
+    ::close(parentShm);
+  }
+
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - startTime);
+  std::println("Memory: fork copied {} MiB in {} ranges, {} ms",
+               copiedSize / (1024 * 1024), rangeCount, elapsed.count());
 }
 
 void vm::reset() {
@@ -1000,6 +1160,7 @@ void *vm::map(void *addr, std::uint64_t len, std::int32_t prot,
     info.device = device;
     info.flags = flags;
     info.offset = offset;
+    info.isDeviceMapped = (internalFlags & kMapInternalReserveOnly) != 0;
 
     gMapInfo.map(address, address + len, info);
   }
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace rx {
+/// Ordered map stored as two level B+ tree: sorted directory of leaves, each
+/// leaf holds up to LeafCapacity sorted entries inline. Lookup is binary
+/// search in directory and in one leaf, iteration walks contiguous entries.
+/// Leaves are allocated one at a time with Allocator, so node allocators fit.
+///
+/// Unlike std::map, any insertion or erasure invalidates all iterators.
+template <typename Key, typename T,
+          template <typename> typename Allocator = std::allocator,
+          std::size_t LeafCapacity = 32>
+class BTreeMap {
+  static_assert(LeafCapacity >= 4);
+
+public:
+  struct value_type {
+    Key first;
+    T second;
+  };
+
+private:
+  struct Leaf {
+    std::size_t count = 0;
+    alignas(value_type) std::byte storage[sizeof(value_type) * LeafCapacity];
+
+    value_type *data() {
+      return std::launder(reinterpret_cast<value_type *>(storage));
+    }
+  };
+
+  struct LeafRef {
+    Key firstKey;
+    Leaf *leaf;
+  };
+
+  std::vector<LeafRef, Allocator<LeafRef>> mLeaves;
+  std::size_t mSize = 0;
+
+  template <bool IsConst> class basic_iterator {
+    using map_type = std::conditional_t<IsConst, const BTreeMap, BTreeMap>;
+
+    map_type *mMap = nullptr;
+    std::size_t mLeaf = 0;
+    std::size_t mSlot = 0;
+
+    friend BTreeMap;
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = BTreeMap::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer =
+        std::conditional_t<IsConst, const value_type *, value_type *>;
+    using reference =
+        std::conditional_t<IsConst, const value_type &, value_type &>;
+
+    basic_iterator() = default;
+    basic_iterator(map_type *map, std::size_t leaf, std::size_t slot)
+        : mMap(map), mLeaf(leaf), mSlot(slot) {}
+
+    operator basic_iterator<true>() const
+      requires(!IsConst)
+    {
+      return {mMap, mLeaf, mSlot};
+    }
+
+    reference operator*() const {
+      return mMap->mLeaves[mLeaf].leaf->data()[mSlot];
+    }
+    pointer operator->() const { return &**this; }
+
+    basic_iterator &operator++() {
+      if (++mSlot == mMap->mLeaves[mLeaf].leaf->count) {
+        ++mLeaf;
+        mSlot = 0;
+      }
+      return *this;
+    }
+
+    basic_iterator &operator--() {
+      if (mSlot == 0) {
+        --mLeaf;
+        mSlot = mMap->mLeaves[mLeaf].leaf->count;
+      }
+      --mSlot;
+      return *this;
+    }
+
+    basic_iterator operator++(int) {
+      auto result = *this;
+      ++*this;
+      return result;
+    }
+
+    basic_iterator operator--(int) {
+      auto result = *this;
+      --*this;
+      return result;
+    }
+
+    bool operator==(const basic_iterator &other) const {
+      return mLeaf == other.mLeaf && mSlot == other.mSlot;
+    }
+  };
+
+public:
+  using iterator = basic_iterator<false>;
+  using const_iterator = basic_iterator<true>;
+
+  BTreeMap() = default;
+  BTreeMap(BTreeMap &&other) noexcept
+      : mLeaves(std::move(other.mLeaves)),
+        mSize(std::exchange(other.mSize, 0)) {
+    other.mLeaves.clear();
+  }
+  BTreeMap &operator=(BTreeMap &&other) noexcept {
+    if (this != &other) {
+      clear();
+      mLeaves = std::move(other.mLeaves);
+      mSize = std::exchange(other.mSize, 0);
+      other.mLeaves.clear();
+    }
+    return *this;
+  }
+  BTreeMap(const BTreeMap &) = delete;
+  BTreeMap &operator=(const BTreeMap &) = delete;
+  ~BTreeMap() { clear(); }
+
+  iterator begin() { return {this, 0, 0}; }
+  iterator end() { return {this, mLeaves.size(), 0}; }
+  const_iterator begin() const { return {this, 0, 0}; }
+  const_iterator end() const { return {this, mLeaves.size(), 0}; }
+
+  [[nodiscard]] bool empty() const { return mSize == 0; }
+  [[nodiscard]] std::size_t size() const { return mSize; }
+
+  void clear() {
+    for (auto &ref : mLeaves) {
+      std::destroy_n(ref.leaf->data(), ref.leaf->count);
+      freeLeaf(ref.leaf);
+    }
+
+    mLeaves.clear();
+    mSize = 0;
+  }
+
+  iterator lower_bound(const Key &key) {
+    auto [leaf, slot] = lowerBoundImpl(key);
+    return {this, leaf, slot};
+  }
+
+  const_iterator lower_bound(const Key &key) const {
+    auto [leaf, slot] = lowerBoundImpl(key);
+    return {this, leaf, slot};
+  }
+
+  iterator find(const Key &key) {
+    auto it = lower_bound(key);
+    return it != end() && it->first == key ? it : end();
+  }
+
+  /// Inserts key if it is not present. Value is consumed in both cases.
+  std::pair<iterator, bool> emplace(const Key &key, T value) {
+    if (mLeaves.empty()) {
+      mLeaves.push_back({key, allocateLeaf()});
+      std::construct_at(mLeaves[0].leaf->data(),
+                        value_type{key, std::move(value)});
+      mLeaves[0].leaf->count = 1;
+      mSize = 1;
+      return {begin(), true};
+    }
+
+    auto leafIndex = findLeaf(key);
+    auto leaf = mLeaves[leafIndex].leaf;
+    auto slot = lowerBoundInLeaf(leaf, key);
+
+    if (slot < leaf->count && leaf->data()[slot].first == key) {
+      return {{this, leafIndex, slot}, false};
+    }
+
+    if (leaf->count == LeafCapacity) {
+      splitLeaf(leafIndex);
+
+      if (slot > LeafCapacity / 2) {
+        ++leafIndex;
+        slot -= LeafCapacity / 2;
+        leaf = mLeaves[leafIndex].leaf;
+      }
+    }
+
+    auto data = leaf->data();
+    for (auto i = leaf->count; i > slot; --i) {
+      relocate(data + i, data + i - 1);
+    }
+
+    std::construct_at(data + slot, value_type{key, std::move(value)});
+    ++leaf->count;
+    ++mSize;
+
+    if (slot == 0) {
+      mLeaves[leafIndex].firstKey = key;
+    }
+
+    return {{this, leafIndex, slot}, true};
+  }
+
+  /// Returns iterator to element that followed erased one.
+  iterator erase(iterator pos) {
+    auto leafIndex = pos.mLeaf;
+    auto slot = pos.mSlot;
+    auto leaf = mLeaves[leafIndex].leaf;
+    auto data = leaf->data();
+
+    std::destroy_at(data + slot);
+    for (auto i = slot + 1; i < leaf->count; ++i) {
+      relocate(data + i - 1, data + i);
+    }
+
+    --leaf->count;
+    --mSize;
+
+    if (leaf->count == 0) {
+      freeLeaf(leaf);
+      mLeaves.erase(mLeaves.begin() + leafIndex);
+      return {this, leafIndex, 0};
+    }
+
+    if (slot == 0) {
+      mLeaves[leafIndex].firstKey = data[0].first;
+    }
+
+    // keep leaves dense, merge underfilled leaf into neighbor
+    if (leaf->count < LeafCapacity / 4) {
+      if (leafIndex + 1 < mLeaves.size() &&
+          leaf->count + mLeaves[leafIndex + 1].leaf->count <=
+              LeafCapacity * 3 / 4) {
+        mergeLeaves(leafIndex);
+      } else if (leafIndex > 0 &&
+                 leaf->count + mLeaves[leafIndex - 1].leaf->count <=
+                     LeafCapacity * 3 / 4) {
+        slot += mLeaves[leafIndex - 1].leaf->count;
+        --leafIndex;
+        mergeLeaves(leafIndex);
+      }
+    }
+
+    if (slot == mLeaves[leafIndex].leaf->count) {
+      return {this, leafIndex + 1, 0};
+    }
+
+    return {this, leafIndex, slot};
+  }
+
+private:
+  static Leaf *allocateLeaf() {
+    Allocator<Leaf> allocator;
+    return std::construct_at(allocator.allocate(1));
+  }
+
+  static void freeLeaf(Leaf *leaf) {
+    Allocator<Leaf> allocator;
+    std::destroy_at(leaf);
+    allocator.deallocate(leaf, 1);
+  }
+
+  static void relocate(value_type *dst, value_type *src) {
+    std::construct_at(dst, std::move(*src));
+    std::destroy_at(src);
+  }
+
+  static std::size_t lowerBoundInLeaf(Leaf *leaf, const Key &key) {
+    auto data = leaf->data();
+    return std::partition_point(data, data + leaf->count,
+                                [&](const value_type &entry) {
+                                  return entry.first < key;
+                                }) -
+           data;
+  }
+
+  // last leaf with first key not greater than key, or first leaf
+  std::size_t findLeaf(const Key &key) const {
+    auto it = std::partition_point(
+        mLeaves.begin(), mLeaves.end(),
+        [&](const LeafRef &ref) { return !(key < ref.firstKey); });
+
+    return it == mLeaves.begin() ? 0 : it - mLeaves.begin() - 1;
+  }
+
+  std::pair<std::size_t, std::size_t> lowerBoundImpl(const Key &key) const {
+    if (mLeaves.empty()) {
+      return {0, 0};
+    }
+
+    auto leafIndex = findLeaf(key);
+    auto slot = lowerBoundInLeaf(mLeaves[leafIndex].leaf, key);
+
+    if (slot == mLeaves[leafIndex].leaf->count) {
+      return {leafIndex + 1, 0};
+    }
+
+    return {leafIndex, slot};
+  }
+
+  void splitLeaf(std::size_t leafIndex) {
+    auto leaf = mLeaves[leafIndex].leaf;
+    auto newLeaf = allocateLeaf();
+    auto half = leaf->count / 2;
+
+    for (std::size_t i = half; i < leaf->count; ++i) {
+      relocate(newLeaf->data() + i - half, leaf->data() + i);
+    }
+
+    newLeaf->count = leaf->count - half;
+    leaf->count = half;
+
+    mLeaves.insert(mLeaves.begin() + leafIndex + 1,
+                   {newLeaf->data()[0].first, newLeaf});
+  }
+
+  // moves entries of next leaf to the end of leaf
+  void mergeLeaves(std::size_t leafIndex) {
+    auto leaf = mLeaves[leafIndex].leaf;
+    auto next = mLeaves[leafIndex + 1].leaf;
+
+    for (std::size_t i = 0; i < next->count; ++i) {
+      relocate(leaf->data() + leaf->count + i, next->data() + i);
+    }
+
+    leaf->count += next->count;
+    freeLeaf(next);
+    mLeaves.erase(mLeaves.begin() + leafIndex + 1);
+  }
+};
+} // namespace rx
@@ -1,12 +1,12 @@
 #pragma once
 
 #include "rx/AddressRange.hpp"
+#include "rx/BTreeMap.hpp"
 #include "rx/Rc.hpp"
 #include <bit>
 #include <cassert>
 #include <concepts>
 #include <cstdint>
-#include <map>
 #include <memory>
 #include <set>
 #include <utility>
@@ -29,14 +29,16 @@ struct StdSetInvalidationHandle {
   }
 };
 
-template <typename InvalidationHandleT = NoInvalidationHandle>
+template <typename InvalidationHandleT = NoInvalidationHandle,
+          template <typename> typename Allocator = std::allocator>
 class MemoryAreaTable : public InvalidationHandleT {
   enum class Kind { O, X };
-  std::map<std::uint64_t, Kind> mAreas;
+  using map_type = BTreeMap<std::uint64_t, Kind, Allocator>;
+  map_type mAreas;
 
 public:
   class iterator {
-    using map_iterator = typename std::map<std::uint64_t, Kind>::iterator;
+    using map_iterator = typename map_type::iterator;
     map_iterator it;
 
   public:
@@ -84,15 +86,17 @@ public:
     return {startAddress, endAddress};
   }
 
+  // modifications of mAreas invalidate its iterators, range ends are tracked
+  // by address
   void map(std::uint64_t beginAddress, std::uint64_t endAddress) {
     auto [beginIt, beginInserted] = mAreas.emplace(beginAddress, Kind::O);
-    auto [endIt, endInserted] = mAreas.emplace(endAddress, Kind::X);
+    auto rangeBegin = beginAddress;
 
     if (!beginInserted) {
       if (beginIt->second == Kind::X) {
         // it was close, extend to open
         assert(beginIt != mAreas.begin());
-        --beginIt;
+        rangeBegin = std::prev(beginIt)->first;
       }
     } else if (beginIt != mAreas.begin()) {
       auto prevRangePointIt = std::prev(beginIt);
@@ -100,17 +104,20 @@ public:
       if (prevRangePointIt->second == Kind::O) {
         // we found range start before inserted one, remove insertion and extend
         // begin
+        rangeBegin = prevRangePointIt->first;
         this->handleInvalidation(beginIt->first);
         mAreas.erase(beginIt);
-        beginIt = prevRangePointIt;
       }
     }
 
+    auto [endIt, endInserted] = mAreas.emplace(endAddress, Kind::X);
+    auto rangeEnd = endAddress;
+
     if (!endInserted) {
       if (endIt->second == Kind::O) {
         // it was open, extend to close
-        assert(endIt != mAreas.end());
-        ++endIt;
+        assert(std::next(endIt) != mAreas.end());
+        rangeEnd = std::next(endIt)->first;
       }
     } else {
       auto nextRangePointIt = std::next(endIt);
@@ -119,17 +126,17 @@ public:
           nextRangePointIt->second == Kind::X) {
         // we found range end after inserted one, remove insertion and extend
         // end
+        rangeEnd = nextRangePointIt->first;
         this->handleInvalidation(std::prev(endIt)->first);
         mAreas.erase(endIt);
-        endIt = nextRangePointIt;
       }
     }
 
     // eat everything in middle of the range
-    ++beginIt;
-    while (beginIt != endIt) {
-      this->handleInvalidation(std::prev(endIt)->first);
-      beginIt = mAreas.erase(beginIt);
+    auto it = std::next(mAreas.find(rangeBegin));
+    while (it->first != rangeEnd) {
+      this->handleInvalidation(std::prev(mAreas.find(rangeEnd))->first);
+      it = mAreas.erase(it);
     }
   }
 
@@ -165,14 +172,8 @@ public:
     if (beginIt->first > beginAddress && beginIt->second == Kind::X) {
       // we have found end after unmap begin, need to insert new end
       this->handleInvalidation(std::prev(beginIt)->first);
-      auto newBeginIt = mAreas.emplace_hint(beginIt, beginAddress, Kind::X);
       mAreas.erase(beginIt);
-
-      if (newBeginIt == mAreas.end()) {
-        return;
-      }
-
-      beginIt = std::next(newBeginIt);
+      beginIt = std::next(mAreas.emplace(beginAddress, Kind::X).first);
     } else if (beginIt->second == Kind::X) {
       beginIt = ++beginIt;
     }
@@ -180,7 +181,7 @@ public:
     Kind lastKind = Kind::X;
     while (beginIt != mAreas.end() && beginIt->first <= endAddress) {
       lastKind = beginIt->second;
-      if (lastKind == Kind::O) {
+      if (lastKind == Kind::O && beginIt != mAreas.begin()) {
         this->handleInvalidation(std::prev(beginIt)->first);
       }
       beginIt = mAreas.erase(beginIt);
@@ -191,7 +192,7 @@ public:
     }
 
     // Last removed was range open, need to insert new one at unmap end
-    mAreas.emplace_hint(beginIt, endAddress, Kind::O);
+    mAreas.emplace(endAddress, Kind::O);
   }
 
   std::size_t totalMemory() const {
@@ -459,9 +460,8 @@ template <typename PayloadT,
           template <typename> typename Allocator = std::allocator>
 class MemoryTableWithPayload {
   using payload_type = Payload<PayloadT>;
-  std::map<std::uint64_t, payload_type, std::less<>,
-           Allocator<std::pair<const std::uint64_t, payload_type>>>
-      mAreas;
+  using map_type = BTreeMap<std::uint64_t, payload_type, Allocator>;
+  map_type mAreas;
 
 public:
   class AreaInfo : public rx::AddressRange {
@@ -476,8 +476,7 @@ public:
   };
 
   class iterator {
-    using map_iterator =
-        typename std::map<std::uint64_t, payload_type>::iterator;
+    using map_iterator = typename map_type::iterator;
     map_iterator it;
 
   public:
@@ -573,11 +572,14 @@ public:
   iterator map(std::uint64_t beginAddress, std::uint64_t endAddress,
                PayloadT payload, bool merge = true, bool noOverride = false) {
     assert(beginAddress < endAddress);
-    auto [beginIt, beginInserted] =
-        mAreas.emplace(beginAddress, payload_type::createOpen(payload));
+    bool beginInserted =
+        mAreas.emplace(beginAddress, payload_type::createOpen(payload)).second;
     auto [endIt, endInserted] =
         mAreas.emplace(endAddress, payload_type::createClose());
 
+    // insertion of end invalidated iterator to begin
+    auto beginIt = mAreas.find(beginAddress);
+
     bool seenOpen = false;
     bool endCollision = false;
     bool lastRemovedIsOpen = false;
@@ -635,7 +637,11 @@ public:
         lastRemovedIsOpen = true;
         lastRemovedOpenPayload = std::move(beginIt->second.get());
       }
+
+      // erase invalidates iterators to both ends
       beginIt = mAreas.erase(beginIt);
+      origBegin = std::prev(beginIt);
+      endIt = mAreas.find(endAddress);
     }
 
     if (endCollision && !seenOpen) {
@@ -653,14 +659,14 @@ public:
       auto prevBegin = std::prev(origBegin);
 
       if (prevBegin->second.get() == origBegin->second.get()) {
-        mAreas.erase(origBegin);
-        origBegin = prevBegin;
+        endIt = mAreas.erase(origBegin);
+        origBegin = std::prev(endIt);
       }
     }
 
     if (endIt->second.isCloseOpen()) {
       if (endIt->second.get() == origBegin->second.get()) {
-        mAreas.erase(endIt);
+        origBegin = std::prev(mAreas.erase(endIt));
       }
     }
 
@@ -669,19 +675,18 @@ public:
 
   void unmap(iterator it) {
     auto openIt = it.it;
-    auto closeIt = openIt;
-    ++closeIt;
+    auto closeIt = std::next(openIt);
 
-    if (openIt->second.isCloseOpen()) {
-      openIt->second = payload_type::createClose();
+    if (closeIt->second.isCloseOpen()) {
+      closeIt->second.setOpen();
     } else {
-      mAreas.erase(openIt);
+      openIt = std::prev(mAreas.erase(closeIt));
     }
 
-    if (closeIt->second.isCloseOpen()) {
-      closeIt->second.setOpen();
+    if (openIt->second.isCloseOpen()) {
+      openIt->second = payload_type::createClose();
     } else {
-      mAreas.erase(closeIt);
+      mAreas.erase(openIt);
     }
   }
 
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+
+namespace rx {
+namespace detail {
+struct PoolFreeNode {
+  PoolFreeNode *next;
+
+  // valid in first node of batch stored in shared pool only
+  PoolFreeNode *nextBatch;
+  std::size_t batchSize;
+};
+
+// Process-wide pool of fixed size nodes. Every thread keeps small cache of
+// free nodes and exchanges them with shared pool in batches, so a node freed
+// by other thread is reused instead of growing one thread's list forever, and
+// cached nodes go back to shared pool when thread exits. Chunks are never
+// returned to system.
+template <std::size_t NodeSize, std::size_t NodeAlign> class NodePool {
+  static constexpr std::size_t kChunkSize = 64 * 1024;
+  static constexpr std::size_t kNodesPerChunk = kChunkSize / NodeSize;
+  static constexpr std::size_t kBatchSize = 64;
+
+  struct ThreadCache {
+    PoolFreeNode *freeList = nullptr;
+    std::size_t count = 0;
+
+    ~ThreadCache() {
+      if (freeList != nullptr) {
+        getInstance().pushBatch(freeList, count);
+      }
+    }
+  };
+
+  std::mutex mMutex;
+  PoolFreeNode *mBatches = nullptr;
+  std::byte *mChunkPos = nullptr;
+  std::byte *mChunkEnd = nullptr;
+
+  static ThreadCache &getCache() {
+    thread_local ThreadCache cache;
+    return cache;
+  }
+
+  void pushBatch(PoolFreeNode *head, std::size_t count) {
+    head->batchSize = count;
+
+    std::lock_guard lock(mMutex);
+    head->nextBatch = mBatches;
+    mBatches = head;
+  }
+
+  void refill(ThreadCache &cache) {
+    std::lock_guard lock(mMutex);
+
+    if (mBatches != nullptr) {
+      auto batch = std::exchange(mBatches, mBatches->nextBatch);
+      cache.freeList = batch;
+      cache.count = batch->batchSize;
+      return;
+    }
+
+    for (std::size_t i = 0; i < kBatchSize; ++i) {
+      if (mChunkPos == mChunkEnd) {
+        mChunkPos = static_cast<std::byte *>(::operator new(
+            kNodesPerChunk * NodeSize, std::align_val_t{NodeAlign}));
+        mChunkEnd = mChunkPos + kNodesPerChunk * NodeSize;
+      }
+
+      auto node = std::exchange(mChunkPos, mChunkPos + NodeSize);
+      cache.freeList = new (node) PoolFreeNode{cache.freeList};
+    }
+
+    cache.count = kBatchSize;
+  }
+
+public:
+  // intentionally leaked, thread caches may be released after static
+  // destructors
+  static NodePool &getInstance() {
+    static NodePool *pool = new NodePool();
+    return *pool;
+  }
+
+  void *allocate() {
+    auto &cache = getCache();
+
+    if (cache.freeList == nullptr) {
+      refill(cache);
+    }
+
+    --cache.count;
+    return std::exchange(cache.freeList, cache.freeList->next);
+  }
+
+  void deallocate(void *node) {
+    auto &cache = getCache();
+    cache.freeList = new (node) PoolFreeNode{cache.freeList};
+
+    if (++cache.count < 2 * kBatchSize) {
+      return;
+    }
+
+    // keep newest half, give the rest to shared pool
+    auto last = cache.freeList;
+    for (std::size_t i = 1; i < kBatchSize; ++i) {
+      last = last->next;
+    }
+
+    auto batch = std::exchange(last->next, nullptr);
+    cache.count = kBatchSize;
+    pushBatch(batch, kBatchSize);
+  }
+};
+} // namespace detail
+
+/// Allocator for node based containers. Single element allocations are
+/// served from per-thread caches of process-wide pool carved from 64 KiB
+/// chunks, so nodes of one container stay close in memory and erase/insert
+/// churn does not reach the system allocator. Nodes may be freed from any
+/// thread. Array allocations use operator new.
+template <typename T> class PoolAllocator {
+  // evaluated on first allocation, T may be incomplete on instantiation
+  static auto &getPool() {
+    constexpr std::size_t kNodeAlign =
+        std::max(alignof(T), alignof(detail::PoolFreeNode));
+    constexpr std::size_t kNodeSize =
+        (std::max(sizeof(T), sizeof(detail::PoolFreeNode)) + kNodeAlign - 1) &
+        ~(kNodeAlign - 1);
+
+    return detail::NodePool<kNodeSize, kNodeAlign>::getInstance();
+  }
+
+public:
+  using value_type = T;
+
+  PoolAllocator() = default;
+  template <typename U> PoolAllocator(const PoolAllocator<U> &) noexcept {}
+
+  T *allocate(std::size_t n) {
+    if (n == 1) {
+      return static_cast<T *>(getPool().allocate());
+    }
+
+    return static_cast<T *>(
+        ::operator new(n * sizeof(T), std::align_val_t{alignof(T)}));
+  }
+
+  void deallocate(T *p, std::size_t n) {
+    if (n == 1) {
+      getPool().deallocate(p);
+      return;
+    }
+
+    ::operator delete(p, n * sizeof(T), std::align_val_t{alignof(T)});
+  }
+
+  template <typename U> bool operator==(const PoolAllocator<U> &) const {
+    return true;
+  }
+};
+} // namespace rx
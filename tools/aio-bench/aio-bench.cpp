@@ -0,0 +1,331 @@
+// Streaming read throughput of sce AIO through orbis::aio_* API.
+//
+// Reads whole file in fixed size chunks three ways: synchronous pread loop,
+// AIO with one request per submit and waiting for every request, and AIO with
+// `depth` requests in flight submitted in batches. Page cache of the file is
+// dropped before every pass unless --cached is passed. Request arrays, ids,
+// results and buffers live in guest address range, same as objects passed by
+// guest libkernel.
+
+#include "orbis/KernelAllocator.hpp"
+#include "orbis/KernelObject.hpp"
+#include "orbis/aio.hpp"
+#include "orbis/file.hpp"
+#include "orbis/thread/Process.hpp"
+#include "orbis/thread/Thread.hpp"
+#include "rx/print.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+constexpr std::uintptr_t kGuestMemoryAddress = 0x10'0000'0000;
+
+struct GuestState {
+  orbis::AioRWRequest requests[orbis::kAioMaxRequests];
+  orbis::AioResult results[orbis::kAioMaxRequests];
+  orbis::AioSubmitId ids[orbis::kAioMaxRequests];
+  orbis::sint states[orbis::kAioMaxRequests];
+};
+
+GuestState *g_state;
+std::byte *g_buffers;
+std::uint64_t g_checksum;
+
+void dropCache(int fd, bool cached) {
+  if (!cached) {
+    ::fdatasync(fd);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  }
+}
+
+void consume(const std::byte *data, std::size_t size) {
+  // touch one word per page, result must not be optimized out
+  for (std::size_t i = 0; i < size; i += 4096) {
+    g_checksum += static_cast<std::uint8_t>(data[i]);
+  }
+}
+
+double runSync(int fd, std::uint64_t fileSize, std::size_t chunkSize) {
+  auto start = std::chrono::steady_clock::now();
+
+  for (std::uint64_t offset = 0; offset < fileSize; offset += chunkSize) {
+    auto count = ::pread(fd, g_buffers, chunkSize, offset);
+    if (count < 0) {
+      rx::println(stderr, "pread failed: {}", std::strerror(errno));
+      std::exit(1);
+    }
+
+    consume(g_buffers, count);
+  }
+
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void check(orbis::ErrorCode error, const char *what) {
+  if (error != orbis::ErrorCode{}) {
+    rx::println(stderr, "{} failed: {}", what, static_cast<int>(error));
+    std::exit(1);
+  }
+}
+
+// keeps `depth` requests in flight, every completed slot is refilled and
+// refills are submitted together
+double runAio(orbis::Thread *thread, orbis::sint guestFd,
+              std::uint64_t fileSize, std::size_t chunkSize,
+              std::size_t depth) {
+  auto start = std::chrono::steady_clock::now();
+  std::uint64_t nextOffset = 0;
+  std::vector<bool> busy(depth);
+  std::size_t inFlight = 0;
+
+  auto fill = [&](std::size_t slot) {
+    g_state->requests[slot] = {
+        .offset = static_cast<orbis::off_t>(nextOffset),
+        .nbyte = chunkSize,
+        .buf = g_buffers + slot * chunkSize,
+        .result = &g_state->results[slot],
+        .fd = guestFd,
+    };
+    nextOffset += chunkSize;
+  };
+
+  auto submit = [&](std::size_t first, std::size_t count) {
+    check(orbis::aio_submit_cmd(
+              thread, orbis::kAioCmdRead | orbis::kAioCmdMultiple,
+              &g_state->requests[first], count, orbis::kAioPriorityHigh,
+              &g_state->ids[first]),
+          "aio_submit_cmd");
+
+    for (std::size_t slot = first; slot < first + count; ++slot) {
+      busy[slot] = true;
+    }
+
+    inFlight += count;
+  };
+
+  for (std::size_t slot = 0; slot < depth && nextOffset < fileSize; ++slot) {
+    fill(slot);
+    submit(slot, 1);
+  }
+
+  std::vector<orbis::AioSubmitId> waitIds;
+  std::vector<std::size_t> waitSlots;
+
+  while (inFlight > 0) {
+    waitIds.clear();
+    waitSlots.clear();
+
+    for (std::size_t slot = 0; slot < depth; ++slot) {
+      if (busy[slot]) {
+        waitIds.push_back(g_state->ids[slot]);
+        waitSlots.push_back(slot);
+      }
+    }
+
+    // ids are copied to guest memory, wait reads them from there
+    auto ids = &g_state->ids[orbis::kAioMaxRequests - waitIds.size()];
+    std::memcpy(ids, waitIds.data(),
+                waitIds.size() * sizeof(orbis::AioSubmitId));
+
+    check(orbis::aio_multi_wait(thread, ids, waitIds.size(), g_state->states,
+                                orbis::kAioWaitOr, nullptr),
+          "aio_multi_wait");
+
+    std::vector<orbis::AioSubmitId> finishedIds;
+    std::vector<bool> refilled(depth);
+
+    for (std::size_t i = 0; i < waitIds.size(); ++i) {
+      if (g_state->states[i] != orbis::kAioStateCompleted) {
+        continue;
+      }
+
+      auto slot = waitSlots[i];
+      auto &result = g_state->results[slot];
+      if (result.returnValue < 0) {
+        rx::println(stderr, "read failed: {}", -result.returnValue);
+        std::exit(1);
+      }
+
+      consume(g_buffers + slot * chunkSize, result.returnValue);
+      finishedIds.push_back(waitIds[i]);
+      busy[slot] = false;
+      inFlight--;
+
+      if (nextOffset < fileSize) {
+        fill(slot);
+        refilled[slot] = true;
+      }
+    }
+
+    std::memcpy(ids, finishedIds.data(),
+                finishedIds.size() * sizeof(orbis::AioSubmitId));
+    check(orbis::aio_multi_delete(thread, ids, finishedIds.size(),
+                                  g_state->states),
+          "aio_multi_delete");
+
+    // every run of adjacent refilled slots is one submit
+    for (std::size_t slot = 0; slot < depth;) {
+      if (!refilled[slot]) {
+        ++slot;
+        continue;
+      }
+
+      auto end = slot;
+      while (end < depth && refilled[end]) {
+        ++end;
+      }
+
+      submit(slot, end - slot);
+      slot = end;
+    }
+  }
+
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void usage(const char *argv0) {
+  rx::println("{} [--file <path>] [--size <MiB>] [--chunk <KiB>] "
+              "[--depth <count>] [--cached]",
+              argv0);
+}
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  std::string path;
+  std::uint64_t fileSize = 256ull << 20;
+  std::size_t chunkSize = 64 << 10;
+  std::size_t depth = 32;
+  bool cached = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i] == std::string_view("--file") && i + 1 < argc) {
+      path = argv[++i];
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--size") && i + 1 < argc) {
+      fileSize = std::strtoull(argv[++i], nullptr, 0) << 20;
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--chunk") && i + 1 < argc) {
+      chunkSize = std::strtoull(argv[++i], nullptr, 0) << 10;
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--depth") && i + 1 < argc) {
+      depth = std::strtoull(argv[++i], nullptr, 0);
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--cached")) {
+      cached = true;
+      continue;
+    }
+
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (fileSize == 0 || chunkSize == 0 || depth == 0 ||
+      depth > orbis::kAioMaxRequests / 2) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  bool createdFile = path.empty();
+  int fd;
+
+  if (createdFile) {
+    path = "/tmp/aio-bench-XXXXXX";
+    fd = ::mkstemp(path.data());
+    if (fd < 0 || ::ftruncate(fd, fileSize) != 0) {
+      rx::println(stderr, "failed to create {}: {}", path,
+                  std::strerror(errno));
+      return 1;
+    }
+
+    std::vector<std::byte> data(chunkSize);
+    for (std::uint64_t offset = 0; offset < fileSize; offset += chunkSize) {
+      std::memset(data.data(), static_cast<int>(offset / chunkSize),
+                  data.size());
+      if (::pwrite(fd, data.data(), data.size(), offset) < 0) {
+        rx::println(stderr, "write failed: {}", std::strerror(errno));
+        return 1;
+      }
+    }
+  } else {
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      rx::println(stderr, "failed to open {}: {}", path, std::strerror(errno));
+      return 1;
+    }
+
+    fileSize = ::lseek(fd, 0, SEEK_END);
+  }
+
+  orbis::initializeAllocator();
+  orbis::constructAllGlobals();
+
+  auto guestMemorySize = sizeof(GuestState) + depth * chunkSize;
+  auto guestMemory = ::mmap(reinterpret_cast<void *>(kGuestMemoryAddress),
+                            guestMemorySize, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE,
+                            -1, 0);
+  if (guestMemory == MAP_FAILED) {
+    rx::println(stderr, "failed to map guest memory: {}",
+                std::strerror(errno));
+    return 1;
+  }
+
+  g_state = new (guestMemory) GuestState{};
+  g_buffers = static_cast<std::byte *>(guestMemory) + sizeof(GuestState);
+
+  // kernel objects are never destroyed, process has no storage to release
+  auto process = new orbis::Process();
+  process->pid = 1;
+
+  auto thread = new orbis::Thread();
+  thread->tproc = process;
+  thread->tid = 100;
+
+  rx::Ref<orbis::File> file = orbis::knew<orbis::File>();
+  file->hostFd = fd;
+  auto guestFd = process->fileDescriptors.insert(file);
+
+  rx::println("{} MiB, {} KiB chunks, depth {}{}", fileSize >> 20,
+              chunkSize >> 10, depth, cached ? ", cached" : "");
+
+  auto report = [&](std::string_view name, double seconds) {
+    rx::println("{:<12} {:>8.1f} MiB/s, {:.3f} s", name,
+                fileSize / seconds / (1 << 20), seconds);
+  };
+
+  dropCache(fd, cached);
+  report("pread:", runSync(fd, fileSize, chunkSize));
+
+  dropCache(fd, cached);
+  report("aio depth 1:", runAio(thread, guestFd, fileSize, chunkSize, 1));
+
+  dropCache(fd, cached);
+  report("aio:", runAio(thread, guestFd, fileSize, chunkSize, depth));
+
+  if (createdFile) {
+    ::unlink(path.c_str());
+  }
+
+  return 0;
+}
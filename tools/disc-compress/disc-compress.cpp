@@ -0,0 +1,174 @@
+// Converts plain disc image to chunk-compressed image read by
+// compressed_block_dev.
+//
+// With --verify whole result is read back through compressed_block_dev in
+// large reads, compared with the source and read throughput of both is
+// reported.
+
+#include "dev/block_dev.hpp"
+#include "rx/print.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+constexpr std::size_t kVerifyBlocks = 512;
+
+double elapsed(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// reads whole device, returns false on short read or mismatch with `image`
+bool readAll(block_dev &dev, const fs::file *image, double &seconds) {
+  std::vector<std::byte> data(kVerifyBlocks * dev.block_size());
+  std::vector<std::byte> expected(image ? data.size() : 0);
+  seconds = 0;
+
+  for (std::size_t block = 0; block < dev.block_count();
+       block += kVerifyBlocks) {
+    auto count = std::min(kVerifyBlocks, dev.block_count() - block);
+
+    auto start = std::chrono::steady_clock::now();
+    auto read = dev.read(block, data.data(), count);
+    seconds += elapsed(start);
+
+    if (read != count) {
+      rx::println(stderr, "short read at block {}", block + read);
+      return false;
+    }
+
+    if (image == nullptr) {
+      continue;
+    }
+
+    auto size = count * dev.block_size();
+    if (image->read_at(block * dev.block_size(), expected.data(), size) !=
+            size ||
+        std::memcmp(data.data(), expected.data(), size) != 0) {
+      rx::println(stderr, "mismatch in blocks {}..{}", block, block + count);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void usage(const char *argv0) {
+  rx::println("{} <image> <output> [--chunk <KiB>] [--level <level>] "
+              "[--no-dedup] [--verify]",
+              argv0);
+}
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  std::vector<std::string_view> paths;
+  compressed_block_dev::create_options options;
+  bool verify = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i] == std::string_view("--chunk") && i + 1 < argc) {
+      options.chunk_size = std::strtoull(argv[++i], nullptr, 0) << 10;
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--level") && i + 1 < argc) {
+      options.level = std::atoi(argv[++i]);
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--no-dedup")) {
+      options.dedup = false;
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--verify")) {
+      verify = true;
+      continue;
+    }
+
+    if (argv[i][0] != '-') {
+      paths.push_back(argv[i]);
+      continue;
+    }
+
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (paths.size() != 2) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  const std::string imagePath(paths[0]);
+  const std::string outPath(paths[1]);
+
+  fs::file image(imagePath);
+  if (!image) {
+    rx::println(stderr, "failed to open {}", imagePath);
+    return 1;
+  }
+
+  if (compressed_block_dev::is_image(image)) {
+    rx::println(stderr, "{} is already compressed", imagePath);
+    return 1;
+  }
+
+  fs::file out(outPath, fs::read + fs::rewrite);
+  if (!out) {
+    rx::println(stderr, "failed to create {}", outPath);
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  if (!compressed_block_dev::create(image, out, options)) {
+    rx::println(stderr, "failed to compress {}", imagePath);
+    out.close();
+    fs::remove_file(outPath);
+    return 1;
+  }
+
+  auto imageSize = image.size();
+  auto outSize = out.size();
+  rx::println("{} MiB -> {} MiB ({:.1f}%), {:.2f} s", imageSize >> 20,
+              outSize >> 20, imageSize ? outSize * 100.0 / imageSize : 0.0,
+              elapsed(start));
+
+  out.close();
+
+  if (!verify) {
+    return 0;
+  }
+
+  auto compressed = compressed_block_dev::open(fs::file(outPath));
+  if (!compressed) {
+    rx::println(stderr, "failed to open {}", outPath);
+    return 1;
+  }
+
+  double compressedSeconds = 0;
+  if (!readAll(*compressed, &image, compressedSeconds)) {
+    return 1;
+  }
+
+  file_view_block_dev plain(image, options.block_size);
+  double plainSeconds = 0;
+  readAll(plain, nullptr, plainSeconds);
+
+  auto report = [&](std::string_view name, double seconds) {
+    rx::println("{:<12} {:>8.1f} MiB/s", name,
+                imageSize / seconds / (1 << 20));
+  };
+
+  report("plain:", plainSeconds);
+  report("compressed:", compressedSeconds);
+  return 0;
+}
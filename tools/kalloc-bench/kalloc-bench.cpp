@@ -0,0 +1,218 @@
+// Multi-threaded stress benchmark of orbis::kalloc/kfree.
+//
+// Every thread keeps a window of live allocations and replaces a random one
+// on each step, sizes follow kernel object mix: mostly small objects, some
+// up to 2 KiB and rare page sized buffers. Afterwards every thread frees the
+// window of its neighbour, so objects are released by other thread than the
+// one allocated them. Contents are checked before every free. Same traffic is
+// replayed through malloc for comparison.
+
+#include "orbis/KernelAllocator.hpp"
+#include "rx/print.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+struct Random {
+  std::uint64_t state;
+
+  std::uint64_t next() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+};
+
+struct Allocation {
+  std::byte *ptr = nullptr;
+  std::size_t size = 0;
+  std::uint8_t tag = 0;
+};
+
+struct Allocator {
+  void *(*allocate)(std::size_t size);
+  void (*deallocate)(void *ptr, std::size_t size);
+};
+
+constexpr Allocator kKernelAllocator = {
+    [](std::size_t size) { return orbis::kalloc(size, alignof(std::max_align_t)); },
+    [](void *ptr, std::size_t size) { orbis::kfree(ptr, size); },
+};
+
+constexpr Allocator kMallocAllocator = {
+    [](std::size_t size) { return std::malloc(size); },
+    [](void *ptr, std::size_t) { std::free(ptr); },
+};
+
+std::size_t randomSize(Random &random) {
+  auto kind = random.next() % 100;
+
+  if (kind < 90) {
+    return 16 + random.next() % 497;
+  }
+
+  if (kind < 99) {
+    return 512 + random.next() % 1537;
+  }
+
+  return 4096 + random.next() % (60 * 1024);
+}
+
+// first and last bytes are enough to catch overlapping allocations
+void fill(Allocation &allocation) {
+  allocation.ptr[0] = std::byte{allocation.tag};
+  allocation.ptr[allocation.size - 1] = std::byte{allocation.tag};
+}
+
+bool check(const Allocation &allocation) {
+  return allocation.ptr[0] == std::byte{allocation.tag} &&
+         allocation.ptr[allocation.size - 1] == std::byte{allocation.tag};
+}
+
+bool release(const Allocator &allocator, Allocation &allocation) {
+  if (allocation.ptr == nullptr) {
+    return true;
+  }
+
+  if (!check(allocation)) {
+    rx::println(stderr, "corrupted allocation {}, size {}",
+                static_cast<void *>(allocation.ptr), allocation.size);
+    return false;
+  }
+
+  allocator.deallocate(allocation.ptr, allocation.size);
+  allocation.ptr = nullptr;
+  return true;
+}
+
+bool churn(const Allocator &allocator, std::vector<Allocation> &window,
+           std::size_t threadIndex, std::size_t opCount) {
+  Random random{0x9e3779b97f4a7c15 + threadIndex};
+
+  for (std::size_t i = 0; i < opCount; ++i) {
+    auto &allocation = window[random.next() % window.size()];
+
+    if (!release(allocator, allocation)) {
+      return false;
+    }
+
+    allocation.size = randomSize(random);
+    allocation.tag = static_cast<std::uint8_t>(i);
+    allocation.ptr =
+        static_cast<std::byte *>(allocator.allocate(allocation.size));
+    fill(allocation);
+  }
+
+  return true;
+}
+
+template <typename Fn>
+double runThreads(std::size_t threadCount, bool &ok, Fn fn) {
+  std::vector<std::thread> threads;
+  std::vector<char> results(threadCount, 1);
+  auto start = std::chrono::steady_clock::now();
+
+  for (std::size_t i = 0; i < threadCount; ++i) {
+    threads.emplace_back([&, i] { results[i] = fn(i); });
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  auto seconds = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+
+  for (auto result : results) {
+    ok = ok && result;
+  }
+
+  return seconds;
+}
+
+bool run(std::string_view name, const Allocator &allocator,
+         std::size_t threadCount, std::size_t windowSize,
+         std::size_t opCount) {
+  std::vector<std::vector<Allocation>> windows(
+      threadCount, std::vector<Allocation>(windowSize));
+  bool ok = true;
+
+  auto churnTime = runThreads(threadCount, ok, [&](std::size_t i) {
+    return churn(allocator, windows[i], i, opCount);
+  });
+
+  auto remoteTime = runThreads(threadCount, ok, [&](std::size_t i) {
+    for (auto &allocation : windows[(i + 1) % threadCount]) {
+      if (!release(allocator, allocation)) {
+        return false;
+      }
+    }
+    return true;
+  });
+
+  if (!ok) {
+    return false;
+  }
+
+  auto ops = static_cast<double>(threadCount) * opCount;
+  auto frees = static_cast<double>(threadCount) * windowSize;
+  rx::println("{:<8} churn {:>6.1f} ns/op, remote free {:>6.1f} ns/op", name,
+              churnTime * 1e9 / ops, remoteTime * 1e9 / frees);
+  return true;
+}
+
+void usage(const char *argv0) {
+  rx::println("{} [--threads <count>] [--window <count>] [--ops <count>]",
+              argv0);
+}
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  std::size_t threadCount = 8;
+  std::size_t windowSize = 4096;
+  std::size_t opCount = 1'000'000;
+
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i] == std::string_view("--threads") && i + 1 < argc) {
+      threadCount = std::strtoull(argv[++i], nullptr, 0);
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--window") && i + 1 < argc) {
+      windowSize = std::strtoull(argv[++i], nullptr, 0);
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--ops") && i + 1 < argc) {
+      opCount = std::strtoull(argv[++i], nullptr, 0);
+      continue;
+    }
+
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (threadCount == 0 || windowSize == 0 || opCount == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  orbis::initializeAllocator();
+
+  rx::println("{} threads, {} live allocations per thread, {} ops per thread",
+              threadCount, windowSize, opCount);
+
+  if (!run("kalloc:", kKernelAllocator, threadCount, windowSize, opCount) ||
+      !run("malloc:", kMallocAllocator, threadCount, windowSize, opCount)) {
+    return 1;
+  }
+
+  return 0;
+}
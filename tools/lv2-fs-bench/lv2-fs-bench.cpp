@@ -0,0 +1,194 @@
+// Multi-threaded sequential read throughput through lv2 fs read path.
+//
+// Every thread streams its own lv2_file on /dev_hdd0, which is mounted to a
+// temporary host directory, into guest memory in fixed size chunks. Two
+// locking schemes are compared: whole mount point locked for every read, as
+// sys_fs_read did before, and lv2_file::read used by sys_fs_read now, which
+// locks mount point shared and the file position with the mutex of the
+// file. Files are read through page cache, so time is dominated by copies
+// and lock contention.
+
+#include "Emu/IdManager.h"
+#include "Emu/Memory/vm.h"
+#include "Emu/VFS.h"
+#include "cellos/sys_fs.h"
+#include "rx/print.hpp"
+#include "util/vm.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+constexpr std::uint32_t kGuestBufferAddress = 0x3000'0000;
+
+enum class Locking { MountPoint, File };
+
+void readStream(lv2_file &file, Locking locking, std::uint32_t addr,
+                std::size_t chunkSize) {
+  const vm::ptr<void> buf = vm::cast(addr);
+
+  file.file.seek(0);
+
+  while (true) {
+    std::uint64_t count;
+
+    if (locking == Locking::MountPoint) {
+      std::lock_guard lock(file.mp->mutex);
+      count = file.op_read(buf, chunkSize);
+    } else {
+      auto result = file.read(buf, chunkSize);
+      if (result.error) {
+        rx::println(stderr, "read failed: {}", +result.error);
+        std::abort();
+      }
+
+      count = result.bytes;
+    }
+
+    if (count < chunkSize) {
+      break;
+    }
+  }
+}
+
+double run(std::vector<std::unique_ptr<lv2_file>> &files, Locking locking,
+           std::size_t chunkSize) {
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+
+  for (std::size_t i = 0; i < files.size(); ++i) {
+    threads.emplace_back(readStream, std::ref(*files[i]), locking,
+                         static_cast<std::uint32_t>(kGuestBufferAddress +
+                                                    i * chunkSize),
+                         chunkSize);
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void usage(const char *argv0) {
+  rx::println("{} [--threads <count>] [--size <MiB>] [--chunk <KiB>]", argv0);
+}
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  std::size_t threadCount = 8;
+  std::uint64_t fileSize = 64ull << 20;
+  std::size_t chunkSize = 64 << 10;
+
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i] == std::string_view("--threads") && i + 1 < argc) {
+      threadCount = std::strtoull(argv[++i], nullptr, 0);
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--size") && i + 1 < argc) {
+      fileSize = std::strtoull(argv[++i], nullptr, 0) << 20;
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--chunk") && i + 1 < argc) {
+      chunkSize = std::strtoull(argv[++i], nullptr, 0) << 10;
+      continue;
+    }
+
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (threadCount == 0 || fileSize == 0 || chunkSize == 0 ||
+      threadCount * chunkSize > 0x1000'0000) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // guest buffers, one per thread
+  utils::memory_commit(vm::g_base_addr + kGuestBufferAddress,
+                       threadCount * chunkSize);
+
+  const auto hostDir =
+      "/tmp/lv2-fs-bench-" + std::to_string(::getpid()) + "/";
+  if (!fs::create_dir(hostDir)) {
+    rx::println(stderr, "failed to create {}", hostDir);
+    return 1;
+  }
+
+  // lv2 objects resolve their mount point through mount info map
+  g_fxo->reset();
+  vfs::mount("/dev_hdd0", hostDir);
+  g_fxo->init<lv2_fs_mount_info_map>();
+
+  std::vector<std::unique_ptr<lv2_file>> files;
+  std::vector<std::byte> data(chunkSize);
+
+  for (std::size_t i = 0; i < threadCount; ++i) {
+    const auto name = "lv2-fs-bench-" + std::to_string(i);
+    const auto path = hostDir + name;
+
+    fs::file out(path, fs::rewrite);
+    if (!out) {
+      rx::println(stderr, "failed to create {}", path);
+      files.clear();
+      g_fxo->clear();
+      return 1;
+    }
+
+    for (std::uint64_t offset = 0; offset < fileSize; offset += chunkSize) {
+      std::memset(data.data(), static_cast<int>(offset / chunkSize + i),
+                  data.size());
+      out.write(data.data(), std::min<std::uint64_t>(chunkSize,
+                                                     fileSize - offset));
+    }
+
+    files.push_back(std::make_unique<lv2_file>(
+        "/dev_hdd0/" + name, fs::file(path, fs::read), CELL_FS_O_RDONLY,
+        CELL_FS_O_RDONLY, path));
+  }
+
+  if (files.front()->mp != &g_mp_sys_dev_hdd0) {
+    rx::println(stderr, "/dev_hdd0 is not mounted");
+    files.clear();
+    g_fxo->clear();
+    return 1;
+  }
+
+  rx::println("{} threads, {} MiB per file, {} KiB chunks", threadCount,
+              fileSize >> 20, chunkSize >> 10);
+
+  auto report = [&](std::string_view name, double seconds) {
+    rx::println("{:<12} {:>8.1f} MiB/s, {:.3f} s", name,
+                threadCount * fileSize / seconds / (1 << 20), seconds);
+  };
+
+  // warm up page cache
+  run(files, Locking::File, chunkSize);
+
+  report("mount lock:", run(files, Locking::MountPoint, chunkSize));
+  report("file lock:", run(files, Locking::File, chunkSize));
+
+  for (auto &file : files) {
+    file->file.close();
+    fs::remove_file(file->real_path);
+  }
+
+  files.clear();
+  g_fxo->clear();
+  fs::remove_dir(hostDir);
+  return 0;
+}
@@ -0,0 +1,297 @@
+// Benchmark of rx::MemoryTableWithPayload with default and pooled leaf
+// allocator.
+//
+// With --capture, traffic is taken from PM4 capture of real session (see
+// `rpcsx --capture-pm4`): map, unmap and protect records drive process vm
+// table like amdgpu::Device does, memory records are cache reads which found
+// new contents, they invalidate previously cached range and look it up and
+// map it again like Cache::Tag::getBuffer.
+//
+// Without capture, synthetic traffic mimics gpu cache per draw: resources are
+// looked up by address, missing resources are mapped, and cpu writes
+// invalidate random ranges. Addresses are 256 byte aligned buffers and
+// textures in 4 GiB window, sizes follow typical constant, vertex and texture
+// buffer sizes.
+
+#include "gnm/capture.hpp"
+#include "rx/MemoryTable.hpp"
+#include "rx/PoolAllocator.hpp"
+#include "rx/print.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+namespace {
+struct Random {
+  std::uint64_t state;
+
+  std::uint64_t next() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+};
+
+enum class OpKind { Query, Map, Invalidate, VmMap, VmUnmap, VmProtect };
+
+struct Op {
+  OpKind kind;
+  std::uint64_t address;
+  std::uint64_t size;
+  std::uint64_t payload = 0;
+};
+
+std::vector<Op> generateTraffic(std::size_t frameCount,
+                                std::size_t resourceCount) {
+  static constexpr std::uint64_t kSizes[] = {
+      0x100, 0x400, 0x1000, 0x4000, 0x10000, 0x40000, 0x100000, 0x400000,
+  };
+
+  Random random{0x9e37'79b9'7f4a'7c15};
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> resources;
+  resources.reserve(resourceCount);
+
+  for (std::size_t i = 0; i < resourceCount; ++i) {
+    auto size = kSizes[random.next() % std::size(kSizes)];
+    auto address = (random.next() % (1ull << 32)) & ~std::uint64_t(0xff);
+    resources.emplace_back(address, size);
+  }
+
+  std::vector<Op> ops;
+
+  for (std::size_t frame = 0; frame < frameCount; ++frame) {
+    // hot set of resources referenced by draws of the frame
+    auto hotBase = random.next() % resourceCount;
+
+    for (std::size_t draw = 0; draw < 256; ++draw) {
+      for (std::size_t slot = 0; slot < 16; ++slot) {
+        auto index = (hotBase + random.next() % 512) % resourceCount;
+        auto [address, size] = resources[index];
+        ops.push_back({OpKind::Query, address, size});
+        ops.push_back({OpKind::Map, address, size});
+      }
+    }
+
+    for (std::size_t i = 0; i < 64; ++i) {
+      auto [address, size] = resources[random.next() % resourceCount];
+      ops.push_back({OpKind::Invalidate, address, size / 2 + 1});
+    }
+  }
+
+  return ops;
+}
+
+// process tables are keyed by pid in capture, resource tables by vmId. Both
+// are folded into one address space, traffic of separate processes rarely
+// overlaps in time
+bool loadCapture(const char *path, std::vector<Op> &ops) {
+  using namespace gnm::capture;
+
+  std::ifstream f(path, std::ios::binary);
+  FileHeader header{};
+  if (!f.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      header.magic != kFileMagic ||
+      header.formatVersion != kFileFormatVersion) {
+    return false;
+  }
+
+  std::set<std::tuple<std::int32_t, std::uint64_t, std::uint64_t>> seenRanges;
+  std::vector<std::byte> payload;
+  RecordHeader recordHeader{};
+
+  while (f.read(reinterpret_cast<char *>(&recordHeader),
+                sizeof(recordHeader))) {
+    payload.resize(recordHeader.size);
+    if (!f.read(reinterpret_cast<char *>(payload.data()), payload.size())) {
+      break;
+    }
+
+    auto get = [&]<typename T>(T result) {
+      std::memcpy(&result, payload.data(),
+                  std::min(sizeof(T), payload.size()));
+      return result;
+    };
+
+    switch (recordHeader.type) {
+    case RecordType::MapMemory: {
+      auto map = get(MapMemoryRecord{});
+      ops.push_back({OpKind::VmMap, map.address, map.size,
+                     static_cast<std::uint64_t>(map.offset) ^
+                         static_cast<std::uint64_t>(map.prot) << 56});
+      break;
+    }
+
+    case RecordType::UnmapMemory: {
+      auto unmap = get(UnmapMemoryRecord{});
+      ops.push_back({OpKind::VmUnmap, unmap.address, unmap.size});
+      break;
+    }
+
+    case RecordType::ProtectMemory: {
+      auto protect = get(ProtectMemoryRecord{});
+      ops.push_back({OpKind::VmProtect, protect.address, protect.size,
+                     static_cast<std::uint64_t>(protect.prot)});
+      break;
+    }
+
+    case RecordType::Memory: {
+      auto memory = get(MemoryRecord{});
+      auto size = payload.size() - std::min(sizeof(memory), payload.size());
+      if (size == 0) {
+        break;
+      }
+
+      if (!seenRanges.emplace(memory.vmId, memory.address, size).second) {
+        ops.push_back({OpKind::Invalidate, memory.address, size});
+      }
+
+      ops.push_back({OpKind::Query, memory.address, size});
+      ops.push_back({OpKind::Map, memory.address, size});
+      break;
+    }
+
+    default:
+      break;
+    }
+  }
+
+  return true;
+}
+
+template <template <typename> typename Allocator>
+std::uint64_t run(const std::vector<Op> &ops, double &seconds) {
+  rx::MemoryTableWithPayload<std::uint64_t, Allocator> table;
+  rx::MemoryTableWithPayload<std::uint64_t, Allocator> vmTable;
+  std::uint64_t checksum = 0;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (auto &op : ops) {
+    switch (op.kind) {
+    case OpKind::Query:
+      if (auto it = table.queryArea(op.address); it != table.end()) {
+        checksum += it.get() ^ it.endAddress();
+      }
+      break;
+
+    case OpKind::Map:
+      if (auto it = table.queryArea(op.address);
+          it == table.end() || it.endAddress() < op.address + op.size) {
+        table.map(op.address, op.address + op.size, op.address, true, true);
+      }
+      break;
+
+    case OpKind::Invalidate:
+      table.unmap(op.address, op.address + op.size);
+      break;
+
+    case OpKind::VmMap:
+      vmTable.map(op.address, op.address + op.size, op.payload);
+      break;
+
+    case OpKind::VmUnmap:
+      vmTable.unmap(op.address, op.address + op.size);
+      break;
+
+    case OpKind::VmProtect:
+      // Device::protectMemory keeps slot and replaces protection
+      if (auto it = vmTable.queryArea(op.address); it != vmTable.end()) {
+        auto slot = it.get();
+        vmTable.map(op.address, op.address + op.size,
+                    (slot & ~(std::uint64_t(0xff) << 56)) |
+                        op.payload << 56);
+      }
+      break;
+    }
+  }
+
+  for (auto area : table) {
+    checksum += area.beginAddress() ^ area.size();
+  }
+
+  for (auto area : vmTable) {
+    checksum += area.beginAddress() ^ area.size() ^ area.get();
+  }
+
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                          start)
+                .count();
+  return checksum;
+}
+
+void usage(const char *argv0) {
+  rx::println("{} [--capture <pm4 capture>] [--frames <count>] [--resources "
+              "<count>]",
+              argv0);
+  rx::println("  --capture <path> - replay table traffic recorded in capture, "
+              "frames and resources options are ignored");
+}
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  std::size_t frameCount = 256;
+  std::size_t resourceCount = 16384;
+  const char *capturePath = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i] == std::string_view("--capture") && i + 1 < argc) {
+      capturePath = argv[++i];
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--frames") && i + 1 < argc) {
+      frameCount = std::strtoull(argv[++i], nullptr, 0);
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--resources") && i + 1 < argc) {
+      resourceCount = std::strtoull(argv[++i], nullptr, 0);
+      continue;
+    }
+
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (frameCount == 0 || resourceCount == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<Op> ops;
+  if (capturePath != nullptr) {
+    if (!loadCapture(capturePath, ops)) {
+      rx::println(stderr, "{} is not a pm4 capture", capturePath);
+      return 1;
+    }
+  } else {
+    ops = generateTraffic(frameCount, resourceCount);
+  }
+
+  double stdSeconds = 0;
+  double poolSeconds = 0;
+  auto stdChecksum = run<std::allocator>(ops, stdSeconds);
+  auto poolChecksum = run<rx::PoolAllocator>(ops, poolSeconds);
+
+  if (stdChecksum != poolChecksum) {
+    rx::println(stderr, "checksum mismatch: {:x} vs {:x}", stdChecksum,
+                poolChecksum);
+    return 1;
+  }
+
+  rx::println("{} operations", ops.size());
+  rx::println("std::allocator:    {:.3f} ms, {:.1f} ns/op", stdSeconds * 1e3,
+              stdSeconds * 1e9 / ops.size());
+  rx::println("rx::PoolAllocator: {:.3f} ms, {:.1f} ns/op", poolSeconds * 1e3,
+              poolSeconds * 1e9 / ops.size());
+  return 0;
+}
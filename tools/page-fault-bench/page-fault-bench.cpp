@@ -0,0 +1,243 @@
+// Compares cost of write tracking backends used by gpu cache: mprotect with
+// SIGSEGV handler against userfaultfd write protection. Memory is shared memfd
+// mapping, same as guest memory. Each round protects all pages and writes one
+// byte to every page, each write resolves single page fault.
+
+#include "rx/print.hpp"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/userfaultfd.h>
+#include <span>
+#include <string_view>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+constexpr std::size_t kPageSize = 4096;
+
+std::byte *g_memory;
+std::size_t g_memorySize;
+
+void handleSegv(int, siginfo_t *info, void *) {
+  auto address = reinterpret_cast<std::uintptr_t>(info->si_addr);
+  auto base = reinterpret_cast<std::uintptr_t>(g_memory);
+
+  if (address < base || address >= base + g_memorySize) {
+    std::signal(SIGSEGV, SIG_DFL);
+    return;
+  }
+
+  auto page = reinterpret_cast<void *>(address & ~(kPageSize - 1));
+  if (::mprotect(page, kPageSize, PROT_READ | PROT_WRITE) != 0) {
+    std::abort();
+  }
+}
+
+void touchPages() {
+  for (std::size_t offset = 0; offset < g_memorySize; offset += kPageSize) {
+    reinterpret_cast<volatile std::byte *>(g_memory)[offset] = std::byte{1};
+  }
+}
+
+double runMprotect(int rounds) {
+  struct sigaction action{};
+  action.sa_sigaction = handleSegv;
+  action.sa_flags = SA_SIGINFO;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGSEGV, &action, nullptr);
+
+  std::chrono::duration<double> elapsed{};
+
+  for (int round = 0; round < rounds; ++round) {
+    ::mprotect(g_memory, g_memorySize, PROT_READ);
+
+    auto start = std::chrono::steady_clock::now();
+    touchPages();
+    elapsed += std::chrono::steady_clock::now() - start;
+  }
+
+  std::signal(SIGSEGV, SIG_DFL);
+  return elapsed.count();
+}
+
+// headers before linux 6.1 have no write protection of shared memory
+#ifdef UFFD_FEATURE_WP_HUGETLBFS_SHMEM
+int openUffd() {
+#ifdef UFFD_USER_MODE_ONLY
+  int fd = ::syscall(SYS_userfaultfd, O_CLOEXEC | UFFD_USER_MODE_ONLY);
+  if (fd >= 0 || errno != EINVAL) {
+    return fd;
+  }
+#endif
+  return ::syscall(SYS_userfaultfd, O_CLOEXEC);
+}
+
+// returns negative value if userfaultfd write protection is not supported
+double runUffd(int rounds) {
+  int fd = openUffd();
+  if (fd < 0) {
+    rx::println(stderr, "userfaultfd: {}", std::strerror(errno));
+    return -1;
+  }
+
+  std::uint64_t features =
+      UFFD_FEATURE_PAGEFAULT_FLAG_WP | UFFD_FEATURE_WP_HUGETLBFS_SHMEM;
+#ifdef UFFD_FEATURE_WP_UNPOPULATED
+  features |= UFFD_FEATURE_WP_UNPOPULATED;
+#endif
+
+  uffdio_api api{.api = UFFD_API, .features = features};
+  uffdio_register reg{
+      .range = {.start = reinterpret_cast<std::uint64_t>(g_memory),
+                .len = g_memorySize},
+      .mode = UFFDIO_REGISTER_MODE_WP,
+  };
+
+  if (::ioctl(fd, UFFDIO_API, &api) != 0 ||
+      ::ioctl(fd, UFFDIO_REGISTER, &reg) != 0) {
+    rx::println(stderr, "userfaultfd write protect: {}", std::strerror(errno));
+    ::close(fd);
+    return -1;
+  }
+
+  std::atomic<bool> stop{false};
+  std::thread faultThread([&] {
+    uffd_msg messages[16];
+    bool stopping = false;
+
+    while (!stopping) {
+      auto result = ::read(fd, messages, sizeof(messages));
+      if (result < 0) {
+        continue;
+      }
+
+      // sampled before the faults are resolved: stop is only set after the
+      // last fault of the rounds is resolved, so the thread always waits for
+      // the wake fault
+      stopping = stop.load(std::memory_order::relaxed);
+
+      for (auto &message : std::span(messages, result / sizeof(uffd_msg))) {
+        if (message.event != UFFD_EVENT_PAGEFAULT) {
+          continue;
+        }
+
+        uffdio_writeprotect wp{
+            .range = {.start = message.arg.pagefault.address &
+                               ~(kPageSize - 1),
+                      .len = kPageSize},
+            .mode = 0,
+        };
+        ::ioctl(fd, UFFDIO_WRITEPROTECT, &wp);
+      }
+    }
+  });
+
+  std::chrono::duration<double> elapsed{};
+
+  for (int round = 0; round < rounds; ++round) {
+    uffdio_writeprotect wp{
+        .range = reg.range,
+        .mode = UFFDIO_WRITEPROTECT_MODE_WP,
+    };
+    ::ioctl(fd, UFFDIO_WRITEPROTECT, &wp);
+
+    auto start = std::chrono::steady_clock::now();
+    touchPages();
+    elapsed += std::chrono::steady_clock::now() - start;
+  }
+
+  // wake fault thread with one more fault
+  stop.store(true, std::memory_order::relaxed);
+  uffdio_writeprotect wp{
+      .range = {.start = reg.range.start, .len = kPageSize},
+      .mode = UFFDIO_WRITEPROTECT_MODE_WP,
+  };
+  ::ioctl(fd, UFFDIO_WRITEPROTECT, &wp);
+  touchPages();
+  faultThread.join();
+
+  ::close(fd);
+  return elapsed.count();
+}
+#else
+double runUffd(int) {
+  rx::println(stderr, "userfaultfd: built without shared memory write "
+                      "protection support");
+  return -1;
+}
+#endif
+
+void usage(const char *argv0) {
+  rx::println("{} [--pages <count>] [--rounds <count>]", argv0);
+}
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  std::size_t pageCount = 16384;
+  int rounds = 16;
+
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i] == std::string_view("--pages") && i + 1 < argc) {
+      pageCount = std::strtoull(argv[++i], nullptr, 0);
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--rounds") && i + 1 < argc) {
+      rounds = std::atoi(argv[++i]);
+      continue;
+    }
+
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (pageCount == 0 || rounds <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  g_memorySize = pageCount * kPageSize;
+
+  int memFd = ::memfd_create("page-fault-bench", MFD_CLOEXEC);
+  if (memFd < 0 || ::ftruncate(memFd, g_memorySize) != 0) {
+    rx::println(stderr, "failed to create memfd: {}", std::strerror(errno));
+    return 1;
+  }
+
+  g_memory = static_cast<std::byte *>(::mmap(nullptr, g_memorySize,
+                                             PROT_READ | PROT_WRITE,
+                                             MAP_SHARED, memFd, 0));
+  if (g_memory == MAP_FAILED) {
+    rx::println(stderr, "failed to map memory: {}", std::strerror(errno));
+    return 1;
+  }
+
+  // populate pages, faults below are write protection faults only
+  touchPages();
+
+  auto faults = static_cast<double>(pageCount) * rounds;
+
+  auto mprotectTime = runMprotect(rounds);
+  rx::println("mprotect + SIGSEGV: {:.0f} faults/s, {:.0f} ns/fault",
+              faults / mprotectTime, mprotectTime * 1e9 / faults);
+
+  auto uffdTime = runUffd(rounds);
+  if (uffdTime < 0) {
+    rx::println("userfaultfd: not supported");
+    return 0;
+  }
+
+  rx::println("userfaultfd wp:     {:.0f} faults/s, {:.0f} ns/fault",
+              faults / uffdTime, uffdTime * 1e9 / faults);
+  return 0;
+}
@@ -0,0 +1,219 @@
+// Throughput of PKG and EDAT decryption primitives.
+//
+// Every pass decrypts the same buffer in place twice: once the way packages
+// were decrypted block by block before, once through the wide CTR/CBC and
+// multi-buffer SHA-1 routines. Outputs of both are compared.
+
+#include "Crypto/aes.h"
+#include "Crypto/sha1.h"
+#include "rx/print.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string_view>
+#include <vector>
+
+namespace {
+constexpr std::size_t kBlockSize = 16;
+
+// PKG debug keystream input, last word is replaced with block index
+struct DebugInput {
+  std::uint8_t bytes[64];
+};
+
+void incrementCounter(std::uint8_t counter[16]) {
+  for (int i = 16; i > 0; i--) {
+    if (++counter[i - 1] != 0) {
+      break;
+    }
+  }
+}
+
+void setBlockIndex(DebugInput &input, std::uint64_t index) {
+  for (int i = 0; i < 8; ++i) {
+    input.bytes[56 + i] = static_cast<std::uint8_t>(index >> (56 - i * 8));
+  }
+}
+
+void ctrByBlock(aes_context *ctx, const std::uint8_t iv[16],
+                std::uint8_t *data, std::size_t blocks) {
+  std::uint8_t counter[16];
+  std::memcpy(counter, iv, sizeof(counter));
+
+  for (std::size_t i = 0; i < blocks; ++i) {
+    std::uint8_t key[16];
+    aes_crypt_ecb(ctx, AES_ENCRYPT, counter, key);
+    incrementCounter(counter);
+
+    for (std::size_t j = 0; j < kBlockSize; ++j) {
+      data[i * kBlockSize + j] ^= key[j];
+    }
+  }
+}
+
+void ctrWide(aes_context *ctx, const std::uint8_t iv[16], std::uint8_t *data,
+             std::size_t blocks) {
+  std::uint8_t counter[16];
+  std::memcpy(counter, iv, sizeof(counter));
+  aes_crypt_ctr_blocks(ctx, blocks, counter, data, data);
+}
+
+void sha1ByBlock(const DebugInput &seed, std::uint8_t *data,
+                 std::size_t blocks) {
+  DebugInput input = seed;
+
+  for (std::size_t i = 0; i < blocks; ++i) {
+    std::uint8_t hash[20];
+    setBlockIndex(input, i);
+    sha1(input.bytes, sizeof(input.bytes), hash);
+
+    for (std::size_t j = 0; j < kBlockSize; ++j) {
+      data[i * kBlockSize + j] ^= hash[j];
+    }
+  }
+}
+
+void sha1Multi(const DebugInput &seed, std::uint8_t *data,
+               std::size_t blocks) {
+  constexpr std::size_t kBatchSize = 16;
+  DebugInput inputs[kBatchSize];
+  std::uint8_t hashes[kBatchSize][20];
+
+  for (std::size_t i = 0; i < blocks; i += kBatchSize) {
+    auto count = std::min(kBatchSize, blocks - i);
+
+    for (std::size_t j = 0; j < count; ++j) {
+      inputs[j] = seed;
+      setBlockIndex(inputs[j], i + j);
+    }
+
+    sha1_multi_64(count, inputs[0].bytes, hashes[0]);
+
+    for (std::size_t j = 0; j < count; ++j) {
+      for (std::size_t k = 0; k < kBlockSize; ++k) {
+        data[(i + j) * kBlockSize + k] ^= hashes[j][k];
+      }
+    }
+  }
+}
+
+void cbcByBlock(aes_context *ctx, const std::uint8_t iv[16],
+                std::uint8_t *data, std::size_t blocks) {
+  std::uint8_t prev[16];
+  std::memcpy(prev, iv, sizeof(prev));
+
+  for (std::size_t i = 0; i < blocks; ++i) {
+    std::uint8_t cipher[16];
+    auto block = data + i * kBlockSize;
+    std::memcpy(cipher, block, sizeof(cipher));
+    aes_crypt_ecb(ctx, AES_DECRYPT, block, block);
+
+    for (std::size_t j = 0; j < kBlockSize; ++j) {
+      block[j] ^= prev[j];
+    }
+
+    std::memcpy(prev, cipher, sizeof(prev));
+  }
+}
+
+void cbcWide(aes_context *ctx, const std::uint8_t iv[16], std::uint8_t *data,
+             std::size_t blocks) {
+  std::uint8_t prev[16];
+  std::memcpy(prev, iv, sizeof(prev));
+  aes_crypt_cbc(ctx, AES_DECRYPT, blocks * kBlockSize, prev, data, data);
+}
+
+template <typename Fn>
+double measure(std::vector<std::uint8_t> &data, Fn &&fn) {
+  auto start = std::chrono::steady_clock::now();
+  fn(data.data(), data.size() / kBlockSize);
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void usage(const char *argv0) { rx::println("{} [--size <MiB>]", argv0); }
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  std::size_t size = 256 << 20;
+
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i] == std::string_view("--size") && i + 1 < argc) {
+      size = std::strtoull(argv[++i], nullptr, 0) << 20;
+      continue;
+    }
+
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (size == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::mt19937_64 random(0x5053335f504b47);
+  std::vector<std::uint8_t> source(size);
+  for (auto &byte : source) {
+    byte = static_cast<std::uint8_t>(random());
+  }
+
+  std::uint8_t key[16];
+  std::uint8_t iv[16];
+  DebugInput debugInput{};
+  for (auto &byte : key) {
+    byte = static_cast<std::uint8_t>(random());
+  }
+  for (auto &byte : iv) {
+    byte = static_cast<std::uint8_t>(random());
+  }
+  for (std::size_t i = 0; i < 32; ++i) {
+    debugInput.bytes[i] = static_cast<std::uint8_t>(random());
+  }
+
+  aes_context encCtx;
+  aes_context decCtx;
+  aes_setkey_enc(&encCtx, key, 128);
+  aes_setkey_dec(&decCtx, key, 128);
+
+  rx::println("{} MiB", size >> 20);
+
+  bool mismatch = false;
+
+  auto compare = [&](std::string_view name, auto &&byBlock, auto &&wide) {
+    std::vector<std::uint8_t> expected = source;
+    std::vector<std::uint8_t> actual = source;
+
+    auto byBlockTime = measure(expected, byBlock);
+    auto wideTime = measure(actual, wide);
+
+    rx::println("{:<10} by block {:>8.1f} MiB/s, wide {:>8.1f} MiB/s, x{:.2f}",
+                name, size / byBlockTime / (1 << 20),
+                size / wideTime / (1 << 20), byBlockTime / wideTime);
+
+    if (expected != actual) {
+      rx::println(stderr, "{}: output mismatch", name);
+      mismatch = true;
+    }
+  };
+
+  compare(
+      "aes-ctr:",
+      [&](auto data, auto blocks) { ctrByBlock(&encCtx, iv, data, blocks); },
+      [&](auto data, auto blocks) { ctrWide(&encCtx, iv, data, blocks); });
+
+  compare(
+      "sha1:",
+      [&](auto data, auto blocks) { sha1ByBlock(debugInput, data, blocks); },
+      [&](auto data, auto blocks) { sha1Multi(debugInput, data, blocks); });
+
+  compare(
+      "aes-cbc:",
+      [&](auto data, auto blocks) { cbcByBlock(&decCtx, iv, data, blocks); },
+      [&](auto data, auto blocks) { cbcWide(&decCtx, iv, data, blocks); });
+
+  return mismatch ? 1 : 0;
+}
@@ -0,0 +1,598 @@
+// Replay of PM4 command stream captured by `rpcsx --capture-pm4`.
+//
+// Captured packets are executed by the emulator's own graphics and compute
+// pipe handlers and resource cache on a headless Vulkan device. Guest memory
+// lives in memfds that the device maps exactly like process memory and dmem,
+// at its guest windows (vmId << 40 | address), which the tool reserves before
+// device creation. The tool is linked above these windows like rpcsx.
+//
+// Capture holds packets of indirect buffers flattened in execution order, so
+// INDIRECT_BUFFER packets are skipped. Waits on memory which was written by
+// cpu after capture point cannot be satisfied, such packets are skipped and
+// reported.
+
+#include "gnm/capture.hpp"
+#include "gnm/pm4.hpp"
+#include "gpu/Device.hpp"
+#include "orbis-config.hpp"
+#include "orbis/KernelAllocator.hpp"
+#include "orbis/KernelContext.hpp"
+#include "orbis/KernelObject.hpp"
+#include "rx/Config.hpp"
+#include "rx/die.hpp"
+#include "rx/mem.hpp"
+#include "rx/print.hpp"
+#include "vk.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace gnm::capture;
+
+namespace {
+struct Record {
+  RecordType type;
+  std::span<const std::byte> payload;
+
+  template <typename T> T get() const {
+    T result{};
+    std::memcpy(&result, payload.data(), std::min(sizeof(T), payload.size()));
+    return result;
+  }
+
+  template <typename T> std::span<const std::byte> tail() const {
+    return payload.subspan(std::min(sizeof(T), payload.size()));
+  }
+};
+
+// guest windows of all processes, the same ranges device maps memory into
+void reserveGuestArena() {
+  for (std::size_t vmId = 0; vmId < amdgpu::Device::kMaxProcessCount;
+       ++vmId) {
+    auto address = orbis::kMinAddress + orbis::kMaxAddress * vmId;
+    auto size = orbis::kMaxAddress - orbis::kMinAddress;
+
+    auto result = ::mmap(reinterpret_cast<void *>(address), size, PROT_NONE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE |
+                             MAP_NORESERVE,
+                         -1, 0);
+
+    if (result == MAP_FAILED) {
+      rx::die("pm4-replay: guest window {:#x}-{:#x} is occupied", address,
+              address + size);
+    }
+  }
+}
+
+int createMemoryFile(const std::string &name) {
+  int fd = ::memfd_create(name.c_str(), 0);
+  if (fd < 0) {
+    rx::die("pm4-replay: failed to create {} memory file", name);
+  }
+  return fd;
+}
+
+void growFile(int fd, std::uint64_t size) {
+  struct stat fileStat{};
+  if (::fstat(fd, &fileStat) != 0) {
+    rx::die("pm4-replay: fstat failed");
+  }
+
+  if (static_cast<std::uint64_t>(fileStat.st_size) < size &&
+      ::ftruncate(fd, size) != 0) {
+    rx::die("pm4-replay: failed to grow memory file to {:#x}", size);
+  }
+}
+
+class Replayer {
+public:
+  explicit Replayer(rx::Ref<amdgpu::Device> device)
+      : mDevice(std::move(device)) {
+    for (std::size_t i = 0; i < std::size(mDevice->dmemFd); ++i) {
+      mDevice->dmemFd[i] = createMemoryFile("dmem-" + std::to_string(i));
+    }
+
+    // cpu side of page protection requests, nothing to protect in replay
+    for (int vmId = 0; vmId < amdgpu::Device::kMaxProcessCount; ++vmId) {
+      mBridges.emplace_back([this, vmId](const std::stop_token &stopToken) {
+        auto &idle = mDevice->cpuCacheCommandsIdle[vmId];
+        std::uint32_t prevIdleValue = 0;
+
+        while (!stopToken.stop_requested()) {
+          idle.wait(prevIdleValue, std::chrono::milliseconds(10));
+          prevIdleValue = idle.load(std::memory_order::acquire);
+
+          for (auto &command : mDevice->cpuCacheCommands[vmId]) {
+            if (command.load(std::memory_order::relaxed) != 0) {
+              command.store(0, std::memory_order::release);
+            }
+          }
+        }
+      });
+    }
+  }
+
+  ~Replayer() {
+    mBridges.clear();
+
+    auto &cacheThread = mDevice->cacheUpdateThread;
+    cacheThread.request_stop();
+    mDevice->gpuCacheCommandIdle.fetch_add(1, std::memory_order::release);
+    mDevice->gpuCacheCommandIdle.notify_all();
+    cacheThread.join();
+  }
+
+  void replay(std::span<const Record> records) {
+    for (auto &record : records) {
+      switch (record.type) {
+      case RecordType::MapProcess: {
+        auto map = record.get<MapProcessRecord>();
+        mapProcess(map.pid, map.vmId);
+        break;
+      }
+
+      case RecordType::UnmapProcess: {
+        auto pid = record.get<UnmapProcessRecord>().pid;
+        auto &process = mDevice->processInfo[pid];
+        if (process.vmId >= 0) {
+          mVmProcesses.erase(process.vmId);
+          mDevice->unmapProcess(pid);
+        }
+        break;
+      }
+
+      case RecordType::MapMemory: {
+        auto map = record.get<MapMemoryRecord>();
+        auto &process = mDevice->processInfo[map.pid];
+        int fd = map.memoryType >= 0 ? mDevice->dmemFd[map.dmemIndex]
+                                     : process.vmFd;
+        if (fd >= 0) {
+          growFile(fd, map.offset + map.size);
+        } else {
+          mPendingFileSizes[map.pid] = std::max(mPendingFileSizes[map.pid],
+                                                map.offset + map.size);
+        }
+
+        mDevice->mapMemory(map.pid, map.address, map.size, map.memoryType,
+                           map.dmemIndex, map.prot, map.offset);
+        ++mMapEvents;
+        break;
+      }
+
+      case RecordType::UnmapMemory: {
+        auto unmap = record.get<UnmapMemoryRecord>();
+        mDevice->unmapMemory(unmap.pid, unmap.address, unmap.size);
+        ++mMapEvents;
+        break;
+      }
+
+      case RecordType::ProtectMemory: {
+        auto protect = record.get<ProtectMemoryRecord>();
+        mDevice->protectMemory(protect.pid, protect.address, protect.size,
+                               protect.prot);
+        ++mMapEvents;
+        break;
+      }
+
+      case RecordType::Memory: {
+        auto memory = record.get<MemoryRecord>();
+        writeMemory(memory.vmId, memory.address, record.tail<MemoryRecord>());
+        break;
+      }
+
+      case RecordType::Packet: {
+        auto packet = record.get<PacketRecord>();
+        auto bytes = record.tail<PacketRecord>();
+        mPacketWords.resize(bytes.size() / sizeof(std::uint32_t));
+        std::memcpy(mPacketWords.data(), bytes.data(),
+                    mPacketWords.size() * sizeof(std::uint32_t));
+        processPacket(packet, mPacketWords);
+        break;
+      }
+
+      case RecordType::Flip: {
+        auto flip = record.get<FlipRecord>();
+        mDevice->flip(flip.pid, flip.bufferIndex, flip.arg);
+        ++mFlips;
+        break;
+      }
+      }
+    }
+  }
+
+  void printStats(double seconds) const {
+    rx::println("{} packets, {} draws, {} dispatches, {} flips, {} map "
+                "events, {} bytes of memory",
+                mPackets, mDraws, mDispatches, mFlips, mMapEvents,
+                mMemoryBytes);
+    rx::println("{:.3f} ms, {:.0f} packets/s", seconds * 1e3,
+                mPackets / seconds);
+
+    if (mIndirectBuffers != 0) {
+      rx::println("{} indirect buffer packets skipped, contents are replayed "
+                  "from capture",
+                  mIndirectBuffers);
+    }
+
+    if (mUnmappedBytes != 0) {
+      rx::println("{} bytes of memory outside of mapped areas ignored",
+                  mUnmappedBytes);
+    }
+
+    for (std::size_t op = 0; op < mUnsatisfied.size(); ++op) {
+      if (mUnsatisfied[op] == 0) {
+        continue;
+      }
+
+      auto name = gnm::pm4OpcodeToString(op);
+      rx::println("{} {} packets were not consumed and skipped",
+                  mUnsatisfied[op],
+                  name != nullptr ? std::string_view(name) : "<unknown>");
+    }
+  }
+
+private:
+  void mapProcess(std::uint32_t pid, int vmId) {
+    auto &process = mDevice->processInfo[pid];
+    if (process.vmId == vmId) {
+      // mapped by previous loop
+      return;
+    }
+
+    process.vmId = vmId;
+    process.vmFd = createMemoryFile("memory-" + std::to_string(pid));
+    mVmProcesses[vmId] = pid;
+
+    if (auto it = mPendingFileSizes.find(pid); it != mPendingFileSizes.end()) {
+      growFile(process.vmFd, it->second);
+      mPendingFileSizes.erase(it);
+    }
+
+    // mappings recorded before process got its vm, map them now
+    struct Area {
+      std::uint64_t address;
+      std::uint64_t size;
+      amdgpu::VmMapSlot slot;
+    };
+
+    std::vector<Area> areas;
+    for (auto slot : process.vmTable) {
+      areas.push_back({slot.beginAddress(), slot.size(), slot.get()});
+    }
+
+    for (auto &area : areas) {
+      auto offset =
+          area.slot.offset + area.address - area.slot.baseAddress;
+      mDevice->mapMemory(pid, area.address, area.size,
+                         area.slot.memoryType, area.slot.memoryType,
+                         area.slot.prot, offset);
+    }
+  }
+
+  // cpu write, gpu cache must flush pages it owns and forget watched ones
+  void invalidatePages(int vmId, std::uint64_t address, std::uint64_t size) {
+    auto firstPage = address / rx::mem::pageSize;
+    auto lastPage = (address + size - 1) / rx::mem::pageSize;
+
+    for (auto page = firstPage; page <= lastPage; ++page) {
+      auto &flags = mDevice->cachePages[vmId][page];
+      bool flushQueued = false;
+
+      while (true) {
+        auto value = flags.load(std::memory_order::relaxed);
+
+        if ((value & amdgpu::kPageReadWriteLock) != 0) {
+          if (!flushQueued && mDevice->pushGpuCacheCommand(vmId, page)) {
+            flushQueued = true;
+            mDevice->gpuCacheCommandIdle.fetch_add(1,
+                                                   std::memory_order::release);
+            mDevice->gpuCacheCommandIdle.notify_all();
+          }
+
+          std::this_thread::yield();
+          continue;
+        }
+
+        if ((value & amdgpu::kPageWriteWatch) == 0) {
+          break;
+        }
+
+        if (flags.compare_exchange_weak(value, amdgpu::kPageInvalidated,
+                                        std::memory_order::relaxed)) {
+          break;
+        }
+      }
+    }
+  }
+
+  void writeMemory(int vmId, std::uint64_t address,
+                   std::span<const std::byte> data) {
+    auto processIt = mVmProcesses.find(vmId);
+    if (processIt == mVmProcesses.end() || data.empty()) {
+      mUnmappedBytes += data.size();
+      return;
+    }
+
+    auto &process = mDevice->processInfo[processIt->second];
+    invalidatePages(vmId, address, data.size());
+
+    while (!data.empty()) {
+      auto slot = process.vmTable.queryArea(address);
+      if (slot == process.vmTable.end()) {
+        mUnmappedBytes += data.size();
+        return;
+      }
+
+      auto size = std::min<std::uint64_t>(slot.endAddress() - address,
+                                          data.size());
+      auto offset = slot->offset + address - slot->baseAddress;
+      int fd = slot->memoryType >= 0 ? mDevice->dmemFd[slot->memoryType]
+                                     : process.vmFd;
+
+      growFile(fd, offset + size);
+      if (::pwrite(fd, data.data(), size, offset) !=
+          static_cast<ssize_t>(size)) {
+        rx::die("pm4-replay: failed to write guest memory at {:#x}", address);
+      }
+
+      mMemoryBytes += size;
+      address += size;
+      data = data.subspan(size);
+    }
+  }
+
+  amdgpu::Registers::ComputeConfig &getComputeConfig(std::uint32_t pipe,
+                                             std::uint32_t queueId) {
+    auto &config = mComputeConfigs[{pipe, queueId}];
+    if (config == nullptr) {
+      config = std::make_unique<amdgpu::Registers::ComputeConfig>();
+      config->state = 1;
+    }
+    return *config;
+  }
+
+  void processPacket(const PacketRecord &packet,
+                     std::span<std::uint32_t> words) {
+    if (words.empty() || (words[0] >> 30) != 3) {
+      return;
+    }
+
+    auto op = (words[0] >> 8) & 0xff;
+    if (op == gnm::IT_INDIRECT_BUFFER || op == gnm::IT_INDIRECT_BUFFER_CNST) {
+      ++mIndirectBuffers;
+      return;
+    }
+
+    auto ring = amdgpu::Ring::createFromRange(packet.vmId, words.data(),
+                                              words.size(),
+                                              packet.indirectLevel);
+    bool consumed;
+
+    if (packet.queue == Queue::Graphics) {
+      if (packet.pipe >= amdgpu::Device::kGfxPipeCount) {
+        rx::die("pm4-replay: invalid graphics pipe {}", packet.pipe);
+      }
+
+      mDevice->graphicsPipes[packet.pipe].processRing(ring);
+      consumed = ring.rptr == ring.wptr;
+    } else {
+      if (packet.pipe >= amdgpu::Device::kComputePipeCount ||
+          packet.queueId >= amdgpu::ComputePipe::kQueueCount) {
+        rx::die("pm4-replay: invalid compute queue {}:{}", packet.pipe,
+                packet.queueId);
+      }
+
+      auto &pipe = mDevice->computePipes[packet.pipe];
+      ring.doorbell = reinterpret_cast<std::uint32_t *>(
+          &getComputeConfig(packet.pipe, packet.queueId));
+      pipe.currentQueueId = packet.queueId;
+      consumed = pipe.processRing(ring);
+    }
+
+    if (!consumed) {
+      ++mUnsatisfied[op];
+      return;
+    }
+
+    ++mPackets;
+
+    switch (op) {
+    case gnm::IT_DRAW_INDIRECT:
+    case gnm::IT_DRAW_INDEX_INDIRECT:
+    case gnm::IT_DRAW_INDEX_2:
+    case gnm::IT_DRAW_INDIRECT_MULTI:
+    case gnm::IT_DRAW_INDEX_AUTO:
+    case gnm::IT_DRAW_INDEX_MULTI_AUTO:
+    case gnm::IT_DRAW_INDEX_OFFSET_2:
+    case gnm::IT_DRAW_INDEX_INDIRECT_MULTI:
+      ++mDraws;
+      break;
+
+    case gnm::IT_DISPATCH_DIRECT:
+    case gnm::IT_DISPATCH_INDIRECT:
+      ++mDispatches;
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  rx::Ref<amdgpu::Device> mDevice;
+  std::vector<std::jthread> mBridges;
+  std::map<int, std::uint32_t> mVmProcesses;
+  std::map<std::uint32_t, std::uint64_t> mPendingFileSizes;
+  std::map<std::pair<std::uint32_t, std::uint32_t>,
+           std::unique_ptr<amdgpu::Registers::ComputeConfig>>
+      mComputeConfigs;
+  std::vector<std::uint32_t> mPacketWords;
+  std::array<std::uint64_t, 256> mUnsatisfied{};
+  std::uint64_t mPackets = 0;
+  std::uint64_t mDraws = 0;
+  std::uint64_t mDispatches = 0;
+  std::uint64_t mFlips = 0;
+  std::uint64_t mMapEvents = 0;
+  std::uint64_t mMemoryBytes = 0;
+  std::uint64_t mUnmappedBytes = 0;
+  std::uint64_t mIndirectBuffers = 0;
+};
+
+bool parseCapture(std::span<const std::byte> data,
+                  std::vector<Record> &records) {
+  FileHeader header{};
+  if (data.size() < sizeof(header)) {
+    return false;
+  }
+
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (header.magic != kFileMagic ||
+      header.formatVersion != kFileFormatVersion) {
+    return false;
+  }
+
+  data = data.subspan(sizeof(header));
+
+  while (data.size() >= sizeof(RecordHeader)) {
+    RecordHeader recordHeader{};
+    std::memcpy(&recordHeader, data.data(), sizeof(recordHeader));
+    data = data.subspan(sizeof(recordHeader));
+
+    if (data.size() < recordHeader.size) {
+      rx::println(stderr, "pm4-replay: truncated capture, ignoring tail");
+      break;
+    }
+
+    records.push_back({
+        .type = recordHeader.type,
+        .payload = data.subspan(0, recordHeader.size),
+    });
+    data = data.subspan(recordHeader.size);
+  }
+
+  return true;
+}
+
+void usage(const char *argv0) {
+  rx::println("{} [options...] <capture>", argv0);
+  rx::println("  --loops <count> - replay capture multiple times, each pass "
+              "starts from the state left by previous one");
+  rx::println("  --gpu <index> - specify physical gpu index to use, default "
+              "is 0");
+  rx::println("  --validate - enable validation layers");
+  rx::println("  --profile-pm4 - print per opcode pm4 packet costs on exit");
+  rx::println("  --shader-cache <path> - use persistent shader cache, "
+              "disabled by default");
+}
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  const char *capturePath = nullptr;
+  unsigned loops = 1;
+
+  rx::g_config.headlessGpu = true;
+  rx::g_config.disableShaderCache = true;
+
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i] == std::string_view("--loops") && i + 1 < argc) {
+      loops = std::max(std::atoi(argv[++i]), 1);
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--gpu") && i + 1 < argc) {
+      rx::g_config.gpuIndex = std::atoi(argv[++i]);
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--validate")) {
+      rx::g_config.validateGpu = true;
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--profile-pm4")) {
+      rx::g_config.profilePm4 = true;
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--shader-cache") && i + 1 < argc) {
+      rx::g_config.disableShaderCache = false;
+      rx::g_config.shaderCachePath = argv[++i];
+      continue;
+    }
+
+    if (capturePath != nullptr || argv[i][0] == '-') {
+      usage(argv[0]);
+      return 1;
+    }
+
+    capturePath = argv[i];
+  }
+
+  if (capturePath == nullptr) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<std::byte> capture;
+  {
+    std::ifstream f(capturePath, std::ios::binary | std::ios::ate);
+    if (!f) {
+      rx::println(stderr, "pm4-replay: failed to open {}", capturePath);
+      return 1;
+    }
+
+    std::size_t size = f.tellg();
+    f.seekg(0, std::ios::beg);
+    capture.resize(size);
+    f.read(reinterpret_cast<char *>(capture.data()), capture.size());
+    if (!f) {
+      rx::println(stderr, "pm4-replay: failed to read {}", capturePath);
+      return 1;
+    }
+  }
+
+  std::vector<Record> records;
+  if (!parseCapture(capture, records)) {
+    rx::println(stderr, "pm4-replay: {} is not a pm4 capture", capturePath);
+    return 1;
+  }
+
+  reserveGuestArena();
+  orbis::initializeAllocator();
+  orbis::constructAllGlobals();
+  orbis::g_context->deviceEventEmitter = orbis::knew<orbis::EventEmitter>();
+
+  double seconds;
+
+  {
+    Replayer replayer(orbis::knew<amdgpu::Device>());
+    auto start = std::chrono::steady_clock::now();
+
+    for (unsigned i = 0; i < loops; ++i) {
+      replayer.replay(records);
+    }
+
+    vkDeviceWaitIdle(vk::context->device);
+    seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+            .count();
+    replayer.printStats(seconds);
+  }
+
+  return 0;
+}
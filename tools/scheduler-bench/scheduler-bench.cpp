@@ -0,0 +1,163 @@
+// Context switch throughput of rx::Scheduler with many guest threads.
+//
+// Yield test: every thread gives up its cpu in a loop, all threads stay
+// runnable. Ping-pong test: threads are paired and take turns through wait
+// channel, half of threads are parked at any moment and every switch goes
+// through wakeup().
+
+#include "rx/print.hpp"
+#include "scheduler.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <ucontext.h>
+#include <vector>
+
+namespace {
+struct GuestThread {
+  void *context;
+  struct {
+    std::uint16_t prio;
+  } prio;
+  ucontext_t ucontext;
+  std::unique_ptr<std::byte[]> stack;
+  std::atomic<std::uint32_t> *turn;
+  std::uint32_t side;
+};
+
+constexpr std::size_t kStackSize = 64 * 1024;
+
+rx::Scheduler<GuestThread> *g_scheduler;
+std::vector<GuestThread> g_threads;
+std::size_t g_switchCount;
+std::atomic<std::size_t> g_finished;
+
+void finishThread() {
+  if (g_finished.fetch_add(1) + 1 == g_threads.size()) {
+    g_finished.notify_all();
+  }
+
+  g_scheduler->exitThisCpu();
+}
+
+void yieldEntry(int index) {
+  auto self = &g_threads[index];
+
+  for (std::size_t i = 0; i < g_switchCount; ++i) {
+    g_scheduler->yield(self);
+  }
+
+  finishThread();
+}
+
+void pingPongEntry(int index) {
+  auto self = &g_threads[index];
+  auto turn = self->turn;
+
+  for (std::size_t i = 0; i < g_switchCount; ++i) {
+    g_scheduler->wait(self, turn, [=] {
+      return turn->load(std::memory_order::acquire) % 2 == self->side;
+    });
+
+    turn->fetch_add(1, std::memory_order::release);
+    g_scheduler->wakeup(turn);
+  }
+
+  finishThread();
+}
+
+double run(std::size_t cpuCount, std::size_t threadCount, void (*entry)(int)) {
+  std::vector<std::atomic<std::uint32_t>> turns(threadCount / 2);
+
+  g_threads = std::vector<GuestThread>(threadCount);
+  g_finished = 0;
+
+  for (std::size_t i = 0; i < threadCount; ++i) {
+    auto &thread = g_threads[i];
+    thread.context = &thread.ucontext;
+    thread.prio.prio = i % 4;
+    thread.stack = std::make_unique<std::byte[]>(kStackSize);
+    thread.turn = &turns[i / 2];
+    thread.side = i % 2;
+
+    ::getcontext(&thread.ucontext);
+    thread.ucontext.uc_stack.ss_sp = thread.stack.get();
+    thread.ucontext.uc_stack.ss_size = kStackSize;
+    thread.ucontext.uc_link = nullptr;
+    ::makecontext(&thread.ucontext, reinterpret_cast<void (*)()>(entry), 1,
+                  static_cast<int>(i));
+  }
+
+  rx::Scheduler<GuestThread> scheduler(cpuCount);
+  g_scheduler = &scheduler;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (auto &thread : g_threads) {
+    scheduler.enqueue(&thread);
+  }
+
+  for (auto finished = g_finished.load(); finished != threadCount;
+       finished = g_finished.load()) {
+    g_finished.wait(finished);
+  }
+
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void usage(const char *argv0) {
+  rx::println("{} [--cpus <count>] [--threads <count>] [--switches <count>]",
+              argv0);
+}
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  std::size_t cpuCount = std::max(std::thread::hardware_concurrency(), 1u);
+  std::size_t threadCount = 512;
+  g_switchCount = 2000;
+
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i] == std::string_view("--cpus") && i + 1 < argc) {
+      cpuCount = std::strtoull(argv[++i], nullptr, 0);
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--threads") && i + 1 < argc) {
+      threadCount = std::strtoull(argv[++i], nullptr, 0);
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--switches") && i + 1 < argc) {
+      g_switchCount = std::strtoull(argv[++i], nullptr, 0);
+      continue;
+    }
+
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (cpuCount == 0 || threadCount < 2 || threadCount % 2 != 0 ||
+      g_switchCount == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  auto switches = static_cast<double>(threadCount) * g_switchCount;
+  rx::println("{} cpus, {} threads, {} switches per thread", cpuCount,
+              threadCount, g_switchCount);
+
+  auto yieldTime = run(cpuCount, threadCount, yieldEntry);
+  rx::println("yield:     {:.0f} switches/s, {:.0f} ns/switch",
+              switches / yieldTime, yieldTime * 1e9 / switches);
+
+  auto pingPongTime = run(cpuCount, threadCount, pingPongEntry);
+  rx::println("ping-pong: {:.0f} switches/s, {:.0f} ns/switch",
+              switches / pingPongTime, pingPongTime * 1e9 / switches);
+  return 0;
+}
@@ -1,8 +1,14 @@
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <optional>
 #include <ostream>
@@ -11,7 +17,10 @@
 #include <shader/glsl.hpp>
 #include <shader/ir.hpp>
 #include <shader/spv.hpp>
+#include <sstream>
+#include <string>
 #include <string_view>
+#include <thread>
 #include <vector>
 
 #ifdef GCN
@@ -251,47 +260,59 @@ static bool writeOutput(OutputParam &outputParam, std::ostream &out,
 }
 
 #ifdef GCN
-static shader::ir::Region parseIsa(shader::ir::Context &context,
-                                   InputParam &inputParam,
-                                   OutputParam &outputParam,
-                                   shader::ir::Location loc,
-                                   std::span<const std::byte> bytes) {
-  shader::gcn::Context semanticContext;
-  shader::spv::BinaryLayout semanticLayout;
+struct GcnSemantic {
+  shader::gcn::Context context;
+  shader::gcn::SemanticModuleInfo moduleInfo;
+  shader::SemanticInfo info;
+};
 
-  if (!inputParam.gcnStage) {
-    inputParam.gcnStage = shader::gcn::Stage::Cs;
-  }
+static bool loadGcnSemantic(GcnSemantic &semantic, InputParam &inputParam,
+                            shader::ir::Location loc) {
+  shader::spv::BinaryLayout semanticLayout;
 
   if (!inputParam.semanticPath.empty()) {
     if (auto result = shader::glsl::parseFile(
-            semanticContext, *inputParam.glslStage, inputParam.semanticPath)) {
+            semantic.context, *inputParam.glslStage, inputParam.semanticPath)) {
       semanticLayout = *result;
     } else {
       std::fprintf(stderr, "Failed to parse semantic '%s'\n",
                    inputParam.semanticPath.c_str());
-      return {};
+      return false;
     }
   } else {
-    if (auto result = shader::spv::deserialize(semanticContext,
+    if (auto result = shader::spv::deserialize(semantic.context,
                                                g_rdna_semantic_spirv, loc)) {
       semanticLayout = *result;
     } else {
       std::fprintf(stderr, "Failed to parse builtin semantic\n");
-      return {};
+      return false;
     }
   }
 
-  shader::gcn::canonicalizeSemantic(semanticContext, semanticLayout);
-  shader::gcn::SemanticModuleInfo gcnSemanticModuleInfo;
-  shader::gcn::collectSemanticModuleInfo(gcnSemanticModuleInfo, semanticLayout);
-  auto gcnSemanticInfo =
-      shader::gcn::collectSemanticInfo(gcnSemanticModuleInfo);
+  shader::gcn::canonicalizeSemantic(semantic.context, semanticLayout);
+  shader::gcn::collectSemanticModuleInfo(semantic.moduleInfo, semanticLayout);
+  semantic.info = shader::gcn::collectSemanticInfo(semantic.moduleInfo);
+  return true;
+}
+
+static shader::ir::Region parseIsa(shader::ir::Context &context,
+                                   InputParam &inputParam,
+                                   OutputParam &outputParam,
+                                   shader::ir::Location loc,
+                                   std::span<const std::byte> bytes) {
+  if (!inputParam.gcnStage) {
+    inputParam.gcnStage = shader::gcn::Stage::Cs;
+  }
+
+  GcnSemantic semantic;
+  if (!loadGcnSemantic(semantic, inputParam, loc)) {
+    return {};
+  }
 
   shader::gcn::Context isaContext;
   shader::gcn::Environment env;
   auto ir = shader::gcn::deserialize(
-      isaContext, env, gcnSemanticInfo, 0,
+      isaContext, env, semantic.info, 0,
       [&](std::uint64_t address) -> std::uint32_t {
         return *reinterpret_cast<const std::uint32_t *>(bytes.data() + address);
       });
@@ -301,7 +322,7 @@ static shader::ir::Region parseIsa(shader::ir::Context &context,
   }
 
   if (auto converted = shader::gcn::convertToSpv(
-          isaContext, ir, gcnSemanticInfo, gcnSemanticModuleInfo,
+          isaContext, ir, semantic.info, semantic.moduleInfo,
           *inputParam.gcnStage, env)) {
     if (auto result = shader::spv::deserialize(context, converted->spv, loc)) {
       return result->merge(context);
@@ -325,6 +346,323 @@ static shader::ir::Region parseSb(shader::ir::Context &context,
   return parseIsa(context, inputParam, outputParam, loc,
                   bytes.subspan(instOffset));
 }
+
+struct BatchCodeRegion {
+  std::uint64_t address;
+  std::size_t size;   // in words
+  std::size_t offset; // in words, from the start of `.gcn` file
+};
+
+struct BatchShader {
+  shader::gcn::Stage stage = shader::gcn::Stage::Cs;
+  std::uint64_t address = 0;
+  shader::gcn::Environment env{};
+  std::vector<std::uint32_t> userSgprs;
+  std::vector<BatchCodeRegion> regions;
+  std::vector<std::uint32_t> code;
+};
+
+struct BatchResult {
+  bool success = false;
+  std::size_t spvWords = 0;
+  std::string error;
+
+  // milliseconds
+  double deserialize = 0;
+  double convert = 0;
+  double optimize = 0;
+  double validate = 0;
+};
+
+// parses `key = value` sidecar written by the rpcsx shader dumper
+static bool parseEnvFile(BatchShader &shader,
+                         const std::filesystem::path &path) {
+  std::ifstream f(path);
+  if (!f) {
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(f, line)) {
+    auto separator = line.find('=');
+    if (separator == std::string::npos) {
+      continue;
+    }
+
+    auto key = std::string_view(line).substr(0, separator);
+    while (!key.empty() && key.back() == ' ') {
+      key.remove_suffix(1);
+    }
+
+    std::istringstream value(line.substr(separator + 1));
+    value >> std::setbase(0);
+
+    auto readU8 = [&]() -> std::uint8_t {
+      unsigned result = 0;
+      value >> result;
+      return result;
+    };
+
+    if (key == "stage") {
+      std::string stageName;
+      value >> stageName;
+      if (auto stage = parseGcnStage(stageName)) {
+        shader.stage = *stage;
+      } else {
+        return false;
+      }
+    } else if (key == "address") {
+      value >> shader.address;
+    } else if (key == "vgpr-count") {
+      shader.env.vgprCount = readU8();
+    } else if (key == "sgpr-count") {
+      shader.env.sgprCount = readU8();
+    } else if (key == "num-threads") {
+      shader.env.numThreadX = readU8();
+      shader.env.numThreadY = readU8();
+      shader.env.numThreadZ = readU8();
+    } else if (key == "supports-barycentric") {
+      shader.env.supportsBarycentric = readU8() != 0;
+    } else if (key == "supports-int8") {
+      shader.env.supportsInt8 = readU8() != 0;
+    } else if (key == "supports-int64-atomics") {
+      shader.env.supportsInt64Atomics = readU8() != 0;
+    } else if (key == "supports-non-semantic-info") {
+      shader.env.supportsNonSemanticInfo = readU8() != 0;
+    } else if (key == "user-sgprs") {
+      std::uint32_t sgpr;
+      while (value >> sgpr) {
+        shader.userSgprs.push_back(sgpr);
+      }
+    } else if (key == "region") {
+      BatchCodeRegion region{};
+      if (!(value >> region.address >> region.size)) {
+        return false;
+      }
+
+      region.offset = shader.regions.empty()
+                          ? 0
+                          : shader.regions.back().offset +
+                                shader.regions.back().size;
+      shader.regions.push_back(region);
+    }
+  }
+
+  return true;
+}
+
+static BatchResult runBatchShader(const GcnSemantic &semantic,
+                                  const OutputParam &outputParam,
+                                  const BatchShader &shader) {
+  using clock = std::chrono::steady_clock;
+  auto elapsed = [](clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(clock::now() - start)
+        .count();
+  };
+
+  BatchResult result;
+  auto env = shader.env;
+  env.userSgprs = shader.userSgprs;
+
+  std::optional<std::uint64_t> missingAddress;
+
+  shader::gcn::Context context;
+  auto start = clock::now();
+  auto ir = shader::gcn::deserialize(
+      context, env, semantic.info, shader.address,
+      [&](std::uint64_t address) -> std::uint32_t {
+        for (auto &region : shader.regions) {
+          if (address >= region.address &&
+              address < region.address + region.size * sizeof(std::uint32_t)) {
+            return shader.code[region.offset +
+                               (address - region.address) /
+                                   sizeof(std::uint32_t)];
+          }
+        }
+
+        if (!missingAddress) {
+          missingAddress = address;
+        }
+        return 0;
+      });
+  result.deserialize = elapsed(start);
+
+  if (missingAddress) {
+    char error[96];
+    std::snprintf(error, sizeof(error),
+                  "read of %#llx is outside of dumped code regions",
+                  static_cast<unsigned long long>(*missingAddress));
+    result.error = error;
+    return result;
+  }
+
+  start = clock::now();
+  auto converted = shader::gcn::convertToSpv(
+      context, ir, semantic.info, semantic.moduleInfo, shader.stage, env);
+  result.convert = elapsed(start);
+
+  if (!converted) {
+    return result;
+  }
+
+  if (outputParam.optLevel >= 3) {
+    start = clock::now();
+    if (auto opt = shader::spv::optimize(converted->spv)) {
+      converted->spv = std::move(*opt);
+    }
+    result.optimize = elapsed(start);
+  }
+
+  if (outputParam.validate) {
+    start = clock::now();
+    auto valid = shader::spv::validate(converted->spv);
+    result.validate = elapsed(start);
+
+    if (!valid) {
+      return result;
+    }
+  }
+
+  result.spvWords = converted->spv.size();
+  result.success = true;
+  return result;
+}
+
+static int runBatch(InputParam &inputParam, const OutputParam &outputParam,
+                    const std::filesystem::path &directory,
+                    unsigned threadCount) {
+  std::vector<std::filesystem::path> paths;
+  std::error_code ec;
+  for (auto &entry :
+       std::filesystem::recursive_directory_iterator(directory, ec)) {
+    if (entry.is_regular_file() && entry.path().extension() == ".gcn") {
+      paths.push_back(entry.path());
+    }
+  }
+
+  if (ec) {
+    std::fprintf(stderr, "failed to read '%s': %s\n",
+                 directory.string().c_str(), ec.message().c_str());
+    return 1;
+  }
+
+  std::sort(paths.begin(), paths.end());
+
+  std::vector<BatchShader> shaders(paths.size());
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    auto &shader = shaders[i];
+    shader.stage = inputParam.gcnStage.value_or(shader::gcn::Stage::Cs);
+
+    auto envPath = std::filesystem::path(paths[i]).replace_extension(".env");
+    if (std::filesystem::exists(envPath) && !parseEnvFile(shader, envPath)) {
+      std::fprintf(stderr, "failed to parse '%s'\n", envPath.c_str());
+      return 1;
+    }
+
+    auto bytes = readFile(paths[i]);
+    if (!bytes) {
+      std::fprintf(stderr, "failed to read '%s'\n", paths[i].c_str());
+      return 1;
+    }
+
+    shader.code.resize(bytes->size() / sizeof(std::uint32_t));
+    std::memcpy(shader.code.data(), bytes->data(),
+                shader.code.size() * sizeof(std::uint32_t));
+
+    if (shader.regions.empty()) {
+      // no region list, whole file is code at shader address
+      shader.regions.push_back({
+          .address = shader.address,
+          .size = shader.code.size(),
+          .offset = 0,
+      });
+    }
+
+    auto &lastRegion = shader.regions.back();
+    if (lastRegion.offset + lastRegion.size != shader.code.size()) {
+      std::fprintf(stderr, "'%s': code regions do not match file size\n",
+                   paths[i].c_str());
+      return 1;
+    }
+  }
+
+  GcnSemantic semantic;
+  if (!loadGcnSemantic(semantic, inputParam,
+                       semantic.context.getUnknownLocation())) {
+    return 1;
+  }
+
+  if (threadCount == 0) {
+    threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  std::vector<BatchResult> results(shaders.size());
+  std::atomic<std::size_t> nextShader{0};
+  auto wallStart = std::chrono::steady_clock::now();
+
+  {
+    std::vector<std::jthread> workers;
+    for (unsigned i = 0; i < threadCount; ++i) {
+      workers.emplace_back([&] {
+        for (std::size_t index; (index = nextShader.fetch_add(1)) <
+                                shaders.size();) {
+          results[index] =
+              runBatchShader(semantic, outputParam, shaders[index]);
+        }
+      });
+    }
+  }
+
+  auto wallTime = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - wallStart)
+                      .count();
+
+  BatchResult total;
+  BatchResult max;
+  std::size_t failures = 0;
+
+  for (std::size_t i = 0; i < shaders.size(); ++i) {
+    auto &result = results[i];
+    std::printf("%s: %s, deserialize %.3f ms, convert %.3f ms, optimize %.3f "
+                "ms, validate %.3f ms, %zu words\n",
+                paths[i].c_str(), result.success ? "ok" : "FAILED",
+                result.deserialize, result.convert, result.optimize,
+                result.validate, result.spvWords);
+
+    if (!result.error.empty()) {
+      std::fprintf(stderr, "%s: %s\n", paths[i].c_str(),
+                   result.error.c_str());
+    }
+
+    failures += result.success ? 0 : 1;
+    total.deserialize += result.deserialize;
+    total.convert += result.convert;
+    total.optimize += result.optimize;
+    total.validate += result.validate;
+    total.spvWords += result.spvWords;
+    max.deserialize = std::max(max.deserialize, result.deserialize);
+    max.convert = std::max(max.convert, result.convert);
+    max.optimize = std::max(max.optimize, result.optimize);
+    max.validate = std::max(max.validate, result.validate);
+  }
+
+  auto count = std::max<std::size_t>(shaders.size(), 1);
+  std::printf("\n%zu shaders, %zu failed, %u threads, wall time %.3f ms\n",
+              shaders.size(), failures, threadCount, wallTime);
+  std::printf("  %-12s %12s %12s %12s\n", "stage", "total ms", "mean ms",
+              "max ms");
+  std::printf("  %-12s %12.3f %12.3f %12.3f\n", "deserialize",
+              total.deserialize, total.deserialize / count, max.deserialize);
+  std::printf("  %-12s %12.3f %12.3f %12.3f\n", "convert", total.convert,
+              total.convert / count, max.convert);
+  std::printf("  %-12s %12.3f %12.3f %12.3f\n", "optimize", total.optimize,
+              total.optimize / count, max.optimize);
+  std::printf("  %-12s %12.3f %12.3f %12.3f\n", "validate", total.validate,
+              total.validate / count, max.validate);
+  std::printf("  %zu spir-v words\n", total.spvWords);
+
+  return failures == 0 ? 0 : 1;
+}
 #endif
 
 static std::optional<shader::ir::Region>
@@ -412,6 +750,9 @@ parseFile(shader::ir::Context &context, InputParam &inputParam,
 void usage(std::FILE *out, const char *argv0) {
   std::fprintf(out, "usage: %s [options] -i <input file> [-o <output file>]\n",
                argv0);
+#ifdef GCN
+  std::fprintf(out, "       %s [options] --batch <corpus directory>\n", argv0);
+#endif
   std::fprintf(out, "\n");
   std::fprintf(out, "  options:\n");
 
@@ -419,6 +760,10 @@ void usage(std::FILE *out, const char *argv0) {
   std::fprintf(out, "    --input-type <glsl|spirv-bin|sb|isa>\n");
   std::fprintf(out, "    --semantic <semantic file>\n");
   std::fprintf(out, "    --input-isa-stage <isa-stage>\n");
+  std::fprintf(out, "    --batch <directory> - convert all *.gcn files with "
+                    "their *.env sidecars and report timings\n");
+  std::fprintf(out, "    --threads <count> - count of batch threads, default "
+                    "is count of cpu threads\n");
 #else
   std::fprintf(out, "    --input-type <glsl|spirv-bin>\n");
 #endif
@@ -466,6 +811,8 @@ void usage(std::FILE *out, const char *argv0) {
 int main(int argc, const char *argv[]) {
   const char *inputFile = nullptr;
   const char *outputFile = nullptr;
+  const char *batchDirectory = nullptr;
+  unsigned batchThreads = 0;
   InputParam inputParam;
   OutputParam outputParam;
 
@@ -555,6 +902,16 @@ int main(int argc, const char *argv[]) {
           continue;
         }
       }
+
+      if (key == std::string_view{"--batch"}) {
+        batchDirectory = value;
+        continue;
+      }
+
+      if (key == std::string_view{"--threads"}) {
+        batchThreads = std::atoi(value);
+        continue;
+      }
 #endif
     }
 
@@ -562,6 +919,12 @@ int main(int argc, const char *argv[]) {
     return 1;
   }
 
+#ifdef GCN
+  if (batchDirectory != nullptr) {
+    return runBatch(inputParam, outputParam, batchDirectory, batchThreads);
+  }
+#endif
+
   if (outputFile == nullptr) {
     outputFile = "-";
   }
@@ -0,0 +1,276 @@
+// Decoder of binary syscall trace written by rpcsx --trace-file.
+//
+// Prints per-syscall call count, error count and latency percentiles sorted
+// by total time spent in syscall. Latencies are collected to log2 histogram
+// of nanoseconds, percentiles are upper bounds of histogram buckets.
+
+#include "orbis/sys/sysentry.hpp"
+#include "orbis/thread/sysent.hpp"
+#include "rx/print.hpp"
+#include "systrace.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+// bucket i holds latencies with bit width i
+constexpr std::size_t kBuckets = 65;
+
+struct SyscallStats {
+  std::uint64_t calls = 0;
+  std::uint64_t errors = 0;
+  std::uint64_t totalNs = 0;
+  std::uint64_t maxNs = 0;
+  std::array<std::uint64_t, kBuckets> histogram{};
+
+  void add(std::uint64_t ns, bool isError) {
+    calls++;
+    errors += isError;
+    totalNs += ns;
+    maxNs = std::max(maxNs, ns);
+    histogram[std::bit_width(ns)]++;
+  }
+
+  std::uint64_t percentile(double fraction) const {
+    auto target = static_cast<std::uint64_t>(calls * fraction);
+    std::uint64_t seen = 0;
+
+    for (std::size_t i = 0; i < kBuckets; ++i) {
+      seen += histogram[i];
+      if (seen > target) {
+        return std::min(maxNs, i == 0 ? 0 : ~std::uint64_t(0) >> (64 - i));
+      }
+    }
+
+    return maxNs;
+  }
+};
+
+using SyscallKey = std::pair<systrace::SysVec, std::uint16_t>;
+
+const orbis::sysentvec *getSysVec(systrace::SysVec sysvec) {
+  switch (sysvec) {
+  case systrace::SysVec::FreeBsd9:
+    return &orbis::freebsd9_sysvec;
+  case systrace::SysVec::FreeBsd11:
+    return &orbis::freebsd11_sysvec;
+  case systrace::SysVec::Ps4:
+    return &orbis::ps4_sysvec;
+  case systrace::SysVec::Ps5:
+    return &orbis::ps5_sysvec;
+  case systrace::SysVec::Unknown:
+    break;
+  }
+
+  return nullptr;
+}
+
+std::string getSyscallName(systrace::SysVec sysvec, std::uint16_t id) {
+  if (auto vec = getSysVec(sysvec); vec != nullptr && id < vec->size) {
+    if (auto name = orbis::getSysentName(vec->table[id].call)) {
+      return name;
+    }
+  }
+
+  return "sys_" + std::to_string(id);
+}
+
+// records of different threads are not ordered, time is relative to first
+// record in file and can be negative
+void printRecord(const systrace::Record &record, std::uint64_t baseTsc,
+                 double nsPerTick) {
+  auto start = static_cast<std::int64_t>(record.enterTsc - baseTsc) *
+               nsPerTick / 1000;
+  auto latency = (record.exitTsc - record.enterTsc) * nsPerTick / 1000;
+
+  if (record.flags & systrace::kRecordDropped) {
+    rx::println("{:14.3f}  [{}] {} records dropped", start, record.tid,
+                record.args[0]);
+    return;
+  }
+
+  std::string args;
+  for (int i = 0; i < record.argCount; ++i) {
+    if (i != 0) {
+      args += ", ";
+    }
+
+    args += std::format("{:#x}", record.args[i]);
+  }
+
+  rx::println("{:14.3f}  {}: [{}] {}({}) -> Status {}, Value {:x}:{:x}, "
+              "{:.3f} us",
+              start, record.flags & systrace::kRecordError ? 'E' : 'S',
+              record.tid, getSyscallName(record.sysvec, record.id), args,
+              record.status, record.retval[0], record.retval[1], latency);
+}
+
+void printHistogram(const SyscallStats &stats) {
+  auto peak = *std::max_element(stats.histogram.begin(),
+                                stats.histogram.end());
+
+  for (std::size_t i = 0; i < kBuckets; ++i) {
+    if (stats.histogram[i] == 0) {
+      continue;
+    }
+
+    auto low = i == 0 ? 0 : std::uint64_t(1) << (i - 1);
+    auto width = stats.histogram[i] * 40 / peak;
+    rx::println("    {:>12} ns | {:<40} {}", low, std::string(width, '#'),
+                stats.histogram[i]);
+  }
+}
+
+void usage(const char *argv0) {
+  rx::println("{} <trace file> [--dump] [--histogram] [--tid <tid>]", argv0);
+}
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  const char *path = nullptr;
+  bool dump = false;
+  bool histogram = false;
+  std::int64_t filterTid = -1;
+
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i] == std::string_view("--dump")) {
+      dump = true;
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--histogram")) {
+      histogram = true;
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--tid") && i + 1 < argc) {
+      filterTid = std::strtoll(argv[++i], nullptr, 0);
+      continue;
+    }
+
+    if (path == nullptr && argv[i][0] != '-') {
+      path = argv[i];
+      continue;
+    }
+
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (path == nullptr) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  auto file = std::fopen(path, "rb");
+  if (file == nullptr) {
+    rx::println(stderr, "failed to open {}: {}", path, std::strerror(errno));
+    return 1;
+  }
+
+  systrace::FileHeader header;
+  if (std::fread(&header, sizeof(header), 1, file) != 1 ||
+      std::memcmp(header.magic, systrace::kMagic, sizeof(header.magic)) !=
+          0) {
+    rx::println(stderr, "{} is not syscall trace", path);
+    return 1;
+  }
+
+  if (header.version != systrace::kVersion ||
+      header.recordSize != sizeof(systrace::Record)) {
+    rx::println(stderr, "unsupported trace version {}, record size {}",
+                header.version, header.recordSize);
+    return 1;
+  }
+
+  auto nsPerTick = header.tscFrequency != 0
+                       ? 1e9 / static_cast<double>(header.tscFrequency)
+                       : 1.0;
+
+  std::map<SyscallKey, SyscallStats> stats;
+  std::map<std::uint32_t, std::uint64_t> dropped;
+  std::vector<systrace::Record> records(4096);
+  std::uint64_t recordCount = 0;
+  std::uint64_t baseTsc = 0;
+  std::uint64_t firstTsc = 0;
+  std::uint64_t lastTsc = 0;
+
+  while (auto count = std::fread(records.data(), sizeof(systrace::Record),
+                                 records.size(), file)) {
+    for (auto &record : std::span(records.data(), count)) {
+      if (filterTid >= 0 && record.tid != filterTid) {
+        continue;
+      }
+
+      if (recordCount++ == 0) {
+        baseTsc = record.enterTsc;
+        firstTsc = record.enterTsc;
+      }
+
+      firstTsc = std::min(firstTsc, record.enterTsc);
+      lastTsc = std::max(lastTsc, record.exitTsc);
+
+      if (dump) {
+        printRecord(record, baseTsc, nsPerTick);
+      }
+
+      if (record.flags & systrace::kRecordDropped) {
+        dropped[record.tid] += record.args[0];
+        continue;
+      }
+
+      auto ns = static_cast<std::uint64_t>(
+          (record.exitTsc - record.enterTsc) * nsPerTick);
+      stats[{record.sysvec, record.id}].add(
+          ns, record.flags & systrace::kRecordError);
+    }
+  }
+
+  std::fclose(file);
+
+  std::vector<std::pair<SyscallKey, SyscallStats>> sorted(stats.begin(),
+                                                          stats.end());
+  std::ranges::sort(sorted, [](auto &lhs, auto &rhs) {
+    return lhs.second.totalNs > rhs.second.totalNs;
+  });
+
+  rx::println("pid {}, {} records, {:.3f} s, tsc {} Hz", header.pid,
+              recordCount, (lastTsc - firstTsc) * nsPerTick / 1e9,
+              header.tscFrequency);
+
+  for (auto [tid, count] : dropped) {
+    rx::println("thread {}: {} records dropped", tid, count);
+  }
+
+  rx::println("{:<40} {:>10} {:>8} {:>12} {:>10} {:>10} {:>10} {:>12}",
+              "syscall", "calls", "errors", "total ms", "avg us", "p50 us",
+              "p99 us", "max us");
+
+  for (auto &[key, entry] : sorted) {
+    rx::println("{:<40} {:>10} {:>8} {:>12.3f} {:>10.3f} {:>10.3f} "
+                "{:>10.3f} {:>12.3f}",
+                getSyscallName(key.first, key.second), entry.calls,
+                entry.errors, entry.totalNs / 1e6,
+                entry.totalNs / 1e3 / entry.calls,
+                entry.percentile(0.5) / 1e3, entry.percentile(0.99) / 1e3,
+                entry.maxNs / 1e3);
+
+    if (histogram) {
+      printHistogram(entry);
+    }
+  }
+
+  return 0;
+}
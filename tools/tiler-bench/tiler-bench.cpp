@@ -0,0 +1,255 @@
+// Correctness check and throughput benchmark of the CPU tiler.
+//
+// Every default tile mode is checked with a set of element sizes, block
+// compressed formats and 2D surface sizes: amdgpu::detile must place every
+// element where getTiledOffset says it is, and tile followed by detile must
+// give the linear surface back. Combinations the reference cannot address,
+// such as thick tile modes on 2D surfaces, are skipped. Then detile and tile
+// throughput is measured on a large surface of one tile mode. Exit status is
+// non-zero if any check fails.
+
+#include "amdgpu/tiler_cpu.hpp"
+#include "gnm/gnm.hpp"
+#include "rx/print.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+constexpr std::uint64_t kMaxCheckedSurfaceSize = 64 << 20;
+
+struct Random {
+  std::uint64_t state;
+
+  std::uint64_t next() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+};
+
+void fill(std::vector<std::byte> &data, Random &random) {
+  for (auto &byte : data) {
+    byte = static_cast<std::byte>(random.next());
+  }
+}
+
+// detiles mip 0 element by element with getTiledOffset, returns false if
+// some element does not fit into the surface. Like the GpuTiler shaders, the
+// surface is addressed in elements: block compressed formats are treated as
+// formats with elements of the same size
+bool referenceDetile(const amdgpu::SurfaceInfo &info,
+                     amdgpu::TileMode tileMode, gnm::DataFormat dfmt,
+                     const std::vector<std::byte> &tiled,
+                     std::vector<std::byte> &linear) {
+  auto &subresource = info.getSubresourceInfo(0);
+  std::size_t elementBytes = (info.bitsPerElement + 7) / 8;
+
+  if (dfmt == gnm::kDataFormatBc1) {
+    dfmt = gnm::kDataFormat32_32;
+  } else if (dfmt == gnm::kDataFormatBc3) {
+    dfmt = gnm::kDataFormat32_32_32_32;
+  }
+
+  for (std::uint32_t z = 0; z < subresource.tiledDepth; ++z) {
+    for (std::uint32_t y = 0; y < subresource.linearHeight; ++y) {
+      for (std::uint32_t x = 0; x < subresource.linearWidth; ++x) {
+        auto tiledOffset =
+            amdgpu::getTiledOffset(
+                gnm::TextureType::Dim2D, false, 0, dfmt, tileMode,
+                info.macroTileMode, 0, 0, subresource.tiledWidth,
+                subresource.tiledHeight, subresource.tiledDepth,
+                subresource.tiledWidth, x, y, z, 0) /
+            8;
+        auto linearOffset =
+            ((std::uint64_t(z) * subresource.linearHeight + y) *
+                 subresource.linearPitch +
+             x) *
+            elementBytes;
+
+        if (tiledOffset + elementBytes > tiled.size() ||
+            linearOffset + elementBytes > linear.size()) {
+          return false;
+        }
+
+        std::memcpy(linear.data() + linearOffset, tiled.data() + tiledOffset,
+                    elementBytes);
+      }
+    }
+  }
+
+  return true;
+}
+
+int check() {
+  static constexpr gnm::DataFormat kFormats[] = {
+      gnm::kDataFormat8,       gnm::kDataFormat16,
+      gnm::kDataFormat32,      gnm::kDataFormat32_32,
+      gnm::kDataFormat32_32_32_32, gnm::kDataFormatBc1,
+      gnm::kDataFormatBc3,
+  };
+
+  static constexpr std::pair<std::uint32_t, std::uint32_t> kShapes[] = {
+      {256, 256},
+      {100, 60},
+      {33, 17},
+  };
+
+  Random random{0x9e37'79b9'7f4a'7c15};
+  std::size_t checked = 0;
+  std::size_t skipped = 0;
+  std::size_t failures = 0;
+
+  auto tileModes = amdgpu::getDefaultTileModes();
+  for (std::size_t index = 0; index < tileModes.size(); ++index) {
+    auto tileMode = tileModes[index];
+
+    for (auto dfmt : kFormats) {
+      for (auto [width, height] : kShapes) {
+        auto info = amdgpu::computeSurfaceInfo(
+            tileMode, gnm::TextureType::Dim2D, dfmt, width, height, 1, width,
+            0, 1, 0, 1, false);
+        // tiled display micro tiling has no layout of 128 bit elements
+        auto arrayMode = tileMode.arrayMode();
+        bool isLinear = arrayMode == amdgpu::kArrayModeLinearGeneral ||
+                        arrayMode == amdgpu::kArrayModeLinearAligned;
+
+        if (info.totalTiledSize == 0 ||
+            info.totalTiledSize > kMaxCheckedSurfaceSize ||
+            (!isLinear &&
+             tileMode.microTileMode() == amdgpu::kMicroTileModeDisplay &&
+             info.bitsPerElement > 64)) {
+          ++skipped;
+          continue;
+        }
+
+        std::vector<std::byte> tiled(info.totalTiledSize);
+        std::vector<std::byte> expected(info.totalLinearSize);
+        std::vector<std::byte> linear(info.totalLinearSize);
+        fill(tiled, random);
+
+        if (!referenceDetile(info, tileMode, dfmt, tiled, expected)) {
+          ++skipped;
+          continue;
+        }
+
+        ++checked;
+        amdgpu::detile(info, tileMode, tiled, linear, 0, 0, 1);
+
+        if (linear != expected) {
+          rx::println(stderr, "detile mismatch: tile mode {}, format {}, {}x{}",
+                      index, static_cast<int>(dfmt), width, height);
+          ++failures;
+          continue;
+        }
+
+        std::vector<std::byte> retiled(tiled.size());
+        std::vector<std::byte> roundTrip(linear.size());
+        amdgpu::tile(info, tileMode, linear, retiled, 0, 0, 1);
+        amdgpu::detile(info, tileMode, retiled, roundTrip, 0, 0, 1);
+
+        if (roundTrip != linear) {
+          rx::println(stderr,
+                      "round trip mismatch: tile mode {}, format {}, {}x{}",
+                      index, static_cast<int>(dfmt), width, height);
+          ++failures;
+        }
+      }
+    }
+  }
+
+  rx::println("{} surfaces checked, {} skipped, {} failed", checked, skipped,
+              failures);
+  return failures == 0 ? 0 : 1;
+}
+
+void bench(std::size_t tileModeIndex, std::uint32_t size, int iterations) {
+  auto tileMode = amdgpu::getDefaultTileModes()[tileModeIndex];
+  auto info = amdgpu::computeSurfaceInfo(
+      tileMode, gnm::TextureType::Dim2D, gnm::kDataFormat8_8_8_8, size, size,
+      1, size, 0, 1, 0, 1, false);
+
+  std::vector<std::byte> tiled(info.totalTiledSize);
+  std::vector<std::byte> linear(info.totalLinearSize);
+  Random random{1};
+  fill(tiled, random);
+
+  auto measure = [&](std::string_view name, auto &&fn) {
+    fn();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+      fn();
+    }
+    auto seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+    rx::println("{:<8} {:>8.1f} MiB/s", name,
+                linear.size() * double(iterations) / seconds / (1 << 20));
+  };
+
+  rx::println("tile mode {}, {}x{} rgba8, {} iterations", tileModeIndex, size,
+              size, iterations);
+  measure("detile:",
+          [&] { amdgpu::detile(info, tileMode, tiled, linear, 0, 0, 1); });
+  measure("tile:",
+          [&] { amdgpu::tile(info, tileMode, linear, tiled, 0, 0, 1); });
+}
+
+void usage(const char *argv0) {
+  rx::println("{} [--tile-mode <index>] [--size <pixels>] [--iterations "
+              "<count>] [--no-check]",
+              argv0);
+}
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  std::size_t tileModeIndex = 14;
+  std::uint32_t size = 4096;
+  int iterations = 10;
+  bool runCheck = true;
+
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i] == std::string_view("--tile-mode") && i + 1 < argc) {
+      tileModeIndex = std::strtoull(argv[++i], nullptr, 0);
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--size") && i + 1 < argc) {
+      size = std::strtoul(argv[++i], nullptr, 0);
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--iterations") && i + 1 < argc) {
+      iterations = std::atoi(argv[++i]);
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--no-check")) {
+      runCheck = false;
+      continue;
+    }
+
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (tileModeIndex >= amdgpu::getDefaultTileModes().size() || size == 0 ||
+      iterations <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (runCheck && check() != 0) {
+    return 1;
+  }
+
+  bench(tileModeIndex, size, iterations);
+  return 0;
+}
@@ -0,0 +1,190 @@
+// Contended umutex and ucond throughput through orbis::umtx_* API.
+//
+// Mutex test: all threads increment shared counter under one umutex. Condvar
+// test: half of threads produce items, other half consume them and sleep on
+// ucond while queue is empty. Objects live in guest address range, same as
+// objects passed by guest libkernel.
+
+#include "orbis/KernelAllocator.hpp"
+#include "orbis/KernelObject.hpp"
+#include "orbis/thread/Process.hpp"
+#include "orbis/thread/Thread.hpp"
+#include "orbis/umtx.hpp"
+#include "rx/print.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <sys/mman.h>
+#include <thread>
+#include <vector>
+
+namespace {
+constexpr std::uintptr_t kGuestStateAddress = 0x10'0000'0000;
+constexpr std::uint64_t kInfinite = ~std::uint64_t{0};
+
+struct GuestState {
+  orbis::umutex mutex;
+  orbis::ucond cond;
+  std::uint64_t counter;
+  std::uint64_t items;
+};
+
+GuestState *g_state;
+
+void lock(orbis::Thread *thread) {
+  while (orbis::umtx_lock_umutex(thread, &g_state->mutex, kInfinite) ==
+         orbis::ErrorCode::TIMEDOUT) {
+  }
+}
+
+void unlock(orbis::Thread *thread) {
+  if (orbis::umtx_unlock_umutex(thread, &g_state->mutex) !=
+      orbis::ErrorCode{}) {
+    rx::println(stderr, "unlock failed, thread {}", thread->tid);
+    std::abort();
+  }
+}
+
+void mutexWorker(orbis::Thread *thread, std::size_t opCount) {
+  for (std::size_t i = 0; i < opCount; ++i) {
+    lock(thread);
+    g_state->counter++;
+    unlock(thread);
+  }
+}
+
+void producer(orbis::Thread *thread, std::size_t opCount) {
+  for (std::size_t i = 0; i < opCount; ++i) {
+    lock(thread);
+    g_state->items++;
+    unlock(thread);
+    orbis::umtx_cv_signal(thread, &g_state->cond);
+  }
+}
+
+void consumer(orbis::Thread *thread, std::size_t opCount) {
+  for (std::size_t i = 0; i < opCount; ++i) {
+    lock(thread);
+
+    // cv wait releases mutex, it is locked again as libthr does
+    while (g_state->items == 0) {
+      orbis::umtx_cv_wait(thread, &g_state->cond, &g_state->mutex, kInfinite,
+                          0);
+      lock(thread);
+    }
+
+    g_state->items--;
+    g_state->counter++;
+    unlock(thread);
+  }
+}
+
+double run(std::vector<orbis::Thread *> &threads, std::size_t opCount,
+           bool condvar) {
+  std::vector<std::thread> workers;
+  auto start = std::chrono::steady_clock::now();
+
+  for (std::size_t i = 0; i < threads.size(); ++i) {
+    auto thread = threads[i];
+
+    workers.emplace_back([=] {
+      if (!condvar) {
+        mutexWorker(thread, opCount);
+      } else if (i % 2 == 0) {
+        producer(thread, opCount);
+      } else {
+        consumer(thread, opCount);
+      }
+    });
+  }
+
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void usage(const char *argv0) {
+  rx::println("{} [--threads <count>] [--ops <count>]", argv0);
+}
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  std::size_t threadCount = 32;
+  std::size_t opCount = 20000;
+
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i] == std::string_view("--threads") && i + 1 < argc) {
+      threadCount = std::strtoull(argv[++i], nullptr, 0);
+      continue;
+    }
+
+    if (argv[i] == std::string_view("--ops") && i + 1 < argc) {
+      opCount = std::strtoull(argv[++i], nullptr, 0);
+      continue;
+    }
+
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (threadCount < 2 || threadCount % 2 != 0 || opCount == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  orbis::initializeAllocator();
+  orbis::constructAllGlobals();
+
+  auto guestMemory = ::mmap(reinterpret_cast<void *>(kGuestStateAddress),
+                            sizeof(GuestState), PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE,
+                            -1, 0);
+  if (guestMemory == MAP_FAILED) {
+    rx::println(stderr, "failed to map guest memory: {}",
+                std::strerror(errno));
+    return 1;
+  }
+
+  g_state = new (guestMemory) GuestState{};
+
+  // kernel objects are never destroyed, process has no storage to release
+  auto process = new orbis::Process();
+  process->pid = 1;
+
+  std::vector<orbis::Thread *> threads(threadCount);
+  for (std::size_t i = 0; i < threadCount; ++i) {
+    threads[i] = new orbis::Thread();
+    threads[i]->tproc = process;
+    threads[i]->tid = 100 + i;
+  }
+
+  auto ops = static_cast<double>(threadCount) * opCount;
+  rx::println("{} threads, {} ops per thread", threadCount, opCount);
+
+  auto mutexTime = run(threads, opCount, false);
+  if (g_state->counter != threadCount * opCount) {
+    rx::println(stderr, "mutex: lost updates, counter {}", g_state->counter);
+    return 1;
+  }
+
+  rx::println("umutex: {:.0f} lock/unlock/s, {:.0f} ns/op", ops / mutexTime,
+              mutexTime * 1e9 / ops);
+
+  g_state->counter = 0;
+  auto condTime = run(threads, opCount, true);
+  if (g_state->counter != threadCount / 2 * opCount || g_state->items != 0) {
+    rx::println(stderr, "ucond: lost items, counter {}", g_state->counter);
+    return 1;
+  }
+
+  rx::println("ucond:  {:.0f} items/s, {:.0f} ns/item",
+              ops / 2 / condTime, condTime * 1e9 / (ops / 2));
+  return 0;
+}